@@ -0,0 +1,21 @@
+-- benchmark baseline, regenerate with: luajit bench/run.lua --save
+return {
+  ["EventBus.add+remove 2k handlers"] = { ops = 307.3, bytes = 16744.0, aborts = 10 },
+  ["EventBus.get_handle_count"] = { ops = 2564288360.8, bytes = 0.0, aborts = 0 },
+  ["EventBus.run 1 handler"] = { ops = 398004.7, bytes = 0.0, aborts = 4 },
+  ["EventBus.run 2k handlers"] = { ops = 396.0, bytes = 2.3, aborts = 1 },
+  ["EventBus.run once 2k handlers"] = { ops = 56892.1, bytes = 0.0, aborts = 0 },
+  ["ctrlp.utils.find_root r"] = { ops = 21547.8, bytes = 1315.8, aborts = 27 },
+  ["ctrlp.utils.find_root ra miss"] = { ops = 17295.4, bytes = 1843.8, aborts = 34 },
+  ["ctrlp.utils.shellescape"] = { ops = 299151.0, bytes = 0.0, aborts = 0 },
+  ["minipath.getabsolute"] = { ops = 44978.0, bytes = 2264.9, aborts = 15 },
+  ["minipath.getdirectory"] = { ops = 186800.8, bytes = 0.0, aborts = 0 },
+  ["minipath.getname"] = { ops = 182697.7, bytes = 0.0, aborts = 1 },
+  ["minipath.join 6 parts"] = { ops = 990072.1, bytes = 136.0, aborts = 4 },
+  ["minipath.join long path"] = { ops = 2079527.7, bytes = 104.0, aborts = 2 },
+  ["stdext.explode 100k lines"] = { ops = 23.2, bytes = 10318216.0, aborts = 1 },
+  ["stdext.explode path"] = { ops = 372774.2, bytes = 592.0, aborts = 22 },
+  ["stdext.findlast path"] = { ops = 3629398.6, bytes = 0.0, aborts = 0 },
+  ["stdext.findlast pattern"] = { ops = 249609.6, bytes = 0.0, aborts = 0 },
+  ["stdext.implode 1k items"] = { ops = 173.1, bytes = 3390925.8, aborts = 0 },
+}
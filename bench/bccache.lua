@@ -0,0 +1,71 @@
+-- Loading the eelua scripts from source (cold) against the bytecode cache
+-- of luaH_loadfile (warm). Runs inside the host simulator, which sets up
+-- the cache directory like the editor does:
+--
+--   eesim bench/bccache.trace
+--
+-- Cold is plain loadfile; the first warm-up call of the warm case fills
+-- the cache. Neither runs the chunks.
+local source = debug.getinfo(1, "S").source:sub(2)
+local bench_dir = source:match("^(.*)[/\\][^/\\]*$") or "."
+package.path = bench_dir .. "/?.lua;" .. package.path
+
+local bench = require "bench"
+
+local files = {
+  "eelua/eelua_init.lua",
+  "eelua/eelua/core/EE_Document.lua",
+  "eelua/eelua/core/EE_Context.lua",
+  "eelua/eelua/core/base.lua",
+  "eelua/eelua/core/journal.lua",
+  "eelua/eelua/core/textview.lua",
+  "eelua/eelua/rope.lua",
+  "eelua/eelua/diff.lua",
+  "eelua/eelua/reload.lua",
+  "eelua/eelua/EventBus.lua",
+  "eelua/eelua/stdext.lua",
+  "eelua/eelua/watcher.lua",
+  "eelua/eelua/profiler.lua",
+  "eelua/eelua/lazy_plugin.lua",
+  "eelua/eelua/script_cache.lua",
+  "eelua/unicode.lua",
+  "eelua/sqlite3_ffi.lua",
+  "eelua/wininet.lua",
+  "eelua/lfs.lua",
+  "eelua/minipath.lua",
+  "eelua/autoload/ctrlp/init.lua",
+  "eelua/autoload/ctrlp/utils.lua",
+  "eelua/autoload/ctrlp/files.lua",
+  "eelua/autoload/ctrlp/rg.lua",
+  "eelua/plugins/ctrlp.lua",
+  "eelua/scripts/handle_cur_line.lua",
+}
+
+local function load_all(load)
+  for i = 1, #files do
+    assert(load(files[i]))
+  end
+end
+
+local cases = {
+  {
+    name = "cold, loadfile",
+    run = function()
+      load_all(loadfile)
+    end,
+  },
+  {
+    name = "warm, bytecode cache",
+    run = function()
+      load_all(eelua.loadfile)
+    end,
+  },
+}
+
+App:output_line(string.format("%d files", #files))
+App:output_line(string.format("%-22s %12s %14s", "case", "ops/sec", "bytes/op"))
+for _, case in ipairs(cases) do
+  case.warmup = 2
+  local r = bench.measure(case)
+  App:output_line(string.format("%-22s %12.1f %14.1f", case.name, r.ops, r.bytes))
+end
@@ -0,0 +1,159 @@
+-- Measures a benchmark case: operations per second, bytes allocated per
+-- operation and the LuaJIT trace aborts while it ran.
+local jit = require "jit"
+
+local clock = os.clock
+local collectgarbage = collectgarbage
+
+local _M = {
+  -- seconds per sample, and samples per case (the median is reported)
+  sample_time = 0.05,
+  samples = 5,
+  -- calls before timing, cases with a slow run set their own warmup
+  warmup = 1000,
+}
+
+local ok, vmdef = pcall(require, "jit.vmdef")
+if not ok then
+  vmdef = nil
+end
+
+local function abort_reason(otr, oex)
+  local fmt = vmdef and vmdef.traceerr[otr]
+  if not fmt then
+    return "trace error " .. tostring(otr)
+  end
+  if oex and fmt:find("%%d") then
+    return fmt:format(oex)
+  end
+  if type(oex) == "number" and fmt:find("%%s") and vmdef.ffnames then
+    return fmt:format(vmdef.ffnames[oex] or tostring(oex))
+  end
+  return (fmt:gsub("%%[ds]", "?"))
+end
+
+-- every case gets its own copy of the loop, so traces recorded for one
+-- case do not decide what gets compiled for the next
+local function new_loop()
+  return assert(loadstring([[
+    local clock, fn, state, n = ...
+    local t0 = clock()
+    for _ = 1, n do
+      fn(state)
+    end
+    return clock() - t0
+  ]], "=bench_loop"))
+end
+
+function _M.measure(case)
+  local state = case.setup and case.setup() or nil
+  local fn = case.run
+  local run_n = new_loop()
+
+  -- trace aborts are counted over a fixed number of warm-up calls from an
+  -- empty trace cache, which keeps the count independent of timing
+  local aborts, reasons = 0, {}
+  local function on_trace(what, tr, func, pc, otr, oex)
+    if what == "abort" then
+      aborts = aborts + 1
+      local reason = abort_reason(otr, oex)
+      reasons[reason] = (reasons[reason] or 0) + 1
+    end
+  end
+  collectgarbage("collect")
+  if jit.status() then
+    jit.flush()
+    jit.attach(on_trace, "trace")
+  end
+  run_n(clock, fn, state, case.warmup or _M.warmup)
+  if jit.status() then
+    jit.attach(on_trace)
+  end
+
+  -- find an iteration count filling a sample
+  local n = 1
+  while run_n(clock, fn, state, n) < _M.sample_time / 4 do
+    n = n * 2
+  end
+  local t = run_n(clock, fn, state, n)
+  if t > 0 then
+    n = math.max(1, math.floor(n * _M.sample_time / t))
+  end
+
+  local ops, bytes = {}, math.huge
+  for i = 1, _M.samples do
+    collectgarbage("collect")
+    collectgarbage("stop")
+    local kb0 = collectgarbage("count")
+    local dt = run_n(clock, fn, state, n)
+    local kb = collectgarbage("count") - kb0
+    collectgarbage("restart")
+    ops[i] = n / math.max(dt, 1e-9)
+    bytes = math.min(bytes, kb * 1024 / n)
+  end
+
+  if case.teardown then
+    case.teardown(state)
+  end
+
+  table.sort(ops)
+  return {
+    ops = ops[math.floor((#ops + 1) / 2)],
+    bytes = bytes,
+    aborts = aborts,
+    reasons = reasons,
+    iterations = n,
+  }
+end
+
+-- a regression is a drop in ops/sec beyond threshold, more bytes per op
+-- beyond threshold (and a few bytes of slack), or a jump in trace aborts;
+-- abort counts jitter from run to run (LuaJIT randomizes its hashing), so
+-- only more than twice the baseline plus two counts
+function _M.compare(result, base, threshold)
+  local flags = {}
+  if base == nil then
+    return flags
+  end
+  if result.ops < base.ops * (1 - threshold) then
+    flags[#flags + 1] = string.format("ops %+.0f%%", (result.ops / base.ops - 1) * 100)
+  end
+  if result.bytes > base.bytes * (1 + threshold) + 16 then
+    flags[#flags + 1] = string.format("bytes %.0f -> %.0f", base.bytes, result.bytes)
+  end
+  if result.aborts > base.aborts * 2 + 2 then
+    flags[#flags + 1] = string.format("aborts %d -> %d", base.aborts, result.aborts)
+  end
+  return flags
+end
+
+function _M.load_baseline(filepath)
+  local chunk = loadfile(filepath)
+  if not chunk then
+    return {}
+  end
+  local ok, t = pcall(chunk)
+  return ok and type(t) == "table" and t or {}
+end
+
+function _M.save_baseline(filepath, results)
+  local names = {}
+  for name in pairs(results) do
+    names[#names + 1] = name
+  end
+  table.sort(names)
+
+  local out = { "-- benchmark baseline, regenerate with: luajit bench/run.lua --save", "return {" }
+  for _, name in ipairs(names) do
+    local r = results[name]
+    out[#out + 1] = string.format("  [%q] = { ops = %.1f, bytes = %.1f, aborts = %d },",
+                                  name, r.ops, r.bytes, r.aborts)
+  end
+  out[#out + 1] = "}"
+
+  local fp = assert(io.open(filepath, "w"))
+  fp:write(table.concat(out, "\n"), "\n")
+  fp:close()
+end
+
+return _M
@@ -0,0 +1,37 @@
+local lfs = require "lfs"
+local utils = require "autoload.ctrlp.utils"
+local inputs = require "cases.inputs"
+
+local project_root = table.concat(inputs.path_parts, "\\", 1, 6)
+local cur_file_dir = table.concat(inputs.path_parts, "\\")
+
+return {
+  {
+    name = "ctrlp.utils.find_root r",
+    setup = function()
+      lfs._dirs[project_root .. "\\.git"] = true
+      return { cur_file_dir = cur_file_dir }
+    end,
+    run = function(opts)
+      return utils._find_root("r", opts)
+    end,
+    teardown = function()
+      lfs._dirs[project_root .. "\\.git"] = nil
+    end,
+  },
+  {
+    name = "ctrlp.utils.find_root ra miss",
+    setup = function()
+      return { cur_file_dir = cur_file_dir }
+    end,
+    run = function(opts)
+      return utils._find_root("ra", opts)
+    end,
+  },
+  {
+    name = "ctrlp.utils.shellescape",
+    run = function()
+      return utils.shellescape(inputs.long_path)
+    end,
+  },
+}
@@ -0,0 +1,63 @@
+local EventBus = require "eelua.EventBus"
+
+local function new_bus(n)
+  local bus = EventBus.new()
+  local handlers = {}
+  for i = 1, n do
+    handlers[i] = function(a, b)
+      return nil
+    end
+    bus:add_event_handler("OnAppMessage", handlers[i])
+  end
+  return { bus = bus, handlers = handlers, args = { 273, 40001, 0 } }
+end
+
+return {
+  {
+    name = "EventBus.run 1 handler",
+    setup = function()
+      return new_bus(1)
+    end,
+    run = function(s)
+      s.bus:run_event_handlers("OnAppMessage", s.args)
+    end,
+  },
+  {
+    name = "EventBus.run 2k handlers",
+    warmup = 20,
+    setup = function()
+      return new_bus(2000)
+    end,
+    run = function(s)
+      s.bus:run_event_handlers("OnAppMessage", s.args)
+    end,
+  },
+  {
+    name = "EventBus.run once 2k handlers",
+    warmup = 20,
+    setup = function()
+      return new_bus(2000)
+    end,
+    run = function(s)
+      s.bus:run_event_handlers("OnAppMessage", s.args, true)
+    end,
+  },
+  {
+    name = "EventBus.add+remove 2k handlers",
+    warmup = 20,
+    setup = function()
+      return new_bus(0)
+    end,
+    run = function(s)
+      local bus = EventBus.new()
+      local handlers = s.handlers
+      for i = 1, 2000 do
+        handlers[i] = handlers[i] or function() end
+        bus:add_event_handler("OnPrePopupTextMenu", handlers[i])
+      end
+      for i = 2000, 1, -1 do
+        bus:remove_event_handler("OnPrePopupTextMenu", handlers[i])
+      end
+    end,
+  },
+}
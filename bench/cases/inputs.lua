@@ -0,0 +1,30 @@
+-- Shared inputs: long Windows paths and a large buffer of source lines.
+local _M = {}
+
+local parts = {
+  "C:", "Users", "developer", "Documents", "Projects", "everedit-plugins",
+  "third_party", "vendor", "github.com", "scriptkitz", "eelua", "ezip",
+  "eelua", "autoload", "ctrlp", "deeply", "nested", "module", "directory",
+}
+
+_M.path_parts = parts
+_M.long_path = table.concat(parts, "\\") .. "\\utils.lua"
+_M.dotted_path = [[C:\Users\developer\.\Documents\Projects\..\Projects\everedit-plugins\.\third_party\vendor\..\vendor\github.com\scriptkitz\eelua\ezip\eelua\autoload\ctrlp\..\ctrlp\utils.lua]]
+
+function _M.lines(n)
+  local out = {}
+  for i = 1, n do
+    out[i] = string.format("    local value_%d = compute(%d, \"%s\")  -- line %d", i % 97, i, parts[i % #parts + 1], i)
+  end
+  return out
+end
+
+local text_100k
+function _M.text_100k()
+  if text_100k == nil then
+    text_100k = table.concat(_M.lines(100000), "\n")
+  end
+  return text_100k
+end
+
+return _M
@@ -0,0 +1,37 @@
+local path = require "minipath"
+local inputs = require "cases.inputs"
+
+local parts = inputs.path_parts
+
+return {
+  {
+    name = "minipath.join 6 parts",
+    run = function()
+      return path.join(parts[1], parts[2], parts[3], parts[4] .. "\\", parts[5], "utils.lua")
+    end,
+  },
+  {
+    name = "minipath.join long path",
+    run = function()
+      return path.join(inputs.long_path, "..", "init.lua")
+    end,
+  },
+  {
+    name = "minipath.getabsolute",
+    run = function()
+      return path.getabsolute(inputs.dotted_path)
+    end,
+  },
+  {
+    name = "minipath.getdirectory",
+    run = function()
+      return path.getdirectory(inputs.long_path)
+    end,
+  },
+  {
+    name = "minipath.getname",
+    run = function()
+      return path.getname(inputs.long_path)
+    end,
+  },
+}
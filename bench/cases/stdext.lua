@@ -0,0 +1,43 @@
+require "eelua.stdext"
+local inputs = require "cases.inputs"
+
+return {
+  {
+    name = "stdext.explode 100k lines",
+    warmup = 3,
+    setup = function()
+      return inputs.text_100k()
+    end,
+    run = function(text)
+      return text:explode("\n", true)
+    end,
+  },
+  {
+    name = "stdext.explode path",
+    run = function()
+      return inputs.long_path:explode("\\", true)
+    end,
+  },
+  {
+    name = "stdext.findlast path",
+    run = function()
+      return inputs.long_path:findlast("\\", true)
+    end,
+  },
+  {
+    name = "stdext.findlast pattern",
+    run = function()
+      return inputs.long_path:findlast("[/\\]")
+    end,
+  },
+  {
+    name = "stdext.implode 1k items",
+    warmup = 20,
+    setup = function()
+      return inputs.lines(1000)
+    end,
+    run = function(arr)
+      return table.implode(arr, "\"", "\"", ", ")
+    end,
+  },
+}
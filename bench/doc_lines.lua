@@ -0,0 +1,82 @@
+-- Line access on a 100k line document. Runs inside the host simulator,
+-- which answers the ECM_* messages from memory:
+--
+--   eesim bench/doc_lines.trace
+--
+-- and prints operations per second and bytes allocated per operation for
+-- getline/setline against getlines/setlines and the lines() iterator.
+local source = debug.getinfo(1, "S").source:sub(2)
+local bench_dir = source:match("^(.*)[/\\][^/\\]*$") or "."
+package.path = bench_dir .. "/?.lua;" .. package.path
+
+local bench = require "bench"
+
+local LINES = 100000
+local BLOCK = 1000
+
+local doc = App.active_doc
+local text = {}
+for i = 1, LINES do
+  text[i] = string.format("%6d local value_%d = compute(%d) -- line of text", i, i, i * 7)
+end
+doc.text = table.concat(text, "\n")
+local block = { unpack(text, 1, BLOCK) }
+-- every case keeps the lines it reads: a string nothing uses is never
+-- created by compiled code, which would leave getline with nothing to do
+local out = {}
+
+local cases = {
+  {
+    name = "getline x100k",
+    run = function()
+      for i = 0, LINES - 1 do
+        out[i + 1] = doc:getline(i)
+      end
+    end,
+  },
+  {
+    name = "getlines 100k",
+    run = function()
+      doc:getlines(0, LINES - 1)
+    end,
+  },
+  {
+    name = "getlines 100k, out",
+    run = function()
+      doc:getlines(0, LINES - 1, out)
+    end,
+  },
+  {
+    name = "lines() 100k",
+    run = function()
+      for lnum, line in doc:lines() do
+        out[lnum + 1] = line
+      end
+    end,
+  },
+  {
+    name = "setline x1k",
+    run = function()
+      for i = 1, BLOCK do
+        doc:setline(i - 1, block[i])
+      end
+    end,
+  },
+  {
+    name = "setlines 1k",
+    run = function()
+      doc:setlines(0, BLOCK - 1, block)
+    end,
+  },
+}
+
+assert(doc.line_nr == LINES)
+local got = doc:getlines(0, LINES - 1)
+assert(#got == LINES and got[LINES] == text[LINES])
+
+App:output_line(string.format("%-20s %12s %14s", "case", "ops/sec", "bytes/op"))
+for _, case in ipairs(cases) do
+  case.warmup = 2
+  local r = bench.measure(case)
+  App:output_line(string.format("%-20s %12.1f %14.1f", case.name, r.ops, r.bytes))
+end
@@ -0,0 +1,84 @@
+-- doc.text = ... on a 20k line document against deleting everything and
+-- inserting the new text, for a few changed lines and for a reformat of
+-- every tenth line. Runs inside the host simulator:
+--
+--   eesim bench/doc_settext.trace
+--
+-- The trace summary lists the messages sent and the edits, repaints and
+-- undo steps they caused.
+local source = debug.getinfo(1, "S").source:sub(2)
+local bench_dir = source:match("^(.*)[/\\][^/\\]*$") or "."
+package.path = bench_dir .. "/?.lua;" .. package.path
+
+local bench = require "bench"
+
+local LINES = 20000
+
+local doc = App.active_doc
+local lines = {}
+for i = 1, LINES do
+  lines[i] = string.format("%6d local value_%d = compute(%d)", i, i, i * 7)
+end
+local original = table.concat(lines, "\n")
+
+-- a copy of lines with every step-th line from first on passed through f
+local function edited(first, step, f)
+  local t = {}
+  for i = 1, LINES do
+    t[i] = lines[i]
+  end
+  for i = first, LINES, step do
+    t[i] = f(t[i])
+  end
+  return table.concat(t, "\n")
+end
+
+local few = edited(1, 4000, function(s) return s .. " -- changed" end)
+local tenth = edited(5, 10, function(s) return "  " .. s end)
+
+local function replace(text)
+  doc:delete()
+  doc:insert(text)
+end
+
+doc.text = original
+
+local cases = {
+  {
+    name = "5 lines, replace",
+    run = function()
+      replace(few)
+      replace(original)
+    end,
+  },
+  {
+    name = "  doc.text",
+    run = function()
+      doc.text = few
+      doc.text = original
+    end,
+  },
+  {
+    name = "2k lines, replace",
+    run = function()
+      replace(tenth)
+      replace(original)
+    end,
+  },
+  {
+    name = "  doc.text",
+    run = function()
+      doc.text = tenth
+      doc.text = original
+    end,
+  },
+}
+
+App:output_line(string.format("%-20s %12s %14s", "case", "ops/sec", "bytes/op"))
+for _, case in ipairs(cases) do
+  case.warmup = 2
+  local r = bench.measure(case)
+  App:output_line(string.format("%-20s %12.1f %14.1f", case.name, r.ops, r.bytes))
+end
+
+assert(doc.line_nr == LINES and doc:getline(LINES - 1) == lines[LINES])
@@ -0,0 +1,88 @@
+-- Searching and counting the lines of a 100k line document, through
+-- doc:gettext() and Lua strings against a view of eelua.core.textview,
+-- which leaves the text wide. Runs inside the host simulator:
+--
+--   eesim bench/doc_textview.trace
+--
+-- The views are read with textview.read(): doc:textview() would hand
+-- out the same view while the version stays, and the simulator reports
+-- edits only after the call. The refilled cases read into the buffer of
+-- one view, as doc:textview() does once the version moves.
+local source = debug.getinfo(1, "S").source:sub(2)
+local bench_dir = source:match("^(.*)[/\\][^/\\]*$") or "."
+package.path = bench_dir .. "/?.lua;" .. package.path
+
+local bench = require "bench"
+local textview = require "eelua.core.textview"
+
+local LINES = 100000
+
+local doc = App.active_doc
+local text = {}
+for i = 1, LINES do
+  text[i] = string.format("%6d local value_%d = compute(%d)", i, i, i * 7)
+end
+text[LINES] = "needle"
+doc.text = table.concat(text, "\n")
+
+local function count_lf(s)
+  local n, pos = 0, 1
+  while true do
+    pos = s:find("\n", pos, true)
+    if pos == nil then
+      return n
+    end
+    n = n + 1
+    pos = pos + 1
+  end
+end
+
+local view
+
+local cases = {
+  {
+    name = "find, gettext",
+    run = function()
+      assert(doc:gettext():find("needle", 1, true))
+    end,
+  },
+  {
+    name = "  textview",
+    run = function()
+      assert(textview.read(doc):find("needle"))
+    end,
+  },
+  {
+    name = "  textview, refilled",
+    run = function()
+      view = textview.read(doc, nil, view)
+      assert(view:find("needle"))
+    end,
+  },
+  {
+    name = "count lines, gettext",
+    run = function()
+      assert(count_lf(doc:gettext(nil, nil, 2)) == LINES - 1)
+    end,
+  },
+  {
+    name = "  textview",
+    run = function()
+      assert(textview.read(doc):count_lines() == LINES)
+    end,
+  },
+  {
+    name = "  textview, refilled",
+    run = function()
+      view = textview.read(doc, nil, view)
+      assert(view:count_lines() == LINES)
+    end,
+  },
+}
+
+App:output_line(string.format("%-22s %12s %14s", "case", "ops/sec", "bytes/op"))
+for _, case in ipairs(cases) do
+  case.warmup = 2
+  local r = bench.measure(case)
+  App:output_line(string.format("%-22s %12.1f %14.1f", case.name, r.ops, r.bytes))
+end
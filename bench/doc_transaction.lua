@@ -0,0 +1,98 @@
+-- Scripted edits on a 20k line document, one message round trip per
+-- edit against doc:transaction(). Runs inside the host simulator:
+--
+--   eesim bench/doc_transaction.trace
+--
+-- The simulator lays out a screen of lines for every repaint, which it
+-- does after each change unless redraw is off; the trace summary lists
+-- the messages sent and the repaints and undo steps.
+local source = debug.getinfo(1, "S").source:sub(2)
+local bench_dir = source:match("^(.*)[/\\][^/\\]*$") or "."
+package.path = bench_dir .. "/?.lua;" .. package.path
+
+local bench = require "bench"
+
+local LINES = 20000
+local EDITS = 5000
+
+local doc = App.active_doc
+local text = {}
+for i = 1, LINES do
+  text[i] = string.format("%6d local value_%d = compute(%d)", i, i, i * 7)
+end
+doc.text = table.concat(text, "\n")
+
+local function setline_block(d)
+  for i = 0, EDITS - 1 do
+    d:setline(i, text[i + 1])
+  end
+end
+
+local function setline_spread(d)
+  for i = 0, EDITS - 1 do
+    d:setline(i * 2, text[i * 2 + 1])
+  end
+end
+
+-- indents EDITS lines and takes the indent away again
+local function indent(d)
+  for i = 0, EDITS - 1 do
+    d:insert_at(i * 3, 0, "  ")
+  end
+end
+
+local function unindent(d)
+  for i = 0, EDITS - 1 do
+    d:delete({ line = i * 3, col = 0 }, { line = i * 3, col = 2 })
+  end
+end
+
+local cases = {
+  {
+    name = "setline x5k block",
+    run = function()
+      setline_block(doc)
+    end,
+  },
+  {
+    name = "  in transaction",
+    run = function()
+      doc:transaction(setline_block)
+    end,
+  },
+  {
+    name = "setline x5k spread",
+    run = function()
+      setline_spread(doc)
+    end,
+  },
+  {
+    name = "  in transaction",
+    run = function()
+      doc:transaction(setline_spread)
+    end,
+  },
+  {
+    name = "indent x5k",
+    run = function()
+      indent(doc)
+      unindent(doc)
+    end,
+  },
+  {
+    name = "  in transaction",
+    run = function()
+      doc:transaction(indent)
+      doc:transaction(unindent)
+    end,
+  },
+}
+
+App:output_line(string.format("%-20s %12s %14s", "case", "ops/sec", "bytes/op"))
+for _, case in ipairs(cases) do
+  case.warmup = 2
+  local r = bench.measure(case)
+  App:output_line(string.format("%-20s %12.1f %14.1f", case.name, r.ops, r.bytes))
+end
+
+assert(doc.line_nr == LINES and doc:getline(LINES - 1) == text[LINES])
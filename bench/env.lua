@@ -0,0 +1,43 @@
+-- Stand-ins for what EverEdit and eelua.dll provide, so the pure Lua
+-- libraries load under a plain LuaJIT.
+local ffi = require "ffi"
+
+ffi.cdef [[
+static const int EEHOOK_RET_DONTROUTE = 0xBC614E;
+]]
+
+local eelua = {
+  app_path = [[C:\Program Files\EverEdit]],
+  clock = function()
+    return os.clock() * 1000
+  end,
+  latency_record = function(name, ms)
+  end,
+  dprint = function(s)
+    io.stderr:write(s, "\n")
+  end,
+  error_push = function(s)
+    io.stderr:write(s, "\n")
+  end,
+}
+package.loaded["eelua"] = eelua
+_G.eelua = eelua
+
+_G.App = {
+  output_line = function(self, text)
+    io.stderr:write(text, "\n")
+  end,
+}
+
+-- lfs goes through Win32 calls, only the parts ctrlp.utils needs are faked:
+-- a directory exists when it is in lfs_dirs
+local lfs_dirs = {}
+package.loaded["lfs"] = {
+  exists_dir = function(p)
+    return lfs_dirs[p] == true
+  end,
+  currentdir = function()
+    return [[C:\Users\dev]]
+  end,
+  _dirs = lfs_dirs,
+}
@@ -0,0 +1,102 @@
+-- Microbenchmarks for the pure Lua eelua libraries.
+--
+--   luajit bench/run.lua [options] [filter]
+--
+--   --save            write the results as the new baseline
+--   --baseline FILE   baseline to compare with (default: bench/baseline.lua)
+--   --threshold R     allowed relative slowdown/growth (default: 0.2)
+--   --list            list the cases
+--
+-- Cases whose name contains filter are run. The exit code is 1 when a case
+-- regressed against the baseline.
+local bench_dir = (arg and arg[0] or ""):match("^(.*)[/\\][^/\\]*$") or "."
+package.path = table.concat({
+  bench_dir .. "/?.lua",
+  bench_dir .. "/../ezip/eelua/?.lua",
+  package.path,
+}, ";")
+
+require "env"
+local bench = require "bench"
+
+local suites = { "cases.stdext", "cases.minipath", "cases.eventbus", "cases.ctrlp_utils" }
+
+local opts = {
+  baseline = bench_dir .. "/baseline.lua",
+  threshold = 0.2,
+}
+local i = 1
+while arg[i] do
+  local a = arg[i]
+  if a == "--save" then
+    opts.save = true
+  elseif a == "--list" then
+    opts.list = true
+  elseif a == "--baseline" then
+    i = i + 1
+    opts.baseline = arg[i]
+  elseif a == "--threshold" then
+    i = i + 1
+    opts.threshold = tonumber(arg[i])
+  else
+    opts.filter = a
+  end
+  i = i + 1
+end
+
+local cases = {}
+for _, suite in ipairs(suites) do
+  for _, case in ipairs(require(suite)) do
+    if not opts.filter or case.name:find(opts.filter, 1, true) then
+      cases[#cases + 1] = case
+    end
+  end
+end
+
+if opts.list then
+  for _, case in ipairs(cases) do
+    print(case.name)
+  end
+  return
+end
+
+local baseline = bench.load_baseline(opts.baseline)
+local results = {}
+local regressions = 0
+
+print(string.format("%-34s %14s %12s %7s %9s", "case", "ops/sec", "bytes/op", "aborts", "vs base"))
+for _, case in ipairs(cases) do
+  local r = bench.measure(case)
+  results[case.name] = r
+
+  local base = baseline[case.name]
+  local delta = base and string.format("%+.1f%%", (r.ops / base.ops - 1) * 100) or "-"
+  local flags = bench.compare(r, base, opts.threshold)
+  print(string.format("%-34s %14.1f %12.1f %7d %9s%s", case.name, r.ops, r.bytes, r.aborts,
+                      delta, #flags > 0 and "  REGRESSION: " .. table.concat(flags, ", ") or ""))
+  local reasons = {}
+  for reason, n in pairs(r.reasons) do
+    reasons[#reasons + 1] = string.format("    abort x%d: %s", n, reason)
+  end
+  table.sort(reasons)
+  for _, line in ipairs(reasons) do
+    print(line)
+  end
+  if #flags > 0 and not opts.save then
+    regressions = regressions + 1
+  end
+end
+
+if opts.save then
+  -- keep the baseline of cases that were filtered out
+  for name, r in pairs(baseline) do
+    if results[name] == nil then
+      results[name] = r
+    end
+  end
+  bench.save_baseline(opts.baseline, results)
+  print("baseline written to " .. opts.baseline)
+elseif regressions > 0 then
+  print(string.format("%d case(s) regressed", regressions))
+  os.exit(1)
+end
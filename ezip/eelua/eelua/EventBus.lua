@@ -1,14 +1,35 @@
 local ffi = require "ffi"
 local string = require "string"
 local table = require "table"
+local eelua = require "eelua"
 
 local C = ffi.C
 local str_fmt = string.format
 local unpack = unpack or table.unpack
 local tinsert = table.insert
+local clock = eelua.clock
+local latency_record = eelua.latency_record
 
 local _M = {}
 
+-- "event:<event>@<file>:<line>" per handler, for eelua.stats()
+local handler_stat_names = setmetatable({}, { __mode = "k" })
+
+local function handler_stat_name(event, handler)
+  local names = handler_stat_names[handler]
+  if names == nil then
+    names = {}
+    handler_stat_names[handler] = names
+  end
+  local name = names[event]
+  if name == nil then
+    local info = debug.getinfo(handler, "S")
+    name = str_fmt("event:%s@%s:%d", event, info.short_src, info.linedefined)
+    names[event] = name
+  end
+  return name
+end
+
 local function tbl_remove_value(tbl, obj)
   local idx = nil
   for k, v in ipairs(tbl) do
@@ -74,15 +95,18 @@ end
 function _M:run_event_handlers(event, args, once)
   local handlers = self.handle_map[event]
   if handlers then
+    local t0 = clock()
     for _, handler in ipairs(handlers) do
       if not once or (once and not self.runned_handlers[handler]) then
+        local t1 = clock()
         local ok, rv = pcall(handler, unpack(args or {}))
+        latency_record(handler_stat_name(event, handler), clock() - t1)
         if once then
           self.runned_handlers[handler] = true
         end
 
         if not ok then
-          App:output_line(str_fmt("ERR: RunEventHandler(%s): %s", event, rv))
+          eelua.error_push(str_fmt("ERR: RunEventHandler(%s): %s", event, rv))
         else
           if rv == C.EEHOOK_RET_DONTROUTE then
             break
@@ -90,6 +114,7 @@ function _M:run_event_handlers(event, args, once)
         end
       end
     end
+    latency_record("event:" .. event, clock() - t0)
   end
 end
 
@@ -12,20 +12,36 @@ local tinsert = table.insert
 local send_message = base.send_message
 
 local _M = {}
+
+local getters = {
+  active_doc = function(self)
+    return _M.get_active_doc(self)
+  end,
+  frame_nr = function(self)
+    return _M.get_frame_nr(self)
+  end,
+  active_frame = function(self)
+    return _M.get_active_frame(self)
+  end,
+  frames = function(self)
+    return _M.get_frames(self)
+  end,
+  app_metrics = function(self)
+    return tonumber(send_message(self.hMain, C.EEM_GETAPPMETRICS))
+  end,
+}
+
 local mt = {
   __index = function(self, k)
-    if k == "active_doc" then
-      return _M.get_active_doc(self)
-    elseif k == "frame_nr" then
-      return _M.get_frame_nr(self)
-    elseif k == "active_frame" then
-      return _M.get_active_frame(self)
-    elseif k == "frames" then
-      return _M.get_frames(self)
-    elseif k == "app_metrics" then
-      return tonumber(send_message(self.hMain, C.EEM_GETAPPMETRICS))
+    local method = _M[k]
+    if method ~= nil then
+      return method
     end
-    return _M[k]
+    local get = getters[k]
+    if get ~= nil then
+      return get(self)
+    end
+    return nil
   end
 }
 
@@ -65,7 +81,7 @@ function _M:save()
 end
 
 function _M:output_text(text)
-  local wstr, wlen = unicode.a2w(text)
+  local wstr, wlen = unicode.a2w_tmp(text)
   send_message(self.hMain, C.EEM_OUTPUTTEXT, wstr, wlen)
 end
 
@@ -158,7 +174,7 @@ function _M:set_view_type(frame_hwnd, value)
 end
 
 function _M:get_frame_from_path(path)
-  local wpath, wlen = unicode.a2w(path)
+  local wpath = unicode.a2w_tmp(path)
   local frame_hwnd = tonumber(send_message(self.hMain, C.EEM_GETFRAMEFROMPATH, wpath))
   return EE_Frame.new(frame_hwnd)
 end
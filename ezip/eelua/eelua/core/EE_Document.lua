@@ -1,11 +1,44 @@
 local ffi = require "ffi"
 local base = require "eelua.core.base"
 local unicode = require "unicode"
+local journal = require "eelua.core.journal"
+local handles = require "eelua.core.handles"
+local textview = require "eelua.core.textview"
+local diff = require "eelua.diff"
 
 local C = ffi.C
 local ffi_new = ffi.new
 local ffi_cast = ffi.cast
+local ffi_str = ffi.string
+local tconcat = table.concat
 local send_message = base.send_message
+local new_tab = base.new_tab
+
+-- Argument structs reused across calls; the editor reads them before
+-- SendMessage returns.
+local sel_ptr = ffi_new("EC_SelInfo[1]")
+local insert_text_ptr = ffi_new("EC_InsertText[1]")
+local bpos_ptr = ffi_new("EC_Pos[1]")
+local epos_ptr = ffi_new("EC_Pos[1]")
+
+-- Open transactions by document handle, see _M:transaction(). Edits made
+-- inside one are queued with positions in the text as it was when the
+-- transaction began.
+local transactions = {}
+local open_transactions = 0
+
+local function transaction_of(self)
+  if open_transactions == 0 then
+    return nil
+  end
+  return transactions[base.ptr2number(self.hwnd)]
+end
+
+local function queue_edit(tx, sl, sc, el, ec, text)
+  local n = tx.n + 1
+  tx.n = n
+  tx.edits[n] = { sl = sl, sc = sc, el = el, ec = ec, text = text, seq = n }
+end
 
 ffi.cdef[[
   typedef struct {
@@ -14,59 +47,100 @@ ffi.cdef[[
 ]]
 
 local _M = {}
+
+-- Property getters and setters by name, looked up after the methods.
+-- Path, encoding and line ends are cached until a hook reports that
+-- they may have changed, see eelua.core.handles.
+local getters = {
+  cursor = function(self)
+    return _M.get_cursor(self)
+  end,
+  fullpath = handles.cached("fullpath", function(self)
+    return _M.get_fullpath(self)
+  end),
+  line_nr = function(self)
+    return tonumber(send_message(self.hwnd, C.ECM_GETLINECNT))
+  end,
+  visual_line_nr = function(self)
+    return tonumber(send_message(self.hwnd, C.ECM_GETVISUALLINECOUNT))
+  end,
+  font_height = function(self)
+    return tonumber(send_message(self.hwnd, C.ECM_GETFONTHEIGHT))
+  end,
+  edit_mode = function(self)
+    return tonumber(send_message(self.hwnd, C.ECM_EDITMODE, 0xFF))
+  end,
+  sel_type = function(self)
+    return _M.get_sel_type(self)
+  end,
+  text = function(self)
+    return _M.gettext(self)
+  end,
+  sel_text = function(self)
+    return _M.get_sel_text(self)
+  end,
+  eol_type = handles.cached("eol_type", function(self)
+    return tonumber(send_message(self.hwnd, C.ECM_SETEOLTYPE, 0xFF))
+  end),
+  encoding = handles.cached("encoding", function(self)
+    return tonumber(send_message(self.hwnd, C.ECM_GETBUFFERENCODING, 0))
+  end),
+  version = function(self)
+    return journal.version(self)
+  end,
+}
+
+local setters = {
+  text = function(self, v)
+    local tx = transaction_of(self)
+    if tx ~= nil then
+      queue_edit(tx, 0, 0, C.INT_MAX, C.INT_MAX, v)
+      return
+    end
+    _M.settext(self, v)
+  end,
+  eol_type = function(self, v)
+    send_message(self.hwnd, C.ECM_SETEOLTYPE, v)
+    handles.uncache(self.hwnd, "eol_type")
+  end,
+  edit_mode = function(self, v)
+    send_message(self.hwnd, C.ECM_EDITMODE, v)
+  end,
+  wrap_mode = function(self, v)
+    send_message(self.hwnd, C.ECM_WRAP, v)
+  end,
+  fold_method = function(self, v)
+    send_message(self.hwnd, C.ECM_SETFOLDMETHOD, v)
+  end,
+  encoding = function(self, v)
+    send_message(self.hwnd, C.ECM_GETBUFFERENCODING, 1, v)
+    handles.uncache(self.hwnd, "encoding")
+  end,
+}
+
 local mt = {
   __index = function(self, k)
-    if k == "cursor" then
-      return _M.get_cursor(self)
-    elseif k == "fullpath" then
-      return _M.get_fullpath(self)
-    elseif k == "line_nr" then
-      return tonumber(send_message(self.hwnd, C.ECM_GETLINECNT))
-    elseif k == "visual_line_nr" then
-      return tonumber(send_message(self.hwnd, C.ECM_GETVISUALLINECOUNT))
-    elseif k == "font_height" then
-      return tonumber(send_message(self.hwnd, C.ECM_GETFONTHEIGHT))
-    elseif k == "edit_mode" then
-      return tonumber(send_message(self.hwnd, C.ECM_EDITMODE, 0xFF))
-    elseif k == "sel_type" then
-      return _M.get_sel_type(self)
-    elseif k == "text" then
-      return _M.gettext(self)
-    elseif k == "sel_text" then
-      return _M.get_sel_text(self)
-    elseif k == "eol_type" then
-      return tonumber(send_message(self.hwnd, C.ECM_SETEOLTYPE, 0xFF))
-    elseif k == "encoding" then
-      return tonumber(send_message(self.hwnd, C.ECM_GETBUFFERENCODING, 0))
+    local method = _M[k]
+    if method ~= nil then
+      return method
     end
-    return _M[k]
+    local get = getters[k]
+    if get ~= nil then
+      return get(self)
+    end
+    return nil
   end,
   __newindex = function(self, k, v)
-    if k == "text" then
-      _M.delete(self)
-      _M.insert(self, v)
-    elseif k == "eol_type" then
-      send_message(self.hwnd, C.ECM_SETEOLTYPE, v)
-    elseif k == "edit_mode" then
-      send_message(self.hwnd, C.ECM_EDITMODE, v)
-    elseif k == "wrap_mode" then
-      send_message(self.hwnd, C.ECM_WRAP, v)
-    elseif k == "fold_method" then
-      send_message(self.hwnd, C.ECM_SETFOLDMETHOD, v)
-    elseif k == "encoding" then
-      send_message(self.hwnd, C.ECM_GETBUFFERENCODING, 1, v)
-    else
+    local set = setters[k]
+    if set == nil then
       error("unkown prop " .. k .. " for EE_Document")
     end
+    set(self, v)
   end
 }
 
-function _M.new(hwnd)
-  if tonumber(hwnd) == 0 then
-    return nil
-  end
-  return ffi_new("EE_Document", { hwnd })
-end
+-- One object per window handle, nil for NULL.
+_M.new = handles.interner("EE_Document")
 
 function _M:get_cursor()
   local p_pos = ffi_new("EC_Pos[1]")
@@ -75,11 +149,10 @@ function _M:get_cursor()
 end
 
 function _M:set_cursor(cursor, visible)
-  local p_pos = ffi_new("EC_Pos[1]")
-  p_pos[0].line = cursor.line
-  p_pos[0].col = cursor.col
+  bpos_ptr[0].line = cursor.line
+  bpos_ptr[0].col = cursor.col
 
-  send_message(self.hwnd, C.ECM_SETPOS, p_pos, visible and 1 or 0)
+  send_message(self.hwnd, C.ECM_SETPOS, bpos_ptr, visible and 1 or 0)
 end
 
 function _M:getline(lnum)
@@ -95,13 +168,132 @@ end
 function _M:setline(lnum, text)
   if lnum == "." then
     lnum = self.cursor.line
-  elseif lnum < 0 or lnum >= self.line_nr then
+  end
+  return _M.setlines(self, lnum, lnum, text)
+end
+
+-- Reads lines first..last with one ECM_GETTEXT into out[n + 1], ...,
+-- splitting the converted text at each LF. Returns the new count.
+local function read_lines(hwnd, first, last, out, n)
+  sel_ptr[0].bpos_line = first
+  sel_ptr[0].bpos_col = 0
+  sel_ptr[0].epos_line = last
+  sel_ptr[0].epos_col = C.INT_MAX
+  sel_ptr[0].lpBuffer = nil
+  sel_ptr[0].nEol = C.EC_EOL_UNIX
+  local wlen = tonumber(send_message(hwnd, C.ECM_GETTEXT, sel_ptr))
+  local wbuf = unicode.get_wide_buf(wlen + 3)
+  sel_ptr[0].lpBuffer = wbuf
+  send_message(hwnd, C.ECM_GETTEXT, sel_ptr)
+  sel_ptr[0].lpBuffer = nil
+
+  local buf, len = unicode.w2a_tmp(wbuf, wlen)
+  local pos = 0
+  while true do
+    local nl = C.memchr(buf + pos, 10, len - pos)
+    n = n + 1
+    if nl == nil then
+      out[n] = ffi_str(buf + pos, len - pos)
+      return n
+    end
+    local stop = tonumber(ffi_cast("const char*", nl) - buf)
+    out[n] = ffi_str(buf + pos, stop - pos)
+    pos = stop + 1
+  end
+end
+
+-- lines per ECM_GETTEXT in getlines, which keeps the conversion in the
+-- retained scratch buffers for all but very long lines
+local LINES_PER_READ = 4096
+
+-- Lines first..last (0-based, last defaults to the last line) as a table
+-- of strings, and their count. The text is read a few thousand lines per
+-- ECM_GETTEXT and split after conversion. Pass out to reuse a table;
+-- entries after the count are left as they were.
+function _M:getlines(first, last, out)
+  local line_nr = tonumber(send_message(self.hwnd, C.ECM_GETLINECNT))
+  first = math.max(first or 0, 0)
+  last = math.min(last or line_nr - 1, line_nr - 1)
+  -- sized up front, growing a 100k array rehashes it 17 times
+  out = out or new_tab(math.max(last - first + 1, 0), 0)
+
+  local n = 0
+  while first <= last do
+    local stop = math.min(first + LINES_PER_READ - 1, last)
+    n = read_lines(self.hwnd, first, stop, out, n)
+    first = stop + 1
+  end
+  return out, n
+end
+
+-- Replaces lines first..last (last defaults to first) with lines, a table
+-- of strings or a string, by one ECM_DELETETEXT and one ECM_INSERTTEXT.
+function _M:setlines(first, last, lines)
+  local tx = transaction_of(self)
+  local line_nr = tx and tx.line_nr or tonumber(send_message(self.hwnd, C.ECM_GETLINECNT))
+  if first < 0 or first >= line_nr then
     return false
   end
+  last = math.max(math.min(last or first, line_nr - 1), first)
+  local text = type(lines) == "table" and tconcat(lines, "\n") or lines
+  if tx ~= nil then
+    queue_edit(tx, first, 0, last, C.INT_MAX, text)
+    return true
+  end
+
+  bpos_ptr[0].line = first
+  bpos_ptr[0].col = 0
+  epos_ptr[0].line = last
+  epos_ptr[0].col = C.INT_MAX
+  send_message(self.hwnd, C.ECM_DELETETEXT, bpos_ptr, epos_ptr)
+
+  local wtext, wlen = unicode.a2w_tmp(text)
+  insert_text_ptr[0].wtext = wtext
+  insert_text_ptr[0].wlen = wlen
+  send_message(self.hwnd, C.ECM_INSERTTEXT, bpos_ptr, insert_text_ptr)
+  return true
+end
+
+-- Iterates over lines first..last as (lnum, text), reading them block
+-- lines at a time (1024 by default) with getlines.
+function _M:lines(first, last, block)
+  block = block or 1024
+  local lnum = math.max(first or 0, 0)
+  local stop = last or C.INT_MAX
+  local buf, n, i = {}, 0, 0
+  return function()
+    if i >= n then
+      if lnum > stop then
+        return nil
+      end
+      buf, n = _M.getlines(self, lnum, math.min(lnum + block - 1, stop), buf)
+      if n == 0 then
+        return nil
+      end
+      i = 0
+    end
+    i = i + 1
+    lnum = lnum + 1
+    return lnum - 1, buf[i]
+  end
+end
 
-  self:set_cursor({ line = lnum, col = 0 })
-  self:send_command(80)  -- ECC_DELTOLINETAIL
-  self:insert(text)
+-- Immutable snapshot of the text, see eelua.core.journal. Reads only the
+-- lines changed since the previous snapshot of this document.
+function _M:snapshot()
+  return journal.snapshot(self)
+end
+
+-- Changes since version (doc.version before them), nil when too old or
+-- not tracked.
+function _M:changes(since)
+  return journal.changes(self, since)
+end
+
+-- The text as a read-only wide view, searched and counted without a
+-- narrow copy, see eelua.core.textview.
+function _M:textview(eol_type)
+  return textview.new(self, eol_type)
 end
 
 function _M:get_fullpath()
@@ -113,7 +305,6 @@ function _M:gettext(begin_pos, end_pos, eol_type)
   begin_pos = begin_pos or { line = 0, col = 0 }
   end_pos = end_pos or { line = C.INT_MAX, col = C.INT_MAX }
 
-  local sel_ptr = ffi_new("EC_SelInfo[1]")
   sel_ptr[0].bpos_line = begin_pos.line
   sel_ptr[0].bpos_col = begin_pos.col
   sel_ptr[0].epos_line = end_pos.line
@@ -123,20 +314,96 @@ function _M:gettext(begin_pos, end_pos, eol_type)
 
   local wlen = tonumber(send_message(self.hwnd, C.ECM_GETTEXT, sel_ptr))
 
-  local strbuf = base.get_string_buf((wlen + 3) * 2)
-  sel_ptr[0].lpBuffer = ffi_cast("wchar_t*", strbuf)
+  local wbuf = unicode.get_wide_buf(wlen + 3)
+  sel_ptr[0].lpBuffer = wbuf
   send_message(self.hwnd, C.ECM_GETTEXT, sel_ptr)
-  return unicode.w2a(sel_ptr[0].lpBuffer, wlen), wlen
+  sel_ptr[0].lpBuffer = nil
+  return unicode.w2a(wbuf, wlen), wlen
+end
+
+-- Iterates over the text between begin_pos and end_pos in ANSI strings
+-- of at most chunk characters (64K by default). The text is read a block
+-- of lines at a time, so memory follows the chunk size (or the longest
+-- line) instead of the size of the document.
+function _M:gettext_chunks(chunk, begin_pos, end_pos, eol_type)
+  chunk = chunk or 65536
+  begin_pos = begin_pos or { line = 0, col = 0 }
+  end_pos = end_pos or { line = C.INT_MAX, col = C.INT_MAX }
+
+  local hwnd = self.hwnd
+  local last_line = math.min(end_pos.line, self.line_nr - 1)
+  local line, col = begin_pos.line, begin_pos.col
+  local block_lines = 64
+  local encoder = unicode.encoder()
+  -- a buffer of its own: the loop body may convert text meanwhile
+  local block, block_cap = nil, 0
+  local wlen, wpos = 0, 0
+  local done = false
+
+  return function()
+    while not done do
+      if wpos < wlen then
+        local n = math.min(chunk, wlen - wpos)
+        local str = encoder:write(block + wpos, n)
+        wpos = wpos + n
+        if str ~= "" then
+          return str
+        end
+      elseif line > last_line then
+        done = true
+        local str = encoder:finish()
+        if str ~= "" then
+          return str
+        end
+      else
+        local eline, ecol = line + block_lines, 0
+        local final = eline > last_line
+        if final then
+          eline, ecol = end_pos.line, end_pos.col
+        end
+        sel_ptr[0].bpos_line = line
+        sel_ptr[0].bpos_col = col
+        sel_ptr[0].epos_line = eline
+        sel_ptr[0].epos_col = ecol
+        sel_ptr[0].lpBuffer = nil
+        sel_ptr[0].nEol = eol_type or C.EC_EOL_NULL
+        wlen = tonumber(send_message(hwnd, C.ECM_GETTEXT, sel_ptr))
+        if wlen + 3 > block_cap then
+          block_cap = math.max(wlen + 3, block_cap * 2)
+          block = ffi_new("wchar_t[?]", block_cap)
+        end
+        sel_ptr[0].lpBuffer = block
+        send_message(hwnd, C.ECM_GETTEXT, sel_ptr)
+        sel_ptr[0].lpBuffer = nil
+        wpos = 0
+
+        if final then
+          line = last_line + 1
+        else
+          -- aim the next block at about one chunk
+          if wlen > 0 then
+            block_lines = math.max(1, math.min(65536, math.floor(chunk * block_lines / wlen)))
+          end
+          line, col = eline, 0
+        end
+      end
+    end
+    return nil
+  end
 end
 
 function _M:delete(begin_pos, end_pos)
   begin_pos = begin_pos or { line = 0, col = 0 }
   end_pos = end_pos or { line = C.INT_MAX, col = C.INT_MAX }
 
-  local bpos_ptr = ffi_new("EC_Pos[1]")
+  local tx = transaction_of(self)
+  if tx ~= nil then
+    queue_edit(tx, begin_pos.line, begin_pos.col, end_pos.line, end_pos.col, "")
+    return
+  end
+
   bpos_ptr[0].line = begin_pos.line
   bpos_ptr[0].col = begin_pos.col
-  local epos_ptr = ffi_new("EC_Pos[1]")
   epos_ptr[0].line = end_pos.line
   epos_ptr[0].col = end_pos.col
 
@@ -144,8 +411,14 @@ function _M:delete(begin_pos, end_pos)
 end
 
 function _M:insert(text)
-  local wtext, wlen = unicode.a2w(text)
-  local insert_text_ptr = ffi_new("EC_InsertText[1]")
+  local tx = transaction_of(self)
+  if tx ~= nil then
+    tx.caret = tx.caret or _M.get_cursor(self)
+    queue_edit(tx, tx.caret.line, tx.caret.col, tx.caret.line, tx.caret.col, text)
+    return
+  end
+
+  local wtext, wlen = unicode.a2w_tmp(text)
   insert_text_ptr[0].wtext = wtext
   insert_text_ptr[0].wlen = wlen
 
@@ -153,16 +426,277 @@ function _M:insert(text)
 end
 
 function _M:insert_at(line, col, text)
-  local pos_ptr = ffi_new("EC_Pos[1]")
-  pos_ptr[0].line = line
-  pos_ptr[0].col = col
+  local tx = transaction_of(self)
+  if tx ~= nil then
+    queue_edit(tx, line, col, line, col, text)
+    return
+  end
 
-  local wtext, wlen = unicode.a2w(text)
-  local insert_text_ptr = ffi_new("EC_InsertText[1]")
+  bpos_ptr[0].line = line
+  bpos_ptr[0].col = col
+
+  local wtext, wlen = unicode.a2w_tmp(text)
   insert_text_ptr[0].wtext = wtext
   insert_text_ptr[0].wlen = wlen
 
-  send_message(self.hwnd, C.ECM_INSERTTEXT, pos_ptr, insert_text_ptr)
+  send_message(self.hwnd, C.ECM_INSERTTEXT, bpos_ptr, insert_text_ptr)
+end
+
+-- inserts first, then by start and order of the calls
+local function edit_before(a, b)
+  if a.sl ~= b.sl then
+    return a.sl < b.sl
+  elseif a.sc ~= b.sc then
+    return a.sc < b.sc
+  end
+  local a_ins = a.el == a.sl and a.ec == a.sc
+  local b_ins = b.el == b.sl and b.ec == b.sc
+  if a_ins ~= b_ins then
+    return a_ins
+  end
+  return a.seq < b.seq
+end
+
+-- Sorts the queued edits and merges each one that starts where the
+-- previous one ends (or on the line after one that replaced whole lines)
+-- into it. Raises an error for overlapping edits.
+local function coalesce(edits)
+  -- scripts mostly edit top-down or bottom-up, table.sort (which the JIT
+  -- does not compile) is left for the rest
+  local n_edits = #edits
+  local ascending, descending = true, true
+  for i = 2, n_edits do
+    if edit_before(edits[i], edits[i - 1]) then
+      ascending = false
+    else
+      descending = false
+    end
+  end
+  if descending and not ascending then
+    for i = 1, math.floor(n_edits / 2) do
+      edits[i], edits[n_edits + 1 - i] = edits[n_edits + 1 - i], edits[i]
+    end
+  elseif not ascending then
+    table.sort(edits, edit_before)
+  end
+  local out, n = {}, 0
+  local prev
+  for i = 1, n_edits do
+    local e = edits[i]
+    if prev ~= nil and prev.el == e.sl and prev.ec == e.sc then
+      prev.el, prev.ec = e.el, e.ec
+      prev.parts = prev.parts or { prev.text }
+      prev.parts[#prev.parts + 1] = e.text
+    elseif prev ~= nil and prev.ec == C.INT_MAX and prev.el + 1 == e.sl and e.sc == 0 then
+      prev.el, prev.ec = e.el, e.ec
+      prev.parts = prev.parts or { prev.text }
+      prev.parts[#prev.parts + 1] = "\n"
+      prev.parts[#prev.parts + 1] = e.text
+    elseif prev ~= nil and (e.sl < prev.el or e.sl == prev.el and e.sc < prev.ec) then
+      error(string.format("overlapping edits at %d:%d in transaction", e.sl, e.sc), 0)
+    else
+      n = n + 1
+      out[n] = e
+      prev = e
+    end
+  end
+  return out, n
+end
+
+-- bottom-up, so no edit moves the text of the ones still to come
+local function apply_edits(hwnd, edits, n)
+  for i = n, 1, -1 do
+    local e = edits[i]
+    bpos_ptr[0].line = e.sl
+    bpos_ptr[0].col = e.sc
+    if e.el ~= e.sl or e.ec ~= e.sc then
+      epos_ptr[0].line = e.el
+      epos_ptr[0].col = e.ec
+      send_message(hwnd, C.ECM_DELETETEXT, bpos_ptr, epos_ptr)
+    end
+    local text = e.parts and tconcat(e.parts) or e.text
+    if text ~= "" then
+      local wtext, wlen = unicode.a2w_tmp(text)
+      insert_text_ptr[0].wtext = wtext
+      insert_text_ptr[0].wlen = wlen
+      send_message(hwnd, C.ECM_INSERTTEXT, bpos_ptr, insert_text_ptr)
+    end
+  end
+end
+
+-- Runs fn(doc) with insert, insert_at, delete, setline, setlines and
+-- doc.text = ... queued instead of applied; their positions refer to the
+-- text as it was before fn, which reads of the document still return.
+-- The edits are then sorted, adjacent ones merged, and applied from the
+-- bottom up as one undo group with redraw off, followed by one
+-- ECM_REDRAW. Returns the number of edits applied after merging, or nil
+-- inside the transaction of an outer call, which gets the edits.
+-- Overlapping edits raise an error and nothing is applied.
+function _M:transaction(fn)
+  local key = base.ptr2number(self.hwnd)
+  if transactions[key] ~= nil then
+    fn(self)
+    return nil
+  end
+
+  local tx = { edits = {}, n = 0, line_nr = self.line_nr }
+  transactions[key] = tx
+  open_transactions = open_transactions + 1
+  local ok, err = pcall(fn, self)
+  transactions[key] = nil
+  open_transactions = open_transactions - 1
+  if not ok then
+    error(err, 0)
+  end
+  if tx.n == 0 then
+    return 0
+  end
+
+  local edits, n = coalesce(tx.edits)
+  local hwnd = self.hwnd
+  send_message(hwnd, C.WM_SETREDRAW, 0)
+  send_message(hwnd, C.ECM_GROUPUNDO, 1)
+  ok, err = pcall(apply_edits, hwnd, edits, n)
+  -- the editor needs every group opened to be closed
+  send_message(hwnd, C.ECM_GROUPUNDO, 0)
+  send_message(hwnd, C.WM_SETREDRAW, 1)
+  send_message(hwnd, C.ECM_REDRAW)
+  if not ok then
+    error(err, 0)
+  end
+  return n
+end
+
+-- Splits text at LF and CRLF from byte pos (0 by default) into lines
+-- after n, scanning it with memchr like read_lines. Stops after line
+-- max_n when given. Returns lines, the count and the byte to go on from,
+-- nil at the end.
+local function split_lines(text, max_n, lines, n, pos)
+  local buf = ffi_cast("const char*", text)
+  local len = #text
+  lines, n, pos = lines or {}, n or 0, pos or 0
+  max_n = max_n or math.huge
+  while n < max_n do
+    local nl = C.memchr(buf + pos, 10, len - pos)
+    n = n + 1
+    if nl == nil then
+      lines[n] = ffi_str(buf + pos, len - pos)
+      return lines, n, nil
+    end
+    local stop = tonumber(ffi_cast("const char*", nl) - buf)
+    local next_pos = stop + 1
+    if stop > pos and buf[stop - 1] == 13 then
+      stop = stop - 1
+    end
+    lines[n] = ffi_str(buf + pos, stop - pos)
+    pos = next_pos
+  end
+  return lines, n, pos
+end
+
+-- Reads the lines of the document after the n in out, up to a count of
+-- last, getlines' number of lines per ECM_GETTEXT. Returns the count.
+local function read_more(hwnd, out, n, last)
+  while n < last do
+    local stop = math.min(n + LINES_PER_READ, last)
+    n = read_lines(hwnd, n, stop - 1, out, n)
+  end
+  return n
+end
+
+-- Queues the edit turning old lines h[1]..h[2] into new lines h[3]..h[4]
+-- (1-based, empty when last < first). Lines are only ever replaced from
+-- column 0 to the end, inserted before a line or deleted up to the start
+-- of the next one, rewriting the line before where there is none.
+local function queue_hunk(self, old, n_old, new, h)
+  local a1, a2, b1, b2 = h[1], h[2], h[3], h[4]
+  if a2 >= a1 and b2 >= b1 then
+    _M.setlines(self, a1 - 1, a2 - 1, tconcat(new, "\n", b1, b2))
+  elseif b2 >= b1 then
+    if a1 <= n_old then
+      _M.insert_at(self, a1 - 1, 0, tconcat(new, "\n", b1, b2) .. "\n")
+    else
+      _M.setlines(self, n_old - 1, n_old - 1, old[n_old] .. "\n" .. tconcat(new, "\n", b1, b2))
+    end
+  elseif a2 < n_old then
+    _M.delete(self, { line = a1 - 1, col = 0 }, { line = a2, col = 0 })
+  elseif a1 > 1 then
+    _M.setlines(self, a1 - 2, a2 - 1, old[a1 - 1])
+  else
+    _M.setlines(self, 0, n_old - 1, "")
+  end
+end
+
+-- past this many hunks settext replaces the span of them all at once
+local MAX_HUNKS = 1024
+-- the least edit distance settext lets the diff look for
+local MIN_DIFF_D = 64
+-- settext first looks at this many times the budget of leading lines
+local PROBE_FACTOR = 16
+
+-- Myers spends about d * d steps on d changed lines, and putting the
+-- whole text in anew costs about a step per line (bench/doc_settext.lua),
+-- so the diff only pays up to about the square root of the line count.
+local function diff_budget(n_old)
+  return math.max(MIN_DIFF_D, math.floor(math.sqrt(2 * n_old)))
+end
+
+-- Sets the text, changing only the lines that differ from the current
+-- ones (see eelua.diff) in one transaction, which keeps the caret,
+-- folds and bookmarks of the rest and the undo step small. Returns the
+-- number of hunks changed. Text with CRs outside of CRLF is put in by a
+-- full replace, the lines would not split the same way, and so is text
+-- whose changes are over the budget of the diff (see diff_budget) and
+-- span most lines. Changes that are over the budget within the leading
+-- lines already are put in that way before the rest is read: reading
+-- and splitting both texts costs about as much as the replace.
+function _M:settext(text)
+  -- the plain find keeps the pattern off texts without any CR
+  if text:find("\r", 1, true) and (text:find("\r[^\n]") or text:byte(-1) == 13) then
+    _M.delete(self)
+    _M.insert(self, text)
+    return 1
+  end
+
+  local n_old = tonumber(send_message(self.hwnd, C.ECM_GETLINECNT))
+  local budget = diff_budget(n_old)
+  local old = new_tab(n_old, 0)
+  local new, n_new, pos
+  local probe = PROBE_FACTOR * budget
+  if n_old > 2 * probe then
+    local na = read_more(self.hwnd, old, 0, probe + budget)
+    new, n_new, pos = split_lines(text, probe + budget)
+    if diff.over_prefix(old, na, new, n_new, probe, budget) then
+      _M.delete(self)
+      _M.insert(self, text)
+      return 1
+    end
+    read_more(self.hwnd, old, na, n_old)
+    if pos ~= nil then
+      new, n_new = split_lines(text, nil, new, n_new, pos)
+    end
+  else
+    read_more(self.hwnd, old, 0, n_old)
+    new, n_new = split_lines(text)
+  end
+  local hunks, nh, over = diff.lines(old, n_old, new, n_new, budget)
+  if nh == 0 then
+    return 0
+  elseif over and 2 * (hunks[1][2] - hunks[1][1] + 1) > n_old then
+    -- a span of most of the text, nothing left worth keeping
+    _M.delete(self)
+    _M.insert(self, text)
+    return 1
+  elseif nh > MAX_HUNKS then
+    hunks = { { hunks[1][1], hunks[nh][2], hunks[1][3], hunks[nh][4] } }
+    nh = 1
+  end
+  _M.transaction(self, function()
+    for i = 1, nh do
+      queue_hunk(self, old, n_old, new, hunks[i])
+    end
+  end)
+  return nh
 end
 
 function _M:gotoline(line, base0)
@@ -196,10 +730,8 @@ function _M:set_sel(begin_pos, end_pos)
   begin_pos = begin_pos or { line = 0, col = 0 }
   end_pos = end_pos or { line = C.INT_MAX, col = C.INT_MAX }
 
-  local bpos_ptr = ffi_new("EC_Pos[1]")
   bpos_ptr[0].line = begin_pos.line
   bpos_ptr[0].col = begin_pos.col
-  local epos_ptr = ffi_new("EC_Pos[1]")
   epos_ptr[0].line = end_pos.line
   epos_ptr[0].col = end_pos.col
 
@@ -220,7 +752,7 @@ end
 
 function _M:comment_line(comment, yes_or_no)
   local val = send_message(self.hwnd, C.ECM_COMMENTLINE,
-                           unicode.a2w(comment),
+                           unicode.W(comment),
                            yes_or_no and 1 or 0)
   return val ~= 0
 end
@@ -246,7 +778,7 @@ function _M:get_wrap_count(lnum)
 end
 
 function _M:insert_snippet(text)
-  local wtext, wlen = unicode.a2w(text)
+  local wtext, wlen = unicode.a2w_tmp(text)
   send_message(self.hwnd, C.ECM_INSERTSNIPPET, wtext, wlen)
 end
 
@@ -1,5 +1,6 @@
 local ffi = require "ffi"
 local base = require "eelua.core.base"
+local handles = require "eelua.core.handles"
 
 local C = ffi.C
 local ffi_new = ffi.new
@@ -13,25 +14,35 @@ ffi.cdef [[
 ]]
 
 local _M = {}
+
+local getters = {
+  doc = function(self)
+    return _M.get_doc(self)
+  end,
+  fullpath = handles.cached("fullpath", function(self)
+    return _M.get_fullpath(self)
+  end),
+  frame_type = function(self)
+    return _M.get_frame_type(self)
+  end,
+}
+
 local mt = {
   __index = function(self, k)
-    if k == "doc" then
-      return _M.get_doc(self)
-    elseif k == "fullpath" then
-      return _M.get_fullpath(self)
-    elseif k == "frame_type" then
-      return _M.get_frame_type(self)
+    local method = _M[k]
+    if method ~= nil then
+      return method
+    end
+    local get = getters[k]
+    if get ~= nil then
+      return get(self)
     end
-    return _M[k]
+    return nil
   end
 }
 
-function _M.new(hwnd)
-  if tonumber(hwnd) == 0 then
-    return nil
-  end
-  return ffi_new("EE_Frame", { hwnd })
-end
+-- One object per window handle, nil for NULL.
+_M.new = handles.interner("EE_Frame")
 
 function _M:get_fullpath()
   return App:get_frame_fullpath(self.hwnd)
@@ -81,6 +81,7 @@ function _M.ptr2number(p)
   return tonumber(ffi_cast("intptr_t", p))
 end
 
+local cdef_t0 = eelua.clock and eelua.clock()
 ffi.cdef [[
 typedef uint8_t uchar;
 
@@ -149,6 +150,7 @@ typedef struct {
 } EE_UpdateUIElement;
 
 void free(void *ptr);
+void *memchr(const void *s, int c, size_t n);
 
 LRESULT SendMessageA(
   HWND   hWnd,
@@ -171,6 +173,8 @@ BOOL GlobalUnlock(
   HANDLE hMem
 );
 
+DWORD GetTickCount(void);
+
 typedef struct tagLVITEMA {
   UINT mask;
   int iItem;
@@ -200,6 +204,7 @@ static const int INT_MAX = 2147483647;
 static const int INT_MIN = -2147483648;
 
 static const int WM_USER = 1024;
+static const int WM_SETREDRAW = 0x000B;
 static const int WM_COMMAND = 0x0111;
 
 static const int LVM_FIRST = 0x1000;
@@ -225,6 +230,7 @@ static const int ECM_HASSEL = WM_USER + 33;
 static const int ECM_GETSEL = WM_USER + 34;
 static const int ECM_GETTEXT = WM_USER + 35;
 static const int ECM_WRAP = WM_USER + 37;
+static const int ECM_GROUPUNDO = WM_USER + 39;
 static const int ECM_GETSELTEXT = WM_USER + 40;
 static const int ECM_FORCECARETVISIBLE = WM_USER + 41;
 static const int ECM_SETPOS = WM_USER + 46;
@@ -291,6 +297,9 @@ static const int EC_EOL_WIN = 1;
 static const int EC_EOL_UNIX = 2;
 static const int EC_EOL_MAC = 3;
 ]]
+if cdef_t0 then
+  eelua.startup_record("ffi.cdef eelua.core.base", eelua.clock() - cdef_t0)
+end
 
 eelua.C = C
 
@@ -298,13 +307,24 @@ function eelua.printf(fmt, ...)
   eelua.dprint(str_fmt(fmt, ...))
 end
 
+-- Numbers are passed through as they are, only pointers and handles are
+-- cast: every ffi.cast boxes a new cdata.
+local function to_param(v)
+  if v == nil then
+    return 0
+  elseif type(v) == "number" then
+    return v
+  end
+  return ffi_cast("LPARAM", v)
+end
+
+local hwnd_type = ffi.typeof("HWND")
+
 function _M.send_message(hwnd, msg, wparam, lparam)
-  return C.SendMessageA(
-    ffi_cast("HWND", hwnd),
-    ffi_cast("UINT", msg),
-    wparam and ffi_cast("WPARAM", wparam) or 0,
-    lparam and ffi_cast("LPARAM", lparam) or 0
-  )
+  if not ffi.istype(hwnd_type, hwnd) then
+    hwnd = ffi_cast(hwnd_type, hwnd)
+  end
+  return C.SendMessageA(hwnd, msg, to_param(wparam), to_param(lparam))
 end
 
 return _M
@@ -0,0 +1,97 @@
+local ffi = require "ffi"
+local eelua = require "eelua"
+local base = require "eelua.core.base"
+
+-- Interned EE_Document/EE_Frame objects and the cached properties of
+-- their windows. The cache lives until the epoch of src/journal.c moves,
+-- which the hooks for saves, closes and tab page info changes do, so a
+-- property is fetched at most once in between. The editor reports no
+-- hook when one of its menu commands converts the encoding or line ends;
+-- mark such commands with eelua.wm_epoch_add(id).
+
+local ffi_new = ffi.new
+local ffi_cast = ffi.cast
+local ptr2number = base.ptr2number
+
+local epoch
+if type(eelua.journal_address) == "function" then
+  epoch = ffi_cast("const volatile int*", eelua.journal_address("epoch"))
+end
+
+local _M = {}
+
+local watching = false
+local cache = {}
+local cache_epoch = -1
+
+-- Returns a constructor of ctype objects from window handles, handing
+-- out the same object for the same handle while it is referenced.
+function _M.interner(ctype)
+  local objs = setmetatable({}, { __mode = "v" })
+  return function(hwnd)
+    local key = ptr2number(hwnd)
+    if key == 0 then
+      return nil
+    end
+    local obj = objs[key]
+    if obj == nil then
+      obj = ffi_new(ctype, { hwnd })
+      objs[key] = obj
+    end
+    return obj
+  end
+end
+
+local function props_of(hwnd)
+  if not watching then
+    watching = eelua.journal_watch()
+    if not watching then
+      return nil
+    end
+  end
+  local now = epoch[0]
+  if now ~= cache_epoch then
+    cache = {}
+    cache_epoch = now
+  end
+  local key = ptr2number(hwnd)
+  local props = cache[key]
+  if props == nil then
+    props = {}
+    cache[key] = props
+  end
+  return props
+end
+
+-- A getter for property name of self.hwnd that calls fetch(self) only
+-- when the value is not cached.
+function _M.cached(name, fetch)
+  if epoch == nil then
+    return fetch
+  end
+  return function(self)
+    local props = props_of(self.hwnd)
+    if props == nil then
+      return fetch(self)
+    end
+    local v = props[name]
+    if v == nil then
+      v = fetch(self)
+      props[name] = v
+    end
+    return v
+  end
+end
+
+-- Drops the cached value of name (all values when nil) for hwnd, after
+-- the plugin changed it.
+function _M.uncache(hwnd, name)
+  local key = ptr2number(hwnd)
+  if name == nil then
+    cache[key] = nil
+  elseif cache[key] ~= nil then
+    cache[key][name] = nil
+  end
+end
+
+return _M
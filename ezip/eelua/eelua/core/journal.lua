@@ -0,0 +1,318 @@
+local ffi = require "ffi"
+local math = require "math"
+local table = require "table"
+local eelua = require "eelua"
+local base = require "eelua.core.base"
+local rope = require "eelua.rope"
+
+-- Change journal of the documents, fed by EEHOOK_UPDATETEXT. The editor
+-- reports each change from inside the SendMessage that made it, so the
+-- hook is a native one (src/journal.c) that only queues the changed
+-- range; pump() moves the queue into the per-document state here.
+--
+-- A document is tracked from the first doc.version or doc:snapshot() on.
+-- Each change bumps its version and marks the changed lines in a list of
+-- segments over the last snapshot, so the next snapshot slices the old
+-- rope for the untouched lines and reads only the changed ones.
+
+local C = ffi.C
+local ffi_new = ffi.new
+local ffi_cast = ffi.cast
+local ptr2number = base.ptr2number
+local send_message = base.send_message
+
+ffi.cdef [[
+typedef struct {
+  HWND doc;
+  HWND frame;
+  EC_Pos spos;
+  EC_Pos epos_old;
+  EC_Pos epos_new;
+} journal_entry;
+]]
+
+local native
+if type(eelua.journal_address) == "function" then
+  native = {
+    read = ffi_cast("int (*)(journal_entry*, int)", eelua.journal_address("read")),
+    lost = ffi_cast("int (*)(void)", eelua.journal_address("lost")),
+  }
+end
+
+-- changes kept for doc:changes()
+local LOG_MAX = 256
+-- past this many segments the next snapshot reads the whole document
+local SEGS_MAX = 4096
+local BATCH = 256
+
+local _M = { available = native ~= nil }
+
+local started = false
+local batch = ffi_new("journal_entry[?]", BATCH)
+-- doc hwnd number -> state
+local docs = {}
+
+local Snapshot = {}
+
+-- Segments are { a = first, n = count } for lines a.. of the last
+-- snapshot, or { n = count } for lines changed since.
+local function push(out, a, n)
+  if n <= 0 then
+    return
+  end
+  local last = out[#out]
+  if last ~= nil and (a == nil and last.a == nil or
+                      a ~= nil and last.a ~= nil and last.a + last.n == a) then
+    last.n = last.n + n
+  else
+    out[#out + 1] = { a = a, n = n }
+  end
+end
+
+-- lines p..q (1-based) were replaced by m lines
+local function replace(segs, p, q, m)
+  local out = {}
+  local pos = 1
+  local done = false
+  for i = 1, #segs do
+    local sg = segs[i]
+    local first, last = pos, pos + sg.n - 1
+    pos = last + 1
+    if first < p then
+      push(out, sg.a, math.min(last, p - 1) - first + 1)
+    end
+    if last >= p and not done then
+      push(out, nil, m)
+      done = true
+    end
+    if last > q then
+      local off = math.max(q + 1, first) - first
+      push(out, sg.a and sg.a + off, sg.n - off)
+    end
+  end
+  if not done then
+    push(out, nil, m)
+  end
+  return out
+end
+
+local function record(st, e)
+  local version = st.version + 1
+  st.version = version
+  st.log[version % LOG_MAX] = {
+    version = version,
+    spos = { line = e.spos.line, col = e.spos.col },
+    epos_old = { line = e.epos_old.line, col = e.epos_old.col },
+    epos_new = { line = e.epos_new.line, col = e.epos_new.col },
+  }
+
+  local segs = st.segs
+  if segs ~= nil then
+    local s = e.spos.line
+    segs = replace(segs, s + 1, e.epos_old.line + 1, e.epos_new.line - s + 1)
+    st.segs = #segs <= SEGS_MAX and segs or nil
+  end
+end
+
+-- changes were lost, every document has to be read again
+local function invalidate_all()
+  for _, st in pairs(docs) do
+    st.version = st.version + 1
+    st.log_start = st.version
+    st.segs = nil
+  end
+end
+
+function _M.pump()
+  if not started then
+    return
+  end
+  if native.lost() > 0 then
+    invalidate_all()
+  end
+  repeat
+    local n = native.read(batch, BATCH)
+    for i = 0, n - 1 do
+      local e = batch[i]
+      if e.doc == nil then
+        local frame = ptr2number(e.frame)
+        for k, st in pairs(docs) do
+          if st.frame == frame then
+            docs[k] = nil
+          end
+        end
+      else
+        local st = docs[ptr2number(e.doc)]
+        if st ~= nil then
+          st.frame = st.frame or ptr2number(e.frame)
+          record(st, e)
+        end
+      end
+    end
+  until n < BATCH
+end
+
+local function find_frame(hwnd)
+  local ctx = eelua._ee_context
+  if ctx == nil then
+    return nil
+  end
+  local main = ffi_cast("EE_Context*", ctx).hMain
+  local count = tonumber(send_message(main, C.EEM_GETFRAMELIST, 0))
+  local frames = ffi_new("HWND[?]", count + 1)
+  count = tonumber(send_message(main, C.EEM_GETFRAMELIST, frames))
+  for i = 0, count - 1 do
+    if ptr2number(ffi_cast("HWND", send_message(main, C.EEM_GETDOCFROMFRAME, frames[i]))) == hwnd then
+      return ptr2number(frames[i])
+    end
+  end
+  return nil
+end
+
+-- State of doc, nil while the journal cannot run (no editor context),
+-- when versions would not move with the text.
+local function track(doc)
+  if not started then
+    started = eelua.journal_start()
+    if not started then
+      return nil
+    end
+  end
+  _M.pump()
+  local key = ptr2number(doc.hwnd)
+  local st = docs[key]
+  if st == nil then
+    st = { version = 0, log_start = 0, log = {}, frame = find_frame(key) }
+    docs[key] = st
+  end
+  return st
+end
+
+-- Version of doc, nil when changes are not tracked.
+function _M.version(doc)
+  if native == nil then
+    return nil
+  end
+  local st = track(doc)
+  return st and st.version
+end
+
+-- Changes after version since, oldest first, as tables of spos,
+-- epos_old and epos_new (0-based lines and columns) and version. Nil
+-- when they are no longer all known.
+function _M.changes(doc, since)
+  if native == nil then
+    return nil
+  end
+  local st = track(doc)
+  if st == nil or since < st.log_start or since < st.version - LOG_MAX then
+    return nil
+  end
+  local out = {}
+  for v = since + 1, st.version do
+    out[#out + 1] = st.log[v % LOG_MAX]
+  end
+  return out
+end
+
+local function read_all(doc)
+  local lines, n = doc:getlines(0)
+  return rope.from(lines, n)
+end
+
+-- Root of the rope for the current text, from the last snapshot and the
+-- changed lines. Nil when the segments do not add up to the document.
+local function rebuild(doc, st, line_nr)
+  local pieces = {}
+  local pos = 0
+  for i = 1, #st.segs do
+    local sg = st.segs[i]
+    if sg.a ~= nil then
+      rope.slice(st.root, sg.a, sg.a + sg.n - 1, pieces)
+    else
+      local lines, n = doc:getlines(pos, pos + sg.n - 1)
+      if n ~= sg.n then
+        return nil
+      end
+      pieces[#pieces + 1] = rope.from(lines, n)
+    end
+    pos = pos + sg.n
+  end
+  if pos ~= line_nr then
+    return nil
+  end
+  return rope.concat(pieces)
+end
+
+-- Immutable snapshot of the text of doc. The first one reads the whole
+-- document, later ones only the lines changed since the previous one,
+-- and the snapshot is shared while the version stays the same.
+-- Changes are seen once the editor has reported them through the hook.
+function _M.snapshot(doc)
+  local st = native and track(doc)
+  if st == nil then
+    return setmetatable({ root = read_all(doc) }, Snapshot)
+  end
+  if st.snap ~= nil and st.snap.version == st.version then
+    return st.snap
+  end
+
+  local root
+  if st.segs ~= nil and st.root ~= nil then
+    root = rebuild(doc, st, doc.line_nr)
+  end
+  if root == nil then
+    root = read_all(doc)
+  end
+  st.root = root
+  st.segs = { { a = 1, n = root.n } }
+  st.snap = setmetatable({ root = root, version = st.version }, Snapshot)
+  return st.snap
+end
+
+-- Snapshot methods take 0-based line numbers like EE_Document.
+
+function Snapshot.__index(self, k)
+  if k == "line_nr" then
+    return self.root.n
+  end
+  return Snapshot[k]
+end
+
+function Snapshot:getline(lnum)
+  if lnum < 0 or lnum >= self.root.n then
+    return ""
+  end
+  return rope.get(self.root, lnum + 1)
+end
+
+-- Lines first..last as a table of strings, and their count.
+function Snapshot:getlines(first, last)
+  local out = {}
+  local n = 0
+  for _, text in rope.lines(self.root, (first or 0) + 1, last and last + 1) do
+    n = n + 1
+    out[n] = text
+  end
+  return out, n
+end
+
+-- Iterates over lines first..last as (lnum, text).
+function Snapshot:lines(first, last)
+  local iter = rope.lines(self.root, (first or 0) + 1, last and last + 1)
+  return function()
+    local lnum, text = iter()
+    if lnum ~= nil then
+      return lnum - 1, text
+    end
+  end
+end
+
+-- The text with the lines joined by eol ("\n" by default).
+function Snapshot:text(eol)
+  local lines = {}
+  local n = rope.append_lines(self.root, lines, 0)
+  return table.concat(lines, eol or "\n", 1, n)
+end
+
+return _M
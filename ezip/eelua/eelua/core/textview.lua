@@ -0,0 +1,174 @@
+local ffi = require "ffi"
+local eelua = require "eelua"
+local base = require "eelua.core.base"
+local unicode = require "unicode"
+local journal = require "eelua.core.journal"
+
+-- Views of the wide text of a document. doc:textview() reads the text
+-- with ECM_GETTEXT into a buffer owned by the view and leaves it wide:
+-- find, count_lines, line_start and hash scan it in place (src/textview.c)
+-- and only slice() and line() convert, just the part asked for. Offsets
+-- are in wchar_t units from 0, lines are 0-based like EE_Document.
+--
+-- A view does not change with the document, unless it is read again:
+-- doc:textview() hands out the last view of each document while
+-- doc.version stays the same, and refills that view, in its own buffer,
+-- once the version moves (or always, when the journal is not running).
+-- Keep offsets, not views, across edits; textview.read() makes a view
+-- that stays.
+
+local C = ffi.C
+local ffi_new = ffi.new
+local ffi_cast = ffi.cast
+local ptr2number = base.ptr2number
+local send_message = base.send_message
+
+local LF = 10
+
+local native
+if type(eelua.textview_address) == "function" then
+  native = {
+    find = ffi_cast("int (*)(const wchar_t*, int, int, const wchar_t*, int)",
+                    eelua.textview_address("find")),
+    count = ffi_cast("int (*)(const wchar_t*, int, int, wchar_t)",
+                     eelua.textview_address("count")),
+    line_start = ffi_cast("int (*)(const wchar_t*, int, int, int)",
+                          eelua.textview_address("line_start")),
+    hash = ffi_cast("unsigned int (*)(const wchar_t*, int, int)",
+                    eelua.textview_address("hash")),
+  }
+end
+
+local View = {}
+View.__index = View
+
+local _M = { available = native ~= nil }
+
+local sel_ptr = ffi_new("EC_SelInfo[1]")
+-- doc hwnd number -> last view
+local views = setmetatable({}, { __mode = "v" })
+
+-- A view of the text of doc with line ends as eol_type (EC_EOL_UNIX by
+-- default, so lines end at "\n"): a new one, or view refilled when
+-- given, which keeps its buffer while the text fits. Nil without
+-- src/textview.c.
+function _M.read(doc, eol_type, view)
+  if native == nil then
+    return nil
+  end
+  eol_type = eol_type or C.EC_EOL_UNIX
+  sel_ptr[0].bpos_line = 0
+  sel_ptr[0].bpos_col = 0
+  sel_ptr[0].epos_line = C.INT_MAX
+  sel_ptr[0].epos_col = C.INT_MAX
+  sel_ptr[0].lpBuffer = nil
+  sel_ptr[0].nEol = eol_type
+  local len = tonumber(send_message(doc.hwnd, C.ECM_GETTEXT, sel_ptr))
+  if view == nil then
+    view = setmetatable({ cap = 0 }, View)
+  end
+  if view.cap < len + 3 then
+    -- some room, so a growing document is not copied on every read
+    view.cap = len + 3 + math.floor(len / 8)
+    view.buf = ffi_new("wchar_t[?]", view.cap)
+    view.ptr = ffi_cast("const wchar_t*", view.buf)
+  end
+  sel_ptr[0].lpBuffer = view.buf
+  send_message(doc.hwnd, C.ECM_GETTEXT, sel_ptr)
+  sel_ptr[0].lpBuffer = nil
+
+  view.len = len
+  view.version = journal.version(doc)
+  view.eol_type = eol_type
+  return view
+end
+
+-- Like read, but hands out the last view of doc again while its version
+-- stays the same, and refills it otherwise. Changes are seen once the
+-- editor has reported them.
+function _M.new(doc, eol_type)
+  eol_type = eol_type or C.EC_EOL_UNIX
+  local key = ptr2number(doc.hwnd)
+  local view = views[key]
+  if view ~= nil and view.version ~= nil and view.eol_type == eol_type and
+      view.version == journal.version(doc) then
+    return view
+  end
+  view = _M.read(doc, eol_type, view)
+  views[key] = view
+  return view
+end
+
+-- Offset of the first str (an ANSI string) at or after offset init (0 by
+-- default), or nil.
+function View:find(str, init)
+  local pat, plen = unicode.a2w_tmp(str)
+  local i = native.find(self.ptr, self.len, init or 0, pat, plen)
+  if i < 0 then
+    return nil
+  end
+  return i
+end
+
+-- Number of lines in units first..last - 1 (the whole text by default),
+-- the line ends there plus one.
+function View:count_lines(first, last)
+  first = first or 0
+  last = math.min(last or self.len, self.len)
+  if last < first then
+    return 0
+  end
+  return native.count(self.ptr, first, last, LF) + 1
+end
+
+-- Offset of the start of line lnum, or nil past the last line.
+function View:line_start(lnum)
+  if lnum < 0 then
+    return nil
+  end
+  local i = native.line_start(self.ptr, self.len, 0, lnum)
+  if i < 0 then
+    return nil
+  end
+  return i
+end
+
+-- Line and column (0-based) of offset, e.g. of a find result.
+function View:pos(offset)
+  offset = math.max(math.min(offset, self.len), 0)
+  local line = native.count(self.ptr, 0, offset, LF)
+  return { line = line, col = offset - native.line_start(self.ptr, self.len, 0, line) }
+end
+
+-- The n units at offset as an ANSI string (to the end when n is nil).
+function View:slice(offset, n)
+  offset = math.max(offset, 0)
+  n = math.min(n or self.len, self.len - offset)
+  if n <= 0 then
+    return ""
+  end
+  return unicode.w2a(self.ptr + offset, n)
+end
+
+-- Line lnum as an ANSI string without its line end, nil past the last.
+function View:line(lnum)
+  local first = self:line_start(lnum)
+  if first == nil then
+    return nil
+  end
+  local next_start = native.line_start(self.ptr, self.len, first, 1)
+  local last = next_start < 0 and self.len or next_start - 1
+  if last > first and self.ptr[last - 1] == 13 then
+    last = last - 1
+  end
+  return self:slice(first, last - first)
+end
+
+-- 32-bit FNV-1a of the units first..last - 1 (the whole text by default).
+function View:hash(first, last)
+  first = first or 0
+  last = math.min(last or self.len, self.len)
+  return tonumber(native.hash(self.ptr, first, last))
+end
+
+return _M
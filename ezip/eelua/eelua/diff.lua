@@ -0,0 +1,220 @@
+-- Line diffs. The common head and tail are trimmed first, the rest goes
+-- through Myers' O((N+M)D) algorithm. When that would take more than a
+-- budget of steps, the trimmed middle is reported as one hunk, which is
+-- never more work to apply than replacing everything. A middle that is
+-- sure to be over the budget is reported so before Myers starts.
+
+local ok, new_tab = pcall(require, "table.new")
+if not ok then
+  new_tab = function (narr, nrec) return {} end
+end
+
+local _M = {
+  -- edit distance and steps Myers may spend before giving up
+  max_d = 512,
+  max_steps = 4000000,
+}
+
+local function backtrack(trace, off, d, n, m)
+  local ma, mb, nm = {}, {}, 0
+  local x, y = n, m
+  for dd = d, 0, -1 do
+    local prev_x, prev_k = 0, 0
+    if dd > 0 then
+      local v = trace[dd]
+      local k = x - y
+      if k == -dd or (k ~= dd and v[off + k - 1] < v[off + k + 1]) then
+        prev_k = k + 1
+      else
+        prev_k = k - 1
+      end
+      prev_x = v[off + prev_k]
+    end
+    local prev_y = prev_x - prev_k
+    -- the diagonal run after the edit of round dd
+    while x > prev_x and y > prev_y do
+      x = x - 1
+      y = y - 1
+      nm = nm + 1
+      ma[nm] = x
+      mb[nm] = y
+    end
+    x, y = prev_x, prev_y
+  end
+  return ma, mb, nm
+end
+
+-- True when turning a[a0 + 1 .. a0 + n] into b[b0 + 1 .. b0 + m] takes
+-- more than limit edits for sure: a line with no equal line left on the
+-- other side has to be deleted or inserted. Stops counting at the first
+-- line of a that settles it.
+local function over_distance(a, a0, n, b, b0, m, limit)
+  local count = new_tab(0, m)
+  for i = b0 + 1, b0 + m do
+    local s = b[i]
+    count[s] = (count[s] or 0) + 1
+  end
+  -- each unmatched line of a leaves one more of b unmatched too, past
+  -- the m - n the lengths differ by
+  local extra = m - n
+  local unmatched = 0
+  for i = a0 + 1, a0 + n do
+    local s = a[i]
+    local c = count[s]
+    if c ~= nil and c > 0 then
+      count[s] = c - 1
+    else
+      unmatched = unmatched + 1
+      if 2 * unmatched + extra > limit then
+        return true
+      end
+    end
+  end
+  return 2 * unmatched + extra > limit
+end
+
+-- Lines of x[1..k] without an equal line in y[1..k + limit], stopping
+-- past limit.
+local function unmatched_prefix(x, nx, y, ny, k, limit)
+  local count = new_tab(0, k + limit)
+  for i = 1, math.min(ny, k + limit) do
+    local s = y[i]
+    count[s] = (count[s] or 0) + 1
+  end
+  local unmatched = 0
+  for i = 1, math.min(nx, k) do
+    local s = x[i]
+    local c = count[s]
+    if c ~= nil and c > 0 then
+      count[s] = c - 1
+    else
+      unmatched = unmatched + 1
+      if unmatched > limit then
+        break
+      end
+    end
+  end
+  return unmatched
+end
+
+-- True when turning a into b takes more than limit edits for sure, judged
+-- from their leading lines: a[1..na] and b[1..nb] hold the first k + limit
+-- lines of each (or all of them). Within limit edits a line moves by at
+-- most limit, so a line of the first k with no equal line among the first
+-- k + limit of the other side is deleted or inserted.
+function _M.over_prefix(a, na, b, nb, k, limit)
+  local deleted = unmatched_prefix(a, na, b, nb, k, limit)
+  return deleted > limit or deleted + unmatched_prefix(b, nb, a, na, k, limit) > limit
+end
+
+-- Matched pairs of a[a0 + 1 .. a0 + n] and b[b0 + 1 .. b0 + m], in
+-- reverse, as offsets from a0 and b0 in ma and mb, and their count. Nil
+-- when over budget. v[k + off] is the furthest x on diagonal k.
+local function myers(a, a0, n, b, b0, m, max_d)
+  max_d = math.min(max_d, n + m)
+  local off = max_d + 2
+  local steps = 0
+  local v = { [off + 1] = 0 }
+  local trace = {}
+
+  for d = 0, max_d do
+    -- v as it was before this round, over the diagonals it reads
+    local snap = {}
+    for i = off - d, off + d do
+      snap[i] = v[i]
+    end
+    trace[d] = snap
+
+    for k = -d, d, 2 do
+      local x
+      if k == -d or (k ~= d and v[off + k - 1] < v[off + k + 1]) then
+        x = v[off + k + 1]
+      else
+        x = v[off + k - 1] + 1
+      end
+      local y = x - k
+      local x0 = x
+      while x < n and y < m and a[a0 + x + 1] == b[b0 + y + 1] do
+        x = x + 1
+        y = y + 1
+      end
+      v[off + k] = x
+      steps = steps + 1 + x - x0
+
+      if x >= n and y >= m then
+        return backtrack(trace, off, d, n, m)
+      end
+    end
+
+    if steps > _M.max_steps then
+      return nil
+    end
+  end
+  return nil
+end
+
+-- Hunks turning lines a[1..n] into b[1..m], as a list of
+-- { a_first, a_last, b_first, b_last } ranges (1-based, inclusive, empty
+-- when last < first) in order, and their count, then true when the
+-- middle was over the budget and is the one hunk. max_d lowers the edit
+-- distance of the budget for this call.
+function _M.lines(a, n, b, m, max_d)
+  n = n or #a
+  m = m or #b
+  max_d = math.min(max_d or _M.max_d, _M.max_d)
+
+  local head = 0
+  local limit = math.min(n, m)
+  while head < limit and a[head + 1] == b[head + 1] do
+    head = head + 1
+  end
+  local tail = 0
+  limit = limit - head
+  while tail < limit and a[n - tail] == b[m - tail] do
+    tail = tail + 1
+  end
+
+  local an, bn = n - head - tail, m - head - tail
+  local hunks = {}
+  if an == 0 and bn == 0 then
+    return hunks, 0
+  end
+
+  local ma, mb, nm
+  if an > 0 and bn > 0 then
+    -- Myers spends at least one step on each of the d + 1 diagonals of
+    -- round d, so d edits cost d * d / 2 steps or more
+    local limit = math.min(max_d, math.floor(math.sqrt(2 * _M.max_steps)))
+    if math.abs(an - bn) > limit or over_distance(a, head, an, b, head, bn, limit) then
+      ma = nil
+    else
+      ma, mb, nm = myers(a, head, an, b, head, bn, limit)
+    end
+  else
+    ma, mb, nm = {}, {}, 0
+  end
+  if ma == nil then
+    hunks[1] = { head + 1, head + an, head + 1, head + bn }
+    return hunks, 1, true
+  end
+
+  -- the gaps between matched lines are the hunks
+  local nh = 0
+  local pa, pb = 0, 0
+  for i = nm, 0, -1 do
+    local xa, xb
+    if i > 0 then
+      xa, xb = ma[i], mb[i]
+    else
+      xa, xb = an, bn
+    end
+    if xa > pa or xb > pb then
+      nh = nh + 1
+      hunks[nh] = { head + pa + 1, head + xa, head + pb + 1, head + xb }
+    end
+    pa, pb = xa + 1, xb + 1
+  end
+  return hunks, nh
+end
+
+return _M
@@ -0,0 +1,107 @@
+-- Lazily activated plugins.
+--
+-- A plugin declares its triggers up front and keeps its body in a module
+-- (usually under autoload/). The module is only required when one of the
+-- triggers fires for the first time:
+--
+--   eelua.add_lazy_plugin {
+--     name = "ctrlp",
+--     module = "autoload.ctrlp.files",
+--     plugin_commands = {
+--       { name = "pl_ctrlp", desc = "CtrlP", func = "run" },
+--     },
+--     console_commands = {
+--       { match = "^CtrlPRg$", module = "autoload.ctrlp.rg", func = "run" },
+--     },
+--     events = {
+--       { event = "OnPrePopupTextMenu", func = "on_popup_menu" },
+--     },
+--   }
+--
+-- `func` names a function exported by the module, defaults to "run".
+
+local string = require "string"
+local table = require "table"
+local eelua = require "eelua"
+
+local str_fmt = string.format
+local tinsert = table.insert
+
+local _M = {}
+
+local plugins = {}
+
+local function activate(spec, mod_name)
+  local mod = require(mod_name)
+  if not spec.activated then
+    spec.activated = true
+    if type(spec.on_activate) == "function" then
+      spec.on_activate(mod)
+    end
+  end
+  return mod
+end
+
+local function make_trigger(spec, trigger)
+  local mod_name = trigger.module or spec.module
+  local func_name = trigger.func or "run"
+  if type(mod_name) ~= "string" then
+    error(str_fmt("lazy plugin '%s': no module given", tostring(spec.name)), 3)
+  end
+
+  return function(...)
+    local mod = activate(spec, mod_name)
+    local fn = mod[func_name]
+    if type(fn) ~= "function" then
+      error(str_fmt("lazy plugin '%s': %s.%s is not a function",
+                    tostring(spec.name), mod_name, func_name))
+    end
+    return fn(...)
+  end
+end
+
+function _M.add(spec)
+  spec.activated = false
+
+  for _, cmd in ipairs(spec.plugin_commands or {}) do
+    eelua.add_plugin_command {
+      name = cmd.name,
+      desc = cmd.desc,
+      long_desc = cmd.long_desc,
+      func = make_trigger(spec, cmd)
+    }
+  end
+
+  for _, cmd in ipairs(spec.console_commands or {}) do
+    eelua.add_console_command {
+      match = cmd.match,
+      desc = cmd.desc,
+      func = make_trigger(spec, cmd)
+    }
+  end
+
+  for _, ev in ipairs(spec.events or {}) do
+    eelua.add_event_handler(ev.event, make_trigger(spec, ev))
+  end
+
+  tinsert(plugins, spec)
+  return spec
+end
+
+-- Forgets spec, the commands and handlers it added are removed by whoever
+-- tracks them (see eelua.reload).
+function _M.remove(spec)
+  for i, v in ipairs(plugins) do
+    if v == spec then
+      table.remove(plugins, i)
+      return true
+    end
+  end
+  return false
+end
+
+function _M.list()
+  return plugins
+end
+
+return _M
@@ -0,0 +1,115 @@
+local string = require "string"
+local table = require "table"
+local io = require "io"
+local eelua = require "eelua"
+
+local str_fmt = string.format
+local tinsert = table.insert
+local tconcat = table.concat
+local tsort = table.sort
+local math_max = math.max
+
+local _M = {}
+
+function _M.start(interval_ms, depth)
+  return eelua.profile_start(interval_ms, depth)
+end
+
+function _M.stop()
+  return eelua.profile_stop()
+end
+
+function _M.reset()
+  eelua.profile_reset()
+end
+
+-- folded stacks ("a;b;c count" per line), the input format of flamegraph.pl
+function _M.folded(stacks)
+  local keys = {}
+  for k in pairs(stacks) do
+    tinsert(keys, k)
+  end
+  tsort(keys)
+
+  local out = {}
+  for _, k in ipairs(keys) do
+    tinsert(out, str_fmt("%s %d", k, stacks[k]))
+  end
+  return tconcat(out, "\n")
+end
+
+function _M.dump(filepath)
+  local stacks = eelua.profile_data()
+  local fp, errmsg = io.open(filepath, "wb")
+  if not fp then
+    return nil, errmsg
+  end
+  fp:write(_M.folded(stacks), "\n")
+  fp:close()
+  return true
+end
+
+local function sorted_counts(counts, n)
+  local list = {}
+  for name, count in pairs(counts) do
+    tinsert(list, { name = name, count = count })
+  end
+  tsort(list, function(a, b)
+    if a.count ~= b.count then
+      return a.count > b.count
+    end
+    return a.name < b.name
+  end)
+  while #list > n do
+    list[#list] = nil
+  end
+  return list
+end
+
+-- self samples per leaf function, per file (the module part of "file:func")
+-- and per entry point, the top n of each
+function _M.summarize(stacks, n)
+  n = n or 10
+  local funcs, files, entries = {}, {}, {}
+  local total = 0
+
+  for stack, count in pairs(stacks) do
+    total = total + count
+    local entry = stack:match("^[^;]*")
+    local leaf = stack:match("([^;]*)$")
+    local file = leaf:match("^(.-):") or leaf
+    funcs[leaf] = (funcs[leaf] or 0) + count
+    files[file] = (files[file] or 0) + count
+    entries[entry] = (entries[entry] or 0) + count
+  end
+
+  return {
+    total = total,
+    funcs = sorted_counts(funcs, n),
+    files = sorted_counts(files, n),
+    entries = sorted_counts(entries, n)
+  }
+end
+
+function _M.format_summary(n)
+  local stacks, info = eelua.profile_data()
+  local s = _M.summarize(stacks, n)
+  local out = {
+    str_fmt("profile: %s, %d samples, %d stacks, %d ms interval, %.1f s",
+            info.running and "running" or "stopped", info.samples, info.stacks,
+            info.interval_ms, info.elapsed_ms / 1000)
+  }
+  local function section(title, list)
+    tinsert(out, title)
+    for _, v in ipairs(list) do
+      tinsert(out, str_fmt("  %5.1f%%  %6d  %s", v.count * 100 / math_max(s.total, 1),
+                           v.count, v.name))
+    end
+  end
+  section("entry points:", s.entries)
+  section("files:", s.files)
+  section("functions (self):", s.funcs)
+  return tconcat(out, "\n")
+end
+
+return _M
@@ -0,0 +1,248 @@
+-- Hot reload of plugins and modules.
+--
+-- Every registration made while a plugin file runs (event handlers, plugin
+-- and console commands, WM command ids, lazy plugins) is recorded with an
+-- undo function under that file, its "owner". Reloading a plugin compiles
+-- the new version first, so a syntax error keeps the old one running, then
+-- undoes the old registrations and runs the file again.
+--
+-- Any other changed file is matched against package.loaded. A loaded
+-- module is required again and the old table is made a copy of the new
+-- one, so modules that captured it with `local M = require "..."` see
+-- the new functions. If the new version fails to load, the old module
+-- stays in place.
+
+local string = require "string"
+local table = require "table"
+local package = require "package"
+local io = require "io"
+local path = require "minipath"
+local watcher = require "eelua.watcher"
+
+local str_fmt = string.format
+local tinsert = table.insert
+local tremove = table.remove
+local unpack = unpack or table.unpack
+
+local _M = {
+  -- ms between two polls of the watcher
+  interval = 1000,
+  -- directory whose files are plugins, everything else is a module
+  plugins_dir = nil,
+  loadfile = loadfile,
+  -- called with a message when something fails to reload
+  on_error = function(msg) print(msg) end,
+  -- called after a batch of changes was applied
+  on_reloaded = nil,
+  -- modules that keep state which must survive a reload
+  pinned = {
+    ["eelua.reload"] = true,
+    ["eelua.watcher"] = true
+  }
+}
+
+local owners = {}
+local owner_stack = {}
+local module_paths = {}
+local the_watcher = nil
+local last_poll = nil
+
+local function normalize(p)
+  return path.translate(p, "/"):lower()
+end
+
+function _M.current_owner()
+  return owner_stack[#owner_stack]
+end
+
+-- Records how to undo a registration made by the file being loaded,
+-- registrations made outside of run_as() are permanent.
+function _M.track(undo)
+  local owner = owner_stack[#owner_stack]
+  if owner == nil then
+    return
+  end
+  local list = owners[owner]
+  if list == nil then
+    list = {}
+    owners[owner] = list
+  end
+  tinsert(list, undo)
+end
+
+-- Runs fn(...) with owner as the current owner, returns like pcall.
+function _M.run_as(owner, fn, ...)
+  tinsert(owner_stack, owner)
+  local rv = { pcall(fn, ...) }
+  tremove(owner_stack)
+  return unpack(rv, 1, table.maxn(rv))
+end
+
+function _M.unload(owner)
+  local list = owners[owner]
+  owners[owner] = nil
+  if list == nil then
+    return 0
+  end
+  for i = #list, 1, -1 do
+    local ok, errmsg = pcall(list[i])
+    if not ok then
+      _M.on_error(str_fmt("ERR: unload %s: %s", owner, errmsg))
+    end
+  end
+  return #list
+end
+
+function _M.owners()
+  local out = {}
+  for owner, list in pairs(owners) do
+    out[owner] = #list
+  end
+  return out
+end
+
+function _M.load_plugin(filepath)
+  local chunk, errmsg = _M.loadfile(filepath)
+  if not chunk then
+    return nil, errmsg
+  end
+  _M.unload(filepath)
+  return _M.run_as(filepath, chunk)
+end
+
+local function module_path(name)
+  local cached = module_paths[name]
+  if cached ~= nil then
+    return cached or nil
+  end
+
+  local sep = package.config:sub(1, 1)
+  local fname = name:gsub("%.", sep)
+  local found = false
+  for template in package.path:gmatch("[^;]+") do
+    local candidate = template:gsub("%?", fname)
+    local fp = io.open(candidate, "rb")
+    if fp then
+      fp:close()
+      found = candidate
+      break
+    end
+  end
+  module_paths[name] = found
+  return found or nil
+end
+
+function _M.modules_for(filepath)
+  local target = normalize(filepath)
+  local out = {}
+  for name in pairs(package.loaded) do
+    if type(name) == "string" and not _M.pinned[name] then
+      local p = module_path(name)
+      if p and normalize(p) == target then
+        tinsert(out, name)
+      end
+    end
+  end
+  table.sort(out)
+  return out
+end
+
+function _M.reload_module(name)
+  local old = package.loaded[name]
+  package.loaded[name] = nil
+  local ok, new = pcall(require, name)
+  if not ok then
+    package.loaded[name] = old
+    return nil, new
+  end
+
+  if type(old) == "table" and type(new) == "table" and old ~= new then
+    -- fields the new version dropped must not linger in the old table
+    for k in pairs(old) do
+      if new[k] == nil then
+        old[k] = nil
+      end
+    end
+    for k, v in pairs(new) do
+      old[k] = v
+    end
+    package.loaded[name] = old
+  end
+  return true
+end
+
+local function is_plugin(filepath)
+  if not _M.plugins_dir then
+    return false
+  end
+  return normalize(path.getdirectory(filepath)) == normalize(_M.plugins_dir)
+end
+
+-- Applies a list of watcher changes, returns the number of reloaded
+-- plugins and modules.
+function _M.apply(changes)
+  local n = 0
+  for _, change in ipairs(changes) do
+    local filepath = change.path
+    if is_plugin(filepath) then
+      if change.kind == "removed" then
+        _M.unload(filepath)
+        n = n + 1
+      else
+        local ok, errmsg = _M.load_plugin(filepath)
+        if ok then
+          n = n + 1
+        else
+          _M.on_error(str_fmt("ERR: reload %s: %s", filepath, tostring(errmsg)))
+        end
+      end
+    elseif change.kind ~= "removed" then
+      for _, name in ipairs(_M.modules_for(filepath)) do
+        local ok, errmsg = _M.reload_module(name)
+        if ok then
+          n = n + 1
+        else
+          _M.on_error(str_fmt("ERR: reload module %s: %s", name, tostring(errmsg)))
+        end
+      end
+    end
+  end
+
+  if n > 0 and _M.on_reloaded then
+    _M.on_reloaded(changes)
+  end
+  return n
+end
+
+-- dirs as for watcher.new(), nil stops watching
+function _M.watch(dirs, backend_name)
+  if dirs == nil then
+    the_watcher = nil
+    return
+  end
+  the_watcher = watcher.new(dirs, backend_name)
+  the_watcher:poll()
+  last_poll = nil
+end
+
+function _M.is_watching()
+  return the_watcher ~= nil
+end
+
+-- Polls the watcher at most once every interval ms, now is a ms clock.
+function _M.poll(now)
+  if the_watcher == nil then
+    return 0
+  end
+  if last_poll and now and now - last_poll < _M.interval then
+    return 0
+  end
+  last_poll = now
+  local changes = the_watcher:poll()
+  if #changes == 0 then
+    return 0
+  end
+  return _M.apply(changes)
+end
+
+return _M
@@ -0,0 +1,214 @@
+local math = require "math"
+
+-- Immutable ropes of lines. A leaf holds up to LEAF lines in an array,
+-- an inner node the line count and depth of its two halves. Slicing
+-- shares every subtree that is wholly inside the range, so a new rope
+-- built from slices of an old one costs O(pieces * depth), not O(lines).
+-- Positions are 1-based.
+
+local floor = math.floor
+local max = math.max
+
+local LEAF = 64
+
+local _M = { LEAF = LEAF }
+
+local function leaf(lines, first, last)
+  local t = {}
+  for i = first, last do
+    t[i - first + 1] = lines[i]
+  end
+  return { n = last - first + 1, depth = 0, lines = t }
+end
+
+local function join(left, right)
+  return {
+    n = left.n + right.n,
+    depth = max(left.depth, right.depth) + 1,
+    left = left,
+    right = right,
+  }
+end
+
+local function build(lines, first, last)
+  if last - first < LEAF then
+    return leaf(lines, first, last)
+  end
+  local mid = floor((first + last) / 2)
+  return join(build(lines, first, mid), build(lines, mid + 1, last))
+end
+
+-- A rope over lines[1..n] (n defaults to #lines), the array is copied.
+function _M.from(lines, n)
+  n = n or #lines
+  if n <= 0 then
+    return leaf(lines, 1, 0)
+  end
+  return build(lines, 1, n)
+end
+
+function _M.get(node, i)
+  while node.lines == nil do
+    local left = node.left
+    if i <= left.n then
+      node = left
+    else
+      i = i - left.n
+      node = node.right
+    end
+  end
+  return node.lines[i]
+end
+
+-- Appends the nodes covering lines a..b of node to pieces.
+local function slice(node, a, b, pieces)
+  if a > b then
+    return
+  end
+  if a == 1 and b == node.n then
+    pieces[#pieces + 1] = node
+  elseif node.lines ~= nil then
+    pieces[#pieces + 1] = leaf(node.lines, a, b)
+  else
+    local ln = node.left.n
+    if a <= ln then
+      slice(node.left, a, math.min(b, ln), pieces)
+    end
+    if b > ln then
+      slice(node.right, max(a - ln, 1), b - ln, pieces)
+    end
+  end
+end
+
+-- Appends the subtrees making up lines a..b of node to pieces, a table
+-- for concat.
+function _M.slice(node, a, b, pieces)
+  pieces = pieces or {}
+  slice(node, a, b, pieces)
+  return pieces
+end
+
+local function concat(pieces, first, last)
+  if first == last then
+    return pieces[first]
+  end
+  -- split where the line counts balance
+  local total = 0
+  for i = first, last do
+    total = total + pieces[i].n
+  end
+  local mid, acc = first, pieces[first].n
+  while mid + 1 < last and acc + pieces[mid + 1].n <= total / 2 do
+    mid = mid + 1
+    acc = acc + pieces[mid].n
+  end
+  return join(concat(pieces, first, mid), concat(pieces, mid + 1, last))
+end
+
+local function append_lines(node, out, n)
+  if node.lines ~= nil then
+    local lines = node.lines
+    for i = 1, node.n do
+      out[n + i] = lines[i]
+    end
+    return n + node.n
+  end
+  n = append_lines(node.left, out, n)
+  return append_lines(node.right, out, n)
+end
+
+-- Copies the lines of node to out[n + 1], ..., returns the new count.
+function _M.append_lines(node, out, n)
+  return append_lines(node, out, n or 0)
+end
+
+-- One rope of the pieces in order. Runs of small pieces are merged into
+-- leaves, and a rope deeper than the log of its size allows is rebuilt.
+function _M.concat(pieces)
+  local merged, n = {}, 0
+  local run, run_n = nil, 0
+  for i = 1, #pieces do
+    local p = pieces[i]
+    if p.n > 0 then
+      if p.lines ~= nil and run_n + p.n <= LEAF then
+        run = run or {}
+        for k = 1, p.n do
+          run[run_n + k] = p.lines[k]
+        end
+        run_n = run_n + p.n
+      else
+        if run ~= nil then
+          n = n + 1
+          merged[n] = { n = run_n, depth = 0, lines = run }
+          run, run_n = nil, 0
+        end
+        if p.lines ~= nil then
+          run = leaf(p.lines, 1, p.n).lines
+          run_n = p.n
+        else
+          n = n + 1
+          merged[n] = p
+        end
+      end
+    end
+  end
+  if run ~= nil then
+    n = n + 1
+    merged[n] = { n = run_n, depth = 0, lines = run }
+  end
+  if n == 0 then
+    return leaf({}, 1, 0)
+  end
+
+  local root = concat(merged, 1, n)
+  if root.depth > 2 * floor(math.log(root.n / LEAF + 1) / math.log(2)) + 8 then
+    local lines = {}
+    append_lines(root, lines, 0)
+    root = build(lines, 1, root.n)
+  end
+  return root
+end
+
+-- Iterates over lines first..last as (lnum, text).
+function _M.lines(node, first, last)
+  first = max(first or 1, 1)
+  last = math.min(last or node.n, node.n)
+  local stack, leaf_lines, i, stop = {}, nil, 0, 0
+  local lnum = first - 1
+
+  -- descend to the leaf holding first, keeping the right halves to visit
+  local a = first
+  while last >= first and node.lines == nil do
+    local ln = node.left.n
+    if a <= ln then
+      stack[#stack + 1] = node.right
+      node = node.left
+    else
+      a = a - ln
+      node = node.right
+    end
+  end
+  if last >= first then
+    leaf_lines, i, stop = node.lines, a - 1, node.n
+  end
+
+  return function()
+    if lnum >= last then
+      return nil
+    end
+    while i >= stop do
+      local next_node = stack[#stack]
+      stack[#stack] = nil
+      while next_node.lines == nil do
+        stack[#stack + 1] = next_node.right
+        next_node = next_node.left
+      end
+      leaf_lines, i, stop = next_node.lines, 0, next_node.n
+    end
+    i = i + 1
+    lnum = lnum + 1
+    return lnum, leaf_lines[i]
+  end
+end
+
+return _M
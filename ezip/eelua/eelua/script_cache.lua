@@ -0,0 +1,116 @@
+local ffi = require "ffi"
+local string = require "string"
+local eelua = require "eelua"
+local base = require "eelua.core.base"
+local path = require "minipath"
+local lfs = require "lfs"
+
+local C = ffi.C
+local str_fmt = string.format
+local loadfile = eelua.loadfile or loadfile
+
+local _M = {
+  -- stat a cached script at most once every N ms, 0 means on every run
+  stat_interval = 0,
+  -- run scripts and console chunks interpreted so the watchdog can stop
+  -- a runaway loop, compiled traces never check hooks. The modules they
+  -- require keep the JIT
+  interruptible = true
+}
+
+local entries = {}
+local stats = {
+  hits = 0,
+  misses = 0,
+  stats = 0
+}
+
+function _M.load(filepath)
+  local key = path.getabsolute(filepath)
+  local entry = entries[key]
+  local now = C.GetTickCount()
+
+  if entry and _M.stat_interval > 0 then
+    local elapsed = now - entry.checked
+    if elapsed >= 0 and elapsed < _M.stat_interval then
+      stats.hits = stats.hits + 1
+      return entry.chunk
+    end
+  end
+
+  stats.stats = stats.stats + 1
+  local attr, errmsg = lfs.attributes(key)
+  if not attr then
+    entries[key] = nil
+    return nil, errmsg
+  end
+
+  if entry and entry.modification == attr.modification and entry.size == attr.size then
+    entry.checked = now
+    stats.hits = stats.hits + 1
+    return entry.chunk
+  end
+
+  stats.misses = stats.misses + 1
+  local chunk, errmsg = loadfile(key)
+  if not chunk then
+    entries[key] = nil
+    return nil, errmsg
+  end
+  if _M.interruptible and jit then
+    jit.off(chunk, true)
+  end
+
+  entries[key] = {
+    chunk = chunk,
+    modification = attr.modification,
+    size = attr.size,
+    checked = now
+  }
+  return chunk
+end
+
+function _M.dofile(filepath, ...)
+  local chunk, errmsg = _M.load(filepath)
+  if not chunk then
+    error(errmsg, 2)
+  end
+  return chunk(...)
+end
+
+function _M.invalidate(filepath)
+  if filepath then
+    entries[path.getabsolute(filepath)] = nil
+  else
+    base.clear_tab(entries)
+  end
+end
+
+function _M.get_stats()
+  local count = 0
+  for _ in pairs(entries) do
+    count = count + 1
+  end
+  return {
+    hits = stats.hits,
+    misses = stats.misses,
+    stats = stats.stats,
+    entries = count
+  }
+end
+
+function _M.reset_stats()
+  stats.hits = 0
+  stats.misses = 0
+  stats.stats = 0
+end
+
+function _M.format_stats()
+  local s = _M.get_stats()
+  local total = s.hits + s.misses
+  return str_fmt("script cache: %d hits, %d misses (%.1f%% hit), %d stats, %d entries, stat_interval=%dms",
+                 s.hits, s.misses, total > 0 and s.hits * 100 / total or 0,
+                 s.stats, s.entries, _M.stat_interval)
+end
+
+return _M
@@ -0,0 +1,111 @@
+-- Polling file watcher.
+--
+-- A watcher keeps a snapshot of some directories and reports what changed
+-- since the previous poll. Backends only need to snapshot one directory:
+--
+--   backend.snapshot(dir, recursive) -> { [filepath] = stamp }
+--
+-- where stamp is any value that changes when the file does. The default
+-- "lfs" backend uses the Win32 calls behind lfs; another backend can be
+-- registered with register_backend() (e.g. an in-memory one in tests).
+
+local string = require "string"
+local table = require "table"
+local path = require "minipath"
+
+local str_fmt = string.format
+local tinsert = table.insert
+
+local _M = {}
+
+local backends = {}
+
+backends.lfs = {
+  snapshot = function(dir, recursive)
+    local lfs = require "lfs"
+    local out = {}
+    local function scan(d)
+      for _, name in ipairs(lfs.list_dir(d, "file")) do
+        local filepath = path.join(d, name)
+        local attr = lfs.attributes(filepath)
+        if attr then
+          out[filepath] = str_fmt("%.3f:%d", attr.modification, attr.size)
+        end
+      end
+      if recursive then
+        for _, name in ipairs(lfs.list_dir(d, "directory")) do
+          scan(path.join(d, name))
+        end
+      end
+    end
+    scan(dir)
+    return out
+  end
+}
+
+function _M.register_backend(name, backend)
+  backends[name] = backend
+end
+
+local mt = {
+  __index = function(self, k)
+    return _M[k]
+  end
+}
+
+-- dirs is a list of { dir = ..., recursive = bool, filter = "%.lua$" }
+function _M.new(dirs, backend_name)
+  local backend = backends[backend_name or "lfs"]
+  if not backend then
+    error(str_fmt("unknown watcher backend '%s'", tostring(backend_name)), 2)
+  end
+  local self = {
+    dirs = dirs,
+    backend = backend,
+    files = nil
+  }
+  setmetatable(self, mt)
+  return self
+end
+
+function _M:snapshot()
+  local files = {}
+  for _, d in ipairs(self.dirs) do
+    for filepath, stamp in pairs(self.backend.snapshot(d.dir, d.recursive)) do
+      if not d.filter or filepath:find(d.filter) then
+        files[filepath] = stamp
+      end
+    end
+  end
+  return files
+end
+
+-- Returns a list of { path = ..., kind = "added"|"modified"|"removed" },
+-- the first poll only takes the initial snapshot and reports nothing.
+function _M:poll()
+  local files = self:snapshot()
+  local old = self.files
+  self.files = files
+  local changes = {}
+  if old == nil then
+    return changes
+  end
+
+  for filepath, stamp in pairs(files) do
+    local prev = old[filepath]
+    if prev == nil then
+      tinsert(changes, { path = filepath, kind = "added" })
+    elseif prev ~= stamp then
+      tinsert(changes, { path = filepath, kind = "modified" })
+    end
+  end
+  for filepath in pairs(old) do
+    if files[filepath] == nil then
+      tinsert(changes, { path = filepath, kind = "removed" })
+    end
+  end
+  table.sort(changes, function(a, b) return a.path < b.path end)
+  return changes
+end
+
+return _M
@@ -2,10 +2,53 @@ local package = require "package"
 local string = require "string"
 package.path = package.path .. string.format([[;%s\eelua\?.lua]], package.exedir or ".")
 
+local eelua = require "eelua"
+local clock = eelua.clock
+local startup_record = eelua.startup_record
+
+-- Startup phases nest, a module requires others and a plugin requires
+-- modules, so each is recorded with its self time: the phases recorded
+-- inside it are taken off. inner[d] sums the time of the phases finished
+-- at depth d; one that raises is not recorded and its time stays with the
+-- phase around it.
+local inner = { 0 }
+local depth = 1
+
+local function phase_begin()
+  depth = depth + 1
+  inner[depth] = 0
+  return clock(), depth
+end
+
+local function phase_end(name, t0, d)
+  local elapsed = clock() - t0
+  startup_record(name, elapsed - inner[d])
+  depth = d - 1
+  inner[depth] = inner[depth] + elapsed
+end
+
+-- phases that time themselves, like the ffi.cdef of eelua.core.base,
+-- are children of the phase they run in
+eelua.startup_record = function(name, elapsed_ms)
+  startup_record(name, elapsed_ms)
+  inner[depth] = inner[depth] + elapsed_ms
+end
+
+-- time every module loaded during startup, restored at the end of this file
+local _require = require
+require = function(name)
+  if package.loaded[name] ~= nil then
+    return _require(name)
+  end
+  local t0, d = phase_begin()
+  local mod = _require(name)
+  phase_end("require " .. name, t0, d)
+  return mod
+end
+
 local ffi = require "ffi"
 local table = require "table"
 local io = require "io"
-local eelua = require "eelua"
 require "eelua.core"
 require "eelua.stdext"
 require "eelua.utils"
@@ -17,6 +60,10 @@ local unicode = require "unicode"
 local path = require "minipath"
 local lfs = require "lfs"
 local EventBus = require "eelua.EventBus"
+local script_cache = require "eelua.script_cache"
+local lazy_plugin = require "eelua.lazy_plugin"
+local profiler = require "eelua.profiler"
+local reload = require "eelua.reload"
 
 local C = ffi.C
 local ffi_new = ffi.new
@@ -33,6 +80,7 @@ local tconcat = table.concat
 App = ffi_cast("EE_Context*", eelua._ee_context)
 local event_bus = EventBus.new()
 eelua.event_bus = event_bus
+eelua.script_cache = script_cache
 
 print = function(...)
   local out = {}
@@ -43,18 +91,23 @@ print = function(...)
   App:output_line(tconcat(out, "\t"))
 end
 
+-- deduplicated and rate limited with the errors of the entry points,
+-- see src/errqueue.h
 local function err(fmt, ...)
-  local msg = str_fmt(fmt, ...)
-  eelua.dprint(msg)
-  App:output_line(msg)
+  eelua.error_push(str_fmt(fmt, ...))
 end
 
 local app_path_strbuf = base.get_string_buf()
 C.GetModuleFileNameA(App.hModule, app_path_strbuf, base.get_string_buf_size())
 eelua.app_path = path.getdirectory(path.getabsolute(ffi_str(app_path_strbuf)))
 
+-- Registrations below are undone through reload.track() when the plugin
+-- file that made them is reloaded or removed.
 function eelua.add_event_handler(event, handler)
   event_bus:add_event_handler(event, handler)
+  reload.track(function()
+    event_bus:remove_event_handler(event, handler)
+  end)
 end
 
 function eelua.remove_event_handler(event, handler)
@@ -65,14 +118,35 @@ function eelua.remove_all_event_handlers(event)
   event_bus:remove_all_event_handlers(event)
 end
 
+local function remove_value(t, value)
+  local i = table.indexof(t, value)
+  if i then
+    table.remove(t, i)
+  end
+end
+
 local _plugin_commands = {}
 function eelua.add_plugin_command(opts)
   tinsert(_plugin_commands, opts)
+  reload.track(function()
+    remove_value(_plugin_commands, opts)
+  end)
 end
 
 local _console_commands = {}
 function eelua.add_console_command(opts)
   tinsert(_console_commands, opts)
+  reload.track(function()
+    remove_value(_console_commands, opts)
+  end)
+end
+
+function eelua.add_lazy_plugin(spec)
+  local rv = lazy_plugin.add(spec)
+  reload.track(function()
+    lazy_plugin.remove(spec)
+  end)
+  return rv
 end
 
 local _wm_commands = {}
@@ -82,7 +156,14 @@ function eelua.register_wm_command(cmd_id, opts)
   end
   opts = opts or {}
   opts.cmd_id = cmd_id
-  _wm_commands[tostring(cmd_id)] = opts
+  _wm_commands[cmd_id] = opts
+  eelua.wm_filter_add(cmd_id)
+  reload.track(function()
+    if _wm_commands[cmd_id] == opts then
+      _wm_commands[cmd_id] = nil
+      eelua.wm_filter_remove(cmd_id)
+    end
+  end)
 end
 
 eelua.add_plugin_command {
@@ -110,6 +191,9 @@ eelua.add_console_command {
       err("ERR: cmdline lua: %s", errmsg)
       return
     end
+    if script_cache.interruptible and jit then
+      jit.off(chunk, true)
+    end
     local ok, errmsg = pcall(chunk)
     if not ok then
       err("ERR: cmdline lua: %s", errmsg)
@@ -117,12 +201,230 @@ eelua.add_console_command {
   end
 }
 
+eelua.add_console_command {
+  match = "^lua%-plugins$",
+  desc = "List lazily activated plugins",
+  func = function(name, cmdline)
+    for _, spec in ipairs(lazy_plugin.list()) do
+      print(str_fmt("%-20s %-30s %s", tostring(spec.name), tostring(spec.module),
+                    spec.activated and "active" or "pending"))
+    end
+  end
+}
+
+eelua.add_console_command {
+  match = "^lua%-startup$",
+  desc = "Show where editor startup time went",
+  func = function(name, cmdline)
+    local phases = eelua.startup_profile()
+    local total = 0
+    for _, v in ipairs(phases) do
+      if v.name == "c: EE_PluginInit" then
+        total = v.ms
+      end
+    end
+    table.sort(phases, function(a, b) return a.ms > b.ms end)
+    for _, v in ipairs(phases) do
+      print(str_fmt("%9.3f ms %6.1f%%  %s", v.ms, total > 0 and v.ms * 100 / total or 0, v.name))
+    end
+  end
+}
+
+eelua.add_console_command {
+  match = "^lua%-mem$",
+  desc = "Show memory held by the eelua VM",
+  func = function(name, cmdline)
+    local s = eelua.mem_stats()
+    print(str_fmt("allocator: %s, live: %.1f KB, peak: %.1f KB, slabs: %.1f KB",
+                  s.allocator, s.live_bytes / 1024, (s.peak_bytes or s.live_bytes) / 1024,
+                  (s.slab_bytes or 0) / 1024))
+    if s.large then
+      print(str_fmt("  large: %d allocs, %d live", s.large.allocs, s.large.live))
+    end
+    for _, c in ipairs(s.classes or {}) do
+      print(str_fmt("  %4d B: %d allocs, %d live", c.size, c.allocs, c.live))
+    end
+  end
+}
+
+eelua.add_console_command {
+  match = "^lua%-gc$",
+  desc = "Show idle GC statistics",
+  func = function(name, cmdline)
+    local s = eelua.gc_stats((cmdline or ""):trim() == "reset")
+    print(str_fmt("idle gc: %s, budget %.2f ms, %d slices, %d skipped, %d steps, %d cycles, total %.2f ms, max %.3f ms",
+                  s.enabled and "on" or "off", s.budget_ms, s.slices, s.skipped, s.steps, s.cycles,
+                  s.total_ms, s.max_ms))
+    for _, b in ipairs(s.buckets) do
+      print(str_fmt("  %8s ms: %d", b.le_ms and ("<= " .. b.le_ms) or "more", b.count))
+    end
+    local h = s.hook
+    print(str_fmt("in hooks: %d pauses, total %.2f ms, max %.3f ms, %d over hold",
+                  h.pauses, h.total_ms, h.max_ms, h.over))
+    for _, b in ipairs(h.buckets) do
+      print(str_fmt("  %8s ms: %d", b.le_ms and ("<= " .. b.le_ms) or "more", b.count))
+    end
+  end
+}
+
+eelua.add_console_command {
+  match = "^lua%-hook%-bench$",
+  desc = "Compare FFI callback and native trampoline dispatch cost",
+  func = function(name, cmdline)
+    local n = tonumber(cmdline) or 100000
+    local handler = function(msg, wparam, lparam)
+      return 0
+    end
+
+    local cb = ffi_cast("pfn_OnAppMessage", handler)
+    local ffi_ms = eelua.time_app_message(tonumber(ffi_cast("intptr_t", cb)), n)
+    cb:free()
+
+    local prev = eelua.get_hook(C.EEHOOK_APPMSG)
+    local filter = eelua.wm_filter(false)
+    eelua.set_hook(C.EEHOOK_APPMSG, handler)
+    local addr = eelua.hook_address(C.EEHOOK_APPMSG)
+    local native_ms = eelua.time_app_message(addr, n)
+    eelua.wm_filter(true)
+    local filtered_ms = eelua.time_app_message(addr, n, C.WM_COMMAND, 0)
+    eelua.wm_filter(filter)
+    eelua.set_hook(C.EEHOOK_APPMSG, prev)
+
+    print(str_fmt("%d dispatches: ffi callback %.1f ns/call, native trampoline %.1f ns/call, "
+                  .. "filtered out %.1f ns/call",
+                  n, ffi_ms * 1e6 / n, native_ms * 1e6 / n, filtered_ms * 1e6 / n))
+  end
+}
+
+eelua.add_console_command {
+  match = "^lua%-errors$",
+  desc = "Show error report statistics, reset them or flush pending errors",
+  func = function(name, cmdline)
+    cmdline = (cmdline or ""):trim()
+    if cmdline == "flush" then
+      eelua.error_flush()
+    end
+    local s = eelua.error_stats(cmdline == "reset")
+    print(str_fmt("errors: reported %d, shown %d, pending %d",
+                  s.reported, s.flushed, s.pending))
+    print(str_fmt("suppressed: duplicates %d, rate limited %d, ring overflow %d",
+                  s.duplicates, s.rate_limited, s.overflowed))
+  end
+}
+
+eelua.add_console_command {
+  match = "^lua%-stats$",
+  desc = "Show hook, event and command latency (ms), \"reset\" clears, other args filter",
+  func = function(name, cmdline)
+    cmdline = (cmdline or ""):trim()
+    local stats = eelua.stats(cmdline == "reset")
+    local names = {}
+    for k in pairs(stats) do
+      if cmdline == "" or cmdline == "reset" or k:find(cmdline, 1, true) then
+        tinsert(names, k)
+      end
+    end
+    table.sort(names)
+    print(str_fmt("%-48s %8s %9s %9s %9s %9s", "name", "count", "p50", "p99", "max", "mean"))
+    for _, k in ipairs(names) do
+      local s = stats[k]
+      print(str_fmt("%-48s %8d %9.3f %9.3f %9.3f %9.3f", k, s.count, s.p50, s.p99, s.max, s.mean))
+    end
+  end
+}
+
+eelua.add_console_command {
+  match = "^lua%-watchdog$",
+  desc = "Show watchdog budgets, \"on\"/\"off\" or \"<entry pattern> <ms>\" to change them",
+  func = function(name, cmdline)
+    local args = string.explode((cmdline or ""):trim(), "%s+")
+    local conf
+    if args[1] == "on" or args[1] == "off" then
+      conf = eelua.watchdog(args[1] == "on")
+    elseif args[1] ~= "" and tonumber(args[2]) then
+      conf = eelua.watchdog({ [args[1]] = tonumber(args[2]) })
+    else
+      conf = eelua.watchdog()
+    end
+    print(str_fmt("watchdog: %s, fired %d times", conf.enabled and "on" or "off", conf.fired))
+    for pattern, ms in pairs(conf.rules) do
+      print(str_fmt("  %-24s %s", pattern, ms > 0 and (ms .. " ms") or "unlimited"))
+    end
+  end
+}
+
+eelua.add_console_command {
+  match = "^lua%-profile$",
+  desc = "Sample the Lua VM: start [ms] | stop | reset | top [n] | dump [file]",
+  func = function(name, cmdline)
+    local args = string.explode((cmdline or ""):trim(), "%s+")
+    local action = args[1] or ""
+    if action == "start" then
+      local ok, errmsg = profiler.start(tonumber(args[2]))
+      print(ok and "profiler started" or errmsg)
+    elseif action == "stop" then
+      print(str_fmt("profiler stopped, %d samples", profiler.stop()))
+    elseif action == "reset" then
+      profiler.reset()
+    elseif action == "dump" then
+      local filepath = args[2] or path.join(eelua.app_path, "eelua", "profile.folded")
+      local ok, errmsg = profiler.dump(filepath)
+      print(ok and ("folded stacks written to " .. filepath) or errmsg)
+    else
+      print(profiler.format_summary(tonumber(args[2])))
+    end
+  end
+}
+
+eelua.add_console_command {
+  match = "^lua%-reload$",
+  desc = "Reload a plugin or module file, \"watch [ms]\"/\"unwatch\" to follow changes",
+  func = function(name, cmdline)
+    local args = string.explode((cmdline or ""):trim(), "%s+")
+    if args[1] == "watch" then
+      reload.interval = tonumber(args[2]) or reload.interval
+      eelua.reload_watch(true)
+      print(str_fmt("watching for changes every %d ms", reload.interval))
+    elseif args[1] == "unwatch" then
+      eelua.reload_watch(false)
+    elseif args[1] ~= "" then
+      local filepath = args[1]
+      if not path.isabsolute(filepath) then
+        filepath = path.join(eelua.app_path, "eelua", filepath)
+      end
+      local n = reload.apply({ { path = filepath, kind = "modified" } })
+      print(str_fmt("%s: %d reloaded", filepath, n))
+    else
+      print(str_fmt("watch: %s", reload.is_watching() and "on" or "off"))
+      for owner, n in pairs(reload.owners()) do
+        print(str_fmt("  %-48s %d registrations", owner, n))
+      end
+    end
+  end
+}
+
+eelua.add_console_command {
+  match = "^lua%-cache$",
+  desc = "Show or reset script cache statistics",
+  func = function(name, cmdline)
+    cmdline = (cmdline or ""):trim()
+    if cmdline == "reset" then
+      script_cache.reset_stats()
+    elseif cmdline == "clear" then
+      script_cache.invalidate()
+    end
+    print(script_cache.format_stats())
+  end
+}
+
 ---
 -- load eeluarc.lua
 ---
 local eeluarc_fpath = path.join(eelua.app_path, [[eelua\eeluarc.lua]])
 if lfs.exists_file(eeluarc_fpath) then
-  dofile(eeluarc_fpath)
+  local t0, d = phase_begin()
+  eelua.dofile(eeluarc_fpath)
+  phase_end("eeluarc.lua", t0, d)
 else
   io.writefile(eeluarc_fpath, "-- write your config here\r\n\r\n")
 end
@@ -132,9 +434,19 @@ end
 -- load plugins
 ---
 local plugins_dir = path.join(eelua.app_path, [[eelua\plugins]])
+reload.plugins_dir = plugins_dir
+reload.loadfile = eelua.loadfile
+reload.on_error = function(msg)
+  err("%s", msg)
+end
 for _, v in ipairs(lfs.list_dir(plugins_dir, "file")) do
   if v:endswith(".lua") then
-    dofile(path.join(plugins_dir, v))
+    local t0, d = phase_begin()
+    local ok, errmsg = reload.load_plugin(path.join(plugins_dir, v))
+    if not ok then
+      err("ERR: load plugin %s: %s", v, errmsg)
+    end
+    phase_end("plugin " .. v, t0, d)
   end
 end
 
@@ -142,6 +454,7 @@ end
 ---
 -- init menu
 ---
+local menu_t0, menu_d = phase_begin()
 eelua.main_menu = Menu.new(App.hMainMenu)
 eelua.plugin_menu = Menu.new(App.hPluginMenu)
 local script_menu = Menu.new()
@@ -157,6 +470,7 @@ for _, v in ipairs(lfs.list_dir(scripts_dir, "file")) do
   end
 end
 eelua.plugin_menu:add_subitem("lua scripts", script_menu)
+phase_end("menu", menu_t0, menu_d)
 
 
 ---
@@ -172,7 +486,7 @@ OnDoFile = function(ctx, rect, wtext)
   end
 
   local filepath = path.join(eelua.app_path, params[1])
-  local ok, chunk = pcall(dofile, filepath)
+  local ok, chunk = pcall(script_cache.dofile, filepath)
   if not ok then
     err("ERR: OnDoFile: %s", chunk)
     return
@@ -184,8 +498,7 @@ OnDoFile = function(ctx, rect, wtext)
   end
 end
 
-OnRunningCommand = ffi_cast("pfn_OnRunningCommand", function(wcommand, wlen)
-  local command = unicode.w2a(wcommand, tonumber(wlen))
+OnRunningCommand = function(command)
   local name, cmdline = command
   local space_idx = command:find(" ", 1, true)
   if space_idx then
@@ -195,7 +508,7 @@ OnRunningCommand = ffi_cast("pfn_OnRunningCommand", function(wcommand, wlen)
 
   for i, cmd in ipairs(_console_commands) do
     if name:match(cmd.match) then
-      local ok, errmsg = pcall(cmd.func, name, cmdline)
+      local ok, errmsg = eelua.call_entry("console:" .. name, cmd.func, name, cmdline)
       if not ok then
         err("ERR: RunningCommand: %s", errmsg)
       end
@@ -203,22 +516,17 @@ OnRunningCommand = ffi_cast("pfn_OnRunningCommand", function(wcommand, wlen)
     end
   end
   return 0
-end)
+end
 
-OnAppMessage = ffi_cast("pfn_OnAppMessage", function(msg, wparam, lparam)
+OnAppMessage = function(msg, wparam, lparam, cmd_id)
   if msg == C.WM_COMMAND then
-    local cmd_id = tonumber(wparam)
-    if cmd_id >= 65536 + 40000 then
-      cmd_id = cmd_id - 65536
-    end
-
-    local cmd_info = _wm_commands[tostring(cmd_id)]
+    local cmd_info = _wm_commands[cmd_id]
     if cmd_info then
       local cmd_type = cmd_info.type or "default"
       if cmd_type == "script" then
         local script_path = cmd_info.script_path
         if script_path then
-          local ok, errmsg = pcall(dofile, script_path)
+          local ok, errmsg = eelua.call_entry("script:menu", script_cache.dofile, script_path)
           if not ok then
             err("ERR: RunMenuScript: %s", errmsg)
           end
@@ -226,7 +534,7 @@ OnAppMessage = ffi_cast("pfn_OnAppMessage", function(msg, wparam, lparam)
       elseif cmd_type == "default" then
         local handler = cmd_info.func
         if handler then
-          local ok, errmsg = pcall(handler)
+          local ok, errmsg = eelua.call_entry("wm:" .. cmd_id, handler)
           if not ok then
             err("ERR: RunCmdHandler: %s", errmsg)
           end
@@ -237,25 +545,24 @@ OnAppMessage = ffi_cast("pfn_OnAppMessage", function(msg, wparam, lparam)
   end
 
   return 0
-end)
+end
 
-OnPreExecuteScript = ffi_cast("pfn_OnPreExecuteScript", function(wpathname)
-  local pathname = unicode.w2a(wpathname, C.lstrlenW(wpathname))
+OnPreExecuteScript = function(pathname)
   if pathname:endswith(".lua") then
-    local ok, errmsg = pcall(dofile, pathname)
+    local ok, errmsg = eelua.call_entry("script:execute", script_cache.dofile, pathname)
     if not ok then
       err("ERR: OnPreExecuteScript: %s", errmsg)
     end
     return C.EEHOOK_RET_DONTROUTE
   end
   return 0
-end)
+end
 
-OnListPluginCommand = ffi_cast("pfn_OnListPluginCommand", function(hwnd)
+OnListPluginCommand = function(hwnd)
   local row = tonumber(base.send_message(hwnd, C.LVM_GETITEMCOUNT))
 
   for i, cmd in ipairs(_plugin_commands) do
-    local p_item = ffi_new("LVITEMA[0]")
+    local p_item = ffi_new("LVITEMA[1]")
     local cur_row = row + i - 1
 
     p_item[0].mask = C.LVIF_TEXT
@@ -282,13 +589,12 @@ OnListPluginCommand = ffi_cast("pfn_OnListPluginCommand", function(hwnd)
   end
 
   return 0
-end)
+end
 
-OnExecutePluginCommand = ffi_cast("pfn_OnExecutePluginCommand", function(wcommand)
-  local command = unicode.w2a(wcommand, C.lstrlenW(wcommand))
+OnExecutePluginCommand = function(command)
   for i, cmd in ipairs(_plugin_commands) do
     if cmd.name == command then
-      local ok, errmsg = pcall(cmd.func)
+      local ok, errmsg = eelua.call_entry("plugin:" .. command, cmd.func)
       if not ok then
         err("ERR: ExecutePluginCommand: %s", errmsg)
       end
@@ -296,26 +602,67 @@ OnExecutePluginCommand = ffi_cast("pfn_OnExecutePluginCommand", function(wcomman
     end
   end
   return 0
-end)
+end
 
-local OnPrePopupTextMenu = ffi_cast("pfn_OnPrePopupTextMenu", function(doc_hwnd, hmenu, x, y)
+local OnPrePopupTextMenu = function(doc_hwnd, hmenu, x, y)
   local doc = EE_Document.new(doc_hwnd)
   local menu = Menu.new(hmenu)
   event_bus:run_event_handlers("OnPrePopupTextMenu", {
     doc, menu, x, y
   }, true)
   return 0
-end)
+end
 
-if #_console_commands > 0 then
-  App:set_hook(C.EEHOOK_RUNCOMMAND, OnRunningCommand)
+-- only hooks that are not routed yet, so this runs again after a reload
+-- added the first command or handler of a kind
+local function set_hook(name, hook_id, func)
+  if eelua.get_hook(hook_id) == func then
+    return
+  end
+  local t0 = clock()
+  eelua.set_hook(hook_id, func)
+  startup_record("set_hook " .. name, clock() - t0)
+end
+
+local function install_hooks()
+  if #_console_commands > 0 then
+    set_hook("RUNCOMMAND", C.EEHOOK_RUNCOMMAND, OnRunningCommand)
+  end
+  set_hook("APPMSG", C.EEHOOK_APPMSG, OnAppMessage)
+  set_hook("PREEXECUTESCRIPT", C.EEHOOK_PREEXECUTESCRIPT, OnPreExecuteScript)
+  if #_plugin_commands > 0 then
+    set_hook("LISTPLUGINCOMMAND", C.EEHOOK_LISTPLUGINCOMMAND, OnListPluginCommand)
+    set_hook("EXECUTEPLUGINCOMMAND", C.EEHOOK_EXECUTEPLUGINCOMMAND, OnExecutePluginCommand)
+  end
+  if event_bus:get_handle_count("OnPrePopupTextMenu") > 0 then
+    set_hook("PRETEXTMENU", C.EEHOOK_PRETEXTMENU, OnPrePopupTextMenu)
+  end
 end
-App:set_hook(C.EEHOOK_APPMSG, OnAppMessage)
-App:set_hook(C.EEHOOK_PREEXECUTESCRIPT, OnPreExecuteScript)
-if #_plugin_commands > 0 then
-  App:set_hook(C.EEHOOK_LISTPLUGINCOMMAND, OnListPluginCommand)
-  App:set_hook(C.EEHOOK_EXECUTEPLUGINCOMMAND, OnExecutePluginCommand)
+
+install_hooks()
+reload.on_reloaded = install_hooks
+
+local function OnAppIdle(hwnd, frame)
+  reload.poll(clock())
+  return 0
 end
-if event_bus:get_handle_count("OnPrePopupTextMenu") > 0 then
-  App:set_hook(C.EEHOOK_PRETEXTMENU, OnPrePopupTextMenu)
+
+-- eelua.reload_watch(true) reloads plugins and modules as they change on
+-- disk, polled from the idle hook every reload.interval ms
+function eelua.reload_watch(enable)
+  if enable then
+    local eelua_dir = path.join(eelua.app_path, "eelua")
+    reload.watch({
+      { dir = plugins_dir, filter = "%.lua$" },
+      { dir = path.join(eelua_dir, "eelua"), recursive = true, filter = "%.lua$" },
+      { dir = path.join(eelua_dir, "autoload"), recursive = true, filter = "%.lua$" },
+    })
+    eelua.set_hook(C.EEHOOK_IDLE, OnAppIdle)
+  else
+    reload.watch(nil)
+    eelua.set_hook(C.EEHOOK_IDLE, nil)
+  end
 end
+
+require = _require
+eelua.startup_record = startup_record
@@ -62,6 +62,21 @@ typedef struct _WIN32_FIND_DATAA {
   WORD  wFinderFlags;
 } WIN32_FIND_DATAA;
 
+typedef struct _WIN32_FILE_ATTRIBUTE_DATA {
+  DWORD dwFileAttributes;
+  FILETIME ftCreationTime;
+  FILETIME ftLastAccessTime;
+  FILETIME ftLastWriteTime;
+  DWORD nFileSizeHigh;
+  DWORD nFileSizeLow;
+} WIN32_FILE_ATTRIBUTE_DATA;
+
+WINBOOL GetFileAttributesExA(
+  const char* lpFileName,
+  int fInfoLevelId,
+  WIN32_FILE_ATTRIBUTE_DATA* lpFileInformation
+);
+
 HANDLE FindFirstFileA(const char* lpFileName, WIN32_FIND_DATAA* lpFindFileData);
 WINBOOL FindNextFileA (HANDLE hFindFile, WIN32_FIND_DATAA* lpFindFileData);
 WINBOOL FindClose (HANDLE hFindFile);
@@ -74,6 +89,13 @@ local _M = {}
 local WIN_FALSE = 0
 local PATH_MAX = 4096
 local INVALID_HANDLE_VALUE = ffi_cast("HANDLE", -1)
+local GET_FILEEX_INFO_STANDARD = 0
+local EPOCH_DIFF_SECS = 11644473600  -- 1601-01-01 to 1970-01-01
+local p_fad = ffi_new("WIN32_FILE_ATTRIBUTE_DATA[1]")
+
+local function filetime2secs(ft)
+  return (ft.dwHighDateTime * 4294967296 + ft.dwLowDateTime) / 1e7 - EPOCH_DIFF_SECS
+end
 
 function _M.exists_file(filepath)
   local rv = C.GetFileAttributesA(filepath)
@@ -152,6 +174,25 @@ function _M.attributes(filepath, aname)
     end
     return mode
   end
+
+  if C.GetFileAttributesExA(filepath, GET_FILEEX_INFO_STANDARD, p_fad) == WIN_FALSE then
+    return nil, str_fmt("cannot obtain information from file '%s'", filepath)
+  end
+
+  local fad = p_fad[0]
+  if aname == "modification" then
+    return filetime2secs(fad.ftLastWriteTime)
+  elseif aname == "size" then
+    return fad.nFileSizeHigh * 4294967296 + fad.nFileSizeLow
+  elseif aname == nil then
+    return {
+      mode = bit.band(fad.dwFileAttributes, C.FILE_ATTRIBUTE_DIRECTORY) ~= 0 and "directory" or "file",
+      size = fad.nFileSizeHigh * 4294967296 + fad.nFileSizeLow,
+      modification = filetime2secs(fad.ftLastWriteTime),
+      access = filetime2secs(fad.ftLastAccessTime),
+      change = filetime2secs(fad.ftCreationTime)
+    }
+  end
 end
 
 function _M.list_dir(pathname, filter, rec)
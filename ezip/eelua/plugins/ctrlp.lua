@@ -4,27 +4,14 @@ ctrlp_working_path_mode = ctrlp_working_path_mode or "ra"
 -- ctrlp_regexp
 -- ctrlp_open_single_match
 
-eelua.add_plugin_command {
-  name = "pl_ctrlp",
-  desc = "CtrlP",
-  func = function()
-    local mod_files = require("autoload.ctrlp.files")
-    mod_files.run()
-  end
-}
-
-eelua.add_console_command {
-  match = "^CtrlP$",
-  func = function(cmd_name, cmdline)
-    local mod_files = require("autoload.ctrlp.files")
-    mod_files.run()
-  end
-}
-
-eelua.add_console_command {
-  match = "^CtrlPRg$",
-  func = function(cmd_name, cmdline)
-    local mod = require("autoload.ctrlp.rg")
-    mod.run()
-  end
+eelua.add_lazy_plugin {
+  name = "ctrlp",
+  module = "autoload.ctrlp.files",
+  plugin_commands = {
+    { name = "pl_ctrlp", desc = "CtrlP", func = "run" },
+  },
+  console_commands = {
+    { match = "^CtrlP$", func = "run" },
+    { match = "^CtrlPRg$", module = "autoload.ctrlp.rg", func = "run" },
+  },
 }
@@ -24,68 +24,398 @@ int lstrlenW(
 );
 ]]
 
+local ffi_new = ffi.new
+local ffi_cast = ffi.cast
+local ffi_str = ffi.string
+
 local CP_UTF8 = 65001
 local CP_ACP = 0
 
+-- The transcoder of eelua.dll (src/transcode.c) converts in one pass with
+-- an ASCII fast path. Without it (e.g. a plain LuaJIT) the Win32 API is
+-- called twice, to size and to convert.
+local native
+do
+  local ok, eelua = pcall(require, "eelua")
+  if ok and type(eelua) == "table" and eelua.transcode_address then
+    native = {
+      to_wide = ffi_cast("int (*)(unsigned int, const char*, int, wchar_t*, int)",
+                         eelua.transcode_address("to_wide")),
+      to_narrow = ffi_cast("int (*)(unsigned int, const wchar_t*, int, char*, int)",
+                           eelua.transcode_address("to_narrow")),
+      narrow_bound = ffi_cast("int (*)(unsigned int, int)",
+                              eelua.transcode_address("narrow_bound")),
+      ascii_prefix = ffi_cast("int (*)(const char*, int)",
+                              eelua.transcode_address("ascii_prefix")),
+      narrow_cut = ffi_cast("int (*)(unsigned int, const char*, int)",
+                            eelua.transcode_address("narrow_cut")),
+    }
+  end
+end
+
+-- Scratch buffers shared by all conversions, grown on demand in the manner
+-- of base.get_string_buf. Buffers above max_retained units are allocated
+-- per call and left to the GC instead of being kept.
+local M = { max_retained = 1024 * 1024 }
+local MIN_BUF = 1024
+local wbuf, wbuf_size = nil, 0
+local cbuf, cbuf_size = nil, 0
+
+local function get_wide_buf(n)
+  if n > wbuf_size then
+    if n > M.max_retained then
+      return ffi_new("wchar_t[?]", n)
+    end
+    wbuf_size = math.max(n, wbuf_size * 2, MIN_BUF)
+    wbuf = ffi_new("wchar_t[?]", wbuf_size)
+  end
+  return wbuf
+end
+
+local function get_char_buf(n)
+  if n > cbuf_size then
+    if n > M.max_retained then
+      return ffi_new("char[?]", n)
+    end
+    cbuf_size = math.max(n, cbuf_size * 2, MIN_BUF)
+    cbuf = ffi_new("char[?]", cbuf_size)
+  end
+  return cbuf
+end
+
+-- converts len bytes of input (all by default) into wstr (cap units),
+-- returns the length or nil and the capacity needed
+local to_wide_into, to_narrow_tmp
+local wide_bound, narrow_cut
+
+if native then
+  to_wide_into = function(cp, input, wstr, cap, len)
+    len = len or #input
+    if cap < len + 1 then
+      local need = native.to_wide(cp, input, len, nil, 0) + 1
+      if cap < need then
+        return nil, need
+      end
+    end
+    local wlen = native.to_wide(cp, input, len, wstr, cap - 1)
+    wstr[wlen] = 0
+    return wlen
+  end
+
+  wide_bound = function(cp, input, len)
+    return (len or #input) + 1
+  end
+
+  narrow_cut = function(cp, input, len)
+    return native.narrow_cut(cp, input, len)
+  end
+
+  to_narrow_tmp = function(cp, wstr, wlen)
+    if wlen <= 0 then
+      return get_char_buf(1), 0
+    end
+    local cap = native.narrow_bound(cp, wlen)
+    local str = get_char_buf(cap)
+    return str, native.to_narrow(cp, wstr, wlen, str, cap)
+  end
+else
+  local C = ffi.C
+
+  ffi.cdef[[
+  int IsDBCSLeadByteEx(unsigned int CodePage, unsigned char TestChar);
+  ]]
+
+  to_wide_into = function(cp, input, wstr, cap, len)
+    len = len or #input
+    local wlen = C.MultiByteToWideChar(cp, 0, input, len, nil, 0)
+    if cap < wlen + 1 then
+      return nil, wlen + 1
+    end
+    C.MultiByteToWideChar(cp, 0, input, len, wstr, wlen)
+    wstr[wlen] = 0
+    return wlen
+  end
+
+  wide_bound = function(cp, input, len)
+    return C.MultiByteToWideChar(cp, 0, input, len or #input, nil, 0) + 1
+  end
+
+  -- see tc_narrow_cut in src/transcode.c
+  narrow_cut = function(cp, input, len)
+    local s = ffi_cast("const uint8_t*", input)
+    if len <= 0 then
+      return 0
+    end
+    if cp == CP_UTF8 then
+      local i = len - 1
+      while i > 0 and len - i < 4 and s[i] >= 0x80 and s[i] < 0xC0 do
+        i = i - 1
+      end
+      local need = s[i] >= 0xF0 and 4 or s[i] >= 0xE0 and 3 or s[i] >= 0xC0 and 2 or 1
+      return len - i < need and i or len
+    end
+    local i = 0
+    while i < len do
+      local n = C.IsDBCSLeadByteEx(cp, s[i]) ~= 0 and 2 or 1
+      if i + n > len then
+        return i
+      end
+      i = i + n
+    end
+    return len
+  end
+
+  to_narrow_tmp = function(cp, wstr, wlen)
+    if wlen <= 0 then
+      return get_char_buf(1), 0
+    end
+    local len = C.WideCharToMultiByte(cp, 0, wstr, wlen, nil, 0, nil, nil)
+    local str = get_char_buf(len)
+    C.WideCharToMultiByte(cp, 0, wstr, wlen, str, len, nil, nil)
+    return str, len
+  end
+end
+
+local function to_narrow(cp, wstr, wlen)
+  if wlen <= 0 then
+    return ""
+  end
+  return ffi_str(to_narrow_tmp(cp, wstr, wlen))
+end
+
+-- a wide copy owned by the caller
+local function to_wide(cp, input)
+  local cap = wide_bound(cp, input)
+  local wstr = ffi_new("wchar_t[?]", cap)
+  return wstr, to_wide_into(cp, input, wstr, cap)
+end
+
+-- a wide form in the scratch buffer, valid until the next conversion
+local function to_wide_tmp(cp, input, len)
+  local cap = wide_bound(cp, input, len)
+  local wstr = get_wide_buf(cap)
+  return wstr, to_wide_into(cp, input, wstr, cap, len)
+end
+
+-- ASCII text reads the same in every supported code page
+local function is_ascii(input)
+  return native ~= nil and native.ascii_prefix(input, #input) == #input
+end
+
 -- UTF-8 to UTF-16
 local function u2w(input)
-  local wlen = ffi.C.MultiByteToWideChar(CP_UTF8, 0, input, #input, nil, 0)
-  local wstr = ffi.new("wchar_t[?]", wlen + 1)
-  ffi.C.MultiByteToWideChar(CP_UTF8, 0, input, #input, wstr, wlen)
-  return wstr, wlen
+  return to_wide(CP_UTF8, input)
 end
 
 local function a2w(input)
-  local wlen = ffi.C.MultiByteToWideChar(CP_ACP, 0, input, #input, nil, 0)
-  local wstr = ffi.new("wchar_t[?]", wlen + 1)
-  ffi.C.MultiByteToWideChar(CP_ACP, 0, input, #input, wstr, wlen)
-  return wstr, wlen
+  return to_wide(CP_ACP, input)
 end
 
 local function w2u(wstr, wlen)
-  local len = ffi.C.WideCharToMultiByte(CP_UTF8, 0, wstr, wlen, nil, 0, nil, nil)
-  local str = ffi.new("char[?]", len + 1)
-  ffi.C.WideCharToMultiByte(CP_UTF8, 0, wstr, wlen, str, len, nil, nil)
-  return ffi.string(str)
+  return to_narrow(CP_UTF8, wstr, wlen)
 end
 
 local function w2a(wstr, wlen)
-  local len = ffi.C.WideCharToMultiByte(CP_ACP, 0, wstr, wlen, nil, 0, nil, nil)
-  local str = ffi.new("char[?]", len + 1)
-  ffi.C.WideCharToMultiByte(CP_ACP, 0, wstr, wlen, str, len, nil, nil)
-  return ffi.string(str)
+  return to_narrow(CP_ACP, wstr, wlen)
 end
 
 -- UTF-8 to ANSI
 local function A(input)
-  local wlen = ffi.C.MultiByteToWideChar(CP_UTF8, 0, input, #input, nil, 0)
-  local wstr = ffi.new("wchar_t[?]", wlen + 1)
-  ffi.C.MultiByteToWideChar(CP_UTF8, 0, input, #input, wstr, wlen)
-
-  local len = ffi.C.WideCharToMultiByte(CP_ACP, 0, wstr, wlen, nil, 0, nil, nil)
-  local str = ffi.new("char[?]", len + 1)
-  ffi.C.WideCharToMultiByte(CP_ACP, 0, wstr, wlen, str, len, nil, nil)
-
-  return ffi.string(str)
+  if is_ascii(input) then
+    return input
+  end
+  local wstr, wlen = to_wide_tmp(CP_UTF8, input)
+  return w2a(wstr, wlen)
 end
 
 local function Pass(input)
   return input
 end
 
-return {
-  L = u2w,
-  A = A,
-  Pass = Pass,
-
-  u2w = u2w,
-  a2w = a2w,
-  w2u = w2u,
-  w2a = w2a,
-  u2a = function (input)
-    return w2a(u2w(input))
-  end,
-  a2u = function (input)
-    return w2u(a2w(input))
-  end,
-}
+-- Wide forms of constant strings (comment markers, command names, ...),
+-- converted once and kept for the life of the VM. Not for arbitrary text.
+local interned_w, interned_len = {}, {}
+
+local function W(input)
+  local wstr = interned_w[input]
+  if wstr == nil then
+    local wlen
+    wstr, wlen = a2w(input)
+    interned_w[input] = wstr
+    interned_len[input] = wlen
+  end
+  return wstr, interned_len[input]
+end
+
+M.L = u2w
+M.A = A
+M.Pass = Pass
+M.W = W
+
+M.u2w = u2w
+M.a2w = a2w
+M.w2u = w2u
+M.w2a = w2a
+M.u2a = A
+M.a2u = function (input)
+  if is_ascii(input) then
+    return input
+  end
+  local wstr, wlen = to_wide_tmp(CP_ACP, input)
+  return w2u(wstr, wlen)
+end
+
+-- Like a2w/u2w but into the shared scratch buffer: no allocation, and the
+-- result is only valid until the next conversion. For text handed to a
+-- SendMessage call and not kept.
+function M.a2w_tmp(input)
+  return to_wide_tmp(CP_ACP, input)
+end
+
+function M.u2w_tmp(input)
+  return to_wide_tmp(CP_UTF8, input)
+end
+
+-- The narrow form as a char* and length in the narrow scratch buffer,
+-- for callers that only look at it or cut it up themselves.
+function M.w2a_tmp(wstr, wlen)
+  return to_narrow_tmp(CP_ACP, wstr, wlen)
+end
+
+-- Converts into a caller buffer of cap wchar_t (NUL included), returns the
+-- length, or nil and the capacity needed when it does not fit.
+function M.a2w_into(input, wstr, cap)
+  return to_wide_into(CP_ACP, input, wstr, cap)
+end
+
+function M.u2w_into(input, wstr, cap)
+  return to_wide_into(CP_UTF8, input, wstr, cap)
+end
+
+-- Scratch buffer of at least n wchar_t, shared with the conversions above.
+M.get_wide_buf = get_wide_buf
+
+local function is_high_surrogate(c)
+  return c >= 0xD800 and c <= 0xDBFF
+end
+
+-- Streaming conversion, for text too large to convert in one piece or
+-- arriving in pieces. A character cut by the end of one piece (a high
+-- surrogate, a DBCS lead byte, a partial UTF-8 sequence) is held back and
+-- completed by the next; finish() flushes what is left.
+
+local encoder_mt = {}
+encoder_mt.__index = encoder_mt
+
+-- wide to narrow, cp defaults to the ANSI code page
+function M.encoder(cp)
+  return setmetatable({ cp = cp or CP_ACP, pair = ffi_new("wchar_t[2]"), held = false }, encoder_mt)
+end
+
+function encoder_mt:write(wstr, wlen)
+  if wlen <= 0 then
+    return ""
+  end
+  local head = ""
+  local start = 0
+  if self.held then
+    self.held = false
+    local pair = self.pair
+    if wstr[0] >= 0xDC00 and wstr[0] <= 0xDFFF then
+      pair[1] = wstr[0]
+      head = to_narrow(self.cp, pair, 2)
+      start = 1
+    else
+      head = to_narrow(self.cp, pair, 1)
+    end
+  end
+  if wlen > start and is_high_surrogate(wstr[wlen - 1]) then
+    self.held = true
+    self.pair[0] = wstr[wlen - 1]
+    wlen = wlen - 1
+  end
+  if start >= wlen then
+    return head
+  end
+  local body = to_narrow(self.cp, wstr + start, wlen - start)
+  return head == "" and body or head .. body
+end
+
+function encoder_mt:finish()
+  if not self.held then
+    return ""
+  end
+  self.held = false
+  return to_narrow(self.cp, self.pair, 1)
+end
+
+local decoder_mt = {}
+decoder_mt.__index = decoder_mt
+
+-- narrow to wide, cp defaults to the ANSI code page; write() and finish()
+-- return the wide text in the scratch buffer, as a2w_tmp does
+function M.decoder(cp)
+  return setmetatable({ cp = cp or CP_ACP, tail = "" }, decoder_mt)
+end
+
+function decoder_mt:write(input)
+  if self.tail ~= "" then
+    input = self.tail .. input
+  end
+  local len = #input
+  local n = narrow_cut(self.cp, input, len)
+  self.tail = n < len and input:sub(n + 1) or ""
+  return to_wide_tmp(self.cp, input, n)
+end
+
+function decoder_mt:finish()
+  local tail = self.tail
+  self.tail = ""
+  return to_wide_tmp(self.cp, tail)
+end
+
+-- Iterates over wlen units of wstr as narrow strings of at most chunk
+-- units each, never splitting a surrogate pair.
+function M.narrow_chunks(wstr, wlen, chunk, cp)
+  chunk = math.max(chunk or 65536, 2)
+  cp = cp or CP_ACP
+  local pos = 0
+  return function()
+    if pos >= wlen then
+      return nil
+    end
+    local n = math.min(chunk, wlen - pos)
+    if pos + n < wlen and is_high_surrogate(wstr[pos + n - 1]) then
+      n = n - 1
+    end
+    local str = to_narrow(cp, wstr + pos, n)
+    pos = pos + n
+    return str
+  end
+end
+
+-- Iterates over input in pieces of at most chunk bytes, never splitting a
+-- character, returning each piece in wide form in the scratch buffer.
+function M.wide_chunks(input, chunk, cp)
+  chunk = math.max(chunk or 65536, 4)
+  cp = cp or CP_ACP
+  local len = #input
+  local pos = 0
+  return function()
+    if pos >= len then
+      return nil
+    end
+    local ptr = ffi_cast("const char*", input) + pos
+    local n = math.min(chunk, len - pos)
+    if pos + n < len then
+      n = narrow_cut(cp, ptr, n)
+      if n == 0 then
+        n = math.min(chunk, len - pos)
+      end
+    end
+    pos = pos + n
+    return to_wide_tmp(cp, ptr, n)
+  end
+end
+
+return M
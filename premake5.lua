@@ -20,3 +20,53 @@ workspace "sln-eelua"
 
     configuration { "gmake" }
       linkoptions { "-Wall -static-libgcc" }
+
+    configuration {}
+
+  -- headless host for replaying traces against the plugin, see sim/
+  if not os.istarget("windows") then
+    project "eesim"
+      kind "ConsoleApp"
+      language "C"
+      files { "src/*.c", "sim/*.c" }
+
+      includedirs { "sim/include", "include" }
+      buildoptions { "-std=gnu11" }
+      links { "luajit-5.1", "dl", "m", "pthread" }
+      linkoptions { "-rdynamic" }
+
+      configuration "Debug"
+        defines { "DEBUG" }
+        symbols "On"
+
+      configuration "Release"
+        defines { "NDEBUG" }
+        optimize "On"
+
+      configuration {}
+  end
+
+  -- unit tests of the C core on the simulator's Windows shim, see tests/
+  if not os.istarget("windows") then
+    project "eelua_tests"
+      kind "ConsoleApp"
+      language "C"
+      files { "src/*.c", "sim/winshim.c", "sim/host.c", "sim/doc.c", "tests/*.c" }
+      -- compiled into tests/test_mempool.c with malloc redirected
+      removefiles { "src/mempool.c" }
+
+      includedirs { "sim/include", "include", "src", "sim" }
+      buildoptions { "-std=gnu11" }
+      links { "luajit-5.1", "dl", "m", "pthread" }
+      linkoptions { "-rdynamic" }
+
+      configuration "Debug"
+        defines { "DEBUG" }
+        symbols "On"
+
+      configuration "Release"
+        defines { "NDEBUG" }
+        optimize "On"
+
+      configuration {}
+  end
@@ -0,0 +1,659 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#include "doc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SIM_SCREEN_LINES    50
+#define SIM_TAB_WIDTH       4
+
+static wchar_t s_empty[1] = { 0 };
+
+// over all documents, for the trace report
+static struct {
+    double edits;
+    double redraws;
+    double undo_steps;
+} s_totals;
+
+// where repaints leave their layout, so the work is not optimized away
+static volatile int s_layout;
+
+
+static int
+line_reserve(sim_line *line, int len)
+{
+    if (len + 1 <= line->cap) {
+        return 1;
+    }
+    int cap = line->cap ? line->cap : 16;
+    while (cap < len + 1) {
+        cap *= 2;
+    }
+    wchar_t *text = (wchar_t *) realloc(line->text, cap * sizeof(wchar_t));
+    if (text == NULL) {
+        return 0;
+    }
+    line->text = text;
+    line->cap = cap;
+    return 1;
+}
+
+
+static void
+line_replace(sim_line *line, int col, int ndel, const wchar_t *text, int len)
+{
+    if (!line_reserve(line, line->len - ndel + len)) {
+        return;
+    }
+    memmove(line->text + col + len, line->text + col + ndel,
+            (line->len - col - ndel) * sizeof(wchar_t));
+    memcpy(line->text + col, text, len * sizeof(wchar_t));
+    line->len += len - ndel;
+    line->text[line->len] = 0;
+}
+
+
+// inserts n empty lines before index at
+static int
+insert_lines(sim_doc *doc, int at, int n)
+{
+    if (doc->nlines + n > doc->cap) {
+        int cap = doc->cap ? doc->cap : 64;
+        while (cap < doc->nlines + n) {
+            cap *= 2;
+        }
+        sim_line *lines = (sim_line *) realloc(doc->lines, cap * sizeof(sim_line));
+        if (lines == NULL) {
+            return 0;
+        }
+        doc->lines = lines;
+        doc->cap = cap;
+    }
+    memmove(doc->lines + at + n, doc->lines + at, (doc->nlines - at) * sizeof(sim_line));
+    memset(doc->lines + at, 0, n * sizeof(sim_line));
+    for (int i = at; i < at + n; i++) {
+        line_reserve(&doc->lines[i], 0);
+        doc->lines[i].text[0] = 0;
+    }
+    doc->nlines += n;
+    return 1;
+}
+
+
+static void
+remove_lines(sim_doc *doc, int at, int n)
+{
+    for (int i = at; i < at + n; i++) {
+        free(doc->lines[i].text);
+    }
+    memmove(doc->lines + at, doc->lines + at + n,
+            (doc->nlines - at - n) * sizeof(sim_line));
+    doc->nlines -= n;
+}
+
+
+static EC_Pos
+clamp_pos(const sim_doc *doc, const EC_Pos *pos)
+{
+    EC_Pos p = *pos;
+    if (p.line < 0) {
+        p.line = 0;
+        p.col = 0;
+    } else if (p.line >= doc->nlines) {
+        p.line = doc->nlines - 1;
+        p.col = doc->lines[p.line].len;
+    }
+    if (p.col < 0) {
+        p.col = 0;
+    } else if (p.col > doc->lines[p.line].len) {
+        p.col = doc->lines[p.line].len;
+    }
+    return p;
+}
+
+
+static int
+pos_less(const EC_Pos *a, const EC_Pos *b)
+{
+    return a->line < b->line || (a->line == b->line && a->col < b->col);
+}
+
+
+sim_doc *
+doc_new(const wchar_t *path)
+{
+    sim_doc *doc = (sim_doc *) calloc(1, sizeof(sim_doc));
+    if (doc == NULL) {
+        return NULL;
+    }
+    doc->eol = EC_EOL_WIN;
+    doc->encoding = CP_UTF8;
+    doc->path = wcsdup(path != NULL ? path : L"");
+    insert_lines(doc, 0, 1);
+    return doc;
+}
+
+
+void
+doc_free(sim_doc *doc)
+{
+    if (doc == NULL) {
+        return;
+    }
+    remove_lines(doc, 0, doc->nlines);
+    free(doc->lines);
+    free(doc->path);
+    GlobalFree(doc->sel_mem);
+    free(doc);
+}
+
+
+static int
+detect_eol(const wchar_t *text, int len)
+{
+    for (int i = 0; i < len; i++) {
+        if (text[i] == L'\r') {
+            return (i + 1 < len && text[i + 1] == L'\n') ? EC_EOL_WIN : EC_EOL_MAC;
+        } else if (text[i] == L'\n') {
+            return EC_EOL_UNIX;
+        }
+    }
+    return EC_EOL_WIN;
+}
+
+
+void
+doc_totals(double *edits, double *redraws, double *undo_steps)
+{
+    *edits = s_totals.edits;
+    *redraws = s_totals.redraws;
+    *undo_steps = s_totals.undo_steps;
+}
+
+
+void
+doc_repaint(sim_doc *doc)
+{
+    int first = doc->caret.line - SIM_SCREEN_LINES / 2;
+    if (first < 0) {
+        first = 0;
+    }
+    int columns = 0;
+    for (int i = first; i < doc->nlines && i < first + SIM_SCREEN_LINES; i++) {
+        const sim_line *line = &doc->lines[i];
+        int col = 0;
+        for (int k = 0; k < line->len; k++) {
+            col = line->text[k] == L'\t' ? (col / SIM_TAB_WIDTH + 1) * SIM_TAB_WIDTH : col + 1;
+        }
+        columns += col;
+    }
+    s_layout = columns;
+    doc->redraws += 1;
+    s_totals.redraws += 1;
+}
+
+
+// an undo step per change outside ECM_GROUPUNDO, a repaint unless redraw
+// is off
+static void
+after_edit(sim_doc *doc)
+{
+    doc->edits += 1;
+    s_totals.edits += 1;
+    if (doc->group_undo == 0) {
+        doc->undo_steps += 1;
+        s_totals.undo_steps += 1;
+    }
+    if (!doc->redraw_off) {
+        doc_repaint(doc);
+    }
+}
+
+
+void
+doc_set_text(sim_doc *doc, const wchar_t *text, int len)
+{
+    sim_doc_changed on_changed = doc->on_changed;
+    EC_Pos start = { 0, 0 };
+
+    doc->on_changed = NULL;
+    remove_lines(doc, 0, doc->nlines);
+    insert_lines(doc, 0, 1);
+    doc_insert(doc, &start, text, len);
+    doc->on_changed = on_changed;
+    doc->eol = detect_eol(text, len);
+    doc->caret = start;
+    doc->has_sel = 0;
+    doc->dirty = 0;
+}
+
+
+int
+doc_load(sim_doc *doc, const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return 0;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *buf = (char *) malloc(size + 1);
+    wchar_t *wbuf = (wchar_t *) malloc((size + 1) * sizeof(wchar_t));
+    if (buf == NULL || wbuf == NULL || fread(buf, 1, size, fp) != (size_t) size) {
+        free(buf);
+        free(wbuf);
+        fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+
+    const char *p = buf;
+    if (size >= 3 && memcmp(buf, "\xEF\xBB\xBF", 3) == 0) {
+        p += 3;
+        size -= 3;
+    }
+    int wlen = MultiByteToWideChar(CP_UTF8, 0, p, (int) size, wbuf, (int) size + 1);
+    doc_set_text(doc, wbuf, wlen);
+    free(buf);
+    free(wbuf);
+    return 1;
+}
+
+
+void
+doc_insert(sim_doc *doc, const EC_Pos *pos, const wchar_t *text, int len)
+{
+    EC_Pos start = clamp_pos(doc, pos);
+    EC_Pos end = start;
+    int seg_start = 0;
+    int first = 1;
+    sim_line *line;
+    wchar_t *tail = NULL;
+    int tail_len = 0;
+
+    // open all the new lines at once, one move of the lines after them
+    int breaks = 0;
+    for (int i = 0; i < len; i++) {
+        if (text[i] == L'\n' || text[i] == L'\r') {
+            breaks++;
+            if (text[i] == L'\r' && i + 1 < len && text[i + 1] == L'\n') {
+                i++;
+            }
+        }
+    }
+    if (breaks > 0 && !insert_lines(doc, start.line + 1, breaks)) {
+        return;
+    }
+
+    for (int i = 0; i <= len; i++) {
+        int is_break = i < len && (text[i] == L'\n' || text[i] == L'\r');
+        if (i < len && !is_break) {
+            continue;
+        }
+        int seg_len = i - seg_start;
+        if (first) {
+            line = &doc->lines[start.line];
+            if (is_break) {
+                // split the line, the tail goes after the last segment
+                tail_len = line->len - start.col;
+                tail = (wchar_t *) malloc((tail_len + 1) * sizeof(wchar_t));
+                if (tail == NULL) {
+                    return;
+                }
+                memcpy(tail, line->text + start.col, tail_len * sizeof(wchar_t));
+                line->len = start.col;
+                line->text[line->len] = 0;
+            }
+            line_replace(line, start.col, 0, text + seg_start, seg_len);
+            end.col = start.col + seg_len;
+            first = 0;
+        } else {
+            end.line++;
+            line = &doc->lines[end.line];
+            line_replace(line, 0, 0, text + seg_start, seg_len);
+            end.col = seg_len;
+        }
+        if (is_break && text[i] == L'\r' && i + 1 < len && text[i + 1] == L'\n') {
+            i++;
+        }
+        seg_start = i + 1;
+    }
+    if (tail != NULL) {
+        line = &doc->lines[end.line];
+        line_replace(line, line->len, 0, tail, tail_len);
+        free(tail);
+    }
+
+    doc->caret = end;
+    doc->has_sel = 0;
+    doc->dirty = 1;
+    after_edit(doc);
+    if (doc->on_changed != NULL) {
+        doc->on_changed(doc, &start, &start, &end);
+    }
+}
+
+
+void
+doc_delete(sim_doc *doc, const EC_Pos *from, const EC_Pos *to)
+{
+    EC_Pos start = clamp_pos(doc, from);
+    EC_Pos end = clamp_pos(doc, to);
+    if (pos_less(&end, &start)) {
+        EC_Pos t = start;
+        start = end;
+        end = t;
+    }
+
+    sim_line *first = &doc->lines[start.line];
+    if (start.line == end.line) {
+        line_replace(first, start.col, end.col - start.col, NULL, 0);
+    } else {
+        sim_line *last = &doc->lines[end.line];
+        line_replace(first, start.col, first->len - start.col,
+                     last->text + end.col, last->len - end.col);
+        remove_lines(doc, start.line + 1, end.line - start.line);
+    }
+
+    doc->caret = start;
+    doc->has_sel = 0;
+    doc->dirty = 1;
+    after_edit(doc);
+    if (doc->on_changed != NULL) {
+        doc->on_changed(doc, &start, &end, &start);
+    }
+}
+
+
+int
+doc_get_text(sim_doc *doc, const EC_Pos *from, const EC_Pos *to, int eol, wchar_t *buf)
+{
+    static const wchar_t *eols[] = { L"\r\n", L"\r\n", L"\n", L"\r" };
+    EC_Pos start = clamp_pos(doc, from);
+    EC_Pos end = clamp_pos(doc, to);
+    if (pos_less(&end, &start)) {
+        EC_Pos t = start;
+        start = end;
+        end = t;
+    }
+    if (eol <= EC_EOL_NULL || eol > EC_EOL_MAC) {
+        eol = doc->eol;
+    }
+    const wchar_t *eol_str = eols[eol];
+    int eol_len = (int) wcslen(eol_str);
+
+    int n = 0;
+    for (int i = start.line; i <= end.line; i++) {
+        const sim_line *line = &doc->lines[i];
+        int b = i == start.line ? start.col : 0;
+        int e = i == end.line ? end.col : line->len;
+        if (buf != NULL) {
+            memcpy(buf + n, line->text + b, (e - b) * sizeof(wchar_t));
+        }
+        n += e - b;
+        if (i < end.line) {
+            if (buf != NULL) {
+                memcpy(buf + n, eol_str, eol_len * sizeof(wchar_t));
+            }
+            n += eol_len;
+        }
+    }
+    if (buf != NULL) {
+        buf[n] = 0;
+    }
+    return n;
+}
+
+
+static void
+move_caret(sim_doc *doc, int offset)
+{
+    EC_Pos p = doc->caret;
+    while (offset > 0) {
+        int room = doc->lines[p.line].len - p.col;
+        if (offset <= room) {
+            p.col += offset;
+            break;
+        }
+        if (p.line + 1 >= doc->nlines) {
+            p.col = doc->lines[p.line].len;
+            break;
+        }
+        offset -= room + 1;
+        p.line++;
+        p.col = 0;
+    }
+    while (offset < 0) {
+        if (-offset <= p.col) {
+            p.col += offset;
+            break;
+        }
+        if (p.line == 0) {
+            p.col = 0;
+            break;
+        }
+        offset += p.col + 1;
+        p.line--;
+        p.col = doc->lines[p.line].len;
+    }
+    doc->caret = p;
+    doc->has_sel = 0;
+}
+
+
+static LRESULT
+doc_command(sim_doc *doc, int cmd)
+{
+    EC_Pos p = doc->caret;
+    EC_Pos q = p;
+
+    switch (cmd) {
+    case ECC_LINEHOME:
+        doc->caret.col = 0;
+        break;
+    case ECC_LINEEND:
+        doc->caret.col = doc->lines[p.line].len;
+        break;
+    case ECC_DOCHOME:
+        doc->caret.line = doc->caret.col = 0;
+        break;
+    case ECC_DOCEND:
+        doc->caret.line = doc->nlines - 1;
+        doc->caret.col = doc->lines[doc->caret.line].len;
+        break;
+    case ECC_SELALL:
+        doc->sel_start.line = doc->sel_start.col = 0;
+        doc->sel_end.line = doc->nlines - 1;
+        doc->sel_end.col = doc->lines[doc->sel_end.line].len;
+        doc->caret = doc->sel_end;
+        doc->has_sel = 1;
+        return 0;
+    case ECC_CLEARSEL:
+        break;
+    case ECC_DELLINE:
+        if (doc->nlines == 1) {
+            q.col = doc->lines[0].len;
+            p.col = 0;
+        } else if (p.line + 1 < doc->nlines) {
+            p.col = 0;
+            q.line = p.line + 1;
+            q.col = 0;
+        } else {
+            p.line--;
+            p.col = doc->lines[p.line].len;
+            q.col = doc->lines[q.line].len;
+        }
+        doc_delete(doc, &p, &q);
+        return 0;
+    case ECC_DELTOLINEHEAD:
+        p.col = 0;
+        doc_delete(doc, &p, &q);
+        return 0;
+    case ECC_DELTOLINETAIL:
+        q.col = doc->lines[p.line].len;
+        doc_delete(doc, &p, &q);
+        return 0;
+    case ECC_NEWLINE:
+        doc_insert(doc, &p, L"\n", 1);
+        return 0;
+    default:
+        return 0;
+    }
+    doc->has_sel = 0;
+    return 0;
+}
+
+
+LRESULT
+doc_message(sim_doc *doc, UINT msg, WPARAM wparam, LPARAM lparam)
+{
+    switch (msg) {
+    case WM_COMMAND:
+        return doc_command(doc, (int) wparam);
+    case WM_SETREDRAW:
+        doc->redraw_off = !wparam;
+        return 0;
+    case ECM_CANUNDO:
+    case ECM_CANREDO:
+        return 0;
+    case ECM_JUMPTOLINE: {
+        EC_Pos p = { (int) wparam - 1, 0 };
+        doc->caret = clamp_pos(doc, &p);
+        doc->has_sel = 0;
+        return 0;
+    }
+    case ECM_GETLINECNT:
+    case ECM_GETVISUALLINECOUNT:
+        return doc->nlines;
+    case ECM_GETPATH:
+        return (LRESULT) doc->path;
+    case ECM_GETCARETPOS:
+        *(EC_Pos *) wparam = doc->caret;
+        return 0;
+    case ECM_GETCHAR: {
+        EC_Pos p = { (int) wparam, (int) lparam };
+        if (p.line < 0 || p.line >= doc->nlines || p.col < 0
+                || p.col >= doc->lines[p.line].len) {
+            return 0;
+        }
+        return doc->lines[p.line].text[p.col];
+    }
+    case ECM_GETLINETEXT: {
+        int lnum = (int) wparam;
+        if (lnum < 0 || lnum >= doc->nlines) {
+            return 0;
+        }
+        const sim_line *line = &doc->lines[lnum];
+        if (lparam != 0) {
+            memcpy((wchar_t *) lparam, line->text, (line->len + 1) * sizeof(wchar_t));
+        }
+        return line->len;
+    }
+    case ECM_GETLINEBUF: {
+        int lnum = (int) wparam;
+        if (lnum < 0 || lnum >= doc->nlines) {
+            return (LRESULT) s_empty;
+        }
+        return (LRESULT) doc->lines[lnum].text;
+    }
+    case ECM_DELETETEXT:
+        doc_delete(doc, (const EC_Pos *) wparam, (const EC_Pos *) lparam);
+        return 0;
+    case ECM_INSERTTEXT: {
+        const EC_InsertText *ins = (const EC_InsertText *) lparam;
+        const EC_Pos *pos = wparam != 0 ? (const EC_Pos *) wparam : &doc->caret;
+        doc_insert(doc, pos, ins->lpText, ins->len);
+        return 0;
+    }
+    case ECM_INSERTSNIPPET:
+        doc_insert(doc, &doc->caret, (const wchar_t *) wparam, (int) lparam);
+        return 0;
+    case ECM_SETEOLTYPE:
+        if (wparam > EC_EOL_NULL && wparam <= EC_EOL_MAC) {
+            doc->eol = (int) wparam;
+        }
+        return doc->eol;
+    case ECM_ISDOCDIRTY:
+        return doc->dirty;
+    case ECM_CLEARDIRTY:
+        doc->dirty = 0;
+        return 0;
+    case ECM_EDITMODE:
+        if (wparam >= EC_EDITMODE_NORMAL && wparam <= EC_EDITMODE_VIRTUALSPACE) {
+            doc->edit_mode = (int) wparam;
+        }
+        return doc->edit_mode;
+    case ECM_WRAP:
+        if (wparam >= EC_WRAP_NONE && wparam <= EC_WRAP_EXPANDTAB) {
+            doc->wrap_mode = (int) wparam;
+        }
+        return doc->wrap_mode;
+    case ECM_SETSEL:
+        doc->sel_start = clamp_pos(doc, (const EC_Pos *) wparam);
+        doc->sel_end = clamp_pos(doc, (const EC_Pos *) lparam);
+        doc->caret = doc->sel_end;
+        doc->has_sel = doc->sel_start.line != doc->sel_end.line
+                       || doc->sel_start.col != doc->sel_end.col;
+        return 0;
+    case ECM_HASSEL:
+        return doc->has_sel ? EC_SEL_NORMAL : EC_SEL_NONE;
+    case ECM_GETSEL:
+        *(EC_Pos *) wparam = doc->has_sel ? doc->sel_start : doc->caret;
+        *(EC_Pos *) lparam = doc->has_sel ? doc->sel_end : doc->caret;
+        return doc->has_sel;
+    case ECM_GETTEXT: {
+        EC_SelInfo *info = (EC_SelInfo *) wparam;
+        return doc_get_text(doc, &info->spos, &info->epos, info->nEol, info->lpBuffer);
+    }
+    case ECM_GETSELTEXT: {
+        EC_Pos b = doc->has_sel ? doc->sel_start : doc->caret;
+        EC_Pos e = doc->has_sel ? doc->sel_end : doc->caret;
+        int n = doc_get_text(doc, &b, &e, EC_EOL_NULL, NULL);
+        GlobalFree(doc->sel_mem);
+        doc->sel_mem = GlobalAlloc(0, (n + 1) * sizeof(wchar_t));
+        if (doc->sel_mem != NULL) {
+            doc_get_text(doc, &b, &e, EC_EOL_NULL, (wchar_t *) doc->sel_mem);
+        }
+        return (LRESULT) doc->sel_mem;
+    }
+    case ECM_GROUPUNDO:
+        doc->group_undo += wparam ? 1 : -1;
+        if (doc->group_undo == 0) {
+            doc->undo_steps += 1;
+            s_totals.undo_steps += 1;
+        }
+        return 0;
+    case ECM_SETPOS:
+        doc->caret = clamp_pos(doc, (const EC_Pos *) wparam);
+        doc->has_sel = 0;
+        return 0;
+    case ECM_MOVECARET:
+        move_caret(doc, (int) wparam);
+        return 0;
+    case ECM_GETBUFFERENCODING:
+        if (wparam == 1) {
+            doc->encoding = (int) lparam;
+        }
+        return doc->encoding;
+    case ECM_REDRAW:
+        doc_repaint(doc);
+        return 0;
+    case ECM_GETFONTHEIGHT:
+        return 16;
+    case ECM_GETLINEHEIGHT:
+        return 18;
+    case ECM_WRAPCOUNT:
+        return 1;
+    case ECM_GETSCOPE:
+        return (LRESULT) s_empty;
+    default:
+        // ECM_FORCECARETVISIBLE, ECM_BOOKMARKER, ECM_ISLOADING, ...
+        return 0;
+    }
+}
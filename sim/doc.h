@@ -0,0 +1,76 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#ifndef EESIM_DOC_H_
+#define EESIM_DOC_H_
+
+#include <windows.h>
+
+#include "eesdk.h"
+
+// In-memory text document answering the ECM_* messages. Text is kept as an
+// array of NUL-terminated lines without line breaks, the EOL style is a
+// property of the document as in the editor.
+
+typedef struct {
+    wchar_t *text;
+    int len;
+    int cap;
+} sim_line;
+
+typedef struct sim_doc sim_doc;
+
+// called after every change with the changed range, see EEHOOK_UPDATETEXT
+typedef void (*sim_doc_changed)(sim_doc *doc, const EC_Pos *start,
+                                const EC_Pos *old_end, const EC_Pos *new_end);
+
+struct sim_doc {
+    sim_line *lines;
+    int nlines;
+    int cap;
+    EC_Pos caret;
+    EC_Pos sel_start;
+    EC_Pos sel_end;
+    int has_sel;
+    int eol;
+    int encoding;
+    int edit_mode;
+    int wrap_mode;
+    int dirty;
+    int group_undo;
+    int redraw_off;             // WM_SETREDRAW FALSE
+    double redraws;
+    double undo_steps;
+    double edits;
+    wchar_t *path;
+    HGLOBAL sel_mem;
+    sim_doc_changed on_changed;
+    void *user;
+};
+
+sim_doc *doc_new(const wchar_t *path);
+void doc_free(sim_doc *doc);
+
+// replaces the whole text, detects the EOL style, does not mark dirty
+void doc_set_text(sim_doc *doc, const wchar_t *text, int len);
+// loads a UTF-8 file through the path mapping, 0 on failure
+int doc_load(sim_doc *doc, const char *path);
+
+void doc_insert(sim_doc *doc, const EC_Pos *pos, const wchar_t *text, int len);
+void doc_delete(sim_doc *doc, const EC_Pos *start, const EC_Pos *end);
+// lays out the lines on screen around the caret as a repaint would, the
+// editor does this after every change unless redraw is off
+void doc_repaint(sim_doc *doc);
+// edits, repaints and undo steps of all documents so far
+void doc_totals(double *edits, double *redraws, double *undo_steps);
+
+// copies [start, end) with eol line breaks into buf (may be NULL), returns
+// the length without the terminating NUL
+int doc_get_text(sim_doc *doc, const EC_Pos *start, const EC_Pos *end, int eol,
+                 wchar_t *buf);
+
+LRESULT doc_message(sim_doc *doc, UINT msg, WPARAM wparam, LPARAM lparam);
+
+#endif  // EESIM_DOC_H_
@@ -0,0 +1,805 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#include "host.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "winshim.h"
+
+#define SIM_WND_MAGIC       0x444E4957  // "WIND"
+#define SIM_HOOK_CHAIN      16
+#define SIM_MAX_FRAMES      1024
+#define SIM_LIST_COLUMNS    4
+#define SIM_FIRST_COMMAND   40000
+
+#define CMD_NEW_TEXT        57600
+#define CMD_SAVE            57603
+
+typedef struct {
+    unsigned magic;
+    int kind;
+    sim_frame *frame;
+} sim_wnd;
+
+struct sim_frame {
+    sim_wnd frame_wnd;
+    sim_wnd doc_wnd;
+    sim_doc *doc;
+};
+
+typedef struct {
+    char *cells[SIM_LIST_COLUMNS];
+} sim_row;
+
+// a hook fired while the plugin is inside SendMessageA, delivered by
+// host_pump() once the call returned
+typedef struct {
+    int id;
+    sim_frame *frame;
+    LONG_PTR args[4];
+    wchar_t *str;
+    ECNMHDR_TextUpdate update;
+} sim_posted;
+
+static struct {
+    EE_Context ctx;
+    sim_wnd main;
+    sim_wnd output;
+    sim_wnd list;
+    sim_wnd other;
+    sim_doc *output_doc;
+    sim_frame *frames[SIM_MAX_FRAMES];
+    int nframes;
+    int active;
+    void *hooks[SIM_HOOK_LIMIT][SIM_HOOK_CHAIN];
+    int nhooks[SIM_HOOK_LIMIT];
+    HMENU popup;
+    sim_row *rows;
+    int nrows;
+    int rows_cap;
+    sim_posted *posted;
+    int nposted;
+    int posted_cap;
+    int echo;
+    sim_send_observer observer;
+    void *observer_ud;
+} s_host;
+
+
+static sim_wnd *
+to_wnd(HWND hwnd)
+{
+    sim_wnd *w = (sim_wnd *) hwnd;
+    return (w != NULL && w->magic == SIM_WND_MAGIC) ? w : NULL;
+}
+
+
+static void
+init_wnd(sim_wnd *w, int kind, sim_frame *frame)
+{
+    w->magic = SIM_WND_MAGIC;
+    w->kind = kind;
+    w->frame = frame;
+}
+
+
+static char *
+to_utf8(const wchar_t *wstr, int wlen)
+{
+    if (wlen < 0) {
+        wlen = lstrlenW(wstr);
+    }
+    int n = WideCharToMultiByte(CP_UTF8, 0, wstr, wlen, NULL, 0, NULL, NULL);
+    char *s = (char *) malloc(n + 1);
+    if (s != NULL) {
+        WideCharToMultiByte(CP_UTF8, 0, wstr, wlen, s, n, NULL, NULL);
+        s[n] = '\0';
+    }
+    return s;
+}
+
+
+static wchar_t *
+to_wide(const char *str)
+{
+    int n = MultiByteToWideChar(CP_UTF8, 0, str, -1, NULL, 0);
+    wchar_t *w = (wchar_t *) malloc(n * sizeof(wchar_t));
+    if (w != NULL) {
+        MultiByteToWideChar(CP_UTF8, 0, str, -1, w, n);
+    }
+    return w;
+}
+
+
+static int
+frame_index(const sim_frame *frame)
+{
+    for (int i = 0; i < s_host.nframes; i++) {
+        if (s_host.frames[i] == frame) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+static void
+post_hook(int id, sim_frame *frame, LONG_PTR a, LONG_PTR b, const wchar_t *str)
+{
+    if (id < 0 || id >= SIM_HOOK_LIMIT || s_host.nhooks[id] == 0) {
+        return;
+    }
+    if (s_host.nposted == s_host.posted_cap) {
+        int cap = s_host.posted_cap ? s_host.posted_cap * 2 : 16;
+        sim_posted *posted = (sim_posted *) realloc(s_host.posted, cap * sizeof(sim_posted));
+        if (posted == NULL) {
+            return;
+        }
+        s_host.posted = posted;
+        s_host.posted_cap = cap;
+    }
+    sim_posted *p = &s_host.posted[s_host.nposted++];
+    memset(p, 0, sizeof(*p));
+    p->id = id;
+    p->frame = frame;
+    p->args[0] = a;
+    p->args[1] = b;
+    p->str = str != NULL ? wcsdup(str) : NULL;
+}
+
+
+static void
+on_doc_changed(sim_doc *doc, const EC_Pos *start, const EC_Pos *old_end,
+               const EC_Pos *new_end)
+{
+    sim_frame *frame = (sim_frame *) doc->user;
+    int n = s_host.nposted;
+    post_hook(EEHOOK_UPDATETEXT, frame, (LONG_PTR) &frame->frame_wnd, 0, NULL);
+    if (s_host.nposted > n) {
+        ECNMHDR_TextUpdate *u = &s_host.posted[n].update;
+        u->hdr.hwndFrom = (HWND) &frame->doc_wnd;
+        u->hdr.code = ECN_UPDATETEXT;
+        u->spos = *start;
+        u->epos1 = *old_end;
+        u->epos2 = *new_end;
+    }
+}
+
+
+int
+host_init(void)
+{
+    memset(&s_host, 0, sizeof(s_host));
+    init_wnd(&s_host.main, SIM_WND_MAIN, NULL);
+    init_wnd(&s_host.output, SIM_WND_OUTPUT, NULL);
+    init_wnd(&s_host.list, SIM_WND_LIST, NULL);
+    init_wnd(&s_host.other, SIM_WND_OTHER, NULL);
+    s_host.active = -1;
+    s_host.output_doc = doc_new(L"");
+    if (s_host.output_doc == NULL) {
+        return 0;
+    }
+
+    EE_Context *ctx = &s_host.ctx;
+    ctx->hMain = (HWND) &s_host.main;
+    ctx->hToolBar = (HWND) &s_host.other;
+    ctx->hStatusBar = (HWND) &s_host.other;
+    ctx->hClient = (HWND) &s_host.other;
+    ctx->hStartPage = (HWND) &s_host.other;
+    ctx->hMainMenu = CreatePopupMenu();
+    ctx->hPluginMenu = CreatePopupMenu();
+    ctx->pCommand = &ctx->dwCommand;
+    ctx->dwCommand = SIM_FIRST_COMMAND;
+    ctx->dwVersion = 0x0400;
+    ctx->dwBuild = 0;
+    ctx->dwLCID = 0x0409;
+    ctx->hModule = (HMODULE) &s_host.other;
+    return 1;
+}
+
+
+static void
+free_rows(void)
+{
+    for (int i = 0; i < s_host.nrows; i++) {
+        for (int k = 0; k < SIM_LIST_COLUMNS; k++) {
+            free(s_host.rows[i].cells[k]);
+        }
+    }
+    s_host.nrows = 0;
+}
+
+
+void
+host_shutdown(void)
+{
+    while (s_host.nframes > 0) {
+        sim_frame *frame = s_host.frames[--s_host.nframes];
+        doc_free(frame->doc);
+        free(frame);
+    }
+    for (int i = 0; i < s_host.nposted; i++) {
+        free(s_host.posted[i].str);
+    }
+    free(s_host.posted);
+    free_rows();
+    free(s_host.rows);
+    doc_free(s_host.output_doc);
+    winshim_menu_free(s_host.ctx.hMainMenu);
+    winshim_menu_free(s_host.ctx.hPluginMenu);
+    winshim_menu_free(s_host.popup);
+    memset(&s_host, 0, sizeof(s_host));
+}
+
+
+EE_Context *
+host_context(void)
+{
+    return &s_host.ctx;
+}
+
+
+void
+host_set_echo(int echo)
+{
+    s_host.echo = echo;
+}
+
+
+void
+host_set_observer(sim_send_observer observer, void *ud)
+{
+    s_host.observer = observer;
+    s_host.observer_ud = ud;
+}
+
+
+const char *
+host_target_name(int target)
+{
+    switch (target) {
+    case SIM_WND_MAIN: return "main";
+    case SIM_WND_FRAME: return "frame";
+    case SIM_WND_DOC: return "doc";
+    case SIM_WND_OUTPUT: return "output";
+    case SIM_WND_LIST: return "list";
+    default: return "other";
+    }
+}
+
+
+const char *
+host_message_name(int target, UINT msg)
+{
+#define NAME(m)     case m: return #m
+    static char buf[32];
+
+    if (msg == WM_COMMAND) {
+        return "WM_COMMAND";
+    }
+    if (msg == WM_SETREDRAW) {
+        return "WM_SETREDRAW";
+    }
+    if (target == SIM_WND_DOC || target == SIM_WND_OUTPUT) {
+        switch (msg) {
+        NAME(ECM_CANUNDO); NAME(ECM_CANREDO); NAME(ECM_JUMPTOLINE);
+        NAME(ECM_GETLINECNT); NAME(ECM_GETPATH); NAME(ECM_GETCARETPOS);
+        NAME(ECM_GETCHAR); NAME(ECM_GETLINETEXT); NAME(ECM_GETLINEBUF);
+        NAME(ECM_DELETETEXT); NAME(ECM_INSERTTEXT); NAME(ECM_SETEOLTYPE);
+        NAME(ECM_ISDOCDIRTY); NAME(ECM_EDITMODE); NAME(ECM_SETSEL);
+        NAME(ECM_HASSEL); NAME(ECM_GETSEL); NAME(ECM_GETTEXT); NAME(ECM_WRAP);
+        NAME(ECM_GROUPUNDO); NAME(ECM_GETSELTEXT); NAME(ECM_FORCECARETVISIBLE);
+        NAME(ECM_SETPOS); NAME(ECM_GETVISUALLINECOUNT); NAME(ECM_GETFONTHEIGHT);
+        NAME(ECM_GETBUFFERENCODING); NAME(ECM_REDRAW); NAME(ECM_MOVECARET);
+        NAME(ECM_WRAPCOUNT); NAME(ECM_INSERTSNIPPET); NAME(ECM_CLEARDIRTY);
+        NAME(ECM_GETSCOPE); NAME(ECM_BOOKMARKER);
+        }
+    } else if (target == SIM_WND_MAIN) {
+        switch (msg) {
+        NAME(EEM_EXCUTESCRIPT); NAME(EEM_GETACTIVETEXT); NAME(EEM_LOADFILE);
+        NAME(EEM_SETHOOK); NAME(EEM_GETFRAMELIST); NAME(EEM_SETACTIVEVIEW);
+        NAME(EEM_SETHOOKS); NAME(EEM_UPDATEUIELEMENT); NAME(EEM_OUTPUTTEXT);
+        NAME(EEM_GETOUTPUTHWND); NAME(EEM_GETDOCFROMFRAME);
+        NAME(EEM_SETVIEWTYPE); NAME(EEM_GETFRAMEFROMPATH);
+        NAME(EEM_GETFRAMETYPE); NAME(EEM_GETFRAMEPATH);
+        NAME(EEM_GETACTIVEFRAME); NAME(EEM_GETAPPMETRICS);
+        }
+    } else if (target == SIM_WND_LIST) {
+        switch (msg) {
+        NAME(LVM_GETITEMCOUNT); NAME(LVM_INSERTITEMA); NAME(LVM_SETITEMTEXTA);
+        }
+    }
+    snprintf(buf, sizeof(buf), "%u", msg);
+    return buf;
+#undef NAME
+}
+
+
+sim_frame *
+host_new_frame(const char *path)
+{
+    if (s_host.nframes >= SIM_MAX_FRAMES) {
+        return NULL;
+    }
+    sim_frame *frame = (sim_frame *) calloc(1, sizeof(sim_frame));
+    if (frame == NULL) {
+        return NULL;
+    }
+    wchar_t *wpath = to_wide(path != NULL ? path : "");
+    frame->doc = doc_new(wpath);
+    free(wpath);
+    if (frame->doc == NULL) {
+        free(frame);
+        return NULL;
+    }
+    init_wnd(&frame->frame_wnd, SIM_WND_FRAME, frame);
+    init_wnd(&frame->doc_wnd, SIM_WND_DOC, frame);
+    frame->doc->user = frame;
+    frame->doc->on_changed = on_doc_changed;
+    s_host.frames[s_host.nframes++] = frame;
+    s_host.active = s_host.nframes - 1;
+    return frame;
+}
+
+
+sim_frame *
+host_open(const char *path)
+{
+    sim_frame *frame = host_new_frame(path);
+    if (frame != NULL && !doc_load(frame->doc, path)) {
+        host_close(frame);
+        return NULL;
+    }
+    return frame;
+}
+
+
+void
+host_close(sim_frame *frame)
+{
+    int i = frame_index(frame);
+    if (i < 0) {
+        return;
+    }
+    host_fire(EEHOOK_PRECLOSE, (LONG_PTR) &frame->frame_wnd, 0, 0, 0);
+    host_fire(EEHOOK_POSTCLOSE, (LONG_PTR) &frame->frame_wnd, 0, 0, 0);
+    host_fire(EEHOOK_REMOVETABPAGE, (LONG_PTR) &frame->frame_wnd, 0, 0, 0);
+
+    // drop notifications that would reach a freed frame
+    for (int k = 0; k < s_host.nposted; k++) {
+        if (s_host.posted[k].frame == frame) {
+            s_host.posted[k].id = -1;
+        }
+    }
+    memmove(s_host.frames + i, s_host.frames + i + 1,
+            (s_host.nframes - i - 1) * sizeof(sim_frame *));
+    s_host.nframes--;
+    if (s_host.active >= s_host.nframes) {
+        s_host.active = s_host.nframes - 1;
+    }
+    doc_free(frame->doc);
+    free(frame);
+}
+
+
+void
+host_save(sim_frame *frame)
+{
+    // nothing is written, saving only clears the dirty flag
+    host_fire(EEHOOK_PRESAVE, (LONG_PTR) &frame->frame_wnd, 0, 0, 0);
+    frame->doc->dirty = 0;
+    host_fire(EEHOOK_POSTSAVE, (LONG_PTR) &frame->frame_wnd, 0, 0, 0);
+}
+
+
+void
+host_activate(sim_frame *frame)
+{
+    int i = frame_index(frame);
+    if (i >= 0 && i != s_host.active) {
+        sim_frame *old = host_active_frame();
+        s_host.active = i;
+        host_fire(EEHOOK_TABPAGESELCHANGED,
+                  old != NULL ? (LONG_PTR) &old->frame_wnd : 0,
+                  (LONG_PTR) &frame->frame_wnd, 0, 0);
+    }
+}
+
+
+sim_frame *
+host_active_frame(void)
+{
+    return s_host.active >= 0 ? s_host.frames[s_host.active] : NULL;
+}
+
+
+int
+host_frame_count(void)
+{
+    return s_host.nframes;
+}
+
+
+sim_frame *
+host_frame_at(int index)
+{
+    return (index >= 0 && index < s_host.nframes) ? s_host.frames[index] : NULL;
+}
+
+
+sim_doc *
+host_frame_doc(sim_frame *frame)
+{
+    return frame->doc;
+}
+
+
+HWND
+host_frame_hwnd(sim_frame *frame)
+{
+    return (HWND) &frame->frame_wnd;
+}
+
+
+HWND
+host_doc_hwnd(sim_frame *frame)
+{
+    return (HWND) &frame->doc_wnd;
+}
+
+
+LRESULT
+host_fire(int id, LONG_PTR a, LONG_PTR b, LONG_PTR c, LONG_PTR d)
+{
+    // every hook is called with four pointer-sized arguments, callees
+    // with fewer parameters ignore the rest
+    typedef LRESULT (*hook_fn)(LONG_PTR, LONG_PTR, LONG_PTR, LONG_PTR);
+    LRESULT rv = 0;
+
+    if (id < 0 || id >= SIM_HOOK_LIMIT) {
+        return 0;
+    }
+    for (int i = 0; i < s_host.nhooks[id]; i++) {
+        rv = ((hook_fn) s_host.hooks[id][i])(a, b, c, d);
+        if (rv == EEHOOK_RET_DONTROUTE) {
+            break;
+        }
+    }
+    return rv;
+}
+
+
+int
+host_hook_count(int id)
+{
+    return (id >= 0 && id < SIM_HOOK_LIMIT) ? s_host.nhooks[id] : 0;
+}
+
+
+// delivers the hooks posted during the last plugin call, returns how many
+int
+host_pump(void)
+{
+    int n = 0;
+    // hooks may post again, take the queue one entry at a time
+    for (int i = 0; i < s_host.nposted; i++) {
+        sim_posted p = s_host.posted[i];
+        s_host.posted[i].str = NULL;
+        if (p.id == EEHOOK_UPDATETEXT) {
+            host_fire(p.id, p.args[0], (LONG_PTR) &p.update, 0, 0);
+        } else if (p.id >= 0) {
+            host_fire(p.id, p.str != NULL ? (LONG_PTR) p.str : p.args[0], p.args[1], 0, 0);
+        }
+        free(p.str);
+        n += p.id >= 0;
+    }
+    s_host.nposted = 0;
+    return n;
+}
+
+
+static void
+set_hook(int id, void *fn)
+{
+    if (id == EEHOOK_REMOVE) {
+        for (int k = 0; k < SIM_HOOK_LIMIT; k++) {
+            for (int i = 0; i < s_host.nhooks[k]; i++) {
+                if (s_host.hooks[k][i] == fn) {
+                    memmove(&s_host.hooks[k][i], &s_host.hooks[k][i + 1],
+                            (s_host.nhooks[k] - i - 1) * sizeof(void *));
+                    s_host.nhooks[k]--;
+                    i--;
+                }
+            }
+        }
+    } else if (id > 0 && id < SIM_HOOK_LIMIT && s_host.nhooks[id] < SIM_HOOK_CHAIN) {
+        s_host.hooks[id][s_host.nhooks[id]++] = fn;
+    }
+}
+
+
+static sim_frame *
+find_frame_by_path(const wchar_t *path)
+{
+    for (int i = 0; i < s_host.nframes; i++) {
+        if (wcscasecmp(s_host.frames[i]->doc->path, path) == 0) {
+            return s_host.frames[i];
+        }
+    }
+    return NULL;
+}
+
+
+static sim_frame *
+frame_of(HWND hwnd)
+{
+    sim_wnd *w = to_wnd(hwnd);
+    return (w != NULL && w->frame != NULL && frame_index(w->frame) >= 0) ? w->frame : NULL;
+}
+
+
+static LRESULT
+main_message(UINT msg, WPARAM wparam, LPARAM lparam)
+{
+    sim_frame *frame = host_active_frame();
+
+    switch (msg) {
+    case WM_COMMAND:
+        if (wparam == CMD_NEW_TEXT) {
+            frame = host_new_frame(NULL);
+            if (frame != NULL) {
+                post_hook(EEHOOK_POSTNEWTEXT, frame, (LONG_PTR) &frame->frame_wnd, 0, NULL);
+            }
+        } else if (wparam == CMD_SAVE) {
+            if (frame != NULL) {
+                frame->doc->dirty = 0;
+                post_hook(EEHOOK_POSTSAVE, frame, (LONG_PTR) &frame->frame_wnd, 0, NULL);
+            }
+        } else {
+            // commands of other plugins reach them through the app message hook
+            post_hook(EEHOOK_APPMSG, NULL, WM_COMMAND, wparam, NULL);
+        }
+        return 0;
+    case EEM_GETACTIVETEXT:
+        return frame != NULL ? (LRESULT) &frame->doc_wnd : 0;
+    case EEM_GETACTIVEFRAME:
+        return frame != NULL ? (LRESULT) &frame->frame_wnd : 0;
+    case EEM_LOADFILE: {
+        const wchar_t *wpath = (const wchar_t *) wparam;
+        sim_frame *found = find_frame_by_path(wpath);
+        if (found == NULL) {
+            char *path = to_utf8(wpath, -1);
+            found = path != NULL ? host_open(path) : NULL;
+            free(path);
+            if (found == NULL) {
+                return 0;
+            }
+            post_hook(EEHOOK_POSTLOAD, found, (LONG_PTR) found->doc->path,
+                      (LONG_PTR) &found->frame_wnd, NULL);
+        }
+        s_host.active = frame_index(found);
+        return (LRESULT) &found->frame_wnd;
+    }
+    case EEM_SETHOOK:
+        set_hook((int) wparam, (void *) lparam);
+        return wparam > 0 && wparam < SIM_HOOK_LIMIT ? s_host.nhooks[wparam] : 0;
+    case EEM_SETHOOKS: {
+        const EE_HookFunc *funcs = (const EE_HookFunc *) wparam;
+        for (int i = 0; i < (int) lparam; i++) {
+            set_hook(funcs[i].nType, funcs[i].lpFunc);
+        }
+        return 0;
+    }
+    case EEM_GETFRAMELIST:
+        if (wparam != 0) {
+            HWND *out = (HWND *) wparam;
+            for (int i = 0; i < s_host.nframes; i++) {
+                out[i] = (HWND) &s_host.frames[i]->frame_wnd;
+            }
+        }
+        return s_host.nframes;
+    case EEM_SETACTIVEVIEW:
+        frame = frame_of((HWND) wparam);
+        if (frame == NULL) {
+            return 0;
+        }
+        s_host.active = frame_index(frame);
+        return 1;
+    case EEM_OUTPUTTEXT: {
+        const wchar_t *text = (const wchar_t *) wparam;
+        int len = lparam > 0 ? (int) lparam : lstrlenW(text);
+        EC_Pos end = { INT_MAX, INT_MAX };
+        doc_insert(s_host.output_doc, &end, text, len);
+        if (s_host.echo) {
+            char *s = to_utf8(text, len);
+            if (s != NULL) {
+                fputs(s, stdout);
+                fflush(stdout);
+                free(s);
+            }
+        }
+        return 0;
+    }
+    case EEM_GETOUTPUTHWND:
+        return (LRESULT) &s_host.output;
+    case EEM_GETDOCFROMFRAME:
+        frame = frame_of((HWND) wparam);
+        return frame != NULL ? (LRESULT) &frame->doc_wnd : 0;
+    case EEM_GETFRAMEFROMPATH:
+        frame = find_frame_by_path((const wchar_t *) wparam);
+        return frame != NULL ? (LRESULT) &frame->frame_wnd : 0;
+    case EEM_GETFRAMETYPE:
+        return frame_of((HWND) wparam) != NULL ? FRAMETYPE_TEXT : FRAMETYPE_UNKOWN;
+    case EEM_GETFRAMEPATH:
+        frame = frame_of((HWND) wparam);
+        return (LRESULT) (frame != NULL ? frame->doc->path : L"");
+    case EEM_EXCUTESCRIPT:
+        post_hook(EEHOOK_PREEXECUTESCRIPT, NULL, 0, 0, (const wchar_t *) wparam);
+        return 0;
+    default:
+        // EEM_UPDATEUIELEMENT, EEM_SETVIEWTYPE (TVT_DEFAULT), EEM_GETAPPMETRICS, ...
+        return 0;
+    }
+}
+
+
+static LRESULT
+list_message(UINT msg, WPARAM wparam, LPARAM lparam)
+{
+    const LVITEMA *item = (const LVITEMA *) lparam;
+    int row;
+
+    switch (msg) {
+    case LVM_GETITEMCOUNT:
+        return s_host.nrows;
+    case LVM_INSERTITEMA:
+        if (s_host.nrows == s_host.rows_cap) {
+            int cap = s_host.rows_cap ? s_host.rows_cap * 2 : 16;
+            sim_row *rows = (sim_row *) realloc(s_host.rows, cap * sizeof(sim_row));
+            if (rows == NULL) {
+                return -1;
+            }
+            s_host.rows = rows;
+            s_host.rows_cap = cap;
+        }
+        row = item->iItem < 0 || item->iItem > s_host.nrows ? s_host.nrows : item->iItem;
+        memmove(s_host.rows + row + 1, s_host.rows + row,
+                (s_host.nrows - row) * sizeof(sim_row));
+        memset(&s_host.rows[row], 0, sizeof(sim_row));
+        s_host.nrows++;
+        break;
+    case LVM_SETITEMTEXTA:
+        row = (int) wparam;
+        if (row < 0 || row >= s_host.nrows) {
+            return 0;
+        }
+        break;
+    default:
+        return 0;
+    }
+
+    if (item->iSubItem >= 0 && item->iSubItem < SIM_LIST_COLUMNS) {
+        char **cell = &s_host.rows[row].cells[item->iSubItem];
+        free(*cell);
+        *cell = item->pszText != NULL ? strdup(item->pszText) : NULL;
+    }
+    return msg == LVM_INSERTITEMA ? row : 1;
+}
+
+
+LRESULT
+SendMessageA(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
+{
+    sim_wnd *w = to_wnd(hwnd);
+    int target = w != NULL ? w->kind : SIM_WND_OTHER;
+
+    if (s_host.observer != NULL) {
+        s_host.observer(target, msg, s_host.observer_ud);
+    }
+    switch (target) {
+    case SIM_WND_MAIN:
+        return main_message(msg, wparam, lparam);
+    case SIM_WND_DOC:
+        if (frame_of(hwnd) == NULL) {
+            return 0;
+        }
+        return doc_message(w->frame->doc, msg, wparam, lparam);
+    case SIM_WND_OUTPUT:
+        return doc_message(s_host.output_doc, msg, wparam, lparam);
+    case SIM_WND_LIST:
+        return list_message(msg, wparam, lparam);
+    default:
+        return 0;
+    }
+}
+
+
+static UINT_PTR
+find_in_menu(HMENU menu, const char *label)
+{
+    const sim_menu_item *items;
+    int n = winshim_menu_items(menu, &items);
+    for (int i = 0; i < n; i++) {
+        if (items[i].flags & MF_POPUP) {
+            UINT_PTR id = find_in_menu((HMENU) items[i].id, label);
+            if (id != 0) {
+                return id;
+            }
+        } else if (items[i].text != NULL && strcmp(items[i].text, label) == 0) {
+            return items[i].id;
+        }
+    }
+    return 0;
+}
+
+
+UINT_PTR
+host_find_menu_command(const char *label)
+{
+    UINT_PTR id = find_in_menu(s_host.ctx.hMainMenu, label);
+    if (id == 0) {
+        id = find_in_menu(s_host.ctx.hPluginMenu, label);
+    }
+    if (id == 0 && s_host.popup != NULL) {
+        id = find_in_menu(s_host.popup, label);
+    }
+    return id;
+}
+
+
+int
+host_list_plugin_commands(int print)
+{
+    free_rows();
+    host_fire(EEHOOK_LISTPLUGINCOMMAND, (LONG_PTR) &s_host.list, 0, 0, 0);
+    if (print) {
+        for (int i = 0; i < s_host.nrows; i++) {
+            const sim_row *r = &s_host.rows[i];
+            printf("  %-32s %s\n", r->cells[1] ? r->cells[1] : "",
+                   r->cells[2] ? r->cells[2] : "");
+        }
+    }
+    return s_host.nrows;
+}
+
+
+static void
+print_menu(HMENU menu, int depth)
+{
+    const sim_menu_item *items;
+    int n = winshim_menu_items(menu, &items);
+    for (int i = 0; i < n; i++) {
+        if (items[i].flags & MF_SEPARATOR) {
+            printf("%*s----\n", depth * 2 + 2, "");
+        } else {
+            printf("%*s%s\n", depth * 2 + 2, "", items[i].text ? items[i].text : "");
+        }
+        if (items[i].flags & MF_POPUP) {
+            print_menu((HMENU) items[i].id, depth + 1);
+        }
+    }
+}
+
+
+int
+host_popup_text_menu(int x, int y, int print)
+{
+    sim_frame *frame = host_active_frame();
+    if (frame == NULL) {
+        return 0;
+    }
+    winshim_menu_free(s_host.popup);
+    s_host.popup = CreatePopupMenu();
+    host_fire(EEHOOK_PRETEXTMENU, (LONG_PTR) &frame->doc_wnd, (LONG_PTR) s_host.popup, x, y);
+    if (print) {
+        print_menu(s_host.popup, 0);
+    }
+    return GetMenuItemCount(s_host.popup);
+}
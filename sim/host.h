@@ -0,0 +1,77 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#ifndef EESIM_HOST_H_
+#define EESIM_HOST_H_
+
+#include <windows.h>
+
+#include "eesdk.h"
+#include "doc.h"
+
+// The stand-in editor: an EE_Context whose windows are host objects, child
+// frames holding sim_doc documents, the output window, the plugin command
+// list view and the hook table filled through EEM_SETHOOK. SendMessageA()
+// dispatches on the target window.
+
+#define SIM_HOOK_LIMIT      128
+
+typedef struct sim_frame sim_frame;
+
+// target kinds, see host_target_name()
+enum {
+    SIM_WND_MAIN = 1,
+    SIM_WND_FRAME,
+    SIM_WND_DOC,
+    SIM_WND_OUTPUT,
+    SIM_WND_LIST,
+    SIM_WND_OTHER
+};
+
+// called for every message the plugin sends
+typedef void (*sim_send_observer)(int target, UINT msg, void *ud);
+
+int host_init(void);
+void host_shutdown(void);
+EE_Context *host_context(void);
+
+// echo EEM_OUTPUTTEXT to stdout
+void host_set_echo(int echo);
+void host_set_observer(sim_send_observer observer, void *ud);
+const char *host_target_name(int target);
+const char *host_message_name(int target, UINT msg);
+
+sim_frame *host_new_frame(const char *path);
+// loads a UTF-8 file (Windows or host path), NULL if it cannot be read
+sim_frame *host_open(const char *path);
+void host_close(sim_frame *frame);
+void host_save(sim_frame *frame);
+void host_activate(sim_frame *frame);
+sim_frame *host_active_frame(void);
+int host_frame_count(void);
+sim_frame *host_frame_at(int index);
+sim_doc *host_frame_doc(sim_frame *frame);
+HWND host_frame_hwnd(sim_frame *frame);
+HWND host_doc_hwnd(sim_frame *frame);
+
+// calls the hooks installed for id in order until one returns
+// EEHOOK_RET_DONTROUTE, returns the last result
+LRESULT host_fire(int id, LONG_PTR a, LONG_PTR b, LONG_PTR c, LONG_PTR d);
+int host_hook_count(int id);
+// hooks caused by a message the plugin sent (EEHOOK_UPDATETEXT, APPMSG for
+// WM_COMMAND, POSTSAVE, ...) are queued and delivered here, as the message
+// loop would after the plugin returned; returns the number delivered
+int host_pump(void);
+
+// command id of a menu item by label, searched in the main, plugin and
+// last popup menus, 0 if none
+UINT_PTR host_find_menu_command(const char *label);
+// shows the plugin command list (EEHOOK_LISTPLUGINCOMMAND), returns rows
+int host_list_plugin_commands(int print);
+// pops up the text menu of the active document (EEHOOK_PRETEXTMENU),
+// returns the number of items the plugin added
+int host_popup_text_menu(int x, int y, int print);
+
+#endif  // EESIM_HOST_H_
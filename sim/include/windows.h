@@ -0,0 +1,225 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#ifndef EESIM_WINDOWS_H_
+#define EESIM_WINDOWS_H_
+
+// The subset of <windows.h> that eelua and its FFI code use, so the plugin
+// sources build unchanged into the Linux host simulator. The functions are
+// implemented in sim/winshim.c. wchar_t is the platform's (4 bytes here),
+// which is also what LuaJIT's FFI uses for wchar_t on this platform.
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+
+#define WINAPI
+#define CALLBACK
+#define __stdcall
+#define __declspec(x)
+
+typedef void *HANDLE;
+typedef HANDLE HWND;
+typedef HANDLE HMENU;
+typedef HANDLE HMODULE;
+typedef HANDLE HINSTANCE;
+typedef HANDLE HICON;
+typedef HANDLE HGLOBAL;
+typedef void *LPVOID;
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint32_t UINT;
+typedef uint32_t LCID;
+typedef int32_t LONG;
+typedef int BOOL;
+typedef intptr_t LONG_PTR;
+typedef uintptr_t UINT_PTR;
+typedef LONG_PTR WPARAM;
+typedef LONG_PTR LPARAM;
+typedef LONG_PTR LRESULT;
+typedef DWORD (WINAPI *LPTHREAD_START_ROUTINE)(LPVOID);
+
+#define TRUE                    1
+#define FALSE                   0
+#define MAX_PATH                260
+#define INFINITE                0xFFFFFFFF
+#define WAIT_OBJECT_0           0
+#define WAIT_TIMEOUT            0x102
+#define INVALID_HANDLE_VALUE    ((HANDLE) (LONG_PTR) -1)
+#define INVALID_FILE_ATTRIBUTES 0xFFFFFFFF
+#define FILE_ATTRIBUTE_DIRECTORY 0x10
+#define FILE_ATTRIBUTE_NORMAL   0x80
+
+#define CP_ACP                  0
+#define CP_UTF8                 65001
+
+#define WM_SETREDRAW            0x000B
+#define WM_COMMAND              0x0111
+#define WM_USER                 0x0400
+
+#define MB_OK                   0x00
+#define MB_ICONERROR            0x10
+
+#define MF_STRING               0x0000
+#define MF_POPUP                0x0010
+#define MF_BYPOSITION           0x0400
+#define MF_SEPARATOR            0x0800
+
+#define LVM_FIRST               0x1000
+#define LVM_GETITEMCOUNT        (LVM_FIRST + 4)
+#define LVM_INSERTITEMA         (LVM_FIRST + 7)
+#define LVM_SETITEMTEXTA        (LVM_FIRST + 46)
+#define LVIF_TEXT               0x0001
+
+#define DLL_PROCESS_DETACH      0
+#define DLL_PROCESS_ATTACH      1
+#define DLL_THREAD_ATTACH       2
+#define DLL_THREAD_DETACH       3
+
+typedef struct {
+    LONG left, top, right, bottom;
+} RECT, *LPRECT;
+
+typedef struct {
+    HWND hwndFrom;
+    UINT_PTR idFrom;
+    UINT code;
+} NMHDR;
+
+typedef struct {
+    HWND hwnd;
+    UINT message;
+    WPARAM wParam;
+    LPARAM lParam;
+    DWORD time;
+} MSG;
+
+typedef union {
+    struct {
+        DWORD LowPart;
+        LONG HighPart;
+    } u;
+    long long QuadPart;
+} LARGE_INTEGER;
+
+typedef struct {
+    DWORD dwLowDateTime;
+    DWORD dwHighDateTime;
+} FILETIME;
+
+typedef struct {
+    DWORD dwFileAttributes;
+    FILETIME ftCreationTime;
+    FILETIME ftLastAccessTime;
+    FILETIME ftLastWriteTime;
+    DWORD nFileSizeHigh;
+    DWORD nFileSizeLow;
+    DWORD dwReserved0;
+    DWORD dwReserved1;
+    char cFileName[MAX_PATH];
+    char cAlternateFileName[14];
+    DWORD dwFileType;
+    DWORD dwCreatorType;
+    WORD wFinderFlags;
+} WIN32_FIND_DATAA;
+
+typedef struct {
+    DWORD dwFileAttributes;
+    FILETIME ftCreationTime;
+    FILETIME ftLastAccessTime;
+    FILETIME ftLastWriteTime;
+    DWORD nFileSizeHigh;
+    DWORD nFileSizeLow;
+} WIN32_FILE_ATTRIBUTE_DATA;
+
+typedef struct {
+    UINT mask;
+    int iItem;
+    int iSubItem;
+    UINT state;
+    UINT stateMask;
+    const char *pszText;
+    int cchTextMax;
+    int iImage;
+    LPARAM lParam;
+    int iIndent;
+    int iGroupId;
+    UINT cColumns;
+    UINT_PTR puColumns;
+    int *piColFmt;
+    int iGroup;
+} LVITEMA;
+
+typedef struct {
+    UINT MaxCharSize;
+    BYTE DefaultChar[2];
+    BYTE LeadByte[12];
+} CPINFO;
+
+// messages
+LRESULT SendMessageA(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam);
+int MessageBoxA(HWND hwnd, const char *text, const char *caption, UINT type);
+void OutputDebugStringA(const char *str);
+
+// modules and files
+DWORD GetModuleFileNameA(HMODULE module, char *buf, DWORD size);
+DWORD GetFileAttributesA(const char *path);
+BOOL GetFileAttributesExA(const char *path, int level, WIN32_FILE_ATTRIBUTE_DATA *data);
+HANDLE FindFirstFileA(const char *pattern, WIN32_FIND_DATAA *data);
+BOOL FindNextFileA(HANDLE find, WIN32_FIND_DATAA *data);
+BOOL FindClose(HANDLE find);
+BOOL CreateDirectoryA(const char *path, void *security);
+BOOL RemoveDirectoryA(const char *path);
+BOOL DeleteFileA(const char *path);
+BOOL CopyFileA(const char *src, const char *dst, BOOL fail_if_exists);
+BOOL SetCurrentDirectoryA(const char *path);
+DWORD GetCurrentDirectoryA(DWORD size, char *buf);
+
+// strings
+int lstrlenW(const wchar_t *str);
+int MultiByteToWideChar(UINT cp, DWORD flags, const char *str, int len,
+                        wchar_t *wstr, int wlen);
+int WideCharToMultiByte(UINT cp, DWORD flags, const wchar_t *wstr, int wlen,
+                        char *str, int len, const char *def, BOOL *used_def);
+BOOL GetCPInfo(UINT cp, CPINFO *info);
+
+// memory
+HGLOBAL GlobalAlloc(UINT flags, size_t size);
+void *GlobalLock(HGLOBAL mem);
+BOOL GlobalUnlock(HGLOBAL mem);
+HGLOBAL GlobalFree(HGLOBAL mem);
+
+// menus
+HMENU CreatePopupMenu(void);
+BOOL IsMenu(HMENU menu);
+int GetMenuItemCount(HMENU menu);
+BOOL AppendMenuA(HMENU menu, UINT flags, UINT_PTR id, const char *text);
+BOOL InsertMenuA(HMENU menu, UINT pos, UINT flags, UINT_PTR id, const char *text);
+
+// threads and synchronization
+HANDLE CreateThread(void *security, size_t stack_size, LPTHREAD_START_ROUTINE start,
+                    LPVOID arg, DWORD flags, DWORD *thread_id);
+HANDLE CreateEventA(void *security, BOOL manual_reset, BOOL initial, const char *name);
+BOOL SetEvent(HANDLE event);
+DWORD WaitForSingleObject(HANDLE handle, DWORD ms);
+BOOL CloseHandle(HANDLE handle);
+void Sleep(DWORD ms);
+DWORD GetCurrentProcessId(void);
+DWORD GetCurrentThreadId(void);
+LONG InterlockedExchange(volatile LONG *target, LONG value);
+LONG InterlockedCompareExchange(volatile LONG *target, LONG value, LONG comparand);
+LONG InterlockedIncrement(volatile LONG *target);
+LONG InterlockedDecrement(volatile LONG *target);
+
+// time
+BOOL QueryPerformanceCounter(LARGE_INTEGER *counter);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *freq);
+DWORD GetTickCount(void);
+
+#endif  // EESIM_WINDOWS_H_
@@ -0,0 +1,129 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+// eesim: loads the plugin into a stand-in editor and replays event traces,
+// so hook dispatch, document access and command execution can be measured
+// without EverEdit.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host.h"
+#include "trace.h"
+#include "winshim.h"
+
+DWORD EE_PluginInit(EE_Context *context);
+DWORD EE_PluginUninit();
+
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+            "usage: eesim [options] [trace...]\n"
+            "  -C dir     app directory holding eelua/ (default: ezip)\n"
+            "  -n count   replay the traces count times (default: 1)\n"
+            "  -o file    record the events and the messages they sent\n"
+            "  -q         do not echo the output window\n"
+            "  -v         show debug output\n"
+            "Without a trace, events are read from stdin.\n");
+}
+
+
+// closes every document so each replay starts from the same state
+static void
+close_all(void)
+{
+    while (host_active_frame() != NULL) {
+        host_close(host_active_frame());
+    }
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    const char *root = "ezip";
+    const char *record = NULL;
+    int rounds = 1;
+    int quiet = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "C:n:o:qvh")) != -1) {
+        switch (opt) {
+        case 'C': root = optarg; break;
+        case 'n': rounds = atoi(optarg); break;
+        case 'o': record = optarg; break;
+        case 'q': quiet = 1; break;
+        case 'v': winshim_set_verbose(1); break;
+        default: usage(); return 2;
+        }
+    }
+
+    // trace paths are taken relative to where eesim was started
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL || chdir(root) != 0) {
+        fprintf(stderr, "eesim: cannot enter %s\n", root);
+        return 2;
+    }
+    char root_abs[PATH_MAX];
+    if (getcwd(root_abs, sizeof(root_abs)) == NULL) {
+        return 2;
+    }
+    winshim_set_root(root_abs);
+
+    FILE *out = NULL;
+    if (record != NULL) {
+        char path[PATH_MAX * 2];
+        snprintf(path, sizeof(path), "%s%s%s", record[0] == '/' ? "" : cwd,
+                 record[0] == '/' ? "" : "/", record);
+        out = fopen(path, "w");
+        if (out == NULL) {
+            fprintf(stderr, "eesim: cannot write %s\n", record);
+            return 2;
+        }
+    }
+
+    if (!host_init()) {
+        return 1;
+    }
+    host_set_echo(!quiet);
+    EE_PluginInit(host_context());
+
+    trace_stats *st = trace_stats_new();
+    trace_record(st, out);
+    int failed = 0;
+    if (optind == argc) {
+        char line[4096];
+        while (fgets(line, sizeof(line), stdin) != NULL) {
+            failed += trace_run_line(st, line) != 0;
+        }
+    } else {
+        for (int round = 0; round < rounds; round++) {
+            for (int i = optind; i < argc; i++) {
+                char path[PATH_MAX * 2];
+                snprintf(path, sizeof(path), "%s%s%s", argv[i][0] == '/' ? "" : cwd,
+                         argv[i][0] == '/' ? "" : "/", argv[i]);
+                int rc = trace_replay(st, path);
+                failed += rc < 0 ? 1 : rc;
+            }
+            close_all();
+            // only the first round is recorded
+            trace_record(st, NULL);
+        }
+    }
+
+    EE_PluginUninit();
+    trace_report(st, stderr);
+    int rc = (failed > 0 || trace_divergences(st) > 0) ? 1 : 0;
+    trace_stats_free(st);
+    host_shutdown();
+    if (out != NULL) {
+        fclose(out);
+    }
+    return rc;
+}
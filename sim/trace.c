@@ -0,0 +1,671 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "host.h"
+
+#define TRACE_MAX_MESSAGES  256
+#define TRACE_MAX_PUMP      16
+
+DWORD dofile(EE_Context *context, LPRECT rect, const wchar_t *text);
+
+typedef struct {
+    int target;
+    UINT msg;
+    int repeat;
+} send_rec;
+
+typedef struct {
+    int target;
+    UINT msg;
+    double count;
+} msg_stat;
+
+typedef struct {
+    int count;
+    int failed;
+    double total_ms;
+    double max_ms;
+    double sends;
+} event_stat;
+
+typedef int (*event_fn)(char *args);
+
+typedef struct {
+    const char *name;
+    event_fn func;
+} event_entry;
+
+struct trace_stats {
+    event_stat events[32];
+    msg_stat messages[TRACE_MAX_MESSAGES];
+    int nmessages;
+    send_rec *sends;
+    int nsends;
+    int sends_cap;
+    int divergences;
+    FILE *record;
+};
+
+
+static double
+now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+
+static void
+on_send(int target, UINT msg, void *ud)
+{
+    trace_stats *st = (trace_stats *) ud;
+
+    if (st->nsends > 0) {
+        send_rec *last = &st->sends[st->nsends - 1];
+        if (last->target == target && last->msg == msg) {
+            last->repeat++;
+            goto count;
+        }
+    }
+    if (st->nsends == st->sends_cap) {
+        int cap = st->sends_cap ? st->sends_cap * 2 : 64;
+        send_rec *sends = (send_rec *) realloc(st->sends, cap * sizeof(send_rec));
+        if (sends == NULL) {
+            goto count;
+        }
+        st->sends = sends;
+        st->sends_cap = cap;
+    }
+    st->sends[st->nsends].target = target;
+    st->sends[st->nsends].msg = msg;
+    st->sends[st->nsends].repeat = 1;
+    st->nsends++;
+
+count:
+    for (int i = 0; i < st->nmessages; i++) {
+        if (st->messages[i].target == target && st->messages[i].msg == msg) {
+            st->messages[i].count++;
+            return;
+        }
+    }
+    if (st->nmessages < TRACE_MAX_MESSAGES) {
+        msg_stat *m = &st->messages[st->nmessages++];
+        m->target = target;
+        m->msg = msg;
+        m->count = 1;
+    }
+}
+
+
+trace_stats *
+trace_stats_new(void)
+{
+    trace_stats *st = (trace_stats *) calloc(1, sizeof(trace_stats));
+    if (st != NULL) {
+        host_set_observer(on_send, st);
+    }
+    return st;
+}
+
+
+void
+trace_stats_free(trace_stats *st)
+{
+    if (st != NULL) {
+        host_set_observer(NULL, NULL);
+        free(st->sends);
+        free(st);
+    }
+}
+
+
+void
+trace_record(trace_stats *st, FILE *out)
+{
+    st->record = out;
+}
+
+
+int
+trace_divergences(const trace_stats *st)
+{
+    return st->divergences;
+}
+
+
+static void
+format_send(const send_rec *s, char *buf, size_t size)
+{
+    int n = snprintf(buf, size, "send %s %s", host_target_name(s->target),
+                     host_message_name(s->target, s->msg));
+    if (s->repeat > 1 && n > 0 && (size_t) n < size) {
+        snprintf(buf + n, size - n, " x%d", s->repeat);
+    }
+}
+
+
+static char *
+skip_space(char *s)
+{
+    while (*s == ' ' || *s == '\t') {
+        s++;
+    }
+    return s;
+}
+
+
+// decodes \n, \r, \t and \\ in place
+static char *
+unescape(char *s)
+{
+    char *out = s;
+    for (const char *p = s; *p; p++) {
+        if (*p == '\\' && p[1] != '\0') {
+            p++;
+            *out++ = *p == 'n' ? '\n' : *p == 'r' ? '\r' : *p == 't' ? '\t' : *p;
+        } else {
+            *out++ = *p;
+        }
+    }
+    *out = '\0';
+    return s;
+}
+
+
+static wchar_t *
+widen(const char *s, int *len)
+{
+    int n = MultiByteToWideChar(CP_UTF8, 0, s, -1, NULL, 0);
+    wchar_t *w = (wchar_t *) malloc(n * sizeof(wchar_t));
+    if (w != NULL) {
+        MultiByteToWideChar(CP_UTF8, 0, s, -1, w, n);
+    }
+    if (len != NULL) {
+        *len = n - 1;
+    }
+    return w;
+}
+
+
+static sim_frame *
+need_frame(void)
+{
+    sim_frame *frame = host_active_frame();
+    if (frame == NULL) {
+        fprintf(stderr, "eesim: no active document\n");
+    }
+    return frame;
+}
+
+
+static int
+ev_new(char *args)
+{
+    sim_frame *frame = host_new_frame(*args ? args : NULL);
+    if (frame == NULL) {
+        return -1;
+    }
+    host_fire(EEHOOK_POSTNEWTEXT, (LONG_PTR) host_frame_hwnd(frame), 0, 0, 0);
+    return 0;
+}
+
+
+static int
+ev_open(char *args)
+{
+    sim_frame *frame = host_open(args);
+    if (frame == NULL) {
+        fprintf(stderr, "eesim: cannot open %s\n", args);
+        return -1;
+    }
+    host_fire(EEHOOK_POSTLOAD, (LONG_PTR) host_frame_doc(frame)->path,
+              (LONG_PTR) host_frame_hwnd(frame), 0, 0);
+    return 0;
+}
+
+
+static int
+ev_close(char *args)
+{
+    sim_frame *frame = need_frame();
+    if (frame == NULL) {
+        return -1;
+    }
+    host_close(frame);
+    return 0;
+}
+
+
+static int
+ev_save(char *args)
+{
+    sim_frame *frame = need_frame();
+    if (frame == NULL) {
+        return -1;
+    }
+    host_save(frame);
+    return 0;
+}
+
+
+static int
+ev_activate(char *args)
+{
+    sim_frame *frame = host_frame_at(atoi(args));
+    if (frame == NULL) {
+        fprintf(stderr, "eesim: no document %s\n", args);
+        return -1;
+    }
+    host_activate(frame);
+    return 0;
+}
+
+
+static int
+ev_text(char *args)
+{
+    sim_frame *frame = need_frame();
+    int len;
+    wchar_t *w = widen(unescape(args), &len);
+    if (frame == NULL || w == NULL) {
+        free(w);
+        return -1;
+    }
+    doc_set_text(host_frame_doc(frame), w, len);
+    free(w);
+    return 0;
+}
+
+
+static int
+ev_type(char *args)
+{
+    sim_frame *frame = need_frame();
+    int len;
+    wchar_t *w = widen(unescape(args), &len);
+    if (frame == NULL || w == NULL) {
+        free(w);
+        return -1;
+    }
+    sim_doc *doc = host_frame_doc(frame);
+    EC_Pos pos = doc->caret;
+    doc_insert(doc, &pos, w, len);
+    free(w);
+    return 0;
+}
+
+
+static int
+ev_caret(char *args)
+{
+    sim_frame *frame = need_frame();
+    EC_Pos pos;
+    if (frame == NULL || sscanf(args, "%d %d", &pos.line, &pos.col) != 2) {
+        return -1;
+    }
+    doc_message(host_frame_doc(frame), ECM_SETPOS, (WPARAM) &pos, 0);
+    return 0;
+}
+
+
+static int
+ev_select(char *args)
+{
+    sim_frame *frame = need_frame();
+    EC_Pos from, to;
+    if (frame == NULL || sscanf(args, "%d %d %d %d", &from.line, &from.col,
+                                &to.line, &to.col) != 4) {
+        return -1;
+    }
+    doc_message(host_frame_doc(frame), ECM_SETSEL, (WPARAM) &from, (LPARAM) &to);
+    return 0;
+}
+
+
+static int
+fire_wide(int id, char *args, int with_length)
+{
+    int len;
+    wchar_t *w = widen(args, &len);
+    if (w == NULL) {
+        return -1;
+    }
+    host_fire(id, (LONG_PTR) w, with_length ? len : 0, 0, 0);
+    free(w);
+    return 0;
+}
+
+
+static int
+ev_command(char *args)
+{
+    return fire_wide(EEHOOK_RUNCOMMAND, args, 1);
+}
+
+
+static int
+ev_plugin(char *args)
+{
+    return fire_wide(EEHOOK_EXECUTEPLUGINCOMMAND, args, 0);
+}
+
+
+static int
+ev_script(char *args)
+{
+    return fire_wide(EEHOOK_PREEXECUTESCRIPT, args, 0);
+}
+
+
+static int
+ev_listplugins(char *args)
+{
+    host_list_plugin_commands(0);
+    return 0;
+}
+
+
+static int
+ev_menu(char *args)
+{
+    UINT_PTR id = host_find_menu_command(args);
+    if (id == 0) {
+        fprintf(stderr, "eesim: no menu item '%s'\n", args);
+        return -1;
+    }
+    host_fire(EEHOOK_APPMSG, WM_COMMAND, (LONG_PTR) id, 0, 0);
+    return 0;
+}
+
+
+static int
+ev_appmsg(char *args)
+{
+    long msg, wp = 0, lp = 0;
+    if (sscanf(args, "%li %li %li", &msg, &wp, &lp) < 1) {
+        return -1;
+    }
+    host_fire(EEHOOK_APPMSG, msg, wp, lp, 0);
+    return 0;
+}
+
+
+static int
+ev_popup(char *args)
+{
+    int x = 0, y = 0;
+    sscanf(args, "%d %d", &x, &y);
+    host_popup_text_menu(x, y, 0);
+    return 0;
+}
+
+
+static int
+ev_idle(char *args)
+{
+    EE_Context *ctx = host_context();
+    int n = *args ? atoi(args) : 1;
+    for (int i = 0; i < n; i++) {
+        sim_frame *frame = host_active_frame();
+        host_fire(EEHOOK_APPIDLE, (LONG_PTR) ctx->hMain,
+                  frame != NULL ? (LONG_PTR) host_frame_hwnd(frame) : 0, 0, 0);
+        if (frame != NULL) {
+            host_fire(EEHOOK_TEXTIDLE, (LONG_PTR) host_doc_hwnd(frame), 0, 0, 0);
+        }
+        host_pump();
+    }
+    return 0;
+}
+
+
+static int
+ev_dofile(char *args)
+{
+    wchar_t *w = widen(unescape(args), NULL);
+    if (w == NULL) {
+        return -1;
+    }
+    dofile(host_context(), NULL, w);
+    free(w);
+    return 0;
+}
+
+
+static const event_entry s_events[] = {
+    { "new", ev_new },
+    { "open", ev_open },
+    { "close", ev_close },
+    { "save", ev_save },
+    { "activate", ev_activate },
+    { "text", ev_text },
+    { "type", ev_type },
+    { "caret", ev_caret },
+    { "select", ev_select },
+    { "command", ev_command },
+    { "plugin", ev_plugin },
+    { "listplugins", ev_listplugins },
+    { "menu", ev_menu },
+    { "appmsg", ev_appmsg },
+    { "script", ev_script },
+    { "popup", ev_popup },
+    { "idle", ev_idle },
+    { "dofile", ev_dofile },
+    { NULL, NULL }
+};
+
+
+// splits "name args" in place, returns the event index or -1
+static int
+parse_event(char *line, char **args)
+{
+    char *s = skip_space(line);
+    size_t n = strcspn(s, " \t");
+    *args = skip_space(s + n);
+    for (int i = 0; s_events[i].name != NULL; i++) {
+        if (strlen(s_events[i].name) == n && strncmp(s, s_events[i].name, n) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+static void
+strip_eol(char *line)
+{
+    line[strcspn(line, "\r\n")] = '\0';
+}
+
+
+static int
+is_blank(const char *line)
+{
+    line = skip_space((char *) line);
+    return *line == '\0' || *line == '#';
+}
+
+
+// runs the event, the sent messages are left in st->sends
+static int
+run_event(trace_stats *st, const char *line)
+{
+    char *copy = strdup(line);
+    char *args;
+    if (copy == NULL) {
+        return -1;
+    }
+    strip_eol(copy);
+    int id = parse_event(copy, &args);
+    if (id < 0) {
+        fprintf(stderr, "eesim: unknown event: %s\n", copy);
+        free(copy);
+        return -1;
+    }
+
+    st->nsends = 0;
+    double t0 = now_ms();
+    int rc = s_events[id].func(args);
+    for (int i = 0; i < TRACE_MAX_PUMP && host_pump() > 0; i++) {
+    }
+    double ms = now_ms() - t0;
+
+    event_stat *es = &st->events[id];
+    es->count++;
+    es->failed += rc != 0;
+    es->total_ms += ms;
+    for (int i = 0; i < st->nsends; i++) {
+        es->sends += st->sends[i].repeat;
+    }
+    if (ms > es->max_ms) {
+        es->max_ms = ms;
+    }
+
+    if (st->record != NULL) {
+        char buf[128];
+        fprintf(st->record, "%s\n", skip_space((char *) line));
+        for (int i = 0; i < st->nsends; i++) {
+            format_send(&st->sends[i], buf, sizeof(buf));
+            fprintf(st->record, "  %s\n", buf);
+        }
+    }
+    free(copy);
+    return rc;
+}
+
+
+int
+trace_run_line(trace_stats *st, const char *line)
+{
+    if (is_blank(line)) {
+        return 0;
+    }
+    return run_event(st, line);
+}
+
+
+// compares the sends of the last event with the recorded ones
+static void
+check_sends(trace_stats *st, char **expected, int nexpected, const char *path, int lineno)
+{
+    char buf[128];
+    int n = st->nsends > nexpected ? st->nsends : nexpected;
+    for (int i = 0; i < n; i++) {
+        const char *want = i < nexpected ? skip_space(expected[i]) : "(none)";
+        if (i < st->nsends) {
+            format_send(&st->sends[i], buf, sizeof(buf));
+        } else {
+            strcpy(buf, "(none)");
+        }
+        if (strcmp(want, buf) != 0) {
+            fprintf(stderr, "%s:%d: diverged at send %d: expected '%s', got '%s'\n",
+                    path, lineno, i + 1, want, buf);
+            st->divergences++;
+            return;
+        }
+    }
+}
+
+
+int
+trace_replay(trace_stats *st, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "eesim: cannot read %s\n", path);
+        return -1;
+    }
+
+    char **lines = NULL;
+    int nlines = 0, cap = 0, recorded = 0;
+    char buf[4096];
+    while (fgets(buf, sizeof(buf), f) != NULL) {
+        if (nlines == cap) {
+            char **grown = (char **) realloc(lines, (cap ? cap * 2 : 256) * sizeof(char *));
+            if (grown == NULL) {
+                break;
+            }
+            lines = grown;
+            cap = cap ? cap * 2 : 256;
+        }
+        strip_eol(buf);
+        lines[nlines++] = strdup(buf);
+        recorded |= strncmp(skip_space(buf), "send ", 5) == 0;
+    }
+    fclose(f);
+
+    int failed = 0;
+    for (int i = 0; i < nlines; i++) {
+        if (is_blank(lines[i])) {
+            continue;
+        }
+        if (strncmp(skip_space(lines[i]), "send ", 5) == 0) {
+            continue;
+        }
+        if (run_event(st, lines[i]) != 0) {
+            fprintf(stderr, "%s:%d: failed: %s\n", path, i + 1, lines[i]);
+            failed++;
+        }
+        if (recorded) {
+            int k = i + 1;
+            while (k < nlines && strncmp(skip_space(lines[k]), "send ", 5) == 0) {
+                k++;
+            }
+            check_sends(st, lines + i + 1, k - i - 1, path, i + 1);
+        }
+    }
+
+    for (int i = 0; i < nlines; i++) {
+        free(lines[i]);
+    }
+    free(lines);
+    return failed;
+}
+
+
+static int
+compare_messages(const void *a, const void *b)
+{
+    double d = ((const msg_stat *) b)->count - ((const msg_stat *) a)->count;
+    return d > 0 ? 1 : d < 0 ? -1 : 0;
+}
+
+
+void
+trace_report(const trace_stats *st, FILE *out)
+{
+    fprintf(out, "%-12s %8s %10s %10s %10s %8s %6s\n",
+            "event", "count", "total ms", "mean us", "max us", "sends", "failed");
+    for (int i = 0; s_events[i].name != NULL; i++) {
+        const event_stat *es = &st->events[i];
+        if (es->count == 0) {
+            continue;
+        }
+        fprintf(out, "%-12s %8d %10.3f %10.2f %10.2f %8.1f %6d\n", s_events[i].name,
+                es->count, es->total_ms, es->total_ms * 1e3 / es->count,
+                es->max_ms * 1e3, es->sends / es->count, es->failed);
+    }
+
+    msg_stat sorted[TRACE_MAX_MESSAGES];
+    memcpy(sorted, st->messages, st->nmessages * sizeof(msg_stat));
+    qsort(sorted, st->nmessages, sizeof(msg_stat), compare_messages);
+    fprintf(out, "\n%-8s %-26s %10s\n", "target", "message", "count");
+    for (int i = 0; i < st->nmessages && i < 12; i++) {
+        fprintf(out, "%-8s %-26s %10.0f\n", host_target_name(sorted[i].target),
+                host_message_name(sorted[i].target, sorted[i].msg), sorted[i].count);
+    }
+
+    double edits, redraws, undo_steps;
+    doc_totals(&edits, &redraws, &undo_steps);
+    fprintf(out, "\nedits: %.0f, redraws: %.0f, undo steps: %.0f\n",
+            edits, redraws, undo_steps);
+    fprintf(out, "divergences: %d\n", st->divergences);
+}
@@ -0,0 +1,58 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#ifndef EESIM_TRACE_H_
+#define EESIM_TRACE_H_
+
+#include <stdio.h>
+
+// A trace is a line based script of editor events, one per line:
+//
+//   # comment
+//   new [path]              new text document (EEHOOK_POSTNEWTEXT)
+//   open <path>             load a UTF-8 file (EEHOOK_POSTLOAD)
+//   close | save            the active document
+//   activate <n>            switch to the n-th document (0-based)
+//   text <str>              replace the text of the active document
+//   type <str>              insert at the caret (EEHOOK_UPDATETEXT)
+//   caret <line> <col>      move the caret
+//   select <l1> <c1> <l2> <c2>
+//   command <cmdline>       console command (EEHOOK_RUNCOMMAND)
+//   plugin <name>           plugin command (EEHOOK_EXECUTEPLUGINCOMMAND)
+//   listplugins             EEHOOK_LISTPLUGINCOMMAND
+//   menu <label>            click a menu item (EEHOOK_APPMSG WM_COMMAND)
+//   appmsg <msg> <wp> <lp>  EEHOOK_APPMSG
+//   script <path>           EEHOOK_PREEXECUTESCRIPT
+//   popup [x y]             EEHOOK_PRETEXTMENU
+//   idle [n]                n rounds of EEHOOK_APPIDLE and EEHOOK_TEXTIDLE
+//   dofile <text>           the exported dofile() entry
+//
+// <str> accepts \n, \r, \t and \\ escapes. A recorded trace follows every
+// event with the messages the plugin sent while handling it:
+//
+//   send <target> <message> [xN]
+//
+// and replaying compares them, a mismatch counts as a divergence.
+
+typedef struct trace_stats trace_stats;
+
+trace_stats *trace_stats_new(void);
+void trace_stats_free(trace_stats *st);
+
+// record events and their sends to out (NULL stops recording)
+void trace_record(trace_stats *st, FILE *out);
+
+// runs one event line, returns 0 on success, -1 for a bad line or an event
+// that could not run (reported to stderr)
+int trace_run_line(trace_stats *st, const char *line);
+
+// runs every event of a trace file, returns the number of failed lines or -1
+// if the file cannot be read
+int trace_replay(trace_stats *st, const char *path);
+
+int trace_divergences(const trace_stats *st);
+void trace_report(const trace_stats *st, FILE *out);
+
+#endif  // EESIM_TRACE_H_
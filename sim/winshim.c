@@ -0,0 +1,916 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#define _GNU_SOURCE
+
+#include "winshim.h"
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SIM_MENU_MAGIC      0x554E454D  // "MENU"
+#define SIM_HANDLE_THREAD   1
+#define SIM_HANDLE_EVENT    2
+#define SIM_HANDLE_FIND     3
+#define EPOCH_DIFF_SECS     11644473600ULL  // 1601-01-01 to 1970-01-01
+
+struct sim_menu {
+    unsigned magic;
+    int count;
+    int cap;
+    sim_menu_item *items;
+};
+
+typedef struct {
+    int kind;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int manual_reset;
+    int signaled;
+    LPTHREAD_START_ROUTINE start;
+    LPVOID arg;
+    DIR *dir;
+    char dir_path[PATH_MAX];
+} sim_handle;
+
+static char s_root[PATH_MAX] = ".";
+static int s_verbose = 0;
+
+
+void
+winshim_set_root(const char *root)
+{
+    snprintf(s_root, sizeof(s_root), "%s", root);
+    size_t n = strlen(s_root);
+    while (n > 1 && s_root[n - 1] == '/') {
+        s_root[--n] = '\0';
+    }
+}
+
+
+const char *
+winshim_root(void)
+{
+    return s_root;
+}
+
+
+void
+winshim_set_verbose(int verbose)
+{
+    s_verbose = verbose;
+}
+
+
+char *
+winshim_map_path(const char *path, char *out, size_t size)
+{
+    size_t app_len = sizeof(SIM_APP_DIR) - 1;
+    const char *rest = path;
+    size_t n = 0;
+
+    if (strncasecmp(path, SIM_APP_DIR, app_len) == 0
+            && (path[app_len] == '\0' || path[app_len] == '\\' || path[app_len] == '/')) {
+        n = (size_t) snprintf(out, size, "%s", s_root);
+        rest = path + app_len;
+    } else if (((path[0] >= 'A' && path[0] <= 'Z') || (path[0] >= 'a' && path[0] <= 'z'))
+               && path[1] == ':') {
+        rest = path + 2;
+    }
+
+    for (; *rest && n + 1 < size; rest++) {
+        out[n++] = *rest == '\\' ? '/' : *rest;
+    }
+    out[n < size ? n : size - 1] = '\0';
+    return out;
+}
+
+
+static void *
+next_symbol(const char *name)
+{
+    void *sym = dlsym(RTLD_NEXT, name);
+    if (sym == NULL) {
+        fprintf(stderr, "eesim: cannot resolve %s\n", name);
+        abort();
+    }
+    return sym;
+}
+
+
+// libc interposition, see winshim.h
+
+FILE *
+fopen(const char *path, const char *mode)
+{
+    static FILE *(*real)(const char *, const char *) = NULL;
+    char host[PATH_MAX];
+    if (real == NULL) {
+        real = (FILE *(*)(const char *, const char *)) next_symbol("fopen");
+    }
+    return real(winshim_map_path(path, host, sizeof(host)), mode);
+}
+
+
+FILE *
+fopen64(const char *path, const char *mode)
+{
+    return fopen(path, mode);
+}
+
+
+int
+stat(const char *path, struct stat *st)
+{
+    static int (*real)(const char *, struct stat *) = NULL;
+    char host[PATH_MAX];
+    if (real == NULL) {
+        real = (int (*)(const char *, struct stat *)) next_symbol("stat");
+    }
+    return real(winshim_map_path(path, host, sizeof(host)), st);
+}
+
+
+int
+remove(const char *path)
+{
+    static int (*real)(const char *) = NULL;
+    char host[PATH_MAX];
+    if (real == NULL) {
+        real = (int (*)(const char *)) next_symbol("remove");
+    }
+    return real(winshim_map_path(path, host, sizeof(host)));
+}
+
+
+int
+rename(const char *from, const char *to)
+{
+    static int (*real)(const char *, const char *) = NULL;
+    char host_from[PATH_MAX];
+    char host_to[PATH_MAX];
+    if (real == NULL) {
+        real = (int (*)(const char *, const char *)) next_symbol("rename");
+    }
+    return real(winshim_map_path(from, host_from, sizeof(host_from)),
+                winshim_map_path(to, host_to, sizeof(host_to)));
+}
+
+
+// messages
+
+int
+MessageBoxA(HWND hwnd, const char *text, const char *caption, UINT type)
+{
+    (void) hwnd;
+    (void) type;
+    fprintf(stderr, "[%s] %s\n", caption ? caption : "MessageBox", text ? text : "");
+    return 1;
+}
+
+
+void
+OutputDebugStringA(const char *str)
+{
+    if (s_verbose) {
+        fprintf(stderr, "%s\n", str);
+    }
+}
+
+
+// modules and files
+
+DWORD
+GetModuleFileNameA(HMODULE module, char *buf, DWORD size)
+{
+    (void) module;
+    if (size == 0) {
+        return 0;
+    }
+    snprintf(buf, size, "%s", SIM_APP_EXE);
+    return (DWORD) strlen(buf);
+}
+
+
+static void
+to_filetime(FILETIME *ft, const struct timespec *ts)
+{
+    uint64_t v = ((uint64_t) ts->tv_sec + EPOCH_DIFF_SECS) * 10000000ULL
+                 + (uint64_t) ts->tv_nsec / 100;
+    ft->dwLowDateTime = (DWORD) v;
+    ft->dwHighDateTime = (DWORD) (v >> 32);
+}
+
+
+static void
+fill_attributes(const struct stat *st, WIN32_FILE_ATTRIBUTE_DATA *data)
+{
+    data->dwFileAttributes = S_ISDIR(st->st_mode) ? FILE_ATTRIBUTE_DIRECTORY
+                                                  : FILE_ATTRIBUTE_NORMAL;
+    to_filetime(&data->ftCreationTime, &st->st_ctim);
+    to_filetime(&data->ftLastAccessTime, &st->st_atim);
+    to_filetime(&data->ftLastWriteTime, &st->st_mtim);
+    data->nFileSizeHigh = (DWORD) ((uint64_t) st->st_size >> 32);
+    data->nFileSizeLow = (DWORD) st->st_size;
+}
+
+
+DWORD
+GetFileAttributesA(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return INVALID_FILE_ATTRIBUTES;
+    }
+    return S_ISDIR(st.st_mode) ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_NORMAL;
+}
+
+
+BOOL
+GetFileAttributesExA(const char *path, int level, WIN32_FILE_ATTRIBUTE_DATA *data)
+{
+    struct stat st;
+    (void) level;
+    if (stat(path, &st) != 0) {
+        return FALSE;
+    }
+    fill_attributes(&st, data);
+    return TRUE;
+}
+
+
+static BOOL
+next_entry(sim_handle *h, WIN32_FIND_DATAA *data)
+{
+    struct dirent *ent;
+    while ((ent = readdir(h->dir)) != NULL) {
+        char path[PATH_MAX];
+        struct stat st;
+        int n = snprintf(path, sizeof(path), "%s/%s", h->dir_path, ent->d_name);
+        // the mapped path is final, skip the interposed stat(); names too
+        // long for it are skipped as well
+        if (n >= (int) sizeof(path) || lstat(path, &st) != 0) {
+            continue;
+        }
+        WIN32_FILE_ATTRIBUTE_DATA attr;
+        fill_attributes(&st, &attr);
+        memset(data, 0, sizeof(*data));
+        data->dwFileAttributes = attr.dwFileAttributes;
+        data->ftCreationTime = attr.ftCreationTime;
+        data->ftLastAccessTime = attr.ftLastAccessTime;
+        data->ftLastWriteTime = attr.ftLastWriteTime;
+        data->nFileSizeHigh = attr.nFileSizeHigh;
+        data->nFileSizeLow = attr.nFileSizeLow;
+        snprintf(data->cFileName, sizeof(data->cFileName), "%s", ent->d_name);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+
+// only "dir\*" patterns, which is all lfs.list_dir() asks for
+HANDLE
+FindFirstFileA(const char *pattern, WIN32_FIND_DATAA *data)
+{
+    char host[PATH_MAX];
+    winshim_map_path(pattern, host, sizeof(host));
+    char *slash = strrchr(host, '/');
+    if (slash == NULL || strcmp(slash + 1, "*") != 0) {
+        return INVALID_HANDLE_VALUE;
+    }
+    *slash = '\0';
+
+    DIR *dir = opendir(host);
+    if (dir == NULL) {
+        return INVALID_HANDLE_VALUE;
+    }
+    sim_handle *h = (sim_handle *) calloc(1, sizeof(sim_handle));
+    if (h == NULL) {
+        closedir(dir);
+        return INVALID_HANDLE_VALUE;
+    }
+    h->kind = SIM_HANDLE_FIND;
+    h->dir = dir;
+    snprintf(h->dir_path, sizeof(h->dir_path), "%s", host);
+    if (!next_entry(h, data)) {
+        FindClose(h);
+        return INVALID_HANDLE_VALUE;
+    }
+    return h;
+}
+
+
+BOOL
+FindNextFileA(HANDLE find, WIN32_FIND_DATAA *data)
+{
+    return next_entry((sim_handle *) find, data);
+}
+
+
+BOOL
+FindClose(HANDLE find)
+{
+    sim_handle *h = (sim_handle *) find;
+    if (h == NULL || h->kind != SIM_HANDLE_FIND) {
+        return FALSE;
+    }
+    closedir(h->dir);
+    free(h);
+    return TRUE;
+}
+
+
+BOOL
+CreateDirectoryA(const char *path, void *security)
+{
+    char host[PATH_MAX];
+    (void) security;
+    return mkdir(winshim_map_path(path, host, sizeof(host)), 0755) == 0;
+}
+
+
+BOOL
+RemoveDirectoryA(const char *path)
+{
+    char host[PATH_MAX];
+    return rmdir(winshim_map_path(path, host, sizeof(host))) == 0;
+}
+
+
+BOOL
+DeleteFileA(const char *path)
+{
+    char host[PATH_MAX];
+    return unlink(winshim_map_path(path, host, sizeof(host))) == 0;
+}
+
+
+BOOL
+CopyFileA(const char *src, const char *dst, BOOL fail_if_exists)
+{
+    struct stat st;
+    if (fail_if_exists && stat(dst, &st) == 0) {
+        return FALSE;
+    }
+    FILE *in = fopen(src, "rb");
+    if (in == NULL) {
+        return FALSE;
+    }
+    FILE *out = fopen(dst, "wb");
+    if (out == NULL) {
+        fclose(in);
+        return FALSE;
+    }
+    char buf[8192];
+    size_t n;
+    int ok = 1;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        if (fwrite(buf, 1, n, out) != n) {
+            ok = 0;
+            break;
+        }
+    }
+    fclose(in);
+    return fclose(out) == 0 && ok;
+}
+
+
+BOOL
+SetCurrentDirectoryA(const char *path)
+{
+    char host[PATH_MAX];
+    return chdir(winshim_map_path(path, host, sizeof(host))) == 0;
+}
+
+
+DWORD
+GetCurrentDirectoryA(DWORD size, char *buf)
+{
+    if (getcwd(buf, size) == NULL) {
+        return 0;
+    }
+    return (DWORD) strlen(buf);
+}
+
+
+// strings, CP_ACP is UTF-8 in the simulator
+
+int
+lstrlenW(const wchar_t *str)
+{
+    return str == NULL ? 0 : (int) wcslen(str);
+}
+
+
+static int
+decode_utf8(const unsigned char *s, int len, int *cp)
+{
+    unsigned c = s[0];
+    int n;
+    unsigned v;
+
+    if (c < 0x80) {
+        *cp = (int) c;
+        return 1;
+    } else if (c >= 0xC2 && c <= 0xDF) {
+        n = 2;
+        v = c & 0x1F;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        n = 3;
+        v = c & 0x0F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        n = 4;
+        v = c & 0x07;
+    } else {
+        *cp = 0xFFFD;
+        return 1;
+    }
+    if (n > len) {
+        *cp = 0xFFFD;
+        return 1;
+    }
+    for (int i = 1; i < n; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            *cp = 0xFFFD;
+            return 1;
+        }
+        v = (v << 6) | (s[i] & 0x3F);
+    }
+    if ((n == 3 && v < 0x800) || (n == 4 && (v < 0x10000 || v > 0x10FFFF))
+            || (v >= 0xD800 && v <= 0xDFFF)) {
+        *cp = 0xFFFD;
+        return n;
+    }
+    *cp = (int) v;
+    return n;
+}
+
+
+int
+MultiByteToWideChar(UINT cp, DWORD flags, const char *str, int len,
+                    wchar_t *wstr, int wlen)
+{
+    const unsigned char *s = (const unsigned char *) str;
+    int n = 0;
+    (void) cp;
+    (void) flags;
+
+    if (len < 0) {
+        len = (int) strlen(str) + 1;
+    }
+    for (int i = 0; i < len; ) {
+        int c;
+        i += decode_utf8(s + i, len - i, &c);
+        if (wstr != NULL) {
+            if (n >= wlen) {
+                return 0;
+            }
+            wstr[n] = (wchar_t) c;
+        }
+        n++;
+    }
+    return n;
+}
+
+
+static int
+encode_utf8(unsigned c, char *out)
+{
+    if (c >= 0xD800 && c <= 0xDFFF) {
+        c = 0xFFFD;
+    }
+    if (c < 0x80) {
+        out[0] = (char) c;
+        return 1;
+    } else if (c < 0x800) {
+        out[0] = (char) (0xC0 | (c >> 6));
+        out[1] = (char) (0x80 | (c & 0x3F));
+        return 2;
+    } else if (c < 0x10000) {
+        out[0] = (char) (0xE0 | (c >> 12));
+        out[1] = (char) (0x80 | ((c >> 6) & 0x3F));
+        out[2] = (char) (0x80 | (c & 0x3F));
+        return 3;
+    } else if (c <= 0x10FFFF) {
+        out[0] = (char) (0xF0 | (c >> 18));
+        out[1] = (char) (0x80 | ((c >> 12) & 0x3F));
+        out[2] = (char) (0x80 | ((c >> 6) & 0x3F));
+        out[3] = (char) (0x80 | (c & 0x3F));
+        return 4;
+    }
+    return encode_utf8(0xFFFD, out);
+}
+
+
+int
+WideCharToMultiByte(UINT cp, DWORD flags, const wchar_t *wstr, int wlen,
+                    char *str, int len, const char *def, BOOL *used_def)
+{
+    int n = 0;
+    (void) cp;
+    (void) flags;
+    (void) def;
+
+    if (used_def != NULL) {
+        *used_def = FALSE;
+    }
+    if (wlen < 0) {
+        wlen = (int) wcslen(wstr) + 1;
+    }
+    for (int i = 0; i < wlen; i++) {
+        char buf[4];
+        int k = encode_utf8((unsigned) wstr[i], buf);
+        if (str != NULL) {
+            if (n + k > len) {
+                return 0;
+            }
+            memcpy(str + n, buf, k);
+        }
+        n += k;
+    }
+    return n;
+}
+
+
+// every code page converts as UTF-8 here, but the DBCS ones report their
+// lead bytes as Windows does, for the code that splits text by them
+BOOL
+GetCPInfo(UINT cp, CPINFO *info)
+{
+    memset(info, 0, sizeof(*info));
+    info->DefaultChar[0] = '?';
+    switch (cp) {
+    case 936:   // Simplified Chinese GBK
+    case 949:   // Korean
+    case 950:   // Traditional Chinese Big5
+        info->MaxCharSize = 2;
+        info->LeadByte[0] = 0x81;
+        info->LeadByte[1] = 0xFE;
+        break;
+    case 932:   // Japanese Shift-JIS
+        info->MaxCharSize = 2;
+        info->LeadByte[0] = 0x81;
+        info->LeadByte[1] = 0x9F;
+        info->LeadByte[2] = 0xE0;
+        info->LeadByte[3] = 0xFC;
+        break;
+    default:
+        info->MaxCharSize = 4;
+        break;
+    }
+    return TRUE;
+}
+
+
+// memory, an HGLOBAL is the block itself
+
+HGLOBAL
+GlobalAlloc(UINT flags, size_t size)
+{
+    (void) flags;
+    return calloc(1, size ? size : 1);
+}
+
+
+void *
+GlobalLock(HGLOBAL mem)
+{
+    return mem;
+}
+
+
+BOOL
+GlobalUnlock(HGLOBAL mem)
+{
+    (void) mem;
+    return TRUE;
+}
+
+
+HGLOBAL
+GlobalFree(HGLOBAL mem)
+{
+    free(mem);
+    return NULL;
+}
+
+
+// menus
+
+static sim_menu *
+to_menu(HMENU menu)
+{
+    sim_menu *m = (sim_menu *) menu;
+    return m != NULL && m->magic == SIM_MENU_MAGIC ? m : NULL;
+}
+
+
+HMENU
+CreatePopupMenu(void)
+{
+    sim_menu *m = (sim_menu *) calloc(1, sizeof(sim_menu));
+    if (m != NULL) {
+        m->magic = SIM_MENU_MAGIC;
+    }
+    return m;
+}
+
+
+BOOL
+IsMenu(HMENU menu)
+{
+    return to_menu(menu) != NULL;
+}
+
+
+int
+GetMenuItemCount(HMENU menu)
+{
+    sim_menu *m = to_menu(menu);
+    return m != NULL ? m->count : -1;
+}
+
+
+BOOL
+InsertMenuA(HMENU menu, UINT pos, UINT flags, UINT_PTR id, const char *text)
+{
+    sim_menu *m = to_menu(menu);
+    if (m == NULL) {
+        return FALSE;
+    }
+    if (!(flags & MF_BYPOSITION) || pos > (UINT) m->count) {
+        pos = (UINT) m->count;
+    }
+    if (m->count == m->cap) {
+        int cap = m->cap ? m->cap * 2 : 8;
+        sim_menu_item *items = (sim_menu_item *) realloc(m->items, cap * sizeof(sim_menu_item));
+        if (items == NULL) {
+            return FALSE;
+        }
+        m->items = items;
+        m->cap = cap;
+    }
+    memmove(m->items + pos + 1, m->items + pos, (m->count - pos) * sizeof(sim_menu_item));
+    m->items[pos].flags = flags & ~MF_BYPOSITION;
+    m->items[pos].id = id;
+    m->items[pos].text = (text != NULL && !(flags & MF_SEPARATOR)) ? strdup(text) : NULL;
+    m->count++;
+    return TRUE;
+}
+
+
+BOOL
+AppendMenuA(HMENU menu, UINT flags, UINT_PTR id, const char *text)
+{
+    return InsertMenuA(menu, (UINT) -1, flags & ~MF_BYPOSITION, id, text);
+}
+
+
+int
+winshim_menu_items(HMENU menu, const sim_menu_item **items)
+{
+    sim_menu *m = to_menu(menu);
+    if (m == NULL) {
+        *items = NULL;
+        return 0;
+    }
+    *items = m->items;
+    return m->count;
+}
+
+
+void
+winshim_menu_free(HMENU menu)
+{
+    sim_menu *m = to_menu(menu);
+    if (m == NULL) {
+        return;
+    }
+    for (int i = 0; i < m->count; i++) {
+        if (m->items[i].flags & MF_POPUP) {
+            winshim_menu_free((HMENU) m->items[i].id);
+        }
+        free(m->items[i].text);
+    }
+    free(m->items);
+    m->magic = 0;
+    free(m);
+}
+
+
+// threads and synchronization
+
+static void *
+thread_main(void *arg)
+{
+    sim_handle *h = (sim_handle *) arg;
+    h->start(h->arg);
+    return NULL;
+}
+
+
+HANDLE
+CreateThread(void *security, size_t stack_size, LPTHREAD_START_ROUTINE start,
+             LPVOID arg, DWORD flags, DWORD *thread_id)
+{
+    (void) security;
+    (void) stack_size;
+    (void) flags;
+    sim_handle *h = (sim_handle *) calloc(1, sizeof(sim_handle));
+    if (h == NULL) {
+        return NULL;
+    }
+    h->kind = SIM_HANDLE_THREAD;
+    h->start = start;
+    h->arg = arg;
+    if (pthread_create(&h->thread, NULL, thread_main, h) != 0) {
+        free(h);
+        return NULL;
+    }
+    if (thread_id != NULL) {
+        *thread_id = 0;
+    }
+    return h;
+}
+
+
+HANDLE
+CreateEventA(void *security, BOOL manual_reset, BOOL initial, const char *name)
+{
+    (void) security;
+    (void) name;
+    sim_handle *h = (sim_handle *) calloc(1, sizeof(sim_handle));
+    if (h == NULL) {
+        return NULL;
+    }
+    h->kind = SIM_HANDLE_EVENT;
+    h->manual_reset = manual_reset;
+    h->signaled = initial;
+    pthread_mutex_init(&h->mutex, NULL);
+    pthread_cond_init(&h->cond, NULL);
+    return h;
+}
+
+
+BOOL
+SetEvent(HANDLE event)
+{
+    sim_handle *h = (sim_handle *) event;
+    pthread_mutex_lock(&h->mutex);
+    h->signaled = 1;
+    pthread_cond_broadcast(&h->cond);
+    pthread_mutex_unlock(&h->mutex);
+    return TRUE;
+}
+
+
+DWORD
+WaitForSingleObject(HANDLE handle, DWORD ms)
+{
+    sim_handle *h = (sim_handle *) handle;
+    if (h->kind == SIM_HANDLE_THREAD) {
+        // only INFINITE waits on threads are used
+        pthread_join(h->thread, NULL);
+        h->thread = 0;
+        return WAIT_OBJECT_0;
+    }
+
+    DWORD rc = WAIT_OBJECT_0;
+    pthread_mutex_lock(&h->mutex);
+    if (ms == INFINITE) {
+        while (!h->signaled) {
+            pthread_cond_wait(&h->cond, &h->mutex);
+        }
+    } else {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += ms / 1000;
+        ts.tv_nsec += (long) (ms % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        while (!h->signaled) {
+            if (pthread_cond_timedwait(&h->cond, &h->mutex, &ts) == ETIMEDOUT) {
+                rc = WAIT_TIMEOUT;
+                break;
+            }
+        }
+    }
+    if (rc == WAIT_OBJECT_0 && !h->manual_reset) {
+        h->signaled = 0;
+    }
+    pthread_mutex_unlock(&h->mutex);
+    return rc;
+}
+
+
+BOOL
+CloseHandle(HANDLE handle)
+{
+    sim_handle *h = (sim_handle *) handle;
+    if (h == NULL) {
+        return FALSE;
+    }
+    if (h->kind == SIM_HANDLE_THREAD && h->thread != 0) {
+        pthread_detach(h->thread);
+    } else if (h->kind == SIM_HANDLE_EVENT) {
+        pthread_mutex_destroy(&h->mutex);
+        pthread_cond_destroy(&h->cond);
+    }
+    free(h);
+    return TRUE;
+}
+
+
+void
+Sleep(DWORD ms)
+{
+    struct timespec ts = { ms / 1000, (long) (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+
+DWORD
+GetCurrentProcessId(void)
+{
+    return (DWORD) getpid();
+}
+
+
+DWORD
+GetCurrentThreadId(void)
+{
+    return (DWORD) syscall(SYS_gettid);
+}
+
+
+LONG
+InterlockedExchange(volatile LONG *target, LONG value)
+{
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+
+LONG
+InterlockedCompareExchange(volatile LONG *target, LONG value, LONG comparand)
+{
+    __atomic_compare_exchange_n(target, &comparand, value, 0,
+                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comparand;
+}
+
+
+LONG
+InterlockedIncrement(volatile LONG *target)
+{
+    return __atomic_add_fetch(target, 1, __ATOMIC_SEQ_CST);
+}
+
+
+LONG
+InterlockedDecrement(volatile LONG *target)
+{
+    return __atomic_sub_fetch(target, 1, __ATOMIC_SEQ_CST);
+}
+
+
+// time
+
+BOOL
+QueryPerformanceCounter(LARGE_INTEGER *counter)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    counter->QuadPart = (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    return TRUE;
+}
+
+
+BOOL
+QueryPerformanceFrequency(LARGE_INTEGER *freq)
+{
+    freq->QuadPart = 1000000000LL;
+    return TRUE;
+}
+
+
+DWORD
+GetTickCount(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (DWORD) (ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
@@ -0,0 +1,41 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#ifndef EESIM_WINSHIM_H_
+#define EESIM_WINSHIM_H_
+
+#include <windows.h>
+
+// Windows paths seen by the plugin are mapped onto the host file system:
+// anything below the virtual app directory (SIM_APP_DIR) is looked up
+// below the simulator root, a drive letter elsewhere is dropped, and
+// backslashes become slashes. fopen(), stat(), remove() and rename() are
+// interposed with the same mapping so LuaJIT's loaders and io library
+// work on the plugin's paths too.
+#define SIM_APP_DIR     "C:\\EverEdit"
+#define SIM_APP_EXE     SIM_APP_DIR "\\EverEdit.exe"
+
+void winshim_set_root(const char *root);
+const char *winshim_root(void);
+
+// Maps a Windows path to a host path, returns out.
+char *winshim_map_path(const char *path, char *out, size_t size);
+
+// OutputDebugStringA/MessageBoxA go to stderr when verbose.
+void winshim_set_verbose(int verbose);
+
+// menu items, for the host to look up and click them
+typedef struct sim_menu sim_menu;
+
+typedef struct {
+    UINT flags;
+    UINT_PTR id;
+    char *text;
+} sim_menu_item;
+
+int winshim_menu_items(HMENU menu, const sim_menu_item **items);
+void winshim_menu_free(HMENU menu);
+
+#endif  // EESIM_WINSHIM_H_
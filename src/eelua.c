@@ -5,14 +5,51 @@
 
 #include "eelua.h"
 
+#include <stdio.h>
+
 #include "lua.h"
 #include "lauxlib.h"
 #include "lualib.h"
 
 #include "util.h"
+#include "lua_helper.h"
+#include "mempool.h"
+#include "gc_idle.h"
+#include "worker.h"
+#include "hooks.h"
+#include "errqueue.h"
+#include "profiler.h"
+#include "latency.h"
+#include "watchdog.h"
+#include "transcode.h"
+#include "journal.h"
+#include "textview.h"
 
 #define LOG_TAG     "eelua"
 
+#define MAX_STARTUP_PHASES  256
+
+typedef struct {
+    char name[96];
+    double elapsed_ms;
+} startup_phase;
+
+static startup_phase s_startup_phases[MAX_STARTUP_PHASES];
+static int s_startup_phase_nr = 0;
+
+
+void
+eelua_startup_record(const char *phase, double elapsed_ms)
+{
+    if (s_startup_phase_nr >= MAX_STARTUP_PHASES) {
+        return;
+    }
+    startup_phase *p = &s_startup_phases[s_startup_phase_nr++];
+    snprintf(p->name, sizeof(p->name), "%s", phase);
+    p->elapsed_ms = elapsed_ms;
+}
+
+
 static int
 Leelua_dprint(lua_State *L)
 {
@@ -22,17 +59,125 @@ Leelua_dprint(lua_State *L)
 }
 
 
+static int
+Leelua_loadfile(lua_State *L)
+{
+    const char *fname = luaL_checkstring(L, 1);
+    if (luaH_loadfile(L, fname) != LUA_OK) {
+        lua_pushnil(L);
+        lua_insert(L, -2);
+        return 2;
+    }
+    return 1;
+}
+
+
+static int
+Leelua_dofile(lua_State *L)
+{
+    const char *fname = luaL_checkstring(L, 1);
+    int n = lua_gettop(L);
+    if (luaH_loadfile(L, fname) != LUA_OK) {
+        lua_error(L);
+    }
+    lua_call(L, 0, LUA_MULTRET);
+    return lua_gettop(L) - n;
+}
+
+
+static int
+Leelua_clock(lua_State *L)
+{
+    lua_pushnumber(L, GetClockMs());
+    return 1;
+}
+
+
+static int
+Leelua_startup_record(lua_State *L)
+{
+    const char *phase = luaL_checkstring(L, 1);
+    double elapsed_ms = luaL_checknumber(L, 2);
+    eelua_startup_record(phase, elapsed_ms);
+    return 0;
+}
+
+
+static int
+Leelua_startup_profile(lua_State *L)
+{
+    lua_createtable(L, s_startup_phase_nr, 0);
+    for (int i = 0; i < s_startup_phase_nr; i++) {
+        lua_createtable(L, 0, 3);
+        lua_pushstring(L, s_startup_phases[i].name);
+        lua_setfield(L, -2, "name");
+        lua_pushnumber(L, s_startup_phases[i].elapsed_ms);
+        lua_setfield(L, -2, "ms");
+        lua_pushinteger(L, i + 1);
+        lua_setfield(L, -2, "seq");
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+
+
+static int
+Leelua_mem_stats(lua_State *L)
+{
+    if (mempool_pushstats(L) == 0) {
+        lua_createtable(L, 0, 2);
+        lua_pushliteral(L, "default");
+        lua_setfield(L, -2, "allocator");
+        lua_pushnumber(L, lua_gc(L, LUA_GCCOUNT, 0) * 1024.0
+                          + lua_gc(L, LUA_GCCOUNTB, 0));
+        lua_setfield(L, -2, "live_bytes");
+    }
+    return 1;
+}
+
+
+// eelua.call_entry(name, f, ...) calls f like pcall, as entry point name:
+// it is timed into eelua.stats() and runs under the watchdog budget for
+// name. On error returns false and the message with a traceback.
+static int
+Leelua_call_entry(lua_State *L)
+{
+    luaL_checkstring(L, 1);
+    luaL_checkany(L, 2);
+    // name stays at index 1 for the whole call, so the pointer is stable
+    int rc = luaH_docall(L, lua_gettop(L) - 2, LUA_MULTRET, lua_tostring(L, 1));
+    lua_pushboolean(L, rc == LUA_OK);
+    lua_insert(L, 2);
+    return lua_gettop(L) - 1;
+}
+
+
 static luaL_Reg  funcs[] = {
     { "dprint", Leelua_dprint },
+    { "loadfile", Leelua_loadfile },
+    { "dofile", Leelua_dofile },
+    { "clock", Leelua_clock },
+    { "startup_record", Leelua_startup_record },
+    { "startup_profile", Leelua_startup_profile },
+    { "mem_stats", Leelua_mem_stats },
+    { "call_entry", Leelua_call_entry },
     { NULL, NULL }
 };
 
 
-int
-luaopen_eelua(lua_State *L)
-{
-    luaL_register(L, "eelua", funcs);
+// subset that is safe to use from worker threads
+static luaL_Reg  worker_funcs[] = {
+    { "dprint", Leelua_dprint },
+    { "loadfile", Leelua_loadfile },
+    { "dofile", Leelua_dofile },
+    { "clock", Leelua_clock },
+    { NULL, NULL }
+};
+
 
+static void
+set_info_fields(lua_State *L)
+{
 #if defined(_M_X64) || defined(__x86_64__)
     lua_pushboolean(L, 1);
 #else
@@ -50,6 +195,37 @@ luaopen_eelua(lua_State *L)
     lua_pushliteral(L, "_VERSION");
     lua_pushliteral(L, EELUA_VERSION);
     lua_rawset(L, -3);
+}
+
+
+int
+luaopen_eelua_worker(lua_State *L)
+{
+    luaL_register(L, "eelua", worker_funcs);
+    transcode_register(L);
+    textview_register(L);
+    set_info_fields(L);
+    lua_pushboolean(L, 1);
+    lua_setfield(L, -2, "is_worker");
+    return 1;
+}
+
+
+int
+luaopen_eelua(lua_State *L)
+{
+    luaL_register(L, "eelua", funcs);
+    gcidle_register(L);
+    worker_register(L);
+    hooks_register(L);
+    errqueue_register(L);
+    profiler_register(L);
+    latency_register(L);
+    watchdog_register(L);
+    transcode_register(L);
+    journal_register(L);
+    textview_register(L);
+    set_info_fields(L);
 
     return 1;
 }
@@ -10,5 +10,8 @@
 #include "lua.h"
 
 int luaopen_eelua(lua_State *L);
+int luaopen_eelua_worker(lua_State *L);
+
+void eelua_startup_record(const char *phase, double elapsed_ms);
 
 #endif  // EELUA_EELUA_H_
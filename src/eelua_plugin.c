@@ -13,12 +13,21 @@
 #include "util.h"
 #include "eelua.h"
 #include "lua_helper.h"
+#include "mempool.h"
+#include "worker.h"
+#include "errqueue.h"
+#include "profiler.h"
+#include "latency.h"
+#include "watchdog.h"
+#include "journal.h"
+#include "hooks.h"
 
 #define LOG_TAG     "eelua_plugin"
 
 EE_Context *g_ee_context = NULL;
 HMODULE g_ee_module = NULL;
 lua_State *g_lua_vm = NULL;
+mempool *g_mempool = NULL;
 
 static int
 run_eelua_init(lua_State *L)
@@ -26,18 +35,21 @@ run_eelua_init(lua_State *L)
     char *p = NULL;
     char buf[PATH_MAX] = { 0 };
     const char fpath[] = "\\eelua\\eelua_init.lua";
+    const char cache_dir[] = "\\eelua\\cache";
 
     memset(buf, '\0', sizeof(buf));
     DWORD ncopy = GetModuleFileNameA(g_ee_context->hModule, buf, MAX_PATH);
     if (ncopy > 0) {
         p = strrchr(buf, '\\');
-        if (p != NULL) {
-            strcpy(p, fpath);
-            *(p + sizeof(fpath) - 1) = '\0';
-        }
     }
 
     if (p != NULL) {
+        strcpy(p, cache_dir);
+        CreateDirectoryA(buf, NULL);
+        luaH_setcachedir(buf);
+
+        strcpy(p, fpath);
+        *(p + sizeof(fpath) - 1) = '\0';
         return luaH_dofile(L, buf);
     } else {
         return luaH_dofile(L, "./eelua/eelua_init.lua");
@@ -49,17 +61,28 @@ DWORD
 EE_PluginInit(EE_Context *context)
 {
     LOGI("EE_PluginInit");
+    double t_init = GetClockMs();
+    double t0 = t_init;
     g_ee_context = context;
-    g_lua_vm = lua_open();
+    g_mempool = mempool_new();
+    g_lua_vm = mempool_newstate(g_mempool);
+    eelua_startup_record("c: lua_open", GetClockMs() - t0);
     lua_State *L = g_lua_vm;
     if (L != NULL) {
+        t0 = GetClockMs();
         luaL_openlibs(L);
+        eelua_startup_record("c: luaL_openlibs", GetClockMs() - t0);
+        t0 = GetClockMs();
         luaopen_eelua(L);
         lua_pushlightuserdata(L, context);
         lua_setfield(L, -2, "_ee_context");
         lua_pop(L, 1);
+        eelua_startup_record("c: luaopen_eelua", GetClockMs() - t0);
+        t0 = GetClockMs();
         run_eelua_init(L);
+        eelua_startup_record("c: eelua_init.lua", GetClockMs() - t0);
     }
+    eelua_startup_record("c: EE_PluginInit", GetClockMs() - t_init);
     return 0;
 }
 
@@ -68,9 +91,19 @@ DWORD
 EE_PluginUninit()
 {
     LOGI("EE_PluginUninit");
+    worker_shutdown();
+    watchdog_shutdown();
     if (g_lua_vm != NULL) {
+        profiler_shutdown(g_lua_vm);
         lua_close(g_lua_vm);
+        g_lua_vm = NULL;
     }
+    mempool_free(g_mempool);
+    g_mempool = NULL;
+    errqueue_shutdown();
+    latency_shutdown();
+    journal_shutdown();
+    hooks_shutdown();
     return 0;
 }
 
@@ -91,7 +124,7 @@ dofile(EE_Context *context, LPRECT rect, const wchar_t *text)
     lua_pushlightuserdata(L, context);
     lua_pushlightuserdata(L, rect);
     lua_pushlightuserdata(L, (void *) text);
-    int rc = luaH_docall(L, 3, 0, NULL);
+    int rc = luaH_docall(L, 3, 0, "OnDoFile");
     if (rc != LUA_OK) {
         const char *msg = lua_tostring(L, -1);
         ReportLuaError(msg);
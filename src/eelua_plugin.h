@@ -10,6 +10,8 @@
 
 #define EELUA_EXPORT    __declspec(dllexport)
 
+extern EE_Context *g_ee_context;
+
 EELUA_EXPORT DWORD EE_PluginInit(EE_Context *context);
 EELUA_EXPORT DWORD EE_PluginUninit();
 EELUA_EXPORT DWORD EE_PluginInfo(wchar_t *text, int len);
@@ -0,0 +1,430 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#include "errqueue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "util.h"
+#include "eelua_plugin.h"
+
+#define LOG_TAG     "errqueue"
+
+#define ERRQ_RING_SIZE      32
+#define ERRQ_DEDUP_SIZE     64
+#define ERRQ_MSG_MAX        4096
+#define ERRQ_LINE_PREFIX    "[eelua] "
+
+typedef struct {
+    unsigned hash;
+    unsigned repeats;
+    double first_ms;
+} dedup_slot;
+
+typedef struct {
+    char *msg;
+    unsigned repeats;
+} ring_entry;
+
+static struct {
+    double dedup_ms;
+    double rate;
+    double burst;
+    int dialog;
+    int idle_hooked;
+} s_conf = { 5000.0, 2.0, 5.0, 0, 0 };
+
+static struct {
+    double reported;
+    double queued;
+    double duplicates;
+    double rate_limited;
+    double overflowed;
+    double flushed;
+} s_stats;
+
+static volatile LONG s_lock = 0;
+static ring_entry s_ring[ERRQ_RING_SIZE];
+static unsigned s_head = 0;
+static unsigned s_count = 0;
+static dedup_slot s_seen[ERRQ_DEDUP_SIZE];
+static double s_tokens = -1;
+static double s_tokens_ms = 0;
+static unsigned s_suppressed = 0;
+static unsigned s_repeats = 0;
+static int s_flushing = 0;
+static int s_dialog_shown = 0;
+
+
+static void
+lock(void)
+{
+    while (InterlockedCompareExchange(&s_lock, 1, 0) != 0) {
+        Sleep(0);
+    }
+}
+
+
+static void
+unlock(void)
+{
+    InterlockedExchange(&s_lock, 0);
+}
+
+
+static unsigned
+hash_msg(const char *msg)
+{
+    unsigned h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *) msg; *p; p++) {
+        h = (h ^ *p) * 16777619u;
+    }
+    return h;
+}
+
+
+// Returns 1 when the message was reported recently and should be dropped,
+// otherwise *repeats gets the number of copies suppressed since then.
+// Every dropped copy is counted once: with its message when that comes
+// again, or else in the "suppressed" line (see expire_repeats).
+static int
+is_duplicate(unsigned h, double now, unsigned *repeats)
+{
+    dedup_slot *slot = &s_seen[h % ERRQ_DEDUP_SIZE];
+    if (slot->hash == h && slot->first_ms != 0 &&
+        now - slot->first_ms < s_conf.dedup_ms) {
+        slot->repeats++;
+        s_repeats++;
+        return 1;
+    }
+    if (slot->hash == h) {
+        *repeats = slot->repeats;
+    } else {
+        // another message takes the slot
+        *repeats = 0;
+        s_suppressed += slot->repeats;
+    }
+    s_repeats -= slot->repeats;
+    slot->hash = h;
+    slot->repeats = 0;
+    slot->first_ms = now;
+    return 0;
+}
+
+
+static int
+take_token(double now)
+{
+    if (s_tokens < 0) {
+        s_tokens = s_conf.burst;
+    } else {
+        s_tokens += (now - s_tokens_ms) * s_conf.rate / 1000.0;
+        if (s_tokens > s_conf.burst) {
+            s_tokens = s_conf.burst;
+        }
+    }
+    s_tokens_ms = now;
+    if (s_tokens < 1.0) {
+        return 0;
+    }
+    s_tokens -= 1.0;
+    return 1;
+}
+
+
+// Moves the copies of messages that did not come again within dedup_ms
+// into the "suppressed" count. Called with the lock held.
+static void
+expire_repeats(double now)
+{
+    for (int i = 0; i < ERRQ_DEDUP_SIZE && s_repeats > 0; i++) {
+        dedup_slot *slot = &s_seen[i];
+        if (slot->repeats > 0 && now - slot->first_ms >= s_conf.dedup_ms) {
+            s_suppressed += slot->repeats;
+            s_repeats -= slot->repeats;
+            slot->repeats = 0;
+        }
+    }
+}
+
+
+static LONG_PTR
+OnAppIdle(HWND hwnd, HWND frame)
+{
+    if (s_count > 0 || s_suppressed > 0 || s_repeats > 0) {
+        errqueue_flush();
+    }
+    return 0;
+}
+
+
+void
+errqueue_push(const char *msg)
+{
+    if (msg == NULL) {
+        msg = "(error object is not a string)";
+    }
+    // the debugger output is cheap and never blocks, keep every copy there
+    OutputDebugStringA(msg);
+
+    size_t len = strlen(msg);
+    if (len > ERRQ_MSG_MAX) {
+        len = ERRQ_MSG_MAX;
+    }
+    char *copy = (char *) malloc(len + 1);
+    if (copy != NULL) {
+        memcpy(copy, msg, len);
+        copy[len] = '\0';
+    }
+
+    unsigned h = hash_msg(msg);
+    double now = GetClockMs();
+    unsigned repeats = 0;
+
+    lock();
+    s_stats.reported += 1;
+    if (is_duplicate(h, now, &repeats)) {
+        s_stats.duplicates += 1;
+    } else if (!take_token(now)) {
+        s_stats.rate_limited += 1;
+        s_suppressed++;
+    } else if (copy != NULL) {
+        if (s_count == ERRQ_RING_SIZE) {
+            // drop the oldest, the newest error is the most useful one
+            free(s_ring[s_head].msg);
+            s_head = (s_head + 1) % ERRQ_RING_SIZE;
+            s_count--;
+            s_stats.overflowed += 1;
+            s_suppressed++;
+        }
+        ring_entry *e = &s_ring[(s_head + s_count) % ERRQ_RING_SIZE];
+        e->msg = copy;
+        e->repeats = repeats;
+        s_count++;
+        s_stats.queued += 1;
+        copy = NULL;
+    }
+    unlock();
+
+    free(copy);
+
+    if (!s_conf.idle_hooked && g_ee_context != NULL) {
+        s_conf.idle_hooked = 1;
+        SendMessageA(g_ee_context->hMain, EEM_SETHOOK, EEHOOK_APPIDLE,
+                     (LPARAM) OnAppIdle);
+    }
+}
+
+
+static void
+output_line(const char *text)
+{
+    if (g_ee_context == NULL) {
+        OutputDebugStringA(text);
+        return;
+    }
+
+    int len = (int) strlen(text);
+    int wlen = MultiByteToWideChar(CP_ACP, 0, text, len, NULL, 0);
+    wchar_t *wbuf = (wchar_t *) malloc((wlen + 1) * sizeof(wchar_t));
+    if (wbuf == NULL) {
+        return;
+    }
+    MultiByteToWideChar(CP_ACP, 0, text, len, wbuf, wlen);
+    wbuf[wlen] = L'\0';
+    SendMessageA(g_ee_context->hMain, EEM_OUTPUTTEXT, (WPARAM) wbuf, wlen);
+    free(wbuf);
+}
+
+
+int
+errqueue_flush(void)
+{
+    char buf[ERRQ_MSG_MAX + 128];
+    int n = 0;
+
+    if (s_flushing) {
+        return 0;
+    }
+    s_flushing = 1;
+
+    for (;;) {
+        ring_entry e;
+        lock();
+        if (s_count == 0) {
+            unlock();
+            break;
+        }
+        e = s_ring[s_head];
+        s_ring[s_head].msg = NULL;
+        s_head = (s_head + 1) % ERRQ_RING_SIZE;
+        s_count--;
+        unlock();
+
+        if (e.repeats > 0) {
+            snprintf(buf, sizeof(buf), ERRQ_LINE_PREFIX "%s\n(seen %u more times since last reported)\n",
+                     e.msg, e.repeats);
+        } else {
+            snprintf(buf, sizeof(buf), ERRQ_LINE_PREFIX "%s\n", e.msg);
+        }
+        free(e.msg);
+        output_line(buf);
+        n++;
+    }
+
+    lock();
+    expire_repeats(GetClockMs());
+    unsigned suppressed = s_suppressed;
+    s_suppressed = 0;
+    s_stats.flushed += n;
+    unlock();
+
+    if (suppressed > 0) {
+        snprintf(buf, sizeof(buf),
+                 ERRQ_LINE_PREFIX "%u more errors suppressed (duplicates or rate limit)\n",
+                 suppressed);
+        output_line(buf);
+    }
+
+    if (n > 0 && s_conf.dialog && !s_dialog_shown) {
+        s_dialog_shown = 1;
+        MessageBoxA(g_ee_context ? g_ee_context->hMain : NULL,
+                    "Lua errors were reported, see the output window for details.\n"
+                    "This dialog is only shown once.",
+                    "[eelua] Error", MB_OK|MB_ICONERROR);
+    }
+
+    s_flushing = 0;
+    return n;
+}
+
+
+void
+errqueue_shutdown(void)
+{
+    lock();
+    while (s_count > 0) {
+        free(s_ring[s_head].msg);
+        s_ring[s_head].msg = NULL;
+        s_head = (s_head + 1) % ERRQ_RING_SIZE;
+        s_count--;
+    }
+    s_head = 0;
+    memset(s_seen, 0, sizeof(s_seen));
+    s_tokens = -1;
+    s_tokens_ms = 0;
+    s_suppressed = 0;
+    s_repeats = 0;
+    s_dialog_shown = 0;
+    unlock();
+
+    // the next push after a restart hooks the idle tick again
+    if (s_conf.idle_hooked && g_ee_context != NULL) {
+        SendMessageA(g_ee_context->hMain, EEM_SETHOOK, EEHOOK_REMOVE, (LPARAM) OnAppIdle);
+    }
+    s_conf.idle_hooked = 0;
+}
+
+
+static double
+opt_number(lua_State *L, const char *key, double def)
+{
+    lua_getfield(L, 1, key);
+    double v = lua_isnil(L, -1) ? def : luaL_checknumber(L, -1);
+    lua_pop(L, 1);
+    return v;
+}
+
+
+// eelua.error_report({ dedup_ms=, rate=, burst=, dialog= }), rate is the
+// number of errors per second that reach the output window after a burst.
+static int
+Leelua_error_report(lua_State *L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    s_conf.dedup_ms = opt_number(L, "dedup_ms", s_conf.dedup_ms);
+    s_conf.rate = opt_number(L, "rate", s_conf.rate);
+    s_conf.burst = opt_number(L, "burst", s_conf.burst);
+    if (s_conf.burst < 1) {
+        s_conf.burst = 1;
+    }
+    lua_getfield(L, 1, "dialog");
+    if (!lua_isnil(L, -1)) {
+        s_conf.dialog = lua_toboolean(L, -1);
+        s_dialog_shown = 0;
+    }
+    lua_pop(L, 1);
+    return 0;
+}
+
+
+static int
+Leelua_error_stats(lua_State *L)
+{
+    int reset = lua_toboolean(L, 1);
+
+    lock();
+    unsigned pending = s_count;
+    if (reset) {
+        memset(&s_stats, 0, sizeof(s_stats));
+    }
+    unlock();
+
+    lua_createtable(L, 0, 8);
+    lua_pushnumber(L, s_stats.reported);
+    lua_setfield(L, -2, "reported");
+    lua_pushnumber(L, s_stats.queued);
+    lua_setfield(L, -2, "queued");
+    lua_pushnumber(L, s_stats.duplicates);
+    lua_setfield(L, -2, "duplicates");
+    lua_pushnumber(L, s_stats.rate_limited);
+    lua_setfield(L, -2, "rate_limited");
+    lua_pushnumber(L, s_stats.overflowed);
+    lua_setfield(L, -2, "overflowed");
+    lua_pushnumber(L, s_stats.flushed);
+    lua_setfield(L, -2, "flushed");
+    lua_pushinteger(L, pending);
+    lua_setfield(L, -2, "pending");
+    lua_pushboolean(L, s_conf.dialog);
+    lua_setfield(L, -2, "dialog");
+    return 1;
+}
+
+
+// eelua.error_push(msg) reports an error of the Lua side through the
+// queue, like the errors of the entry points.
+static int
+Leelua_error_push(lua_State *L)
+{
+    errqueue_push(luaL_checkstring(L, 1));
+    return 0;
+}
+
+
+static int
+Leelua_error_flush(lua_State *L)
+{
+    lua_pushinteger(L, errqueue_flush());
+    return 1;
+}
+
+
+void
+errqueue_register(lua_State *L)
+{
+    lua_pushcfunction(L, Leelua_error_report);
+    lua_setfield(L, -2, "error_report");
+    lua_pushcfunction(L, Leelua_error_stats);
+    lua_setfield(L, -2, "error_stats");
+    lua_pushcfunction(L, Leelua_error_push);
+    lua_setfield(L, -2, "error_push");
+    lua_pushcfunction(L, Leelua_error_flush);
+    lua_setfield(L, -2, "error_flush");
+}
@@ -0,0 +1,31 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#ifndef EELUA_ERRQUEUE_H_
+#define EELUA_ERRQUEUE_H_
+
+#include "config.h"
+#include "lua.h"
+
+// Non-blocking error reporting. Errors are deduplicated by message hash,
+// rate limited with a token bucket and kept in a bounded ring that is
+// flushed to the output window from EEHOOK_APPIDLE, so a handler failing
+// on every keystroke never stalls the message loop.
+
+// Queues an error message, safe to call from any thread.
+void errqueue_push(const char *msg);
+
+// Writes queued errors to the output window, returns the number written.
+int errqueue_flush(void);
+
+// Drops everything still queued, forgets the messages seen and the rate
+// limit, and takes the idle hook out.
+void errqueue_shutdown(void);
+
+// Registers eelua.error_report(), eelua.error_stats(), eelua.error_push()
+// and eelua.error_flush() into the table on top.
+void errqueue_register(lua_State *L);
+
+#endif  // EELUA_ERRQUEUE_H_
@@ -0,0 +1,403 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#include "gc_idle.h"
+
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "util.h"
+#include "eelua_plugin.h"
+
+#define LOG_TAG     "gc_idle"
+
+#define NBUCKETS    9
+
+#define SENTINEL_MT "eelua.gc_idle.sentinel"
+
+// upper bounds (ms) of the pause duration histograms, last one is open
+static const double bucket_bounds[NBUCKETS - 1] = {
+    0.1, 0.25, 0.5, 1, 2, 4, 8, 16
+};
+
+static struct {
+    lua_State *L;
+    int enabled;
+    int hooks_installed;
+    int text_idle;
+    int pause;
+    int stepmul;
+    int step_kb;
+    int idle_start;
+    int hold_kb;
+    double budget_ms;
+} s_conf = { NULL, 0, 0, 0, 400, 200, 8, 50, 1024, 2.0 };
+
+// What the collector is doing, as far as can be seen from outside:
+// a finalizer-only sentinel is collected at the end of every cycle.
+static struct {
+    int sentinel;
+    int in_cycle;
+    int cycle_kb;       // GCCOUNT when the last cycle ended
+    int threshold_kb;   // where the next one starts by itself
+    int depth;          // nested hook calls
+    int holding;
+    int hook_kb;        // GCCOUNT when the outermost hook was entered
+} s_gc;
+
+typedef struct {
+    double count;
+    double total_ms;
+    double max_ms;
+    double last_ms;
+    double buckets[NBUCKETS];
+} pause_hist;
+
+static struct {
+    pause_hist idle;
+    double steps;
+    double cycles;
+    double skipped;
+    pause_hist hook;
+    double over;
+} s_stats;
+
+
+static void
+record_pause(pause_hist *h, double ms)
+{
+    int i = 0;
+    while (i < NBUCKETS - 1 && ms > bucket_bounds[i]) {
+        i++;
+    }
+    h->buckets[i] += 1;
+    h->count += 1;
+    h->total_ms += ms;
+    h->last_ms = ms;
+    if (ms > h->max_ms) {
+        h->max_ms = ms;
+    }
+}
+
+
+static void
+new_sentinel(lua_State *L)
+{
+    lua_newuserdata(L, 1);
+    luaL_getmetatable(L, SENTINEL_MT);
+    lua_setmetatable(L, -2);
+    lua_pop(L, 1);
+    s_gc.sentinel = 1;
+}
+
+
+static void
+cycle_ended(lua_State *L)
+{
+    s_gc.cycle_kb = lua_gc(L, LUA_GCCOUNT, 0);
+    s_gc.threshold_kb = (int) ((double) s_gc.cycle_kb * s_conf.pause / 100);
+    s_gc.in_cycle = 0;
+}
+
+
+// __gc of the sentinel: a cycle has just ended, leave another one for
+// the next.
+static int
+sentinel_gc(lua_State *L)
+{
+    s_gc.sentinel = 0;
+    if (s_conf.enabled) {
+        cycle_ended(L);
+        new_sentinel(L);
+    }
+    return 0;
+}
+
+
+// Moves the point where the collector next steps by itself to kb, by
+// restarting it with a pause that lands there.
+static void
+set_threshold(lua_State *L, int kb)
+{
+    int total_kb = lua_gc(L, LUA_GCCOUNT, 0);
+    int pause = (int) ((double) kb * 100 / (total_kb > 0 ? total_kb : 1));
+    int old = lua_gc(L, LUA_GCSETPAUSE, pause);
+    lua_gc(L, LUA_GCRESTART, -1);
+    lua_gc(L, LUA_GCSETPAUSE, old);
+}
+
+
+double
+gcidle_step(lua_State *L, double budget_ms)
+{
+    int steps = 0;
+    int cycles = 0;
+    double t0 = GetClockMs();
+    double elapsed = 0;
+
+    do {
+        steps++;
+        if (lua_gc(L, LUA_GCSTEP, s_conf.step_kb)) {
+            // a cycle just finished, nothing left to do until the next one
+            cycles++;
+            elapsed = GetClockMs() - t0;
+            break;
+        }
+        elapsed = GetClockMs() - t0;
+    } while (elapsed < budget_ms);
+
+    record_pause(&s_stats.idle, elapsed);
+    s_stats.steps += steps;
+    s_stats.cycles += cycles;
+    s_gc.in_cycle = cycles == 0;
+    return elapsed;
+}
+
+
+// A step on a paused collector starts the next cycle, so idle time only
+// goes to one that is running or is idle_start % of the way to its
+// threshold.
+static void
+idle_slice(lua_State *L)
+{
+    if (!s_gc.in_cycle) {
+        int kb = lua_gc(L, LUA_GCCOUNT, 0);
+        int start = s_gc.cycle_kb
+                    + (int) ((double) (s_gc.threshold_kb - s_gc.cycle_kb) * s_conf.idle_start / 100);
+        if (kb < start) {
+            s_stats.skipped += 1;
+            return;
+        }
+    }
+    gcidle_step(L, s_conf.budget_ms);
+}
+
+
+void
+gcidle_hook_enter(lua_State *L)
+{
+    if (s_gc.depth++ > 0 || !s_conf.enabled || L != s_conf.L) {
+        return;
+    }
+    int kb = lua_gc(L, LUA_GCCOUNT, 0);
+    if (kb >= s_gc.threshold_kb) {
+        s_gc.in_cycle = 1;
+    }
+    int hold = kb + s_conf.hold_kb;
+    s_gc.hook_kb = kb;
+    s_gc.holding = 1;
+    set_threshold(L, s_gc.in_cycle || hold > s_gc.threshold_kb ? hold : s_gc.threshold_kb);
+}
+
+
+void
+gcidle_hook_leave(lua_State *L)
+{
+    if (--s_gc.depth > 0 || !s_gc.holding) {
+        return;
+    }
+    s_gc.holding = 0;
+    if (!s_conf.enabled) {
+        lua_gc(L, LUA_GCRESTART, -1);
+        return;
+    }
+
+    int kb = lua_gc(L, LUA_GCCOUNT, 0);
+    int grown = kb - s_gc.hook_kb;
+    if (grown > s_conf.hold_kb) {
+        // the collector stepped inside the hook after all
+        s_stats.over += 1;
+    }
+    if (!s_gc.in_cycle && kb < s_gc.threshold_kb) {
+        set_threshold(L, s_gc.threshold_kb);
+    } else if (grown > 0) {
+        // the work the hook's allocations would have paid for as it ran
+        double t0 = GetClockMs();
+        s_gc.in_cycle = !lua_gc(L, LUA_GCSTEP, grown);
+        record_pause(&s_stats.hook, GetClockMs() - t0);
+    } else {
+        // running but owed nothing: step again on the next allocation
+        set_threshold(L, kb);
+    }
+}
+
+
+static LONG_PTR
+OnAppIdle(HWND hwnd, HWND frame)
+{
+    if (s_conf.enabled && s_conf.L != NULL) {
+        idle_slice(s_conf.L);
+    }
+    return 0;
+}
+
+
+static LONG_PTR
+OnTextIdle(HWND hwnd)
+{
+    if (s_conf.enabled && s_conf.text_idle && s_conf.L != NULL) {
+        idle_slice(s_conf.L);
+    }
+    return 0;
+}
+
+
+static void
+install_hooks(void)
+{
+    if (s_conf.hooks_installed || g_ee_context == NULL) {
+        return;
+    }
+    SendMessageA(g_ee_context->hMain, EEM_SETHOOK, EEHOOK_APPIDLE,
+                 (LPARAM) OnAppIdle);
+    SendMessageA(g_ee_context->hMain, EEM_SETHOOK, EEHOOK_TEXTIDLE,
+                 (LPARAM) OnTextIdle);
+    s_conf.hooks_installed = 1;
+}
+
+
+static int
+opt_int(lua_State *L, const char *key, int def)
+{
+    lua_getfield(L, 1, key);
+    int v = lua_isnil(L, -1) ? def : (int) luaL_checkinteger(L, -1);
+    lua_pop(L, 1);
+    return v;
+}
+
+
+static double
+opt_number(lua_State *L, const char *key, double def)
+{
+    lua_getfield(L, 1, key);
+    double v = lua_isnil(L, -1) ? def : luaL_checknumber(L, -1);
+    lua_pop(L, 1);
+    return v;
+}
+
+
+// eelua.gc_idle(false) restores the default schedule,
+// eelua.gc_idle({ pause=, stepmul=, step_kb=, budget_ms=, text_idle=,
+// idle_start=, hold_kb= }) enables idle stepping. Hooks then hold the
+// collector for up to hold_kb of allocation and pay for it when they
+// return, where the pause is measured.
+static int
+Leelua_gc_idle(lua_State *L)
+{
+    if (lua_isboolean(L, 1) && !lua_toboolean(L, 1)) {
+        if (s_conf.enabled) {
+            lua_gc(L, LUA_GCSETPAUSE, 200);
+            lua_gc(L, LUA_GCSETSTEPMUL, 200);
+            s_conf.enabled = 0;
+        }
+        return 0;
+    }
+
+    if (lua_istable(L, 1)) {
+        s_conf.pause = opt_int(L, "pause", s_conf.pause);
+        s_conf.stepmul = opt_int(L, "stepmul", s_conf.stepmul);
+        s_conf.step_kb = opt_int(L, "step_kb", s_conf.step_kb);
+        s_conf.idle_start = opt_int(L, "idle_start", s_conf.idle_start);
+        s_conf.hold_kb = opt_int(L, "hold_kb", s_conf.hold_kb);
+        s_conf.budget_ms = opt_number(L, "budget_ms", s_conf.budget_ms);
+        lua_getfield(L, 1, "text_idle");
+        if (!lua_isnil(L, -1)) {
+            s_conf.text_idle = lua_toboolean(L, -1);
+        }
+        lua_pop(L, 1);
+    }
+
+    s_conf.L = L;
+    s_conf.enabled = 1;
+    lua_gc(L, LUA_GCSETPAUSE, s_conf.pause);
+    lua_gc(L, LUA_GCSETSTEPMUL, s_conf.stepmul);
+    if (!s_gc.sentinel) {
+        if (luaL_newmetatable(L, SENTINEL_MT)) {
+            lua_pushcfunction(L, sentinel_gc);
+            lua_setfield(L, -2, "__gc");
+        }
+        lua_pop(L, 1);
+        cycle_ended(L);
+        new_sentinel(L);
+    }
+    install_hooks();
+    return 0;
+}
+
+
+static void
+push_buckets(lua_State *L, const pause_hist *h)
+{
+    lua_createtable(L, NBUCKETS, 0);
+    for (int i = 0; i < NBUCKETS; i++) {
+        lua_createtable(L, 0, 2);
+        if (i < NBUCKETS - 1) {
+            lua_pushnumber(L, bucket_bounds[i]);
+            lua_setfield(L, -2, "le_ms");
+        }
+        lua_pushnumber(L, h->buckets[i]);
+        lua_setfield(L, -2, "count");
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "buckets");
+}
+
+
+static int
+Leelua_gc_stats(lua_State *L)
+{
+    if (lua_toboolean(L, 1)) {
+        memset(&s_stats, 0, sizeof(s_stats));
+    }
+
+    lua_createtable(L, 0, 12);
+    lua_pushboolean(L, s_conf.enabled);
+    lua_setfield(L, -2, "enabled");
+    lua_pushnumber(L, s_conf.budget_ms);
+    lua_setfield(L, -2, "budget_ms");
+    lua_pushnumber(L, s_stats.idle.count);
+    lua_setfield(L, -2, "slices");
+    lua_pushnumber(L, s_stats.steps);
+    lua_setfield(L, -2, "steps");
+    lua_pushnumber(L, s_stats.cycles);
+    lua_setfield(L, -2, "cycles");
+    lua_pushnumber(L, s_stats.skipped);
+    lua_setfield(L, -2, "skipped");
+    lua_pushnumber(L, s_stats.idle.total_ms);
+    lua_setfield(L, -2, "total_ms");
+    lua_pushnumber(L, s_stats.idle.max_ms);
+    lua_setfield(L, -2, "max_ms");
+    lua_pushnumber(L, s_stats.idle.last_ms);
+    lua_setfield(L, -2, "last_ms");
+    push_buckets(L, &s_stats.idle);
+
+    // the steps paid when hooks return
+    lua_createtable(L, 0, 6);
+    lua_pushnumber(L, s_stats.hook.count);
+    lua_setfield(L, -2, "pauses");
+    lua_pushnumber(L, s_stats.hook.total_ms);
+    lua_setfield(L, -2, "total_ms");
+    lua_pushnumber(L, s_stats.hook.max_ms);
+    lua_setfield(L, -2, "max_ms");
+    lua_pushnumber(L, s_stats.hook.last_ms);
+    lua_setfield(L, -2, "last_ms");
+    lua_pushnumber(L, s_stats.over);
+    lua_setfield(L, -2, "over");
+    push_buckets(L, &s_stats.hook);
+    lua_setfield(L, -2, "hook");
+    return 1;
+}
+
+
+void
+gcidle_register(lua_State *L)
+{
+    lua_pushcfunction(L, Leelua_gc_idle);
+    lua_setfield(L, -2, "gc_idle");
+    lua_pushcfunction(L, Leelua_gc_stats);
+    lua_setfield(L, -2, "gc_stats");
+}
@@ -0,0 +1,27 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#ifndef EELUA_GC_IDLE_H_
+#define EELUA_GC_IDLE_H_
+
+#include "config.h"
+#include "lua.h"
+
+// Idle-time GC scheduling: the collector gets a conservative pause and is
+// stepped in bounded slices from EEHOOK_APPIDLE (and optionally
+// EEHOOK_TEXTIDLE) instead of in the middle of a keystroke. Steps that
+// hooks would take as they allocate are held until they return.
+
+// Runs one GC slice of at most budget_ms, returns the elapsed time in ms.
+double gcidle_step(lua_State *L, double budget_ms);
+
+// Called around every hook handler, see hooks.c.
+void gcidle_hook_enter(lua_State *L);
+void gcidle_hook_leave(lua_State *L);
+
+// Registers eelua.gc_idle() and eelua.gc_stats() into the table on top.
+void gcidle_register(lua_State *L);
+
+#endif  // EELUA_GC_IDLE_H_
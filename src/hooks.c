@@ -0,0 +1,430 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#include "hooks.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "util.h"
+#include "eelua_plugin.h"
+#include "gc_idle.h"
+#include "journal.h"
+#include "lua_helper.h"
+#include "transcode.h"
+
+#define LOG_TAG     "hooks"
+
+#define WSTR_STACK_BUF  512
+#define WM_ID_LIMIT     65536
+
+typedef struct {
+    int id;
+    void *func;
+} hook_entry;
+
+static lua_State *s_L = NULL;
+static int s_refs[HOOK_MAX_ID];
+static unsigned char s_installed[HOOK_MAX_ID];
+static int s_initialized = 0;
+
+// WM_COMMAND ids that have a Lua handler, see eelua.wm_filter_add()
+static unsigned char s_wm_bits[WM_ID_LIMIT / 8];
+static int s_wm_filter = 1;
+// WM_COMMAND ids that move the epoch, see eelua.wm_epoch_add()
+static unsigned char s_wm_epoch_bits[WM_ID_LIMIT / 8];
+
+
+void
+hooks_pushwstring(lua_State *L, const wchar_t *wstr, int len)
+{
+    char stack_buf[WSTR_STACK_BUF];
+    char *buf = stack_buf;
+
+    if (wstr == NULL) {
+        lua_pushliteral(L, "");
+        return;
+    }
+    if (len < 0) {
+        len = lstrlenW(wstr);
+    }
+
+    int cap = tc_narrow_bound(CP_ACP, len);
+    if (cap > WSTR_STACK_BUF) {
+        buf = (char *) malloc(cap);
+        if (buf == NULL) {
+            // not inside a protected call yet, so do not raise
+            lua_pushliteral(L, "");
+            return;
+        }
+    }
+    int n = tc_to_narrow(CP_ACP, wstr, len, buf, cap);
+    lua_pushlstring(L, buf, n);
+    if (buf != stack_buf) {
+        free(buf);
+    }
+}
+
+
+static int
+push_handler(int id)
+{
+    lua_State *L = s_L;
+    if (L == NULL || s_refs[id] == LUA_NOREF) {
+        return 0;
+    }
+    lua_rawgeti(L, LUA_REGISTRYINDEX, s_refs[id]);
+    return 1;
+}
+
+
+static LONG_PTR
+call_handler(const char *entry, int narg)
+{
+    lua_State *L = s_L;
+    LONG_PTR rv = 0;
+
+    gcidle_hook_enter(L);
+    if (luaH_docall(L, narg, 1, entry) != LUA_OK) {
+        ReportLuaError(lua_tostring(L, -1));
+    } else if (lua_isnumber(L, -1)) {
+        rv = (LONG_PTR) lua_tonumber(L, -1);
+    }
+    lua_pop(L, 1);
+    gcidle_hook_leave(L);
+    return rv;
+}
+
+
+static LONG_PTR
+OnRunningCommand(const wchar_t *command, LONG_PTR length)
+{
+    if (!push_handler(EEHOOK_RUNCOMMAND)) {
+        return 0;
+    }
+    hooks_pushwstring(s_L, command, (int) length);
+    return call_handler("hook:RUNCOMMAND", 1);
+}
+
+
+static int
+wm_command_id(WPARAM wp)
+{
+    WPARAM cmd_id = wp;
+    if (cmd_id >= 65536 + 40000) {
+        cmd_id -= 65536;
+    }
+    return cmd_id < WM_ID_LIMIT ? (int) cmd_id : -1;
+}
+
+
+static LONG_PTR
+OnAppMessage(LONG_PTR msg, WPARAM wp, LPARAM lp)
+{
+    int cmd_id = -1;
+    if (msg == WM_COMMAND) {
+        cmd_id = wm_command_id(wp);
+        if (cmd_id >= 0 && (s_wm_epoch_bits[cmd_id >> 3] & (1 << (cmd_id & 7)))) {
+            journal_touch();
+        }
+    }
+    // every message the editor routes comes through here, so anything
+    // that is not one of our commands must stay out of the VM
+    if (s_wm_filter && (cmd_id < 0 || !(s_wm_bits[cmd_id >> 3] & (1 << (cmd_id & 7))))) {
+        return 0;
+    }
+    if (!push_handler(EEHOOK_APPMSG)) {
+        return 0;
+    }
+    lua_pushnumber(s_L, (lua_Number) msg);
+    lua_pushnumber(s_L, (lua_Number) wp);
+    lua_pushnumber(s_L, (lua_Number) lp);
+    lua_pushinteger(s_L, cmd_id);
+    return call_handler("hook:APPMSG", 4);
+}
+
+
+static LONG_PTR
+OnPreExecuteScript(const wchar_t *pathname)
+{
+    if (!push_handler(EEHOOK_PREEXECUTESCRIPT)) {
+        return 0;
+    }
+    hooks_pushwstring(s_L, pathname, -1);
+    return call_handler("hook:PREEXECUTESCRIPT", 1);
+}
+
+
+static LONG_PTR
+OnListPluginCommand(HWND hwnd)
+{
+    if (!push_handler(EEHOOK_LISTPLUGINCOMMAND)) {
+        return 0;
+    }
+    lua_pushlightuserdata(s_L, hwnd);
+    return call_handler("hook:LISTPLUGINCOMMAND", 1);
+}
+
+
+static LONG_PTR
+OnExecutePluginCommand(const wchar_t *command)
+{
+    if (!push_handler(EEHOOK_EXECUTEPLUGINCOMMAND)) {
+        return 0;
+    }
+    hooks_pushwstring(s_L, command, -1);
+    return call_handler("hook:EXECUTEPLUGINCOMMAND", 1);
+}
+
+
+static LONG_PTR
+OnPrePopupTextMenu(HWND doc, HMENU menu, LONG_PTR x, LONG_PTR y)
+{
+    if (!push_handler(EEHOOK_PRETEXTMENU)) {
+        return 0;
+    }
+    lua_pushlightuserdata(s_L, doc);
+    lua_pushlightuserdata(s_L, menu);
+    lua_pushnumber(s_L, (lua_Number) x);
+    lua_pushnumber(s_L, (lua_Number) y);
+    return call_handler("hook:PRETEXTMENU", 4);
+}
+
+
+// the handler is called on every idle message, keep it cheap
+static LONG_PTR
+OnAppIdle(HWND hwnd, HWND frame)
+{
+    if (!push_handler(EEHOOK_APPIDLE)) {
+        return 0;
+    }
+    lua_pushlightuserdata(s_L, hwnd);
+    lua_pushlightuserdata(s_L, frame);
+    return call_handler("hook:APPIDLE", 2);
+}
+
+
+static const hook_entry s_hooks[] = {
+    { EEHOOK_RUNCOMMAND, (void *) OnRunningCommand },
+    { EEHOOK_APPMSG, (void *) OnAppMessage },
+    { EEHOOK_PREEXECUTESCRIPT, (void *) OnPreExecuteScript },
+    { EEHOOK_LISTPLUGINCOMMAND, (void *) OnListPluginCommand },
+    { EEHOOK_EXECUTEPLUGINCOMMAND, (void *) OnExecutePluginCommand },
+    { EEHOOK_PRETEXTMENU, (void *) OnPrePopupTextMenu },
+    { EEHOOK_APPIDLE, (void *) OnAppIdle },
+    { 0, NULL }
+};
+
+
+static const hook_entry *
+find_hook(int id)
+{
+    for (const hook_entry *e = s_hooks; e->func != NULL; e++) {
+        if (e->id == id) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+
+static void
+init_refs(void)
+{
+    if (!s_initialized) {
+        for (int i = 0; i < HOOK_MAX_ID; i++) {
+            s_refs[i] = LUA_NOREF;
+        }
+        s_initialized = 1;
+    }
+}
+
+
+// eelua.set_hook(id, fn) installs the native trampoline for hook id (once)
+// and routes it to fn, fn = nil detaches the Lua handler.
+static int
+Leelua_set_hook(lua_State *L)
+{
+    int id = (int) luaL_checkinteger(L, 1);
+    const hook_entry *e = find_hook(id);
+    if (e == NULL) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "no native trampoline for hook %d", id);
+        return 2;
+    }
+    if (!lua_isnoneornil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TFUNCTION);
+    }
+
+    init_refs();
+    s_L = L;
+    luaL_unref(L, LUA_REGISTRYINDEX, s_refs[id]);
+    s_refs[id] = LUA_NOREF;
+    if (lua_isfunction(L, 2)) {
+        lua_pushvalue(L, 2);
+        s_refs[id] = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    if (!s_installed[id] && g_ee_context != NULL) {
+        SendMessageA(g_ee_context->hMain, EEM_SETHOOK, id, (LPARAM) e->func);
+        s_installed[id] = 1;
+    }
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+
+static int
+Leelua_get_hook(lua_State *L)
+{
+    int id = (int) luaL_checkinteger(L, 1);
+    init_refs();
+    if (id < 0 || id >= HOOK_MAX_ID || s_refs[id] == LUA_NOREF) {
+        lua_pushnil(L);
+    } else {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, s_refs[id]);
+    }
+    return 1;
+}
+
+
+static int
+Leelua_hook_address(lua_State *L)
+{
+    const hook_entry *e = find_hook((int) luaL_checkinteger(L, 1));
+    if (e == NULL) {
+        lua_pushnil(L);
+    } else {
+        lua_pushlightuserdata(L, e->func);
+    }
+    return 1;
+}
+
+
+static int
+check_wm_id(lua_State *L, int idx)
+{
+    lua_Integer id = luaL_checkinteger(L, idx);
+    luaL_argcheck(L, id >= 0 && id < WM_ID_LIMIT, idx, "command id out of range");
+    return (int) id;
+}
+
+
+// eelua.wm_filter_add(id) lets WM_COMMAND id through to the APPMSG handler
+static int
+Leelua_wm_filter_add(lua_State *L)
+{
+    int id = check_wm_id(L, 1);
+    s_wm_bits[id >> 3] |= (unsigned char) (1 << (id & 7));
+    return 0;
+}
+
+
+static int
+Leelua_wm_filter_remove(lua_State *L)
+{
+    int id = check_wm_id(L, 1);
+    s_wm_bits[id >> 3] &= (unsigned char) ~(1 << (id & 7));
+    return 0;
+}
+
+
+// eelua.wm_epoch_add(id[, false]) marks WM_COMMAND id as one that may
+// change the encoding or line ends of a document (false unmarks it)
+static int
+Leelua_wm_epoch_add(lua_State *L)
+{
+    int id = check_wm_id(L, 1);
+    if (lua_isnoneornil(L, 2) || lua_toboolean(L, 2)) {
+        s_wm_epoch_bits[id >> 3] |= (unsigned char) (1 << (id & 7));
+    } else {
+        s_wm_epoch_bits[id >> 3] &= (unsigned char) ~(1 << (id & 7));
+    }
+    return 0;
+}
+
+
+// eelua.wm_filter([enable]) returns the previous state, with the filter
+// off every app message is passed to the APPMSG handler
+static int
+Leelua_wm_filter(lua_State *L)
+{
+    lua_pushboolean(L, s_wm_filter);
+    if (!lua_isnoneornil(L, 1)) {
+        s_wm_filter = lua_toboolean(L, 1);
+    }
+    return 1;
+}
+
+
+// eelua.time_app_message(fn, n[, msg, wparam]) calls an OnAppMessage-shaped
+// function pointer n times the way the host does and returns the elapsed
+// ms. fn is a light userdata or an address number (e.g. of an ffi
+// callback), wparam defaults to the iteration index.
+static int
+Leelua_time_app_message(lua_State *L)
+{
+    LONG_PTR (*fn)(LONG_PTR, WPARAM, LPARAM);
+    if (lua_islightuserdata(L, 1)) {
+        fn = (LONG_PTR (*)(LONG_PTR, WPARAM, LPARAM)) lua_touserdata(L, 1);
+    } else {
+        fn = (LONG_PTR (*)(LONG_PTR, WPARAM, LPARAM)) (intptr_t) luaL_checknumber(L, 1);
+    }
+    int n = (int) luaL_optinteger(L, 2, 100000);
+    LONG_PTR msg = (LONG_PTR) luaL_optinteger(L, 3, WM_USER);
+    int fixed_wp = !lua_isnoneornil(L, 4);
+    WPARAM wp = (WPARAM) luaL_optinteger(L, 4, 0);
+    luaL_argcheck(L, fn != NULL, 1, "NULL function");
+
+    double t0 = GetClockMs();
+    for (int i = 0; i < n; i++) {
+        fn(msg, fixed_wp ? wp : (WPARAM) i, 0);
+    }
+    lua_pushnumber(L, GetClockMs() - t0);
+    return 1;
+}
+
+
+void
+hooks_shutdown(void)
+{
+    for (const hook_entry *e = s_hooks; e->func != NULL; e++) {
+        if (s_installed[e->id] && g_ee_context != NULL) {
+            SendMessageA(g_ee_context->hMain, EEM_SETHOOK, EEHOOK_REMOVE, (LPARAM) e->func);
+        }
+        s_installed[e->id] = 0;
+    }
+    // the references went with the state
+    s_L = NULL;
+    s_initialized = 0;
+    memset(s_wm_bits, 0, sizeof(s_wm_bits));
+    memset(s_wm_epoch_bits, 0, sizeof(s_wm_epoch_bits));
+    s_wm_filter = 1;
+}
+
+
+void
+hooks_register(lua_State *L)
+{
+    lua_pushcfunction(L, Leelua_set_hook);
+    lua_setfield(L, -2, "set_hook");
+    lua_pushcfunction(L, Leelua_get_hook);
+    lua_setfield(L, -2, "get_hook");
+    lua_pushcfunction(L, Leelua_hook_address);
+    lua_setfield(L, -2, "hook_address");
+    lua_pushcfunction(L, Leelua_time_app_message);
+    lua_setfield(L, -2, "time_app_message");
+    lua_pushcfunction(L, Leelua_wm_filter_add);
+    lua_setfield(L, -2, "wm_filter_add");
+    lua_pushcfunction(L, Leelua_wm_filter_remove);
+    lua_setfield(L, -2, "wm_filter_remove");
+    lua_pushcfunction(L, Leelua_wm_filter);
+    lua_setfield(L, -2, "wm_filter");
+    lua_pushcfunction(L, Leelua_wm_epoch_add);
+    lua_setfield(L, -2, "wm_epoch_add");
+}
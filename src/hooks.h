@@ -0,0 +1,35 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#ifndef EELUA_HOOKS_H_
+#define EELUA_HOOKS_H_
+
+#include "config.h"
+#include "lua.h"
+
+// Native hook trampolines. The editor calls a C function which converts
+// the arguments (wide strings become ANSI Lua strings, handles become
+// light userdata) and calls the Lua handler registered with
+// eelua.set_hook(id, fn) through a registry reference.
+//
+// APPMSG is pre-filtered: unless eelua.wm_filter(false) is set, only
+// WM_COMMAND messages whose id was added with eelua.wm_filter_add() reach
+// Lua, as handler(msg, wparam, lparam, cmd_id). Ids added with
+// eelua.wm_epoch_add() (commands that convert the encoding or line ends,
+// which no hook reports) move the epoch of journal.h first, whether or
+// not they reach Lua.
+
+#define HOOK_MAX_ID     128
+
+// Pushes the ANSI form of a wide string, len < 0 means NUL-terminated.
+void hooks_pushwstring(lua_State *L, const wchar_t *wstr, int len);
+
+// Registers eelua.set_hook() and friends into the table on top.
+void hooks_register(lua_State *L);
+
+// Removes the trampolines from the editor and forgets the handlers.
+void hooks_shutdown(void);
+
+#endif  // EELUA_HOOKS_H_
@@ -0,0 +1,253 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#include "journal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "eelua_plugin.h"
+
+#define LOG_TAG     "journal"
+
+typedef struct {
+    const char *name;
+    void *func;
+} journal_func;
+
+static struct {
+    journal_entry *entries;
+    int head;           // next entry to read
+    int count;          // entries in use, from 0
+    int cap;
+    int lost;
+    int started;
+    int watching;
+} s_journal;
+
+// bumped whenever cached document properties may have changed, read by
+// the FFI through journal_address("epoch")
+static volatile int s_epoch;
+
+
+static journal_entry *
+append(void)
+{
+    if (s_journal.head > 0 && s_journal.head == s_journal.count) {
+        s_journal.head = s_journal.count = 0;
+    }
+    if (s_journal.count - s_journal.head >= JOURNAL_MAX) {
+        s_journal.lost++;
+        return NULL;
+    }
+    if (s_journal.count == s_journal.cap) {
+        if (s_journal.head > 0) {
+            // slide the unread entries down before growing
+            int n = s_journal.count - s_journal.head;
+            memmove(s_journal.entries, s_journal.entries + s_journal.head,
+                    n * sizeof(journal_entry));
+            s_journal.head = 0;
+            s_journal.count = n;
+        } else {
+            int cap = s_journal.cap ? s_journal.cap * 2 : 256;
+            journal_entry *entries = (journal_entry *) realloc(
+                s_journal.entries, cap * sizeof(journal_entry));
+            if (entries == NULL) {
+                s_journal.lost++;
+                return NULL;
+            }
+            s_journal.entries = entries;
+            s_journal.cap = cap;
+        }
+    }
+    return &s_journal.entries[s_journal.count++];
+}
+
+
+static LONG_PTR
+OnUpdateText(HWND frame, ECNMHDR_TextUpdate *info)
+{
+    if (!s_journal.started || info == NULL) {
+        return 0;
+    }
+    HWND doc = info->hdr.hwndFrom;
+    if (doc == NULL && g_ee_context != NULL) {
+        doc = (HWND) SendMessageA(g_ee_context->hMain, EEM_GETDOCFROMFRAME,
+                                  (WPARAM) frame, 0);
+    }
+    journal_entry *e = append();
+    if (e != NULL) {
+        e->doc = doc;
+        e->frame = frame;
+        e->spos = info->spos;
+        e->epos_old = info->epos1;
+        e->epos_new = info->epos2;
+    }
+    return 0;
+}
+
+
+static LONG_PTR
+OnPostClose(HWND frame)
+{
+    s_epoch++;
+    if (!s_journal.started) {
+        return 0;
+    }
+    journal_entry *e = append();
+    if (e != NULL) {
+        memset(e, 0, sizeof(*e));
+        e->frame = frame;
+    }
+    return 0;
+}
+
+
+static LONG_PTR
+OnPostSave(HWND frame)
+{
+    s_epoch++;
+    return 0;
+}
+
+
+static LONG_PTR
+OnTabPageInfoChanged(HWND frame)
+{
+    s_epoch++;
+    return 0;
+}
+
+
+static void
+set_hook(int id, void *fn)
+{
+    SendMessageA(g_ee_context->hMain, EEM_SETHOOK, id, (LPARAM) fn);
+}
+
+
+int
+journal_read(journal_entry *out, int cap)
+{
+    int n = s_journal.count - s_journal.head;
+    if (n > cap) {
+        n = cap;
+    }
+    if (n > 0) {
+        memcpy(out, s_journal.entries + s_journal.head, n * sizeof(journal_entry));
+        s_journal.head += n;
+    }
+    return n;
+}
+
+
+int
+journal_lost(void)
+{
+    int lost = s_journal.lost;
+    s_journal.lost = 0;
+    return lost;
+}
+
+
+void
+journal_touch(void)
+{
+    s_epoch++;
+}
+
+
+void
+journal_shutdown(void)
+{
+    if (g_ee_context != NULL) {
+        if (s_journal.started) {
+            set_hook(EEHOOK_REMOVE, OnUpdateText);
+        }
+        if (s_journal.watching) {
+            set_hook(EEHOOK_REMOVE, OnPostSave);
+            set_hook(EEHOOK_REMOVE, OnTabPageInfoChanged);
+        }
+        if (s_journal.started || s_journal.watching) {
+            set_hook(EEHOOK_REMOVE, OnPostClose);
+        }
+    }
+    free(s_journal.entries);
+    memset(&s_journal, 0, sizeof(s_journal));
+}
+
+
+// eelua.journal_start() installs the trampolines, changes are queued from
+// then on
+static int
+Leelua_journal_start(lua_State *L)
+{
+    if (!s_journal.started && g_ee_context != NULL) {
+        set_hook(EEHOOK_UPDATETEXT, OnUpdateText);
+        if (!s_journal.watching) {
+            set_hook(EEHOOK_POSTCLOSE, OnPostClose);
+        }
+        s_journal.started = 1;
+    }
+    lua_pushboolean(L, s_journal.started);
+    return 1;
+}
+
+
+// eelua.journal_watch() installs the hooks that bump the epoch
+static int
+Leelua_journal_watch(lua_State *L)
+{
+    if (!s_journal.watching && g_ee_context != NULL) {
+        set_hook(EEHOOK_POSTSAVE, OnPostSave);
+        set_hook(EEHOOK_TABPAGEINFOCHANGED, OnTabPageInfoChanged);
+        if (!s_journal.started) {
+            set_hook(EEHOOK_POSTCLOSE, OnPostClose);
+        }
+        s_journal.watching = 1;
+    }
+    lua_pushboolean(L, s_journal.watching);
+    return 1;
+}
+
+
+static const journal_func s_funcs[] = {
+    { "read", (void *) journal_read },
+    { "lost", (void *) journal_lost },
+    { "epoch", (void *) &s_epoch },
+    { NULL, NULL }
+};
+
+
+// eelua.journal_address(name) returns the C function (or for "epoch" the
+// counter) for the FFI to cast, see eelua/core/journal.lua
+static int
+Leelua_journal_address(lua_State *L)
+{
+    const char *name = luaL_checkstring(L, 1);
+    for (const journal_func *f = s_funcs; f->name != NULL; f++) {
+        if (strcmp(f->name, name) == 0) {
+            lua_pushlightuserdata(L, f->func);
+            return 1;
+        }
+    }
+    lua_pushnil(L);
+    return 1;
+}
+
+
+void
+journal_register(lua_State *L)
+{
+    lua_pushcfunction(L, Leelua_journal_start);
+    lua_setfield(L, -2, "journal_start");
+    lua_pushcfunction(L, Leelua_journal_watch);
+    lua_setfield(L, -2, "journal_watch");
+    lua_pushcfunction(L, Leelua_journal_address);
+    lua_setfield(L, -2, "journal_address");
+}
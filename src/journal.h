@@ -0,0 +1,52 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#ifndef EELUA_JOURNAL_H_
+#define EELUA_JOURNAL_H_
+
+#include "config.h"
+#include "lua.h"
+
+// Text changes from EEHOOK_UPDATETEXT and closed frames from
+// EEHOOK_POSTCLOSE, queued natively. The editor sends these from inside
+// the SendMessage that made the change, often an FFI call from compiled
+// Lua code, where entering the Lua state again is not allowed. So the
+// trampolines only append to a queue, which eelua/core/journal.lua drains
+// through the FFI. Main thread only.
+//
+// The epoch counts the saves, closes and tab page info changes seen, and
+// the menu commands marked with eelua.wm_epoch_add() (see hooks.h), after
+// which cached paths, encodings and line ends of documents may be stale
+// (eelua/core/handles.lua).
+
+typedef struct {
+    HWND doc;           // NULL when frame was closed
+    HWND frame;
+    EC_Pos spos;
+    EC_Pos epos_old;    // end of the replaced text, before the change
+    EC_Pos epos_new;    // end of the new text
+} journal_entry;
+
+// Moves up to cap queued entries to out, oldest first, returns how many.
+int journal_read(journal_entry *out, int cap);
+
+// Number of entries dropped because the queue was full since the last
+// call, the queue holds JOURNAL_MAX entries.
+int journal_lost(void);
+
+#define JOURNAL_MAX     65536
+
+// Moves the epoch, for changes seen by hooks outside this file.
+void journal_touch(void);
+
+// Removes the trampolines and frees the queue.
+void journal_shutdown(void);
+
+// Registers eelua.journal_start(), eelua.journal_watch() (installs the
+// hooks for the epoch) and eelua.journal_address(name) into the table on
+// top.
+void journal_register(lua_State *L);
+
+#endif  // EELUA_JOURNAL_H_
@@ -0,0 +1,227 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#include "latency.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "util.h"
+
+#define LOG_TAG     "latency"
+
+#define LAT_SUB_BITS    4
+#define LAT_SUB         (1 << LAT_SUB_BITS)
+#define LAT_NBUCKETS    (LAT_SUB + (32 - LAT_SUB_BITS) * LAT_SUB)
+#define LAT_TABLE_SIZE  512     // power of 2
+#define LAT_MAX_NAMES   (LAT_TABLE_SIZE / 2)
+
+typedef struct {
+    char *name;
+    unsigned hash;
+    double count;
+    double sum_us;
+    unsigned max_us;
+    unsigned buckets[LAT_NBUCKETS];
+} lat_hist;
+
+static lat_hist *s_table[LAT_TABLE_SIZE];
+static int s_nhists = 0;
+
+
+static int
+highest_bit(unsigned v)
+{
+    int k = 0;
+    if (v >= 1u << 16) { v >>= 16; k += 16; }
+    if (v >= 1u << 8) { v >>= 8; k += 8; }
+    if (v >= 1u << 4) { v >>= 4; k += 4; }
+    if (v >= 1u << 2) { v >>= 2; k += 2; }
+    if (v >= 1u << 1) { k += 1; }
+    return k;
+}
+
+
+static int
+bucket_index(unsigned us)
+{
+    if (us < LAT_SUB) {
+        return (int) us;
+    }
+    int k = highest_bit(us);
+    int sub = (int) (us >> (k - LAT_SUB_BITS)) & (LAT_SUB - 1);
+    return LAT_SUB + (k - LAT_SUB_BITS) * LAT_SUB + sub;
+}
+
+
+// midpoint of a bucket in microseconds
+static double
+bucket_value(int i)
+{
+    if (i < LAT_SUB) {
+        return i;
+    }
+    int k = (i - LAT_SUB) / LAT_SUB + LAT_SUB_BITS;
+    int sub = (i - LAT_SUB) % LAT_SUB;
+    double width = (double) (1u << (k - LAT_SUB_BITS));
+    return (LAT_SUB + sub) * width + width / 2;
+}
+
+
+static unsigned
+hash_name(const char *s)
+{
+    unsigned h = 2166136261u;
+    for (; *s; s++) {
+        h = (h ^ (unsigned char) *s) * 16777619u;
+    }
+    return h;
+}
+
+
+static lat_hist *
+find_hist(const char *name, int create)
+{
+    unsigned h = hash_name(name);
+    unsigned i = h & (LAT_TABLE_SIZE - 1);
+
+    for (;;) {
+        lat_hist *hist = s_table[i];
+        if (hist == NULL) {
+            break;
+        }
+        if (hist->hash == h && strcmp(hist->name, name) == 0) {
+            return hist;
+        }
+        i = (i + 1) & (LAT_TABLE_SIZE - 1);
+    }
+
+    if (!create || s_nhists >= LAT_MAX_NAMES) {
+        return NULL;
+    }
+    lat_hist *hist = (lat_hist *) calloc(1, sizeof(lat_hist));
+    size_t len = strlen(name);
+    char *copy = (char *) malloc(len + 1);
+    if (hist == NULL || copy == NULL) {
+        free(hist);
+        free(copy);
+        return NULL;
+    }
+    memcpy(copy, name, len + 1);
+    hist->name = copy;
+    hist->hash = h;
+    s_table[i] = hist;
+    s_nhists++;
+    return hist;
+}
+
+
+void
+latency_record(const char *name, double ms)
+{
+    lat_hist *hist = find_hist(name, 1);
+    if (hist == NULL) {
+        return;
+    }
+
+    double us = ms * 1000.0 + 0.5;
+    unsigned v = us <= 0 ? 0 : (us >= 4294967295.0 ? 0xFFFFFFFFu : (unsigned) us);
+    hist->buckets[bucket_index(v)]++;
+    hist->count += 1;
+    hist->sum_us += v;
+    if (v > hist->max_us) {
+        hist->max_us = v;
+    }
+}
+
+
+static double
+percentile_ms(const lat_hist *hist, double q)
+{
+    double target = q * hist->count;
+    double seen = 0;
+
+    if (hist->count == 0) {
+        return 0;
+    }
+    for (int i = 0; i < LAT_NBUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= target && hist->buckets[i] > 0) {
+            double v = bucket_value(i);
+            return (v < hist->max_us ? v : hist->max_us) / 1000.0;
+        }
+    }
+    return hist->max_us / 1000.0;
+}
+
+
+void
+latency_shutdown(void)
+{
+    for (int i = 0; i < LAT_TABLE_SIZE; i++) {
+        if (s_table[i] != NULL) {
+            free(s_table[i]->name);
+            free(s_table[i]);
+            s_table[i] = NULL;
+        }
+    }
+    s_nhists = 0;
+}
+
+
+// eelua.latency_record(name, ms)
+static int
+Leelua_latency_record(lua_State *L)
+{
+    latency_record(luaL_checkstring(L, 1), luaL_checknumber(L, 2));
+    return 0;
+}
+
+
+// eelua.stats([reset]) returns { [name] = { count=, mean=, p50=, p90=,
+// p99=, max= } } with times in ms; reset clears every histogram first.
+static int
+Leelua_stats(lua_State *L)
+{
+    if (lua_toboolean(L, 1)) {
+        latency_shutdown();
+    }
+
+    lua_createtable(L, 0, s_nhists);
+    for (int i = 0; i < LAT_TABLE_SIZE; i++) {
+        const lat_hist *hist = s_table[i];
+        if (hist == NULL) {
+            continue;
+        }
+        lua_createtable(L, 0, 6);
+        lua_pushnumber(L, hist->count);
+        lua_setfield(L, -2, "count");
+        lua_pushnumber(L, hist->count > 0 ? hist->sum_us / hist->count / 1000.0 : 0);
+        lua_setfield(L, -2, "mean");
+        lua_pushnumber(L, percentile_ms(hist, 0.50));
+        lua_setfield(L, -2, "p50");
+        lua_pushnumber(L, percentile_ms(hist, 0.90));
+        lua_setfield(L, -2, "p90");
+        lua_pushnumber(L, percentile_ms(hist, 0.99));
+        lua_setfield(L, -2, "p99");
+        lua_pushnumber(L, hist->max_us / 1000.0);
+        lua_setfield(L, -2, "max");
+        lua_setfield(L, -2, hist->name);
+    }
+    return 1;
+}
+
+
+void
+latency_register(lua_State *L)
+{
+    lua_pushcfunction(L, Leelua_latency_record);
+    lua_setfield(L, -2, "latency_record");
+    lua_pushcfunction(L, Leelua_stats);
+    lua_setfield(L, -2, "stats");
+}
@@ -0,0 +1,26 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#ifndef EELUA_LATENCY_H_
+#define EELUA_LATENCY_H_
+
+#include "config.h"
+#include "lua.h"
+
+// Named latency histograms. Values are kept in microseconds in log-linear
+// buckets (16 linear sub-buckets per power of two, like HdrHistogram with
+// one significant hex digit), so percentiles are within ~6% at any scale.
+// luaH_docall records every named entry point; Lua code records events
+// and commands through eelua.latency_record(). Main thread only.
+
+void latency_record(const char *name, double ms);
+
+// Frees every histogram.
+void latency_shutdown(void);
+
+// Registers eelua.latency_record() and eelua.stats() into the table on top.
+void latency_register(lua_State *L);
+
+#endif  // EELUA_LATENCY_H_
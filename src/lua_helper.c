@@ -5,11 +5,42 @@
 
 #include "lua_helper.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "lua.h"
 #include "lauxlib.h"
 #include "lualib.h"
 
 #include "util.h"
+#include "latency.h"
+#include "watchdog.h"
+
+#define LOG_TAG     "lua_helper"
+
+#define BCCACHE_MAGIC       "EELUAC2"
+
+#define ENTRY_STACK_MAX     16
+
+#define FNV64_OFFSET        14695981039346656037ULL
+#define FNV64_PRIME         1099511628211ULL
+
+// The cache is keyed by the size and a hash of the source, not its mtime:
+// a file saved twice within the resolution of the timestamp would
+// otherwise load stale bytecode.
+typedef struct {
+    char magic[8];
+    unsigned long long hash;
+    long long size;
+    unsigned int path_len;
+} bccache_header;
+
+static char s_cache_dir[PATH_MAX] = { 0 };
+
+// entry points of the luaH_docall calls in progress on the main VM
+static const char *s_entries[ENTRY_STACK_MAX];
+static int s_nentries = 0;
 
 static int
 msghandler(lua_State *L)
@@ -23,6 +54,8 @@ msghandler(lua_State *L)
             msg = lua_pushfstring(L, "(error object is a %s value)",
                                   luaL_typename(L, 1));
         }
+    } else if (strstr(msg, "\nstack traceback:") != NULL) {
+        return 1;  /* carries its own, see watchdog_hook */
     }
     luaL_traceback(L, L, msg, 1);  /* append a standard traceback */
     return 1;  /* return the traceback */
@@ -46,15 +79,42 @@ luaH_docall(lua_State *L, int narg, int nres, const char *extra_msg)
 {
     // ջǺӲб
     int base = lua_gettop(L) - narg;  // λ
+    double t0 = 0;
+    int wd = 0;
+    if (extra_msg != NULL) {
+        t0 = GetClockMs();
+        wd = watchdog_enter(L, extra_msg);
+        if (s_nentries < ENTRY_STACK_MAX) {
+            s_entries[s_nentries] = extra_msg;
+        }
+        s_nentries++;
+    }
     lua_pushcfunction(L, msghandler);
     lua_insert(L, base);  //  msghandler
     int rc = lua_pcall(L, narg, nres, base);  // úջΪбϢ
     lua_remove(L, base);  // Ƴ msghandler
+    if (extra_msg != NULL) {
+        watchdog_leave(L, wd);
+        s_nentries--;
+        latency_record(extra_msg, GetClockMs() - t0);
+        if (rc != LUA_OK && lua_type(L, -1) == LUA_TSTRING) {
+            lua_pushfstring(L, "%s: %s", extra_msg, lua_tostring(L, -1));
+            lua_replace(L, -2);
+        }
+    }
     // NOTE: úϢҪд
     return rc;
 }
 
 
+const char *
+luaH_curentry(void)
+{
+    int n = s_nentries < ENTRY_STACK_MAX ? s_nentries : ENTRY_STACK_MAX;
+    return n > 0 ? s_entries[n - 1] : NULL;
+}
+
+
 static int
 luaH_dochunk(lua_State *L, int rc)
 {
@@ -68,10 +128,196 @@ luaH_dochunk(lua_State *L, int rc)
 }
 
 
+void
+luaH_setcachedir(const char *dir)
+{
+    if (dir == NULL) {
+        s_cache_dir[0] = '\0';
+    } else {
+        snprintf(s_cache_dir, sizeof(s_cache_dir), "%s", dir);
+    }
+}
+
+
+static unsigned long long
+fnv1a64(const void *data, size_t len)
+{
+    unsigned long long h = FNV64_OFFSET;
+    const unsigned char *p = (const unsigned char *) data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= FNV64_PRIME;
+    }
+    return h;
+}
+
+
+static int
+bccache_path(const char *fname, char *buf, size_t size)
+{
+    if (s_cache_dir[0] == '\0') {
+        return 0;
+    }
+    unsigned long long h = fnv1a64(fname, strlen(fname));
+    int n = snprintf(buf, size, "%s\\%08x%08x.luac", s_cache_dir,
+                     (unsigned int) (h >> 32), (unsigned int) h);
+    return n > 0 && (size_t) n < size;
+}
+
+
+// Reads the whole of fname into a malloc'ed buffer, NULL on failure.
+static char *
+read_source(const char *fname, long *len)
+{
+    char *buf = NULL;
+    FILE *fp = fopen(fname, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+    if (fseek(fp, 0, SEEK_END) == 0 && (*len = ftell(fp)) >= 0
+        && fseek(fp, 0, SEEK_SET) == 0) {
+        buf = (char *) malloc(*len > 0 ? *len : 1);
+        if (buf != NULL && fread(buf, 1, *len, fp) != (size_t) *len) {
+            free(buf);
+            buf = NULL;
+        }
+    }
+    fclose(fp);
+    return buf;
+}
+
+
+static int
+bccache_load(lua_State *L, const char *fname, const char *cpath,
+             unsigned long long hash, long size)
+{
+    bccache_header hdr;
+    char path[PATH_MAX];
+    char *code = NULL;
+    long code_len = 0;
+    int rc = -1;
+
+    FILE *fp = fopen(cpath, "rb");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1
+        || memcmp(hdr.magic, BCCACHE_MAGIC, sizeof(hdr.magic)) != 0
+        || hdr.hash != hash
+        || hdr.size != (long long) size
+        || hdr.path_len != strlen(fname)
+        || hdr.path_len >= sizeof(path)
+        || fread(path, 1, hdr.path_len, fp) != hdr.path_len
+        || memcmp(path, fname, hdr.path_len) != 0) {
+        goto done;
+    }
+
+    long pos = ftell(fp);
+    if (fseek(fp, 0, SEEK_END) != 0) {
+        goto done;
+    }
+    code_len = ftell(fp) - pos;
+    if (code_len <= 0 || fseek(fp, pos, SEEK_SET) != 0) {
+        goto done;
+    }
+    code = (char *) malloc(code_len);
+    if (code == NULL || fread(code, 1, code_len, fp) != (size_t) code_len) {
+        goto done;
+    }
+
+    // the chunk name is taken from the dumped bytecode
+    rc = luaL_loadbuffer(L, code, code_len, fname);
+    if (rc != LUA_OK) {
+        LOGW("stale bytecode cache for %s: %s", fname, lua_tostring(L, -1));
+        lua_pop(L, 1);
+        rc = -1;
+    }
+
+done:
+    free(code);
+    fclose(fp);
+    return rc;
+}
+
+
+static int
+bccache_writer(lua_State *L, const void *p, size_t size, void *ud)
+{
+    return fwrite(p, 1, size, (FILE *) ud) != size;
+}
+
+
+static void
+bccache_save(lua_State *L, const char *fname, const char *cpath,
+             unsigned long long hash, long size)
+{
+    bccache_header hdr;
+    char tmp_path[PATH_MAX];
+
+    // the main state and the workers may write the same entry at once
+    int n = snprintf(tmp_path, sizeof(tmp_path), "%s.%lu.%lu.tmp", cpath,
+                     (unsigned long) GetCurrentProcessId(),
+                     (unsigned long) GetCurrentThreadId());
+    if (n <= 0 || (size_t) n >= sizeof(tmp_path)) {
+        return;
+    }
+    FILE *fp = fopen(tmp_path, "wb");
+    if (fp == NULL) {
+        return;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, BCCACHE_MAGIC, sizeof(hdr.magic));
+    hdr.hash = hash;
+    hdr.size = (long long) size;
+    hdr.path_len = (unsigned int) strlen(fname);
+
+    int failed = fwrite(&hdr, sizeof(hdr), 1, fp) != 1
+        || fwrite(fname, 1, hdr.path_len, fp) != hdr.path_len
+        || lua_dump(L, bccache_writer, fp) != 0;
+    failed = (fclose(fp) != 0) || failed;
+
+    remove(cpath);
+    if (failed || rename(tmp_path, cpath) != 0) {
+        LOGW("unable to write bytecode cache for %s", fname);
+        remove(tmp_path);
+    }
+}
+
+
+int
+luaH_loadfile(lua_State *L, const char *fname)
+{
+    char cpath[PATH_MAX];
+    long len = 0;
+    char *src = NULL;
+
+    if (!bccache_path(fname, cpath, sizeof(cpath))
+        || (src = read_source(fname, &len)) == NULL) {
+        return luaL_loadfile(L, fname);
+    }
+
+    unsigned long long hash = fnv1a64(src, len);
+    int rc = bccache_load(L, fname, cpath, hash, len);
+    if (rc != LUA_OK) {
+        // the same chunk name as luaL_loadfile gives
+        lua_pushfstring(L, "@%s", fname);
+        rc = luaL_loadbuffer(L, src, len, lua_tostring(L, -1));
+        lua_remove(L, -2);
+        if (rc == LUA_OK) {
+            bccache_save(L, fname, cpath, hash, len);
+        }
+    }
+    free(src);
+    return rc;
+}
+
+
 int
 luaH_dofile(lua_State *L, const char *fname)
 {
-    return luaH_dochunk(L, luaL_loadfile(L, fname));
+    return luaH_dochunk(L, luaH_loadfile(L, fname));
 }
 
 
@@ -9,7 +9,16 @@
 #include "config.h"
 #include "lua.h"
 
+// extra_msg names the entry point (e.g. "hook:APPMSG"), it prefixes the
+// error message, is what luaH_curentry() returns during the call and
+// names the latency histogram the call is timed into and the watchdog
+// budget that applies.
+// Only the main VM may pass a non-NULL extra_msg.
 int luaH_docall(lua_State *L, int narg, int nres, const char *extra_msg);
+const char *luaH_curentry(void);
+
+void luaH_setcachedir(const char *dir);
+int luaH_loadfile(lua_State *L, const char *fname);
 
 int luaH_dofile(lua_State *L, const char *fname);
 int luaH_dostring(lua_State *L, const char *code);
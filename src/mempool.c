@@ -0,0 +1,356 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#include "mempool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "util.h"
+
+#define LOG_TAG     "mempool"
+
+#define SLAB_SIZE   (16 * 1024)
+#define SLAB_HEADER 16  // keeps blocks 16 bytes aligned
+
+static const size_t class_sizes[MEMPOOL_NCLASSES] = {
+    16, 32, 48, 64, 80, 96, 128, 160, 192, 256, 384, 512
+};
+
+typedef struct free_block {
+    struct free_block *next;
+} free_block;
+
+typedef struct slab {
+    struct slab *next;
+} slab;
+
+typedef struct {
+    free_block *free_list;
+    size_t allocs;
+    size_t frees;
+    size_t live;
+} size_class;
+
+struct mempool {
+    size_class classes[MEMPOOL_NCLASSES];
+    unsigned char class_of[MEMPOOL_MAX_SMALL / 16 + 1];
+    slab *slabs;
+    size_t slab_bytes;
+    size_t live_bytes;
+    size_t peak_bytes;
+    size_t large_allocs;
+    size_t large_frees;
+    size_t large_live;
+};
+
+
+mempool *
+mempool_new(void)
+{
+    mempool *pool = (mempool *) calloc(1, sizeof(mempool));
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    int c = 0;
+    for (size_t i = 0; i <= MEMPOOL_MAX_SMALL / 16; i++) {
+        while (class_sizes[c] < i * 16) {
+            c++;
+        }
+        pool->class_of[i] = (unsigned char) c;
+    }
+    return pool;
+}
+
+
+void
+mempool_free(mempool *pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+
+    slab *s = pool->slabs;
+    while (s != NULL) {
+        slab *next = s->next;
+        free(s);
+        s = next;
+    }
+    free(pool);
+}
+
+
+static int
+class_index(mempool *pool, size_t size)
+{
+    if (size > MEMPOOL_MAX_SMALL) {
+        return -1;
+    }
+    return pool->class_of[(size + 15) / 16];
+}
+
+
+static free_block *
+refill(mempool *pool, int c)
+{
+    slab *s = (slab *) malloc(SLAB_SIZE);
+    if (s == NULL) {
+        return NULL;
+    }
+    s->next = pool->slabs;
+    pool->slabs = s;
+    pool->slab_bytes += SLAB_SIZE;
+
+    size_t bsize = class_sizes[c];
+    char *p = (char *) s + SLAB_HEADER;
+    char *end = (char *) s + SLAB_SIZE - bsize;
+    free_block *head = NULL;
+    for (; p <= end; p += bsize) {
+        free_block *b = (free_block *) p;
+        b->next = head;
+        head = b;
+    }
+    return head;
+}
+
+
+static void *
+small_alloc(mempool *pool, int c)
+{
+    size_class *sc = &pool->classes[c];
+    free_block *b = sc->free_list;
+    if (b == NULL) {
+        b = refill(pool, c);
+        if (b == NULL) {
+            return NULL;
+        }
+    }
+    sc->free_list = b->next;
+    sc->allocs++;
+    sc->live++;
+    return b;
+}
+
+
+static void
+small_free(mempool *pool, int c, void *ptr)
+{
+    size_class *sc = &pool->classes[c];
+    free_block *b = (free_block *) ptr;
+    b->next = sc->free_list;
+    sc->free_list = b;
+    sc->frees++;
+    sc->live--;
+}
+
+
+static void
+block_free(mempool *pool, void *ptr, size_t size)
+{
+    int c = class_index(pool, size);
+    if (c >= 0) {
+        small_free(pool, c, ptr);
+    } else {
+        free(ptr);
+        pool->large_frees++;
+        pool->large_live--;
+    }
+    pool->live_bytes -= size;
+}
+
+
+static void *
+block_alloc(mempool *pool, size_t size)
+{
+    void *p;
+    int c = class_index(pool, size);
+    if (c >= 0) {
+        p = small_alloc(pool, c);
+    } else {
+        p = malloc(size);
+        if (p != NULL) {
+            pool->large_allocs++;
+            pool->large_live++;
+        }
+    }
+
+    if (p != NULL) {
+        pool->live_bytes += size;
+        if (pool->live_bytes > pool->peak_bytes) {
+            pool->peak_bytes = pool->live_bytes;
+        }
+    }
+    return p;
+}
+
+
+// Makes the large block ptr of osize bytes a slab of class c whose first
+// block is the object, moved there from ptr, the rest going to the free
+// list. For shrinks into a class when no new slab can be had: the VM
+// takes a failed shrink as out of memory, and the block cannot stay as
+// it is because it would be freed as one of class c.
+static void *
+adopt_as_slab(mempool *pool, int c, void *ptr, size_t osize, size_t nsize)
+{
+    size_t bsize = class_sizes[c];
+    if (osize < SLAB_HEADER + bsize) {
+        // a few bytes short of the header, which malloc often has spare
+        void *p = realloc(ptr, SLAB_HEADER + bsize);
+        if (p == NULL) {
+            return NULL;
+        }
+        ptr = p;
+        pool->live_bytes += SLAB_HEADER + bsize;
+        pool->live_bytes -= osize;
+        osize = SLAB_HEADER + bsize;
+    }
+
+    char *base = (char *) ptr;
+    memmove(base + SLAB_HEADER, base, nsize);
+    slab *s = (slab *) base;
+    s->next = pool->slabs;
+    pool->slabs = s;
+    pool->slab_bytes += osize;
+
+    size_class *sc = &pool->classes[c];
+    for (char *p = base + SLAB_HEADER + bsize; p + bsize <= base + osize; p += bsize) {
+        free_block *b = (free_block *) p;
+        b->next = sc->free_list;
+        sc->free_list = b;
+    }
+    sc->allocs++;
+    sc->live++;
+    pool->large_frees++;
+    pool->large_live--;
+    pool->live_bytes += nsize;
+    pool->live_bytes -= osize;
+    return base + SLAB_HEADER;
+}
+
+
+void *
+mempool_alloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+    mempool *pool = (mempool *) ud;
+
+    if (ptr == NULL) {
+        return nsize == 0 ? NULL : block_alloc(pool, nsize);
+    }
+
+    if (nsize == 0) {
+        block_free(pool, ptr, osize);
+        return NULL;
+    }
+
+    int oc = class_index(pool, osize);
+    int nc = class_index(pool, nsize);
+    if (oc >= 0 && oc == nc) {
+        // same size class, the block already fits
+        pool->live_bytes += nsize;
+        pool->live_bytes -= osize;
+        if (pool->live_bytes > pool->peak_bytes) {
+            pool->peak_bytes = pool->live_bytes;
+        }
+        return ptr;
+    }
+
+    if (oc < 0 && nc < 0) {
+        void *p = realloc(ptr, nsize);
+        if (p != NULL) {
+            pool->live_bytes += nsize;
+            pool->live_bytes -= osize;
+            if (pool->live_bytes > pool->peak_bytes) {
+                pool->peak_bytes = pool->live_bytes;
+            }
+        }
+        return p;
+    }
+
+    void *p = block_alloc(pool, nsize);
+    if (p != NULL) {
+        memcpy(p, ptr, osize < nsize ? osize : nsize);
+        block_free(pool, ptr, osize);
+    } else if (oc >= 0 && nc >= 0 && nsize < osize) {
+        // a shrink must not fail: the block stays, from now on in the
+        // smaller class, which it is big enough for
+        pool->classes[oc].frees++;
+        pool->classes[oc].live--;
+        pool->classes[nc].allocs++;
+        pool->classes[nc].live++;
+        pool->live_bytes += nsize;
+        pool->live_bytes -= osize;
+        p = ptr;
+    } else if (nc >= 0 && nsize < osize) {
+        p = adopt_as_slab(pool, nc, ptr, osize, nsize);
+    }
+    return p;
+}
+
+
+lua_State *
+mempool_newstate(mempool *pool)
+{
+    lua_State *L = NULL;
+    if (pool != NULL) {
+        L = lua_newstate(mempool_alloc, pool);
+    }
+    if (L == NULL) {
+        LOGW("custom allocator refused, using the default one");
+        L = luaL_newstate();
+    }
+    return L;
+}
+
+
+int
+mempool_pushstats(lua_State *L)
+{
+    void *ud = NULL;
+    lua_Alloc f = lua_getallocf(L, &ud);
+    if (f != mempool_alloc || ud == NULL) {
+        return 0;
+    }
+
+    mempool *pool = (mempool *) ud;
+    lua_createtable(L, 0, 8);
+    lua_pushliteral(L, "pool");
+    lua_setfield(L, -2, "allocator");
+    lua_pushnumber(L, (lua_Number) pool->live_bytes);
+    lua_setfield(L, -2, "live_bytes");
+    lua_pushnumber(L, (lua_Number) pool->peak_bytes);
+    lua_setfield(L, -2, "peak_bytes");
+    lua_pushnumber(L, (lua_Number) pool->slab_bytes);
+    lua_setfield(L, -2, "slab_bytes");
+
+    lua_createtable(L, 0, 3);
+    lua_pushnumber(L, (lua_Number) pool->large_allocs);
+    lua_setfield(L, -2, "allocs");
+    lua_pushnumber(L, (lua_Number) pool->large_frees);
+    lua_setfield(L, -2, "frees");
+    lua_pushnumber(L, (lua_Number) pool->large_live);
+    lua_setfield(L, -2, "live");
+    lua_setfield(L, -2, "large");
+
+    lua_createtable(L, MEMPOOL_NCLASSES, 0);
+    for (int i = 0; i < MEMPOOL_NCLASSES; i++) {
+        size_class *sc = &pool->classes[i];
+        lua_createtable(L, 0, 4);
+        lua_pushnumber(L, (lua_Number) class_sizes[i]);
+        lua_setfield(L, -2, "size");
+        lua_pushnumber(L, (lua_Number) sc->allocs);
+        lua_setfield(L, -2, "allocs");
+        lua_pushnumber(L, (lua_Number) sc->frees);
+        lua_setfield(L, -2, "frees");
+        lua_pushnumber(L, (lua_Number) sc->live);
+        lua_setfield(L, -2, "live");
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "classes");
+    return 1;
+}
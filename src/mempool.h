@@ -0,0 +1,34 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#ifndef EELUA_MEMPOOL_H_
+#define EELUA_MEMPOOL_H_
+
+#include "config.h"
+#include "lua.h"
+
+// Size-class pool allocator for a lua_State. Blocks up to
+// MEMPOOL_MAX_SMALL bytes come from per-class free lists carved out of
+// slabs, bigger blocks go straight to the C heap.
+
+#define MEMPOOL_NCLASSES    12
+#define MEMPOOL_MAX_SMALL   512
+
+typedef struct mempool mempool;
+
+mempool *mempool_new(void);
+void mempool_free(mempool *pool);
+
+void *mempool_alloc(void *ud, void *ptr, size_t osize, size_t nsize);
+
+// Creates a state using the pool, falls back to the default allocator
+// when the VM refuses custom allocators (64-bit LuaJIT without GC64).
+lua_State *mempool_newstate(mempool *pool);
+
+// Pushes a table with the pool counters of L and returns 1, returns 0
+// without pushing anything if L does not use a mempool.
+int mempool_pushstats(lua_State *L);
+
+#endif  // EELUA_MEMPOOL_H_
@@ -0,0 +1,253 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#include "profiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "luajit.h"
+
+#include "util.h"
+#include "lua_helper.h"
+
+#define LOG_TAG     "profiler"
+
+#define PROF_TABLE_SIZE     8192    // power of 2
+#define PROF_MAX_STACKS     (PROF_TABLE_SIZE / 2)
+#define PROF_KEY_MAX        2048
+#define PROF_OTHER          "[other]"
+
+typedef struct {
+    char *stack;
+    unsigned hash;
+    double count;
+} prof_slot;
+
+static struct {
+    lua_State *L;
+    int running;
+    int interval_ms;
+    int depth;
+    double samples;
+    double started_ms;
+    double elapsed_ms;
+} s_prof = { NULL, 0, 10, 32, 0, 0, 0 };
+
+static prof_slot s_slots[PROF_TABLE_SIZE];
+static int s_nstacks = 0;
+
+
+static unsigned
+hash_key(const char *s, size_t len)
+{
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char) s[i]) * 16777619u;
+    }
+    return h;
+}
+
+
+static void
+add_stack(const char *key, size_t len)
+{
+    unsigned h = hash_key(key, len);
+    unsigned i = h & (PROF_TABLE_SIZE - 1);
+
+    for (;;) {
+        prof_slot *slot = &s_slots[i];
+        if (slot->stack == NULL) {
+            if (s_nstacks >= PROF_MAX_STACKS && strcmp(key, PROF_OTHER) != 0) {
+                // keep the table sparse, lump the long tail together
+                add_stack(PROF_OTHER, sizeof(PROF_OTHER) - 1);
+                return;
+            }
+            slot->stack = (char *) malloc(len + 1);
+            if (slot->stack == NULL) {
+                return;
+            }
+            memcpy(slot->stack, key, len);
+            slot->stack[len] = '\0';
+            slot->hash = h;
+            slot->count = 1;
+            s_nstacks++;
+            return;
+        }
+        if (slot->hash == h && strncmp(slot->stack, key, len) == 0
+            && slot->stack[len] == '\0') {
+            slot->count += 1;
+            return;
+        }
+        i = (i + 1) & (PROF_TABLE_SIZE - 1);
+    }
+}
+
+
+static void
+clear_stacks(void)
+{
+    for (int i = 0; i < PROF_TABLE_SIZE; i++) {
+        free(s_slots[i].stack);
+    }
+    memset(s_slots, 0, sizeof(s_slots));
+    s_nstacks = 0;
+    s_prof.samples = 0;
+    s_prof.elapsed_ms = 0;
+}
+
+
+static void
+profile_callback(void *data, lua_State *L, int samples, int vmstate)
+{
+    char key[PROF_KEY_MAX];
+    const char *entry = luaH_curentry();
+    size_t len = 0;
+
+    // the timer keeps ticking while the VM is not running, so samples
+    // piles up across idle time; every callback counts as one sample
+    (void) data;
+    (void) samples;
+
+    const char *stack = luaJIT_profile_dumpstack(L, "F;", -s_prof.depth, &len);
+    while (len > 0 && stack[len - 1] == ';') {
+        len--;
+    }
+
+    int n = snprintf(key, sizeof(key), "%s;%.*s", entry ? entry : "main",
+                     (int) len, stack);
+    if (n < 0 || n >= (int) sizeof(key)) {
+        n = (int) sizeof(key) - 1;
+    }
+    if (vmstate == 'G' && n < (int) sizeof(key) - 5) {
+        memcpy(key + n, ";[GC]", 5);
+        n += 5;
+    } else if (vmstate == 'J' && n < (int) sizeof(key) - 6) {
+        memcpy(key + n, ";[JIT]", 6);
+        n += 6;
+    }
+    key[n] = '\0';
+
+    add_stack(key, n);
+    s_prof.samples += 1;
+}
+
+
+static void
+stop_profile(void)
+{
+    if (s_prof.running) {
+        luaJIT_profile_stop(s_prof.L);
+        s_prof.elapsed_ms += GetClockMs() - s_prof.started_ms;
+        s_prof.running = 0;
+    }
+}
+
+
+void
+profiler_shutdown(lua_State *L)
+{
+    (void) L;
+    stop_profile();
+    clear_stacks();
+}
+
+
+// eelua.profile_start([interval_ms[, depth]]) starts sampling the calling
+// VM, the stacks collected so far are kept until eelua.profile_reset().
+static int
+Leelua_profile_start(lua_State *L)
+{
+    char mode[32];
+    int interval_ms = (int) luaL_optinteger(L, 1, s_prof.interval_ms);
+    int depth = (int) luaL_optinteger(L, 2, s_prof.depth);
+    luaL_argcheck(L, interval_ms > 0, 1, "interval must be positive");
+    luaL_argcheck(L, depth > 0 && depth <= 256, 2, "depth out of range");
+
+    if (s_prof.running) {
+        lua_pushnil(L);
+        lua_pushliteral(L, "profiler already running");
+        return 2;
+    }
+
+    s_prof.L = L;
+    s_prof.interval_ms = interval_ms;
+    s_prof.depth = depth;
+    snprintf(mode, sizeof(mode), "fi%d", interval_ms);
+    luaJIT_profile_start(L, mode, profile_callback, NULL);
+    s_prof.started_ms = GetClockMs();
+    s_prof.running = 1;
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+
+static int
+Leelua_profile_stop(lua_State *L)
+{
+    stop_profile();
+    lua_pushnumber(L, s_prof.samples);
+    return 1;
+}
+
+
+static int
+Leelua_profile_reset(lua_State *L)
+{
+    clear_stacks();
+    if (s_prof.running) {
+        s_prof.started_ms = GetClockMs();
+    }
+    return 0;
+}
+
+
+// eelua.profile_data() returns { [folded stack] = samples } and an info
+// table with running, samples, stacks, interval_ms and elapsed_ms.
+static int
+Leelua_profile_data(lua_State *L)
+{
+    lua_createtable(L, 0, s_nstacks);
+    for (int i = 0; i < PROF_TABLE_SIZE; i++) {
+        if (s_slots[i].stack != NULL) {
+            lua_pushnumber(L, s_slots[i].count);
+            lua_setfield(L, -2, s_slots[i].stack);
+        }
+    }
+
+    double elapsed = s_prof.elapsed_ms;
+    if (s_prof.running) {
+        elapsed += GetClockMs() - s_prof.started_ms;
+    }
+    lua_createtable(L, 0, 5);
+    lua_pushboolean(L, s_prof.running);
+    lua_setfield(L, -2, "running");
+    lua_pushnumber(L, s_prof.samples);
+    lua_setfield(L, -2, "samples");
+    lua_pushinteger(L, s_nstacks);
+    lua_setfield(L, -2, "stacks");
+    lua_pushinteger(L, s_prof.interval_ms);
+    lua_setfield(L, -2, "interval_ms");
+    lua_pushnumber(L, elapsed);
+    lua_setfield(L, -2, "elapsed_ms");
+    return 2;
+}
+
+
+void
+profiler_register(lua_State *L)
+{
+    lua_pushcfunction(L, Leelua_profile_start);
+    lua_setfield(L, -2, "profile_start");
+    lua_pushcfunction(L, Leelua_profile_stop);
+    lua_setfield(L, -2, "profile_stop");
+    lua_pushcfunction(L, Leelua_profile_reset);
+    lua_setfield(L, -2, "profile_reset");
+    lua_pushcfunction(L, Leelua_profile_data);
+    lua_setfield(L, -2, "profile_data");
+}
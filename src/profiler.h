@@ -0,0 +1,23 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#ifndef EELUA_PROFILER_H_
+#define EELUA_PROFILER_H_
+
+#include "config.h"
+#include "lua.h"
+
+// Sampling profiler on top of the LuaJIT profiler API. Every sample is
+// folded into "entry;frame;...;frame" where entry is the luaH_docall entry
+// point that was running, and counted in a C hash table, so a running
+// profile costs one stack dump per interval and nothing in between.
+
+// Stops a running profile and frees the collected stacks.
+void profiler_shutdown(lua_State *L);
+
+// Registers eelua.profile_start() and friends into the table on top.
+void profiler_register(lua_State *L);
+
+#endif  // EELUA_PROFILER_H_
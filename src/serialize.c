@@ -0,0 +1,244 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#include "serialize.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#define MAX_DEPTH   64
+
+enum {
+    TAG_NIL = 0,
+    TAG_FALSE,
+    TAG_TRUE,
+    TAG_NUMBER,
+    TAG_STRING,
+    TAG_TABLE,
+    TAG_TABLE_END,
+};
+
+
+void
+sbuf_free(sbuf *b)
+{
+    free(b->data);
+    b->data = NULL;
+    b->len = 0;
+    b->cap = 0;
+}
+
+
+static int
+sbuf_put(sbuf *b, const void *p, size_t n)
+{
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap : 64;
+        while (cap < b->len + n) {
+            cap *= 2;
+        }
+        char *data = (char *) realloc(b->data, cap);
+        if (data == NULL) {
+            return -1;
+        }
+        b->data = data;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+    return 0;
+}
+
+
+static int
+put_tag(sbuf *b, unsigned char tag)
+{
+    return sbuf_put(b, &tag, 1);
+}
+
+
+int
+serialize_string(sbuf *out, const char *s, size_t len)
+{
+    unsigned int n = (unsigned int) len;
+    if (put_tag(out, TAG_STRING) != 0 || sbuf_put(out, &n, sizeof(n)) != 0) {
+        return -1;
+    }
+    return sbuf_put(out, s, len);
+}
+
+
+static int
+encode(lua_State *L, int idx, sbuf *b, int depth, const char **err)
+{
+    switch (lua_type(L, idx)) {
+    case LUA_TNIL:
+        return put_tag(b, TAG_NIL);
+
+    case LUA_TBOOLEAN:
+        return put_tag(b, lua_toboolean(L, idx) ? TAG_TRUE : TAG_FALSE);
+
+    case LUA_TNUMBER: {
+        lua_Number n = lua_tonumber(L, idx);
+        if (put_tag(b, TAG_NUMBER) != 0) {
+            return -1;
+        }
+        return sbuf_put(b, &n, sizeof(n));
+    }
+
+    case LUA_TSTRING: {
+        size_t len;
+        const char *s = lua_tolstring(L, idx, &len);
+        return serialize_string(b, s, len);
+    }
+
+    case LUA_TTABLE:
+        if (depth >= MAX_DEPTH) {
+            *err = "table nested too deep (or cyclic)";
+            return -1;
+        }
+        if (idx < 0) {
+            idx = lua_gettop(L) + idx + 1;
+        }
+        if (put_tag(b, TAG_TABLE) != 0) {
+            return -1;
+        }
+        lua_checkstack(L, 3);
+        lua_pushnil(L);
+        while (lua_next(L, idx) != 0) {
+            if (encode(L, -2, b, depth + 1, err) != 0
+                || encode(L, -1, b, depth + 1, err) != 0) {
+                lua_pop(L, 2);
+                return -1;
+            }
+            lua_pop(L, 1);
+        }
+        return put_tag(b, TAG_TABLE_END);
+
+    default:
+        *err = "only nil, boolean, number, string and table values can be passed";
+        return -1;
+    }
+}
+
+
+int
+serialize_values(lua_State *L, int first, int last, sbuf *out,
+                 const char **err)
+{
+    *err = "out of memory";
+    for (int i = first; i <= last; i++) {
+        if (encode(L, i, out, 0, err) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+typedef struct {
+    const char *p;
+    const char *end;
+} reader;
+
+
+static int
+decode(lua_State *L, reader *r, int depth)
+{
+    if (r->p >= r->end || depth > MAX_DEPTH) {
+        return -1;
+    }
+    lua_checkstack(L, 3);
+
+    unsigned char tag = (unsigned char) *r->p++;
+    switch (tag) {
+    case TAG_NIL:
+        lua_pushnil(L);
+        return 0;
+
+    case TAG_FALSE:
+    case TAG_TRUE:
+        lua_pushboolean(L, tag == TAG_TRUE);
+        return 0;
+
+    case TAG_NUMBER: {
+        lua_Number n;
+        if ((size_t) (r->end - r->p) < sizeof(n)) {
+            return -1;
+        }
+        memcpy(&n, r->p, sizeof(n));
+        r->p += sizeof(n);
+        lua_pushnumber(L, n);
+        return 0;
+    }
+
+    case TAG_STRING: {
+        unsigned int n;
+        if ((size_t) (r->end - r->p) < sizeof(n)) {
+            return -1;
+        }
+        memcpy(&n, r->p, sizeof(n));
+        r->p += sizeof(n);
+        if ((size_t) (r->end - r->p) < n) {
+            return -1;
+        }
+        lua_pushlstring(L, r->p, n);
+        r->p += n;
+        return 0;
+    }
+
+    case TAG_TABLE:
+        lua_newtable(L);
+        for (;;) {
+            if (r->p >= r->end) {
+                lua_pop(L, 1);
+                return -1;
+            }
+            if ((unsigned char) *r->p == TAG_TABLE_END) {
+                r->p++;
+                return 0;
+            }
+            if (decode(L, r, depth + 1) != 0) {
+                lua_pop(L, 1);
+                return -1;
+            }
+            // lua_rawset raises on these, and callers are not protected
+            if (lua_isnil(L, -1)
+                || (lua_type(L, -1) == LUA_TNUMBER && lua_tonumber(L, -1) != lua_tonumber(L, -1))) {
+                lua_pop(L, 2);
+                return -1;
+            }
+            if (decode(L, r, depth + 1) != 0) {
+                lua_pop(L, 2);
+                return -1;
+            }
+            lua_rawset(L, -3);
+        }
+
+    default:
+        return -1;
+    }
+}
+
+
+int
+deserialize_values(lua_State *L, const char *data, size_t len)
+{
+    reader r = { data, data + len };
+    int top = lua_gettop(L);
+    int n = 0;
+
+    while (r.p < r.end) {
+        if (decode(L, &r, 0) != 0) {
+            lua_settop(L, top);
+            return -1;
+        }
+        n++;
+    }
+    return n;
+}
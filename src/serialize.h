@@ -0,0 +1,36 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#ifndef EELUA_SERIALIZE_H_
+#define EELUA_SERIALIZE_H_
+
+#include "config.h"
+#include "lua.h"
+
+// Flat binary encoding of plain Lua values (nil, booleans, numbers,
+// strings and tables of those) used to pass data between lua_States.
+// Buffers live on the C heap so they can cross threads.
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} sbuf;
+
+void sbuf_free(sbuf *b);
+
+// Encodes the values at stack indices [first, last]. Returns 0 on success,
+// otherwise -1 with *err set to a static message.
+int serialize_values(lua_State *L, int first, int last, sbuf *out,
+                     const char **err);
+
+// Appends a single string value, for producers without a lua_State.
+int serialize_string(sbuf *out, const char *s, size_t len);
+
+// Pushes the values encoded in data and returns their count, or -1 if the
+// buffer is malformed (nothing is pushed then).
+int deserialize_values(lua_State *L, const char *data, size_t len);
+
+#endif  // EELUA_SERIALIZE_H_
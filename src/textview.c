@@ -0,0 +1,172 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#include "textview.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#if (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)) \
+    && WCHAR_MAX <= 0xFFFF
+#include <emmintrin.h>
+#define TV_SSE2     1
+#endif
+
+#define FNV_OFFSET  2166136261u
+#define FNV_PRIME   16777619u
+
+typedef struct {
+    const char *name;
+    void *func;
+} textview_entry;
+
+
+// Offset of the first unit in text[from..to), or -1.
+static int
+find_unit(const wchar_t *text, int from, int to, wchar_t unit)
+{
+    int i = from;
+
+#ifdef TV_SSE2
+    const __m128i needle = _mm_set1_epi16((short) unit);
+    for (; i + 8 <= to; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (text + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(v, needle));
+        if (mask != 0) {
+            int bit = 0;
+            while ((mask & 1) == 0) {
+                mask >>= 1;
+                bit++;
+            }
+            // two mask bits per unit
+            return i + bit / 2;
+        }
+    }
+#endif
+    for (; i < to; i++) {
+        if (text[i] == unit) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+int
+tv_find(const wchar_t *text, int len, int from, const wchar_t *pat, int plen)
+{
+    if (from < 0) {
+        from = 0;
+    }
+    if (plen <= 0) {
+        return from <= len ? from : -1;
+    }
+    int last = len - plen + 1;
+    while (from < last) {
+        int i = find_unit(text, from, last, pat[0]);
+        if (i < 0) {
+            return -1;
+        }
+        if (wmemcmp(text + i + 1, pat + 1, plen - 1) == 0) {
+            return i;
+        }
+        from = i + 1;
+    }
+    return -1;
+}
+
+
+int
+tv_count(const wchar_t *text, int from, int to, wchar_t unit)
+{
+    int count = 0;
+    int i = from < 0 ? 0 : from;
+
+#ifdef TV_SSE2
+    const __m128i needle = _mm_set1_epi16((short) unit);
+    while (i + 8 <= to) {
+        // 16-bit lanes, flushed before they can wrap
+        __m128i acc = _mm_setzero_si128();
+        int stop = to - i > 8 * 0xFFFF ? i + 8 * 0xFFFF : to;
+        for (; i + 8 <= stop; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (text + i));
+            acc = _mm_sub_epi16(acc, _mm_cmpeq_epi16(v, needle));
+        }
+        uint16_t lanes[8];
+        _mm_storeu_si128((__m128i *) lanes, acc);
+        for (int k = 0; k < 8; k++) {
+            count += lanes[k];
+        }
+    }
+#endif
+    for (; i < to; i++) {
+        count += text[i] == unit;
+    }
+    return count;
+}
+
+
+int
+tv_line_start(const wchar_t *text, int len, int from, int lines)
+{
+    int i = from < 0 ? 0 : from;
+    for (; lines > 0; lines--) {
+        i = find_unit(text, i, len, L'\n');
+        if (i < 0) {
+            return -1;
+        }
+        i++;
+    }
+    return i <= len ? i : -1;
+}
+
+
+unsigned int
+tv_hash(const wchar_t *text, int from, int to)
+{
+    uint32_t h = FNV_OFFSET;
+    for (int i = from < 0 ? 0 : from; i < to; i++) {
+        h = (h ^ (uint32_t) text[i]) * FNV_PRIME;
+    }
+    return h;
+}
+
+
+static const textview_entry s_funcs[] = {
+    { "find", (void *) tv_find },
+    { "count", (void *) tv_count },
+    { "line_start", (void *) tv_line_start },
+    { "hash", (void *) tv_hash },
+    { NULL, NULL }
+};
+
+
+// eelua.textview_address(name) returns the C function for the FFI to
+// cast, see eelua/core/textview.lua
+static int
+Leelua_textview_address(lua_State *L)
+{
+    const char *name = luaL_checkstring(L, 1);
+    for (const textview_entry *e = s_funcs; e->name != NULL; e++) {
+        if (strcmp(e->name, name) == 0) {
+            lua_pushlightuserdata(L, e->func);
+            return 1;
+        }
+    }
+    lua_pushnil(L);
+    return 1;
+}
+
+
+void
+textview_register(lua_State *L)
+{
+    lua_pushcfunction(L, Leelua_textview_address);
+    lua_setfield(L, -2, "textview_address");
+}
@@ -0,0 +1,34 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#ifndef EELUA_TEXTVIEW_H_
+#define EELUA_TEXTVIEW_H_
+
+#include "config.h"
+#include "lua.h"
+
+// Read-only scans of wide text, for the views of document text that
+// doc:textview() returns (eelua/core/textview.lua), so searching and
+// counting need no narrow copy. Offsets are in wchar_t units from 0.
+// Runs are compared 8 units at a time with SSE2 where wchar_t is 16 bits.
+
+// Offset of the first pat[0..plen) in text[from..len), or -1.
+int tv_find(const wchar_t *text, int len, int from, const wchar_t *pat, int plen);
+
+// Number of units equal to unit in text[from..to).
+int tv_count(const wchar_t *text, int from, int to, wchar_t unit);
+
+// Offset of the start of the line lines '\n' after from, or -1 when the
+// text has fewer.
+int tv_line_start(const wchar_t *text, int len, int from, int lines);
+
+// 32-bit FNV-1a of the units of text[from..to).
+unsigned int tv_hash(const wchar_t *text, int from, int to);
+
+// Registers eelua.textview_address(name) into the table on top, which
+// returns the functions above as light userdata for the FFI.
+void textview_register(lua_State *L);
+
+#endif  // EELUA_TEXTVIEW_H_
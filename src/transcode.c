@@ -0,0 +1,493 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#include "transcode.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TC_SSE2     1
+#endif
+
+#if WCHAR_MAX > 0xFFFF
+#define TC_WIDE32   1  // wchar_t holds a whole code point (not on Windows)
+#endif
+
+#define LOG_TAG     "transcode"
+
+#define REPLACEMENT_CHAR    0xFFFD
+
+typedef struct {
+    const char *name;
+    void *func;
+} transcode_entry;
+
+
+int
+tc_ascii_prefix(const char *src, int len)
+{
+    const unsigned char *s = (const unsigned char *) src;
+    int i = 0;
+
+#ifdef TC_SSE2
+    for (; i + 16 <= len; i += 16) {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) (s + i)));
+        if (mask != 0) {
+            while ((mask & 1) == 0) {
+                mask >>= 1;
+                i++;
+            }
+            return i;
+        }
+    }
+#else
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, s + i, sizeof(w));
+        if (w & 0x8080808080808080ULL) {
+            break;
+        }
+    }
+#endif
+    while (i < len && s[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+
+// Widens the ASCII run at src, returns the number of units converted.
+static int
+widen_ascii(const unsigned char *src, int len, wchar_t *dst, int cap)
+{
+    int n = len < cap ? len : cap;
+    int i = 0;
+
+#ifdef TC_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        if (_mm_movemask_epi8(v) != 0) {
+            break;
+        }
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+#ifdef TC_WIDE32
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128((__m128i *) (dst + i + 4), _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128((__m128i *) (dst + i + 8), _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128((__m128i *) (dst + i + 12), _mm_unpackhi_epi16(hi, zero));
+#else
+        _mm_storeu_si128((__m128i *) (dst + i), lo);
+        _mm_storeu_si128((__m128i *) (dst + i + 8), hi);
+#endif
+    }
+#endif
+    for (; i < n && src[i] < 0x80; i++) {
+        dst[i] = src[i];
+    }
+    return i;
+}
+
+
+// Narrows the ASCII run at src, returns the number of units converted.
+static int
+narrow_ascii(const wchar_t *src, int wlen, unsigned char *dst, int cap)
+{
+    int n = wlen < cap ? wlen : cap;
+    int i = 0;
+
+#ifdef TC_SSE2
+#ifdef TC_WIDE32
+    const __m128i high = _mm_set1_epi32((int) 0xFFFFFF80);
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (src + i + 4));
+        __m128i bits = _mm_and_si128(_mm_or_si128(a, b), high);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(bits, _mm_setzero_si128())) != 0xFFFF) {
+            break;
+        }
+        __m128i w = _mm_packs_epi32(a, b);
+        _mm_storel_epi64((__m128i *) (dst + i), _mm_packus_epi16(w, w));
+    }
+#else
+    const __m128i high = _mm_set1_epi16((short) 0xFF80);
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (src + i + 8));
+        __m128i bits = _mm_and_si128(_mm_or_si128(a, b), high);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(bits, _mm_setzero_si128())) != 0xFFFF) {
+            break;
+        }
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(a, b));
+    }
+#endif
+#endif
+    for (; i < n && (unsigned) src[i] < 0x80; i++) {
+        dst[i] = (unsigned char) src[i];
+    }
+    return i;
+}
+
+
+// Decodes one UTF-8 sequence at s (s[0] >= 0x80). An ill-formed sequence
+// yields U+FFFD for its maximal subpart, as the Win32 API does.
+static unsigned
+decode_utf8(const unsigned char *s, int len, int *used)
+{
+    unsigned c = s[0];
+    unsigned lo = 0x80, hi = 0xBF;
+    int need;
+
+    if (c >= 0xC2 && c <= 0xDF) {
+        need = 1;
+        c &= 0x1F;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        need = 2;
+        if (c == 0xE0) {
+            lo = 0xA0;
+        } else if (c == 0xED) {
+            hi = 0x9F;
+        }
+        c &= 0x0F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        need = 3;
+        if (c == 0xF0) {
+            lo = 0x90;
+        } else if (c == 0xF4) {
+            hi = 0x8F;
+        }
+        c &= 0x07;
+    } else {
+        *used = 1;
+        return REPLACEMENT_CHAR;
+    }
+
+    for (int k = 1; k <= need; k++) {
+        if (k >= len || s[k] < lo || s[k] > hi) {
+            *used = k;
+            return REPLACEMENT_CHAR;
+        }
+        c = (c << 6) | (s[k] & 0x3F);
+        lo = 0x80;
+        hi = 0xBF;
+    }
+    *used = need + 1;
+    return c;
+}
+
+
+static int
+utf8_to_wide(const unsigned char *s, int len, wchar_t *dst, int cap)
+{
+    int i = 0, o = 0;
+
+    while (i < len) {
+        if (s[i] < 0x80) {
+            int n;
+            if (dst == NULL) {
+                n = tc_ascii_prefix((const char *) s + i, len - i);
+            } else {
+                n = widen_ascii(s + i, len - i, dst + o, cap - o);
+                if (n == 0) {
+                    break;  // dst is full
+                }
+            }
+            i += n;
+            o += n;
+            continue;
+        }
+
+        int used;
+        unsigned c = decode_utf8(s + i, len - i, &used);
+#ifndef TC_WIDE32
+        if (c > 0xFFFF) {
+            if (dst != NULL) {
+                if (o + 2 > cap) {
+                    break;
+                }
+                c -= 0x10000;
+                dst[o] = (wchar_t) (0xD800 | (c >> 10));
+                dst[o + 1] = (wchar_t) (0xDC00 | (c & 0x3FF));
+            }
+            o += 2;
+            i += used;
+            continue;
+        }
+#endif
+        if (dst != NULL) {
+            if (o >= cap) {
+                break;
+            }
+            dst[o] = (wchar_t) c;
+        }
+        o++;
+        i += used;
+    }
+    return o;
+}
+
+
+static int
+wide_to_utf8(const wchar_t *src, int wlen, unsigned char *dst, int cap)
+{
+    int i = 0, o = 0;
+
+    while (i < wlen) {
+        unsigned c = (unsigned) src[i];
+        if (c < 0x80) {
+            int n;
+            if (dst == NULL) {
+                for (n = 0; i + n < wlen && (unsigned) src[i + n] < 0x80; n++) {
+                }
+            } else {
+                n = narrow_ascii(src + i, wlen - i, dst + o, cap - o);
+                if (n == 0) {
+                    break;
+                }
+            }
+            i += n;
+            o += n;
+            continue;
+        }
+
+        int used = 1;
+        if (c >= 0xD800 && c <= 0xDFFF) {
+#ifndef TC_WIDE32
+            unsigned c2 = i + 1 < wlen ? (unsigned) src[i + 1] : 0;
+            if (c <= 0xDBFF && c2 >= 0xDC00 && c2 <= 0xDFFF) {
+                c = 0x10000 + ((c - 0xD800) << 10) + (c2 - 0xDC00);
+                used = 2;
+            } else
+#endif
+            c = REPLACEMENT_CHAR;
+        } else if (c > 0x10FFFF) {
+            c = REPLACEMENT_CHAR;
+        }
+
+        unsigned char buf[4];
+        int n;
+        if (c < 0x800) {
+            buf[0] = (unsigned char) (0xC0 | (c >> 6));
+            buf[1] = (unsigned char) (0x80 | (c & 0x3F));
+            n = 2;
+        } else if (c < 0x10000) {
+            buf[0] = (unsigned char) (0xE0 | (c >> 12));
+            buf[1] = (unsigned char) (0x80 | ((c >> 6) & 0x3F));
+            buf[2] = (unsigned char) (0x80 | (c & 0x3F));
+            n = 3;
+        } else {
+            buf[0] = (unsigned char) (0xF0 | (c >> 18));
+            buf[1] = (unsigned char) (0x80 | ((c >> 12) & 0x3F));
+            buf[2] = (unsigned char) (0x80 | ((c >> 6) & 0x3F));
+            buf[3] = (unsigned char) (0x80 | (c & 0x3F));
+            n = 4;
+        }
+        if (dst != NULL) {
+            if (o + n > cap) {
+                break;
+            }
+            memcpy(dst + o, buf, n);
+        }
+        o += n;
+        i += used;
+    }
+    return o;
+}
+
+
+int
+tc_to_wide(UINT cp, const char *src, int len, wchar_t *dst, int cap)
+{
+    if (len <= 0) {
+        return 0;
+    }
+    if (cp == CP_UTF8) {
+        return utf8_to_wide((const unsigned char *) src, len, dst, cap);
+    }
+
+    int n = dst == NULL ? tc_ascii_prefix(src, len)
+                        : widen_ascii((const unsigned char *) src, len, dst, cap);
+    if (n == len || (dst != NULL && n == cap)) {
+        return n;
+    }
+    return n + MultiByteToWideChar(cp, 0, src + n, len - n, dst ? dst + n : NULL,
+                                   dst ? cap - n : 0);
+}
+
+
+int
+tc_to_narrow(UINT cp, const wchar_t *src, int wlen, char *dst, int cap)
+{
+    if (wlen <= 0) {
+        return 0;
+    }
+    if (cp == CP_UTF8) {
+        return wide_to_utf8(src, wlen, (unsigned char *) dst, cap);
+    }
+
+    int n = 0;
+    if (dst == NULL) {
+        while (n < wlen && (unsigned) src[n] < 0x80) {
+            n++;
+        }
+    } else {
+        n = narrow_ascii(src, wlen, (unsigned char *) dst, cap);
+    }
+    if (n == wlen || (dst != NULL && n == cap)) {
+        return n;
+    }
+    return n + WideCharToMultiByte(cp, 0, src + n, wlen - n, dst ? dst + n : NULL,
+                                   dst ? cap - n : 0, NULL, NULL);
+}
+
+
+int
+tc_narrow_bound(UINT cp, int wlen)
+{
+    // last code page and its MaxCharSize packed in one int, so worker
+    // threads can share it without a lock
+    static volatile int s_last = -1;
+
+    if (cp == CP_UTF8) {
+#ifdef TC_WIDE32
+        return wlen * 4;
+#else
+        return wlen * 3;  // a surrogate pair needs 4 bytes for 2 units
+#endif
+    }
+    int last = s_last;
+    if (last < 0 || (UINT) (last >> 4) != cp) {
+        CPINFO info;
+        int max = GetCPInfo(cp, &info) ? (int) info.MaxCharSize : 4;
+        last = (int) (cp << 4) | (max & 0xF);
+        s_last = last;
+    }
+    return wlen * (last & 0xF);
+}
+
+
+// How a code page splits text into characters.
+enum {
+    MB_SINGLE,      // one byte each
+    MB_DOUBLE,      // DBCS, a lead byte takes one more byte
+    MB_GB18030,     // one, two or four bytes
+    MB_UTF8
+};
+
+
+static int
+classify_cp(UINT cp, CPINFO *info)
+{
+    if (cp == CP_UTF8) {
+        return MB_UTF8;
+    }
+    if (cp == 54936) {
+        return MB_GB18030;
+    }
+    if (!GetCPInfo(cp, info) || info->MaxCharSize == 1) {
+        return MB_SINGLE;
+    }
+    return info->MaxCharSize == 2 ? MB_DOUBLE : MB_UTF8;
+}
+
+
+static int
+is_lead_byte(const CPINFO *info, unsigned char c)
+{
+    for (int i = 0; i + 1 < (int) sizeof(info->LeadByte); i += 2) {
+        if (info->LeadByte[i] == 0 && info->LeadByte[i + 1] == 0) {
+            break;
+        }
+        if (c >= info->LeadByte[i] && c <= info->LeadByte[i + 1]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+int
+tc_narrow_cut(UINT cp, const char *src, int len)
+{
+    const unsigned char *s = (const unsigned char *) src;
+    CPINFO info;
+
+    if (len <= 0) {
+        return 0;
+    }
+    int kind = classify_cp(cp, &info);
+    if (kind == MB_SINGLE) {
+        return len;
+    }
+    if (kind == MB_UTF8) {
+        // back up over the continuation bytes to the last lead byte
+        int i = len - 1;
+        while (i > 0 && len - i < 4 && (s[i] & 0xC0) == 0x80) {
+            i--;
+        }
+        int need = s[i] >= 0xF0 ? 4 : s[i] >= 0xE0 ? 3 : s[i] >= 0xC0 ? 2 : 1;
+        return len - i < need ? i : len;
+    }
+
+    // a trail byte may look like a lead byte, so scan forward from src
+    int i = tc_ascii_prefix(src, len);
+    while (i < len) {
+        int n = 1;
+        if (kind == MB_GB18030) {
+            if (s[i] >= 0x81 && s[i] <= 0xFE) {
+                n = i + 1 < len && s[i + 1] >= 0x30 && s[i + 1] <= 0x39 ? 4 : 2;
+            }
+        } else if (is_lead_byte(&info, s[i])) {
+            n = 2;
+        }
+        if (i + n > len) {
+            return i;
+        }
+        i += n;
+    }
+    return len;
+}
+
+
+static const transcode_entry s_funcs[] = {
+    { "to_wide", (void *) tc_to_wide },
+    { "to_narrow", (void *) tc_to_narrow },
+    { "narrow_bound", (void *) tc_narrow_bound },
+    { "ascii_prefix", (void *) tc_ascii_prefix },
+    { "narrow_cut", (void *) tc_narrow_cut },
+    { NULL, NULL }
+};
+
+
+// eelua.transcode_address(name) returns the C function for the FFI to
+// cast, see unicode.lua
+static int
+Leelua_transcode_address(lua_State *L)
+{
+    const char *name = luaL_checkstring(L, 1);
+    for (const transcode_entry *e = s_funcs; e->name != NULL; e++) {
+        if (strcmp(e->name, name) == 0) {
+            lua_pushlightuserdata(L, e->func);
+            return 1;
+        }
+    }
+    lua_pushnil(L);
+    return 1;
+}
+
+
+void
+transcode_register(lua_State *L)
+{
+    lua_pushcfunction(L, Leelua_transcode_address);
+    lua_setfield(L, -2, "transcode_address");
+}
@@ -0,0 +1,39 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#ifndef EELUA_TRANSCODE_H_
+#define EELUA_TRANSCODE_H_
+
+#include "config.h"
+#include "lua.h"
+
+// Single pass conversions between multibyte text and wchar_t. Runs of
+// ASCII are checked and widened/narrowed 16 bytes at a time (SSE2 when
+// available, a word at a time otherwise). UTF-8 is converted here, with
+// ill-formed input replaced by U+FFFD as MultiByteToWideChar does; other
+// code pages hand the text after the ASCII run to the Win32 API.
+//
+// With dst == NULL the functions return the length the conversion needs,
+// otherwise at most cap units are written and their count is returned.
+
+int tc_to_wide(UINT cp, const char *src, int len, wchar_t *dst, int cap);
+int tc_to_narrow(UINT cp, const wchar_t *src, int wlen, char *dst, int cap);
+
+// Capacity that always holds the narrow form of wlen wide units.
+int tc_narrow_bound(UINT cp, int wlen);
+
+// Length of the leading ASCII run of src.
+int tc_ascii_prefix(const char *src, int len);
+
+// Length of the longest prefix of src that ends on a character boundary,
+// src itself starting on one. What is left is the start of a character
+// cut off at the end of the buffer, for the next chunk to complete.
+int tc_narrow_cut(UINT cp, const char *src, int len);
+
+// Registers eelua.transcode_address(name) into the table on top, which
+// returns the functions above as light userdata for the FFI.
+void transcode_register(lua_State *L);
+
+#endif  // EELUA_TRANSCODE_H_
@@ -8,6 +8,8 @@
 #include <stdio.h>
 #include <stdarg.h>
 
+#include "errqueue.h"
+
 
 static const char *
 Level2Str(int level)
@@ -38,6 +40,22 @@ LoggerImpl(const char *domain, int level, const char *fmt, ...)
 }
 
 
+double
+GetClockMs(void)
+{
+    static double ms_per_tick = 0.0;
+    LARGE_INTEGER counter;
+
+    if (ms_per_tick == 0.0) {
+        LARGE_INTEGER freq;
+        QueryPerformanceFrequency(&freq);
+        ms_per_tick = 1000.0 / (double) freq.QuadPart;
+    }
+    QueryPerformanceCounter(&counter);
+    return (double) counter.QuadPart * ms_per_tick;
+}
+
+
 void
 ReportLuaWarn(const char *msg)
 {
@@ -48,5 +66,6 @@ ReportLuaWarn(const char *msg)
 void
 ReportLuaError(const char *msg)
 {
-    MessageBoxA(NULL, msg, "[eelua] Error", MB_OK|MB_ICONERROR);
+    // never block the message loop here, see errqueue.h
+    errqueue_push(msg);
 }
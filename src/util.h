@@ -23,6 +23,8 @@ void LoggerImpl(const char *domain, int level, const char *fmt, ...);
 #define LOGI(fmt, ...) LoggerImpl(LOG_TAG, LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
 #define LOGD(fmt, ...) LoggerImpl(LOG_TAG, LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
 
+double GetClockMs(void);
+
 void ReportLuaWarn(const char *msg);
 void ReportLuaError(const char *msg);
 
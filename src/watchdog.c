@@ -0,0 +1,326 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#include "watchdog.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "util.h"
+
+#define LOG_TAG     "watchdog"
+
+#define WD_TICK_MS      50
+#define WD_STACK_MAX    16
+#define WD_MAX_RULES    32
+#define WD_PATTERN_MAX  64
+#define WD_TRACE_MAX    4096
+
+typedef struct {
+    char pattern[WD_PATTERN_MAX];
+    int budget_ms;
+} wd_rule;
+
+typedef struct {
+    lua_Hook func;
+    int mask;
+    int count;
+} wd_hook;
+
+typedef struct {
+    double deadline;
+    double started;
+    const char *entry;
+    int budget_ms;
+    LONG armed;
+    wd_hook saved;
+} wd_frame;
+
+static wd_rule s_rules[WD_MAX_RULES] = {
+    { "hook:*", 2000 },
+    { "worker callback", 2000 },
+    { "console:*", 30000 },
+    { "plugin:*", 30000 },
+    { "wm:*", 30000 },
+    { "script:*", 30000 },
+    { "OnDoFile", 30000 },
+};
+static int s_nrules = 7;
+
+static struct {
+    lua_State *L;
+    HANDLE thread;
+    HANDLE wake;
+    int enabled;
+    double fired_count;
+    volatile LONG quit;
+    volatile LONG armed;
+    volatile LONG fired;
+    volatile double deadline;
+    double started;
+    const char *entry;
+    int budget_ms;
+    int traced;
+    // the hook installed before the entry, put back when ours goes
+    wd_hook saved;
+    // the error with the traceback of where the budget ran out
+    char trace[WD_TRACE_MAX];
+} s_wd = { NULL, NULL, NULL, 1, 0 };
+
+static wd_frame s_stack[WD_STACK_MAX];
+static int s_depth = 0;
+
+
+// budget of the longest rule matching entry, -1 if none does
+static int
+find_budget(const char *entry)
+{
+    int best_len = -1;
+    int budget = -1;
+
+    for (int i = 0; i < s_nrules; i++) {
+        const char *pattern = s_rules[i].pattern;
+        int len = (int) strlen(pattern);
+        int match;
+        if (len > 0 && pattern[len - 1] == '*') {
+            match = strncmp(entry, pattern, len - 1) == 0;
+        } else {
+            match = strcmp(entry, pattern) == 0;
+        }
+        if (match && len > best_len) {
+            best_len = len;
+            budget = s_rules[i].budget_ms;
+        }
+    }
+    return budget;
+}
+
+
+static void
+restore_hook(lua_State *L)
+{
+    lua_sethook(L, s_wd.saved.func, s_wd.saved.mask, s_wd.saved.count);
+}
+
+
+static void
+watchdog_hook(lua_State *L, lua_Debug *ar)
+{
+    (void) ar;
+    // the thread only looks at the deadline, confirm it here
+    if (!s_wd.armed || GetClockMs() <= s_wd.deadline) {
+        InterlockedExchange(&s_wd.fired, 0);
+        restore_hook(L);
+        return;
+    }
+    // the hook stays installed, a pcall in the script cannot swallow this;
+    // every raise carries the traceback of the first, where the script was
+    // when the budget ran out
+    if (!s_wd.traced) {
+        char msg[WD_PATTERN_MAX + 64];
+        snprintf(msg, sizeof(msg), "watchdog: %s ran longer than its %d ms budget",
+                 s_wd.entry ? s_wd.entry : "?", s_wd.budget_ms);
+        luaL_traceback(L, L, msg, 0);
+        snprintf(s_wd.trace, sizeof(s_wd.trace), "%s", lua_tostring(L, -1));
+        lua_pop(L, 1);
+        s_wd.traced = 1;
+    }
+    lua_pushstring(L, s_wd.trace);
+    lua_error(L);
+}
+
+
+static DWORD WINAPI
+watchdog_main(LPVOID arg)
+{
+    (void) arg;
+    while (!s_wd.quit) {
+        WaitForSingleObject(s_wd.wake, WD_TICK_MS);
+        if (s_wd.armed && !s_wd.fired && GetClockMs() > s_wd.deadline) {
+            InterlockedExchange(&s_wd.fired, 1);
+            s_wd.fired_count += 1;
+            // lua_sethook is the one API call that is safe from another
+            // thread, it is how lua.c and luajit.c handle Ctrl-C. With a
+            // count of 1 the error is raised again on the first instruction
+            // outside whatever pcall caught it.
+            lua_sethook(s_wd.L, watchdog_hook, LUA_MASKCOUNT, 1);
+        }
+    }
+    return 0;
+}
+
+
+static int
+start_thread(void)
+{
+    if (s_wd.thread != NULL) {
+        return 1;
+    }
+    s_wd.quit = 0;
+    s_wd.wake = CreateEventA(NULL, FALSE, FALSE, NULL);
+    if (s_wd.wake == NULL) {
+        return 0;
+    }
+    s_wd.thread = CreateThread(NULL, 0, watchdog_main, NULL, 0, NULL);
+    if (s_wd.thread == NULL) {
+        LOGE("CreateThread failed");
+        CloseHandle(s_wd.wake);
+        s_wd.wake = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+
+int
+watchdog_enter(lua_State *L, const char *entry)
+{
+    if (!s_wd.enabled || s_depth >= WD_STACK_MAX) {
+        return 0;
+    }
+    int budget = find_budget(entry);
+    if (budget < 0 || !start_thread()) {
+        // no rule of its own, the enclosing budget keeps running
+        return 0;
+    }
+
+    wd_frame *f = &s_stack[s_depth++];
+    f->deadline = s_wd.deadline;
+    f->started = s_wd.started;
+    f->entry = s_wd.entry;
+    f->budget_ms = s_wd.budget_ms;
+    f->armed = s_wd.armed;
+    f->saved = s_wd.saved;
+    // a debugger or script hook set before the entry; ours can only be
+    // there while an outer entry is being aborted
+    if (lua_gethook(L) != watchdog_hook) {
+        s_wd.saved.func = lua_gethook(L);
+        s_wd.saved.mask = lua_gethookmask(L);
+        s_wd.saved.count = lua_gethookcount(L);
+    }
+
+    double now = GetClockMs();
+    InterlockedExchange(&s_wd.armed, 0);
+    s_wd.L = L;
+    s_wd.entry = entry;
+    s_wd.budget_ms = budget;
+    s_wd.started = now;
+    s_wd.deadline = now + budget;
+    InterlockedExchange(&s_wd.armed, budget > 0);
+    return 1;
+}
+
+
+void
+watchdog_leave(lua_State *L, int token)
+{
+    if (!token) {
+        return;
+    }
+
+    double now = GetClockMs();
+    wd_frame *f = &s_stack[--s_depth];
+
+    InterlockedExchange(&s_wd.armed, 0);
+    if (InterlockedExchange(&s_wd.fired, 0)) {
+        restore_hook(L);
+    }
+    s_wd.traced = 0;
+    // time spent in a nested budgeted entry is not charged to the outer one
+    s_wd.deadline = f->deadline + (now - s_wd.started);
+    s_wd.started = f->started;
+    s_wd.entry = f->entry;
+    s_wd.budget_ms = f->budget_ms;
+    s_wd.saved = f->saved;
+    InterlockedExchange(&s_wd.armed, f->armed);
+}
+
+
+void
+watchdog_shutdown(void)
+{
+    if (s_wd.thread == NULL) {
+        return;
+    }
+    InterlockedExchange(&s_wd.quit, 1);
+    SetEvent(s_wd.wake);
+    WaitForSingleObject(s_wd.thread, INFINITE);
+    CloseHandle(s_wd.thread);
+    CloseHandle(s_wd.wake);
+    s_wd.thread = NULL;
+    s_wd.wake = NULL;
+}
+
+
+static void
+set_rule(const char *pattern, int budget_ms)
+{
+    for (int i = 0; i < s_nrules; i++) {
+        if (strcmp(s_rules[i].pattern, pattern) == 0) {
+            if (budget_ms < 0) {
+                s_rules[i] = s_rules[--s_nrules];
+            } else {
+                s_rules[i].budget_ms = budget_ms;
+            }
+            return;
+        }
+    }
+    if (budget_ms >= 0 && s_nrules < WD_MAX_RULES) {
+        snprintf(s_rules[s_nrules].pattern, WD_PATTERN_MAX, "%s", pattern);
+        s_rules[s_nrules].budget_ms = budget_ms;
+        s_nrules++;
+    }
+}
+
+
+// eelua.watchdog(true|false) switches the watchdog on or off,
+// eelua.watchdog({ ["hook:*"] = 500, ["script:*"] = 0, OnDoFile = false })
+// sets budgets in ms (0 = unlimited, false removes the rule).
+// Returns { enabled=, fired=, rules={ [pattern] = ms } }.
+static int
+Leelua_watchdog(lua_State *L)
+{
+    if (lua_isboolean(L, 1)) {
+        s_wd.enabled = lua_toboolean(L, 1);
+    } else if (lua_istable(L, 1)) {
+        lua_pushnil(L);
+        while (lua_next(L, 1) != 0) {
+            const char *pattern = luaL_checkstring(L, -2);
+            luaL_argcheck(L, strlen(pattern) < WD_PATTERN_MAX, 1, "pattern too long");
+            if (lua_isboolean(L, -1) && !lua_toboolean(L, -1)) {
+                set_rule(pattern, -1);
+            } else {
+                set_rule(pattern, (int) luaL_checkinteger(L, -1));
+            }
+            lua_pop(L, 1);
+        }
+    } else if (!lua_isnoneornil(L, 1)) {
+        luaL_typerror(L, 1, "boolean or table");
+    }
+
+    lua_createtable(L, 0, 3);
+    lua_pushboolean(L, s_wd.enabled);
+    lua_setfield(L, -2, "enabled");
+    lua_pushnumber(L, s_wd.fired_count);
+    lua_setfield(L, -2, "fired");
+    lua_createtable(L, 0, s_nrules);
+    for (int i = 0; i < s_nrules; i++) {
+        lua_pushinteger(L, s_rules[i].budget_ms);
+        lua_setfield(L, -2, s_rules[i].pattern);
+    }
+    lua_setfield(L, -2, "rules");
+    return 1;
+}
+
+
+void
+watchdog_register(lua_State *L)
+{
+    lua_pushcfunction(L, Leelua_watchdog);
+    lua_setfield(L, -2, "watchdog");
+}
@@ -0,0 +1,38 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#ifndef EELUA_WATCHDOG_H_
+#define EELUA_WATCHDOG_H_
+
+#include "config.h"
+#include "lua.h"
+
+// Time budgets for luaH_docall entry points. A background thread polls the
+// deadline of the innermost budgeted entry; once it passes, a count hook is
+// installed that raises "watchdog: ..." on every instruction until that
+// entry unwinds, so even a script that swallows errors with pcall gets
+// aborted, and every raise carries the traceback of the first. A hook set
+// before the entry, by a debugger say, is put back when it unwinds.
+//
+// Hooks do not run inside JIT-compiled loops. Scripts and console chunks
+// are loaded with the JIT off (script_cache.interruptible), so they can be
+// stopped anywhere; the code of plugins, hooks and required modules is
+// compiled and is only stopped once a loop leaves its trace.
+//
+// Budgets come from rules matched against the entry name ("hook:*" matches
+// every hook), the longest matching rule wins and a budget of 0 means
+// unlimited. Main VM only.
+
+// Returns a token for watchdog_leave(), 0 when the entry has no budget.
+int watchdog_enter(lua_State *L, const char *entry);
+void watchdog_leave(lua_State *L, int token);
+
+// Stops the watchdog thread.
+void watchdog_shutdown(void);
+
+// Registers eelua.watchdog() into the table on top.
+void watchdog_register(lua_State *L);
+
+#endif  // EELUA_WATCHDOG_H_
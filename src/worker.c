@@ -0,0 +1,527 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#include "worker.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#include "util.h"
+#include "eelua.h"
+#include "eelua_plugin.h"
+#include "lua_helper.h"
+#include "serialize.h"
+
+#define LOG_TAG     "worker"
+
+#define DEFAULT_WORKERS     2
+
+typedef struct {
+    int id;
+    int cb_ref;
+    char *module;
+    char *func;
+    sbuf args;
+    sbuf result;
+    int ok;
+} job;
+
+// single producer / single consumer ring
+typedef struct {
+    job *slots[WORKER_RING_SIZE];
+    volatile LONG head;  // consumer
+    volatile LONG tail;  // producer
+} ring;
+
+typedef struct {
+    HANDLE thread;
+    HANDLE wake;
+    volatile LONG quit;
+    lua_State *L;
+    ring inbox;   // main -> worker
+    ring outbox;  // worker -> main
+    int inflight; // owned by the main thread
+} worker;
+
+static worker s_workers[WORKER_MAX];
+static int s_worker_nr = 0;
+static char *s_package_path = NULL;
+static int s_next_job_id = 1;
+static lua_State *s_main_L = NULL;
+static int s_idle_hooked = 0;
+
+static struct {
+    double submitted;
+    double completed;
+    double failed;
+} s_stats;
+
+
+// Interlocked operations double as full barriers; the other side's index
+// is read with a no-op compare-exchange so it is an acquiring load.
+#define ATOMIC_LOAD(p)  InterlockedCompareExchange((p), 0, 0)
+
+static int
+ring_push(ring *r, job *j)
+{
+    LONG tail = r->tail;
+    if (tail - ATOMIC_LOAD(&r->head) >= WORKER_RING_SIZE) {
+        return 0;
+    }
+    r->slots[tail % WORKER_RING_SIZE] = j;
+    InterlockedExchange(&r->tail, tail + 1);
+    return 1;
+}
+
+
+static job *
+ring_pop(ring *r)
+{
+    LONG head = r->head;
+    if (head == ATOMIC_LOAD(&r->tail)) {
+        return NULL;
+    }
+    job *j = r->slots[head % WORKER_RING_SIZE];
+    InterlockedExchange(&r->head, head + 1);
+    return j;
+}
+
+
+static void
+job_free(job *j)
+{
+    free(j->module);
+    free(j->func);
+    sbuf_free(&j->args);
+    sbuf_free(&j->result);
+    free(j);
+}
+
+
+static void
+set_error(job *j, const char *msg)
+{
+    if (msg == NULL) {
+        msg = "(error object is not a string)";
+    }
+    sbuf_free(&j->result);
+    serialize_string(&j->result, msg, strlen(msg));
+    j->ok = 0;
+}
+
+
+// require(module)[func], run protected: whatever the module returns, a
+// failure is an error message and not a panic of the worker state.
+static int
+job_lookup(lua_State *L)
+{
+    const char *module = luaL_checkstring(L, 1);
+    const char *func = luaL_checkstring(L, 2);
+
+    lua_getglobal(L, "require");
+    lua_pushvalue(L, 1);
+    lua_call(L, 1, 1);
+    if (!lua_istable(L, -1)) {
+        return luaL_error(L, "module %s returned %s, not a table",
+                          module, luaL_typename(L, -1));
+    }
+    lua_getfield(L, -1, func);
+    if (!lua_isfunction(L, -1)) {
+        return luaL_error(L, "%s.%s is not a function", module, func);
+    }
+    return 1;
+}
+
+
+static void
+run_job(worker *w, job *j)
+{
+    lua_State *L = w->L;
+    int top = lua_gettop(L);
+    const char *err = NULL;
+
+    lua_pushcfunction(L, job_lookup);
+    lua_pushstring(L, j->module);
+    lua_pushstring(L, j->func);
+    if (luaH_docall(L, 2, 1, NULL) != LUA_OK) {
+        set_error(j, lua_tostring(L, -1));
+        lua_settop(L, top);
+        return;
+    }
+
+    int nargs = deserialize_values(L, j->args.data, j->args.len);
+    if (nargs < 0) {
+        set_error(j, "malformed job arguments");
+        lua_settop(L, top);
+        return;
+    }
+
+    int base = lua_gettop(L) - nargs;
+    if (luaH_docall(L, nargs, LUA_MULTRET, NULL) != LUA_OK) {
+        set_error(j, lua_tostring(L, -1));
+    } else if (serialize_values(L, base, lua_gettop(L), &j->result, &err) != 0) {
+        set_error(j, err);
+    } else {
+        j->ok = 1;
+    }
+    lua_settop(L, top);
+}
+
+
+static DWORD WINAPI
+worker_main(LPVOID arg)
+{
+    worker *w = (worker *) arg;
+
+    for (;;) {
+        job *j = ring_pop(&w->inbox);
+        if (j == NULL) {
+            if (ATOMIC_LOAD(&w->quit)) {
+                break;
+            }
+            WaitForSingleObject(w->wake, INFINITE);
+            continue;
+        }
+
+        run_job(w, j);
+        lua_gc(w->L, LUA_GCSTEP, 0);
+        // the main thread never has more than WORKER_RING_SIZE jobs in
+        // flight per worker, so this only spins if it is not polling
+        while (!ring_push(&w->outbox, j)) {
+            Sleep(1);
+        }
+    }
+    return 0;
+}
+
+
+static lua_State *
+worker_newstate(void)
+{
+    lua_State *L = luaL_newstate();
+    if (L == NULL) {
+        return NULL;
+    }
+    luaL_openlibs(L);
+    luaopen_eelua_worker(L);
+    lua_pop(L, 1);
+
+    if (s_package_path != NULL) {
+        lua_getglobal(L, "package");
+        lua_pushstring(L, s_package_path);
+        lua_setfield(L, -2, "path");
+        lua_pop(L, 1);
+    }
+    return L;
+}
+
+
+static int
+worker_start(lua_State *L, int n)
+{
+    if (s_worker_nr > 0) {
+        return s_worker_nr;
+    }
+    if (n < 1) {
+        n = 1;
+    } else if (n > WORKER_MAX) {
+        n = WORKER_MAX;
+    }
+
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "path");
+    const char *path = lua_tostring(L, -1);
+    free(s_package_path);
+    s_package_path = NULL;
+    if (path != NULL) {
+        s_package_path = (char *) malloc(strlen(path) + 1);
+        if (s_package_path != NULL) {
+            strcpy(s_package_path, path);
+        }
+    }
+    lua_pop(L, 2);
+
+    for (int i = 0; i < n; i++) {
+        worker *w = &s_workers[i];
+        memset(w, 0, sizeof(*w));
+        w->L = worker_newstate();
+        w->wake = CreateEventA(NULL, FALSE, FALSE, NULL);
+        if (w->L != NULL && w->wake != NULL) {
+            w->thread = CreateThread(NULL, 0, worker_main, w, 0, NULL);
+        }
+        if (w->thread == NULL) {
+            if (w->L != NULL) {
+                lua_close(w->L);
+            }
+            if (w->wake != NULL) {
+                CloseHandle(w->wake);
+            }
+            memset(w, 0, sizeof(*w));
+            break;
+        }
+        s_worker_nr++;
+    }
+
+    if (s_worker_nr == 0) {
+        LOGE("unable to start any worker");
+    }
+    return s_worker_nr;
+}
+
+
+void
+worker_shutdown(void)
+{
+    for (int i = 0; i < s_worker_nr; i++) {
+        worker *w = &s_workers[i];
+        InterlockedExchange(&w->quit, 1);
+        SetEvent(w->wake);
+    }
+
+    for (int i = 0; i < s_worker_nr; i++) {
+        worker *w = &s_workers[i];
+        WaitForSingleObject(w->thread, INFINITE);
+        CloseHandle(w->thread);
+        CloseHandle(w->wake);
+
+        job *j;
+        while ((j = ring_pop(&w->inbox)) != NULL) {
+            job_free(j);
+        }
+        while ((j = ring_pop(&w->outbox)) != NULL) {
+            job_free(j);
+        }
+        lua_close(w->L);
+        memset(w, 0, sizeof(*w));
+    }
+    s_worker_nr = 0;
+    s_main_L = NULL;
+    free(s_package_path);
+    s_package_path = NULL;
+}
+
+
+static void
+deliver(lua_State *L, job *j)
+{
+    if (j->ok) {
+        s_stats.completed += 1;
+    } else {
+        s_stats.failed += 1;
+    }
+
+    if (j->cb_ref == LUA_NOREF) {
+        return;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, j->cb_ref);
+    luaL_unref(L, LUA_REGISTRYINDEX, j->cb_ref);
+    lua_pushboolean(L, j->ok);
+    int n = deserialize_values(L, j->result.data, j->result.len);
+    if (n < 0) {
+        lua_pop(L, 1);
+        lua_pushboolean(L, 0);
+        lua_pushliteral(L, "malformed job result");
+        n = 1;
+    }
+
+    if (luaH_docall(L, n + 1, 0, "worker callback") != LUA_OK) {
+        ReportLuaError(lua_tostring(L, -1));
+        lua_pop(L, 1);
+    }
+}
+
+
+int
+worker_poll(lua_State *L)
+{
+    int delivered = 0;
+    for (int i = 0; i < s_worker_nr; i++) {
+        worker *w = &s_workers[i];
+        job *j;
+        while ((j = ring_pop(&w->outbox)) != NULL) {
+            w->inflight--;
+            deliver(L, j);
+            job_free(j);
+            delivered++;
+        }
+    }
+    return delivered;
+}
+
+
+static LONG_PTR
+OnAppIdle(HWND hwnd, HWND frame)
+{
+    if (s_main_L != NULL) {
+        worker_poll(s_main_L);
+    }
+    return 0;
+}
+
+
+static worker *
+pick_worker(void)
+{
+    worker *best = NULL;
+    for (int i = 0; i < s_worker_nr; i++) {
+        worker *w = &s_workers[i];
+        if (w->inflight < WORKER_RING_SIZE
+            && (best == NULL || w->inflight < best->inflight)) {
+            best = w;
+        }
+    }
+    return best;
+}
+
+
+static char *
+dup_string(lua_State *L, int idx)
+{
+    size_t len;
+    const char *s = luaL_checklstring(L, idx, &len);
+    char *p = (char *) malloc(len + 1);
+    if (p != NULL) {
+        memcpy(p, s, len + 1);
+    }
+    return p;
+}
+
+
+// eelua.spawn(module, func, args, callback) -> job_id | nil, errmsg
+// Runs require(module)[func](unpack(args)) on a worker; callback(ok, ...)
+// is called on the main thread with the results or the error message.
+static int
+Leelua_spawn(lua_State *L)
+{
+    const char *err = NULL;
+    luaL_checkstring(L, 1);
+    luaL_checkstring(L, 2);
+    if (!lua_isnoneornil(L, 3)) {
+        luaL_checktype(L, 3, LUA_TTABLE);
+    }
+    if (!lua_isnoneornil(L, 4)) {
+        luaL_checktype(L, 4, LUA_TFUNCTION);
+    }
+
+    if (worker_start(L, DEFAULT_WORKERS) == 0) {
+        lua_pushnil(L);
+        lua_pushliteral(L, "no worker available");
+        return 2;
+    }
+    s_main_L = L;
+    if (!s_idle_hooked && g_ee_context != NULL) {
+        SendMessageA(g_ee_context->hMain, EEM_SETHOOK, EEHOOK_APPIDLE,
+                     (LPARAM) OnAppIdle);
+        s_idle_hooked = 1;
+    }
+
+    worker *w = pick_worker();
+    if (w == NULL) {
+        lua_pushnil(L);
+        lua_pushliteral(L, "worker queues are full");
+        return 2;
+    }
+
+    job *j = (job *) calloc(1, sizeof(job));
+    if (j == NULL) {
+        return luaL_error(L, "out of memory");
+    }
+    j->module = dup_string(L, 1);
+    j->func = dup_string(L, 2);
+
+    if (lua_istable(L, 3)) {
+        int n = (int) lua_objlen(L, 3);
+        lua_checkstack(L, n);
+        for (int i = 1; i <= n; i++) {
+            lua_rawgeti(L, 3, i);
+        }
+        int top = lua_gettop(L);
+        int rc = serialize_values(L, top - n + 1, top, &j->args, &err);
+        lua_pop(L, n);
+        if (rc != 0) {
+            job_free(j);
+            lua_pushnil(L);
+            lua_pushstring(L, err);
+            return 2;
+        }
+    }
+
+    if (lua_isfunction(L, 4)) {
+        lua_pushvalue(L, 4);
+        j->cb_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    } else {
+        j->cb_ref = LUA_NOREF;
+    }
+    j->id = s_next_job_id++;
+
+    int id = j->id;
+    ring_push(&w->inbox, j);
+    w->inflight++;
+    SetEvent(w->wake);
+    s_stats.submitted += 1;
+
+    lua_pushinteger(L, id);
+    return 1;
+}
+
+
+// eelua.worker_start(n) starts n workers (default 2) ahead of the first
+// eelua.spawn(), returns the number of running workers.
+static int
+Leelua_worker_start(lua_State *L)
+{
+    lua_pushinteger(L, worker_start(L, (int) luaL_optinteger(L, 1, DEFAULT_WORKERS)));
+    return 1;
+}
+
+
+static int
+Leelua_worker_poll(lua_State *L)
+{
+    lua_pushinteger(L, worker_poll(L));
+    return 1;
+}
+
+
+static int
+Leelua_worker_stats(lua_State *L)
+{
+    int pending = 0;
+    for (int i = 0; i < s_worker_nr; i++) {
+        pending += s_workers[i].inflight;
+    }
+
+    lua_createtable(L, 0, 5);
+    lua_pushinteger(L, s_worker_nr);
+    lua_setfield(L, -2, "workers");
+    lua_pushinteger(L, pending);
+    lua_setfield(L, -2, "pending");
+    lua_pushnumber(L, s_stats.submitted);
+    lua_setfield(L, -2, "submitted");
+    lua_pushnumber(L, s_stats.completed);
+    lua_setfield(L, -2, "completed");
+    lua_pushnumber(L, s_stats.failed);
+    lua_setfield(L, -2, "failed");
+    return 1;
+}
+
+
+void
+worker_register(lua_State *L)
+{
+    lua_pushcfunction(L, Leelua_spawn);
+    lua_setfield(L, -2, "spawn");
+    lua_pushcfunction(L, Leelua_worker_start);
+    lua_setfield(L, -2, "worker_start");
+    lua_pushcfunction(L, Leelua_worker_poll);
+    lua_setfield(L, -2, "worker_poll");
+    lua_pushcfunction(L, Leelua_worker_stats);
+    lua_setfield(L, -2, "worker_stats");
+}
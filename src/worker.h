@@ -0,0 +1,30 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#ifndef EELUA_WORKER_H_
+#define EELUA_WORKER_H_
+
+#include "config.h"
+#include "lua.h"
+
+// Background worker pool. Every worker thread owns a lua_State with the
+// standard libraries and the pure-Lua eelua modules on package.path.
+// Jobs and results are serialized and passed through single-producer/
+// single-consumer rings; completions are delivered back to the main VM
+// from the idle hook (or an explicit eelua.worker_poll()).
+
+#define WORKER_MAX          16
+#define WORKER_RING_SIZE    256
+
+// Runs finished jobs' callbacks in L, returns how many were delivered.
+int worker_poll(lua_State *L);
+
+// Stops all worker threads and closes their states.
+void worker_shutdown(void);
+
+// Registers eelua.spawn() and friends into the table on top.
+void worker_register(lua_State *L);
+
+#endif  // EELUA_WORKER_H_
@@ -0,0 +1,88 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+// The plugin's C core against the simulator host (sim/host.c), without
+// running eelua_init.lua.
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#include "eelua.h"
+#include "eelua_plugin.h"
+#include "errqueue.h"
+#include "hooks.h"
+#include "journal.h"
+#include "host.h"
+#include "test.h"
+
+
+// check(cond, what) for the Lua side, reported at the calling line
+static int
+l_check(lua_State *L)
+{
+    lua_Debug ar;
+    const char *file = "?";
+    int line = 0;
+    if (lua_getstack(L, 1, &ar) && lua_getinfo(L, "Sl", &ar)) {
+        file = ar.short_src;
+        line = ar.currentline;
+    }
+    test_check(lua_toboolean(L, 1), luaL_optstring(L, 2, "check"), file, line);
+    return 0;
+}
+
+
+void
+fixture_openlua(lua_State *L)
+{
+    luaL_openlibs(L);
+    lua_register(L, "check", l_check);
+    lua_getglobal(L, "package");
+    lua_pushliteral(L, "ezip/eelua/?.lua;tests/lua/?.lua");
+    lua_setfield(L, -2, "path");
+    lua_pop(L, 1);
+}
+
+
+void
+fixture_dofile(lua_State *L, const char *file)
+{
+    if (luaL_dofile(L, file) != 0) {
+        test_check(0, lua_tostring(L, -1), file, 0);
+    }
+    lua_settop(L, 0);
+}
+
+
+lua_State *
+fixture_open(void)
+{
+    if (!host_init()) {
+        return NULL;
+    }
+    g_ee_context = host_context();
+
+    lua_State *L = luaL_newstate();
+    fixture_openlua(L);
+    luaopen_eelua(L);
+    lua_pushlightuserdata(L, g_ee_context);
+    lua_setfield(L, -2, "_ee_context");
+    lua_pop(L, 1);
+    return L;
+}
+
+
+void
+fixture_close(lua_State *L)
+{
+    // the hooks go while the host that holds them is still there
+    hooks_shutdown();
+    journal_shutdown();
+    errqueue_shutdown();
+    lua_close(L);
+    host_shutdown();
+    g_ee_context = NULL;
+}
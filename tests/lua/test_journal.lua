@@ -0,0 +1,125 @@
+-- Tests of eelua.core.journal, run by tests/test_document.c with check()
+-- and the document doc_hwnd from there. After each round of edits the
+-- snapshot must read as the document does, while only the changed lines
+-- are read again: the segments of the last snapshot are spliced by
+-- replace() and sliced out of the old rope by rebuild().
+
+local EE_Document = require "eelua.core.EE_Document"
+
+local doc = EE_Document.new(doc_hwnd)
+
+-- lines read through doc:getlines() since the last reset
+local reads = 0
+local getlines = EE_Document.getlines
+EE_Document.getlines = function(self, first, last, out)
+  local lines, n = getlines(self, first, last, out)
+  reads = reads + n
+  return lines, n
+end
+
+local function text_of(n)
+  local t = {}
+  for i = 1, n do
+    t[i] = "line " .. i
+  end
+  return table.concat(t, "\n")
+end
+
+-- snapshot of doc after the edits, checked against the text and against
+-- the number of lines it may read
+local function check_snapshot(what, max_reads)
+  host_pump()
+  reads = 0
+  local snap = doc:snapshot()
+  local n_read = reads
+  local want, n = getlines(doc, 0)
+  local same = snap.line_nr == n
+  for i = 1, n do
+    if snap:getline(i - 1) ~= want[i] then
+      same = false
+      break
+    end
+  end
+  check(same, what .. ": snapshot reads as the document")
+  if max_reads ~= nil then
+    check(n_read <= max_reads, what .. ": read " .. n_read .. " lines, at most " .. max_reads)
+  end
+  return snap
+end
+
+doc:insert(text_of(100))
+check_snapshot("first", 100)
+
+-- one line changed, then the same snapshot while nothing changes
+doc:setlines(49, 49, "changed")
+local snap = check_snapshot("one line", 1)
+check(doc:snapshot() == snap, "unchanged document, same snapshot")
+
+-- lines inserted, and a line deleted before the same spot; the line an
+-- edit starts or ends on counts as changed
+doc:insert_at(10, 0, "new 1\nnew 2\nnew 3\n")
+doc:delete({ line = 5, col = 0 }, { line = 6, col = 0 })
+check_snapshot("insert and delete", 5)
+
+-- adjacent edits, each next to the last one, merge into one segment
+doc:setlines(20, 20, "a")
+doc:setlines(21, 21, "b")
+doc:setlines(19, 19, "c")
+check_snapshot("adjacent", 3)
+
+-- an edit over two earlier ones and the old lines between them
+doc:setlines(30, 30, "x")
+doc:setlines(40, 40, "y")
+doc:setlines(30, 40, "z1\nz2")
+check_snapshot("overlapping", 2)
+
+-- lines inserted and then deleted again before the snapshot
+doc:insert_at(60, 0, "gone 1\ngone 2\n")
+doc:delete({ line = 60, col = 0 }, { line = 62, col = 0 })
+check_snapshot("inserted and deleted", 1)
+
+-- the first and the last line, text appended and cut from the end
+doc:setlines(0, 0, "first")
+doc:setlines(doc.line_nr - 1, doc.line_nr - 1, "last")
+check_snapshot("ends", 2)
+doc:insert_at(doc.line_nr - 1, 4, "\nmore 1\nmore 2")
+check_snapshot("appended", 3)
+doc:delete({ line = doc.line_nr - 10, col = 0 }, { line = doc.line_nr, col = 0 })
+check_snapshot("cut from the end", 1)
+
+-- a line split in the middle and joined again
+doc:insert_at(70, 2, "\n")
+check_snapshot("split", 2)
+doc:delete({ line = 70, col = 2 }, { line = 71, col = 0 })
+check_snapshot("joined", 1)
+
+-- random edits, several per snapshot
+local seed = 12345
+local function random(n)
+  seed = (seed * 1103515245 + 12345) % 2147483648
+  return seed % n
+end
+
+local ok = true
+for round = 1, 50 do
+  for _ = 1, 1 + random(4) do
+    local n = doc.line_nr
+    local first = random(n)
+    local last = math.min(n - 1, first + random(3))
+    local kind = random(3)
+    if kind == 0 then
+      doc:setlines(first, last, "r" .. round .. "\nr" .. round)
+    elseif kind == 1 then
+      doc:insert_at(first, 0, "i" .. round .. "\n")
+    elseif n > 1 then
+      doc:delete({ line = first, col = 0 }, { line = last + 1, col = 0 })
+    end
+  end
+  host_pump()
+  local snap = doc:snapshot()
+  local want, n = getlines(doc, 0)
+  if snap.line_nr ~= n or snap:text() ~= table.concat(want, "\n", 1, n) then
+    ok = false
+  end
+end
+check(ok, "random edits")
@@ -0,0 +1,139 @@
+-- Tests of eelua.reload, run by tests/test_reload.c with check() from
+-- there. Files change in an in-memory watcher backend; plugins are loaded
+-- from memory too, modules from files next to os.tmpname().
+
+local reload = require "eelua.reload"
+local watcher = require "eelua.watcher"
+local path = require "minipath"
+
+local PLUGINS = "/plugins"
+
+-- filepath -> { stamp =, source = }
+local files = {}
+
+watcher.register_backend("mem", {
+  snapshot = function(dir, recursive)
+    local out = {}
+    for filepath, f in pairs(files) do
+      if path.getdirectory(filepath) == dir then
+        out[filepath] = f.stamp
+      end
+    end
+    return out
+  end
+})
+
+local function put(filepath, source)
+  local f = files[filepath]
+  files[filepath] = { stamp = f and f.stamp + 1 or 1, source = source }
+end
+
+local errors = {}
+reload.on_error = function(msg)
+  table.insert(errors, msg)
+end
+reload.plugins_dir = PLUGINS
+reload.loadfile = function(filepath)
+  return load(files[filepath].source, "@" .. filepath)
+end
+
+local tmp = os.tmpname()
+local tmp_dir = path.getdirectory(tmp)
+local module_name = path.getname(tmp) .. "_reload_mod"
+local module_file = path.join(tmp_dir, module_name .. ".lua")
+package.path = tmp_dir .. "/?.lua;" .. package.path
+
+reload.watch({ { dir = PLUGINS }, { dir = tmp_dir } }, "mem")
+
+-- plugins: registrations are undone by owner
+
+registry = {}
+
+local plugin = PLUGINS .. "/a.lua"
+local function plugin_source(name)
+  return ([[
+local reload = require "eelua.reload"
+registry.%s = true
+reload.track(function() registry.%s = nil end)
+]]):format(name, name)
+end
+
+put(plugin, plugin_source("first"))
+check(reload.poll() == 1, "added plugin is loaded")
+check(registry.first == true, "plugin ran")
+check(reload.owners()[plugin] == 1, "registration recorded under its file")
+
+put(plugin, plugin_source("second"))
+check(reload.poll() == 1, "modified plugin is reloaded")
+check(registry.first == nil, "old registration undone")
+check(registry.second == true, "new version ran")
+check(reload.owners()[plugin] == 1, "only the new registration is left")
+
+put(plugin, "registry.third = ")
+check(reload.poll() == 0, "broken plugin is not counted")
+check(#errors == 1 and errors[1]:find("a.lua", 1, true) ~= nil, "error reported")
+check(registry.second == true and registry.third == nil, "old version keeps running")
+
+files[plugin] = nil
+check(reload.poll() == 1, "removed plugin is unloaded")
+check(registry.second == nil, "its registrations are undone")
+check(reload.owners()[plugin] == nil, "and forgotten")
+
+reload.track(function() end)
+check(next(reload.owners()) == nil, "registrations outside run_as are permanent")
+
+local ok, errmsg = reload.run_as("outer", function()
+  reload.track(function() end)
+  reload.run_as("inner", function()
+    reload.track(function() end)
+    reload.track(function() end)
+  end)
+  error("fails after registering", 0)
+end)
+check(not ok and errmsg == "fails after registering", "run_as returns like pcall")
+check(reload.owners().outer == 1 and reload.owners().inner == 2, "nested owners")
+check(reload.current_owner() == nil, "owner stack unwound")
+check(reload.unload("outer") == 1 and reload.unload("inner") == 2, "unload counts")
+
+-- modules: the loaded table follows the file
+
+local function write_module(source)
+  local fp = assert(io.open(module_file, "wb"))
+  fp:write(source)
+  fp:close()
+  put(module_file, source)
+end
+
+write_module([[
+local M = {}
+M.version = 1
+M.dropped = true
+function M.get() return M.version end
+return M
+]])
+local m = require(module_name)
+reload.poll()
+check(m.version == 1 and m.dropped == true, "module loaded")
+
+write_module([[
+local M = {}
+M.version = 2
+M.added = "yes"
+function M.get() return M.version * 10 end
+return M
+]])
+errors = {}
+check(reload.poll() == 1, "modified module is reloaded")
+check(package.loaded[module_name] == m, "same table stays loaded")
+check(m.version == 2 and m.added == "yes", "new fields copied")
+check(m.get() == 20, "new functions")
+check(m.dropped == nil, "fields missing from the new version cleared")
+
+write_module("return {")
+check(reload.poll() == 0, "broken module is not counted")
+check(#errors == 1 and errors[1]:find(module_name, 1, true) ~= nil, "module error reported")
+check(package.loaded[module_name] == m and m.version == 2, "old module stays")
+
+reload.watch(nil)
+os.remove(module_file)
+os.remove(tmp)
@@ -0,0 +1,91 @@
+-- Tests of doc.text = ..., run by tests/test_document.c with check() and
+-- the document doc_hwnd from there. The text must always come out as set;
+-- changes the diff takes are one undo step of hunks, the full replace is
+-- a delete and an insert, two steps.
+
+local EE_Document = require "eelua.core.EE_Document"
+
+local doc = EE_Document.new(doc_hwnd)
+
+local function text_of(n, fmt)
+  local t = {}
+  for i = 1, n do
+    t[i] = string.format(fmt or "line %d", i)
+  end
+  return table.concat(t, "\n")
+end
+
+local function text()
+  local lines, n = doc:getlines(0)
+  return table.concat(lines, "\n", 1, n)
+end
+
+local function reset(s)
+  doc:delete()
+  doc:insert_at(0, 0, s)
+end
+
+-- sets new on a document holding old, checks the text, the number of
+-- hunks settext returns and the undo steps it took (1 for the diff, 2 for
+-- the full replace); want_text is new unless given
+local function check_settext(what, old, new, want_hunks, want_steps, want_text)
+  reset(old)
+  local _, _, undo_steps = doc_stats()
+  local nh = doc:settext(new)
+  local _, _, undo_after = doc_stats()
+  check(text() == (want_text or new), what .. ": text")
+  check(nh == want_hunks, what .. ": " .. tostring(nh) .. " hunks, want " .. want_hunks)
+  check(undo_after - undo_steps == want_steps,
+        what .. ": " .. (undo_after - undo_steps) .. " undo steps, want " .. want_steps)
+end
+
+local TEN = text_of(10)
+
+check_settext("same text", TEN, TEN, 0, 0)
+check_settext("append at end", TEN, TEN .. "\nmore 1\nmore 2", 1, 1)
+check_settext("append to the last line", TEN, TEN .. " and more", 1, 1)
+check_settext("delete to end", TEN, text_of(4), 1, 1)
+check_settext("delete all but the first", TEN, "line 1", 1, 1)
+check_settext("insert at start", TEN, "new\n" .. TEN, 1, 1)
+check_settext("delete at start", TEN, TEN:sub(#"line 1\n" + 1), 1, 1)
+check_settext("two apart", TEN, TEN:gsub("line 3\n", "three\n"):gsub("line 8\n", ""), 2, 1)
+
+-- a trailing newline is an empty last line, added and taken away
+check_settext("trailing newline added", TEN, TEN .. "\n", 1, 1)
+check_settext("trailing newline removed", TEN .. "\n", TEN, 1, 1)
+check_settext("emptied", TEN, "", 1, 1)
+check_settext("from empty", "", TEN, 1, 1)
+
+-- CRLF splits like LF; the editor also breaks lines at a CR on its own,
+-- which the diff does not, so such text goes in by the full replace
+check_settext("CRLF", TEN, (TEN:gsub("line 5\n", "five\n"):gsub("\n", "\r\n")), 1, 1,
+              (TEN:gsub("line 5\n", "five\n")))
+check_settext("lone CR", TEN, "line 1\rline 2\n", 1, 2, "line 1\nline 2\n")
+check_settext("CR at the end", TEN, TEN .. "\r", 1, 2, TEN .. "\n")
+
+-- on a long text, a change near the end still goes through the diff past
+-- the leading lines, every line changed is put in anew before the rest is
+-- read, and so is a change to most lines further down
+local LONG = text_of(20000)
+check_settext("long, near the end", LONG, LONG:gsub("line 19990\n", "changed\n"), 1, 1)
+check_settext("long, appended", LONG, LONG .. "\nmore", 1, 1)
+check_settext("long, every line", LONG, text_of(20000, "other %d"), 1, 2)
+check_settext("long, most lines after the start", LONG,
+              text_of(200) .. "\n" .. text_of(19800, "other %d"), 1, 2)
+
+-- the probe of the leading lines: a line moves by at most the budget, so
+-- only lines with no equal one that near count as changed
+local diff = require "eelua.diff"
+local function lines_of(n, fmt, first)
+  local t = {}
+  for i = 1, n do
+    t[i] = string.format(fmt, (first or 1) + i - 1)
+  end
+  return t
+end
+local a = lines_of(40, "%d")
+check(not diff.over_prefix(a, 40, a, 40, 32, 8), "over_prefix: same lines")
+check(not diff.over_prefix(a, 40, lines_of(40, "%d", 9), 40, 32, 8), "over_prefix: shifted by the budget")
+check(diff.over_prefix(a, 40, lines_of(40, "%d", 10), 40, 32, 8), "over_prefix: shifted past it")
+check(diff.over_prefix(a, 40, lines_of(40, "x%d"), 40, 32, 8), "over_prefix: all changed")
+check(diff.over_prefix(a, 40, lines_of(4, "%d"), 4, 32, 8), "over_prefix: other side cut short")
@@ -0,0 +1,113 @@
+-- Tests of EE_Document:transaction(), run by tests/test_document.c with
+-- check() and the document doc_hwnd from there. Edits queued in one are
+-- sorted and merged where they touch, then applied as one undo step;
+-- overlapping ones raise an error and leave the document as it was.
+
+local EE_Document = require "eelua.core.EE_Document"
+
+local doc = EE_Document.new(doc_hwnd)
+
+local LINES = "l0\nl1\nl2\nl3\nl4\nl5\nl6\nl7\nl8\nl9"
+
+local function reset()
+  doc:delete()
+  doc:insert_at(0, 0, LINES)
+end
+
+local function text()
+  local lines, n = doc:getlines(0)
+  return table.concat(lines, "\n", 1, n)
+end
+
+-- runs fn in a transaction on a fresh document, checks the number of
+-- edits it applied, the text after it, and that it was one undo step
+local function check_tx(what, want_n, want_text, fn)
+  reset()
+  local _, _, undo_steps = doc_stats()
+  local n = doc:transaction(fn)
+  local _, _, undo_after = doc_stats()
+  check(n == want_n, what .. ": " .. tostring(n) .. " edits, want " .. want_n)
+  check(text() == want_text, what .. ": text")
+  check(undo_after == undo_steps + 1, what .. ": one undo step")
+end
+
+-- edits that meet merge into one, whichever order they come in
+check_tx("adjacent lines", 1, "l0\nl1\na\nb\nl4\nl5\nl6\nl7\nl8\nl9", function()
+  doc:setlines(2, 2, "a")
+  doc:setlines(3, 3, "b")
+end)
+check_tx("adjacent lines, bottom-up", 1, "l0\nl1\na\nb\nc\nl5\nl6\nl7\nl8\nl9", function()
+  doc:setlines(4, 4, "c")
+  doc:setlines(3, 3, "b")
+  doc:setlines(2, 2, "a")
+end)
+check_tx("line and deleted line after it", 1, "l0\nl1\na\nl4\nl5\nl6\nl7\nl8\nl9", function()
+  doc:setlines(2, 2, "a")
+  doc:delete({ line = 3, col = 0 }, { line = 4, col = 0 })
+end)
+check_tx("inserts at one spot, in call order", 1, "l0\nl1\nl2\nl3\nl4\nxyl5\nl6\nl7\nl8\nl9", function()
+  doc:insert_at(5, 0, "x")
+  doc:insert_at(5, 0, "y")
+end)
+check_tx("insert before a replaced line", 1, "l0\nl1\nl2\nl3\np\nq\nl5\nl6\nl7\nl8\nl9", function()
+  doc:setlines(4, 4, "q")
+  doc:insert_at(4, 0, "p\n")
+end)
+check_tx("delete and insert at its end", 1, "l0\nZ\nl2\nl3\nl4\nl5\nl6\nl7\nl8\nl9", function()
+  doc:insert_at(1, 2, "Z")
+  doc:delete({ line = 1, col = 0 }, { line = 1, col = 2 })
+end)
+
+-- apart, in no order, each one stays at its old position
+check_tx("apart", 3, "l0\na\nl2\nl3\nl4\nl5\nc\nl6\nl7\nl8\n", function()
+  doc:insert_at(6, 0, "c\n")
+  doc:setlines(1, 1, "a")
+  doc:setlines(9, 9, "")
+end)
+
+-- reads in the transaction see the text as it was before it
+check_tx("reads", 1, "l0\nl1\nnew\nl3\nl4\nl5\nl6\nl7\nl8\nl9", function()
+  doc:setlines(2, 2, "new")
+  check(doc:getline(2) == "l2", "reads: old line in the transaction")
+  check(doc.line_nr == 10, "reads: old line count in the transaction")
+end)
+
+-- a nested transaction hands its edits to the outer one
+check_tx("nested", 1, "l0\nl1\na\nb\nl4\nl5\nl6\nl7\nl8\nl9", function()
+  doc:setlines(2, 2, "a")
+  check(doc:transaction(function()
+    doc:setlines(3, 3, "b")
+  end) == nil, "nested: no count inside")
+end)
+
+-- overlapping edits, and errors in the function, apply nothing
+local function check_fails(what, pattern, fn)
+  reset()
+  local edits = doc_stats()
+  local ok, err = pcall(doc.transaction, doc, fn)
+  check(not ok and tostring(err):find(pattern, 1, true) ~= nil, what .. ": " .. tostring(err))
+  check(doc_stats() == edits and text() == LINES, what .. ": document unchanged")
+end
+
+check_fails("overlapping lines", "overlapping edits at 3:0", function()
+  doc:setlines(2, 4, "x")
+  doc:setlines(3, 3, "y")
+end)
+check_fails("overlapping in a line", "overlapping edits at 2:2", function()
+  doc:delete({ line = 2, col = 1 }, { line = 2, col = 3 })
+  doc:delete({ line = 2, col = 2 }, { line = 2, col = 4 })
+end)
+check_fails("insert in a deleted range", "overlapping edits at 4:1", function()
+  doc:delete({ line = 3, col = 0 }, { line = 5, col = 0 })
+  doc:insert_at(4, 1, "x")
+end)
+check_fails("error in the function", "script failed", function()
+  doc:setlines(2, 2, "a")
+  error("script failed", 0)
+end)
+
+-- after a failed one edits go to the document right away again
+reset()
+doc:setlines(0, 0, "direct")
+check(doc:getline(0) == "direct", "edit after a failed transaction")
+check(doc:transaction(function() end) == 0, "empty transaction")
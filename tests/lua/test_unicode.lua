@@ -0,0 +1,121 @@
+-- Tests of the streaming conversions of unicode.lua, run by
+-- tests/test_unicode.c with check() from there. Text cut into pieces at
+-- every offset must convert to the same as in one piece. The simulator
+-- shim converts every code page as UTF-8, so the ANSI code page is tried
+-- along with CP_UTF8.
+
+local ffi = require "ffi"
+local unicode = require "unicode"
+
+local CP_UTF8 = 65001
+local CP_ACP = 0
+local WCHAR = ffi.sizeof("wchar_t")
+
+-- ASCII, two, three and four byte characters, and ill-formed sequences
+local TEXT = "ab\xC3\xA9c\xE4\xB8\xAD\xF0\x9F\x98\x80d\n" ..
+             "\xE2\x82\xAC\xF0\x9F\x98\xC3\xA9\x80x\xE4\xB8"
+
+-- the wide text as a Lua string, to compare
+local function wide_bytes(wstr, wlen)
+  return ffi.string(wstr, wlen * WCHAR)
+end
+
+local function test_wide_chunks(cp)
+  local wstr, wlen = unicode.wide_chunks(TEXT, #TEXT, cp)()
+  local whole = wide_bytes(wstr, wlen)
+  local ok = true
+  for chunk = 4, #TEXT do
+    local out = {}
+    for piece, n in unicode.wide_chunks(TEXT, chunk, cp) do
+      out[#out + 1] = wide_bytes(piece, n)
+    end
+    if table.concat(out) ~= whole then
+      ok = false
+    end
+  end
+  check(ok, "wide_chunks at every chunk size, cp " .. cp)
+end
+
+local function test_decoder(cp)
+  local wstr, wlen = unicode.wide_chunks(TEXT, #TEXT, cp)()
+  local whole = wide_bytes(wstr, wlen)
+  local ok = true
+  for i = 0, #TEXT do
+    for j = i, #TEXT do
+      local d = unicode.decoder(cp)
+      local out = {}
+      for _, s in ipairs({ TEXT:sub(1, i), TEXT:sub(i + 1, j), TEXT:sub(j + 1) }) do
+        out[#out + 1] = wide_bytes(d:write(s))
+      end
+      out[#out + 1] = wide_bytes(d:finish())
+      if table.concat(out) ~= whole then
+        ok = false
+      end
+    end
+  end
+  check(ok, "decoder cut at every two offsets, cp " .. cp)
+end
+
+-- the wide form of TEXT with surrogate pairs and lone surrogates added;
+-- where wchar_t is 32 bits each surrogate converts on its own, and the
+-- pairs only show that nothing is lost or doubled at the cuts
+local function wide_text()
+  local wstr, wlen = unicode.u2w(TEXT)
+  local units = {}
+  for i = 0, wlen - 1 do
+    units[#units + 1] = wstr[i]
+  end
+  for _, u in ipairs({ 0xD83D, 0xDE00, 0x61, 0xD800, 0xDC00, 0xD800 }) do
+    units[#units + 1] = u
+  end
+  return ffi.new("wchar_t[?]", #units, units), #units
+end
+
+local function test_narrow_chunks(cp)
+  local wstr, wlen = wide_text()
+  local whole = unicode.narrow_chunks(wstr, wlen, wlen, cp)()
+  local ok = true
+  for chunk = 2, wlen do
+    local out = {}
+    for piece in unicode.narrow_chunks(wstr, wlen, chunk, cp) do
+      out[#out + 1] = piece
+    end
+    if table.concat(out) ~= whole then
+      ok = false
+    end
+  end
+  check(ok, "narrow_chunks at every chunk size, cp " .. cp)
+end
+
+local function test_encoder(cp)
+  local wstr, wlen = wide_text()
+  local whole = unicode.narrow_chunks(wstr, wlen, wlen, cp)()
+  local ok = true
+  for i = 0, wlen do
+    for j = i, wlen do
+      local e = unicode.encoder(cp)
+      local s = e:write(wstr, i) .. e:write(wstr + i, j - i) ..
+                e:write(wstr + j, wlen - j) .. e:finish()
+      if s ~= whole then
+        ok = false
+      end
+    end
+  end
+  check(ok, "encoder cut at every two offsets, cp " .. cp)
+end
+
+for _, cp in ipairs({ CP_UTF8, CP_ACP }) do
+  test_wide_chunks(cp)
+  test_decoder(cp)
+  test_narrow_chunks(cp)
+  test_encoder(cp)
+end
+
+-- empty input gives nothing, and pieces are never empty
+check(unicode.wide_chunks("", 4)() == nil, "wide_chunks of nothing")
+check(unicode.narrow_chunks(ffi.new("wchar_t[1]"), 0, 2)() == nil, "narrow_chunks of nothing")
+local d = unicode.decoder(CP_UTF8)
+local _, n = d:write("\xE4\xB8")
+check(n == 0, "decoder holds back a cut character")
+_, n = d:finish()
+check(n == 1, "decoder flushes it on finish")
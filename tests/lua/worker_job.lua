@@ -0,0 +1,21 @@
+-- Modules for the worker tests in tests/test_worker.c.
+
+local M = {}
+
+function M.add(a, b)
+  return a + b
+end
+
+function M.echo(...)
+  return ...
+end
+
+function M.fail(msg)
+  error(msg, 0)
+end
+
+function M.bad_result()
+  return print
+end
+
+return M
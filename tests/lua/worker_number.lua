@@ -0,0 +1,3 @@
+-- A module that is not a table, see tests/test_worker.c.
+
+return 42
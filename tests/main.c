@@ -0,0 +1,59 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "test.h"
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+} test_suite;
+
+static const test_suite s_suites[] = {
+    { "mempool", test_mempool },
+    { "serialize", test_serialize },
+    { "transcode", test_transcode },
+    { "unicode", test_unicode },
+    { "worker", test_worker },
+    { "hooks", test_hooks },
+    { "errqueue", test_errqueue },
+    { "reload", test_reload },
+    { "document", test_document },
+    { NULL, NULL }
+};
+
+static int s_checks = 0;
+static int s_failed = 0;
+
+
+void
+test_check(int ok, const char *expr, const char *file, int line)
+{
+    s_checks++;
+    if (!ok) {
+        s_failed++;
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+    }
+}
+
+
+int
+main(int argc, char **argv)
+{
+    const char *filter = argc > 1 ? argv[1] : NULL;
+
+    for (const test_suite *t = s_suites; t->name != NULL; t++) {
+        if (filter != NULL && strstr(t->name, filter) == NULL) {
+            continue;
+        }
+        int failed = s_failed;
+        t->run();
+        printf("%-12s %s\n", t->name, s_failed == failed ? "ok" : "FAILED");
+    }
+    printf("%d checks, %d failed\n", s_checks, s_failed);
+    return s_failed > 0 ? 1 : 0;
+}
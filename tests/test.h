@@ -0,0 +1,45 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+#ifndef EELUA_TEST_H_
+#define EELUA_TEST_H_
+
+#include "lua.h"
+
+// Unit tests of the C core, built as eelua_tests against the Windows shim
+// of the host simulator (sim/winshim.c) and run from the top directory:
+//
+//   bin/Release/eelua_tests [name]
+//
+// A suite is a function calling CHECK; it keeps going after a failed
+// check, and the runner exits with 1 if any check failed. Lua modules the
+// tests load are in tests/lua.
+
+#define CHECK(cond) test_check((cond) != 0, #cond, __FILE__, __LINE__)
+
+void test_check(int ok, const char *expr, const char *file, int line);
+
+// tests/fixture.c: fixture_open() makes the simulator host g_ee_context
+// and returns a Lua state with the eelua table of the plugin (no
+// eelua_init.lua); fixture_close() takes both down again. Lua states of
+// the tests get check(cond, what) and package.path set to ezip/eelua and
+// tests/lua from fixture_openlua().
+lua_State *fixture_open(void);
+void fixture_close(lua_State *L);
+void fixture_openlua(lua_State *L);
+// runs a Lua file, failing to load or run it is a failed check
+void fixture_dofile(lua_State *L, const char *file);
+
+void test_document(void);
+void test_errqueue(void);
+void test_hooks(void);
+void test_mempool(void);
+void test_serialize(void);
+void test_transcode(void);
+void test_unicode(void);
+void test_reload(void);
+void test_worker(void);
+
+#endif  // EELUA_TEST_H_
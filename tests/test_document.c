@@ -0,0 +1,65 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+// Runs the Lua tests of eelua/core on a document of the simulator host,
+// each in a fresh fixture. The document is doc_hwnd; host_pump() delivers
+// the change hooks the edits caused, as the editor does once the script
+// returns, and doc_stats() the edits, repaints and undo steps of the
+// document so far.
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "host.h"
+#include "test.h"
+
+
+static const char *const s_files[] = {
+    "tests/lua/test_journal.lua",
+    "tests/lua/test_transaction.lua",
+    "tests/lua/test_settext.lua",
+    NULL
+};
+
+static sim_doc *s_doc;
+
+
+static int
+l_host_pump(lua_State *L)
+{
+    lua_pushinteger(L, host_pump());
+    return 1;
+}
+
+
+static int
+l_doc_stats(lua_State *L)
+{
+    lua_pushnumber(L, s_doc->edits);
+    lua_pushnumber(L, s_doc->redraws);
+    lua_pushnumber(L, s_doc->undo_steps);
+    return 3;
+}
+
+
+void
+test_document(void)
+{
+    for (const char *const *file = s_files; *file != NULL; file++) {
+        lua_State *L = fixture_open();
+        CHECK(L != NULL);
+        if (L == NULL) {
+            return;
+        }
+        sim_frame *frame = host_new_frame(NULL);
+        lua_pushlightuserdata(L, host_doc_hwnd(frame));
+        lua_setglobal(L, "doc_hwnd");
+        s_doc = host_frame_doc(frame);
+        lua_register(L, "host_pump", l_host_pump);
+        lua_register(L, "doc_stats", l_doc_stats);
+        fixture_dofile(L, *file);
+        fixture_close(L);
+    }
+}
@@ -0,0 +1,161 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+// src/errqueue.c against the output window of the simulator host: copies
+// of a message within dedup_ms are counted once, with the message when it
+// comes again or in the "suppressed" line, the rate limit drops into that
+// line too, and errqueue_shutdown() starts everything over.
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "errqueue.h"
+#include "host.h"
+#include "test.h"
+
+#define DEDUP_MS        100
+#define OUTPUT_MAX      4096
+
+
+// The text of the output window as ASCII, emptied after reading.
+static const char *
+take_output(void)
+{
+    static wchar_t wbuf[OUTPUT_MAX];
+    static char buf[OUTPUT_MAX];
+    HWND output = (HWND) SendMessageA(host_context()->hMain, EEM_GETOUTPUTHWND, 0, 0);
+    EC_SelInfo info = { { 0, 0 }, { INT_MAX, INT_MAX }, NULL, EC_EOL_UNIX };
+    int len = (int) SendMessageA(output, ECM_GETTEXT, (WPARAM) &info, 0);
+    buf[0] = '\0';
+    if (len < OUTPUT_MAX) {
+        info.lpBuffer = wbuf;
+        SendMessageA(output, ECM_GETTEXT, (WPARAM) &info, 0);
+        for (int i = 0; i <= len; i++) {
+            buf[i] = wbuf[i] < 128 ? (char) wbuf[i] : '?';
+        }
+    }
+    SendMessageA(output, ECM_DELETETEXT, (WPARAM) &info.spos, (LPARAM) &info.epos);
+    return buf;
+}
+
+
+// eelua.error_stats()[key], reset afterwards when reset is set
+static double
+stat(lua_State *L, const char *key, int reset)
+{
+    lua_getglobal(L, "eelua");
+    lua_getfield(L, -1, "error_stats");
+    lua_pushboolean(L, 0);
+    lua_call(L, 1, 1);
+    lua_getfield(L, -1, key);
+    double v = lua_tonumber(L, -1);
+    lua_settop(L, 0);
+    if (reset) {
+        CHECK(luaL_dostring(L, "eelua.error_stats(true)") == 0);
+    }
+    return v;
+}
+
+
+static void
+test_duplicates(lua_State *L)
+{
+    errqueue_push("same");
+    errqueue_push("same");
+    errqueue_push("same");
+    CHECK(stat(L, "queued", 0) == 1);
+    CHECK(stat(L, "duplicates", 1) == 2);
+    CHECK(errqueue_flush() == 1);
+    CHECK(strcmp(take_output(), "[eelua] same\n") == 0);
+
+    // after the window the next copy comes with the count of those dropped
+    Sleep(DEDUP_MS + 50);
+    errqueue_push("same");
+    CHECK(errqueue_flush() == 1);
+    CHECK(strcmp(take_output(),
+                 "[eelua] same\n(seen 2 more times since last reported)\n") == 0);
+    // counted once: not again in the "suppressed" line
+    errqueue_flush();
+    CHECK(strcmp(take_output(), "") == 0);
+
+    // copies of a message that does not come again go into that line once
+    // the window is over
+    errqueue_push("other");
+    errqueue_push("other");
+    errqueue_push("other");
+    CHECK(errqueue_flush() == 1);
+    CHECK(strcmp(take_output(), "[eelua] other\n") == 0);
+    Sleep(DEDUP_MS + 50);
+    errqueue_flush();
+    CHECK(strcmp(take_output(),
+                 "[eelua] 2 more errors suppressed (duplicates or rate limit)\n") == 0);
+    errqueue_flush();
+    CHECK(strcmp(take_output(), "") == 0);
+    stat(L, "queued", 1);
+}
+
+
+static void
+test_rate_limit(lua_State *L)
+{
+    CHECK(luaL_dostring(L, "eelua.error_report({ rate = 0, burst = 2 })") == 0);
+    errqueue_push("one");
+    errqueue_push("two");
+    errqueue_push("three");
+    errqueue_push("four");
+    CHECK(stat(L, "queued", 0) == 2);
+    CHECK(stat(L, "rate_limited", 1) == 2);
+    CHECK(errqueue_flush() == 2);
+    CHECK(strcmp(take_output(),
+                 "[eelua] one\n[eelua] two\n"
+                 "[eelua] 2 more errors suppressed (duplicates or rate limit)\n") == 0);
+}
+
+
+static void
+test_shutdown(lua_State *L)
+{
+    errqueue_push("kept");
+    errqueue_push("kept");
+    CHECK(host_hook_count(EEHOOK_APPIDLE) == 1);
+    errqueue_shutdown();
+    CHECK(host_hook_count(EEHOOK_APPIDLE) == 0);
+    CHECK(stat(L, "pending", 1) == 0);
+
+    // the rate limit, the messages seen and their copies are forgotten
+    errqueue_push("kept");
+    CHECK(stat(L, "duplicates", 0) == 0);
+    CHECK(stat(L, "rate_limited", 0) == 0);
+    CHECK(host_hook_count(EEHOOK_APPIDLE) == 1);
+    CHECK(errqueue_flush() == 1);
+    CHECK(strcmp(take_output(), "[eelua] kept\n") == 0);
+    stat(L, "queued", 1);
+}
+
+
+void
+test_errqueue(void)
+{
+    lua_State *L = fixture_open();
+    CHECK(L != NULL);
+    if (L == NULL) {
+        return;
+    }
+    char chunk[128];
+    snprintf(chunk, sizeof(chunk),
+             "eelua.error_stats(true)\n"
+             "eelua.error_report({ dedup_ms = %d, rate = 1000, burst = 100 })", DEDUP_MS);
+    CHECK(luaL_dostring(L, chunk) == 0);
+    test_duplicates(L);
+    test_rate_limit(L);
+    test_shutdown(L);
+    // back to the defaults for the suites after this one
+    CHECK(luaL_dostring(L, "eelua.error_report({ dedup_ms = 5000, rate = 2, burst = 5 })") == 0);
+    fixture_close(L);
+}
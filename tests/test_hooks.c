@@ -0,0 +1,189 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+// The native hook trampolines of src/hooks.c, the WM_COMMAND filter in
+// front of APPMSG and the commands marked to move the journal epoch, called
+// by the simulator host the way the editor calls them.
+
+#include <string.h>
+#include <wchar.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "host.h"
+#include "test.h"
+
+#define LONG_COMMAND    1000
+
+
+// runs chunk, true if it returns true
+static int
+lua_true(lua_State *L, const char *chunk)
+{
+    int ok = luaL_dostring(L, chunk) == 0 && lua_toboolean(L, -1);
+    lua_settop(L, 0);
+    return ok;
+}
+
+
+static void
+test_trampolines(lua_State *L)
+{
+    lua_pushinteger(L, EEHOOK_RUNCOMMAND);
+    lua_setglobal(L, "RUNCOMMAND");
+    lua_pushinteger(L, EEHOOK_PRETEXTMENU);
+    lua_setglobal(L, "PRETEXTMENU");
+
+    CHECK(luaL_dostring(L,
+        "calls = 0\n"
+        "eelua.set_hook(RUNCOMMAND, function(cmd) calls = calls + 1; last = cmd; return 7 end)\n"
+        "return eelua.set_hook(RUNCOMMAND, function(cmd) calls = calls + 1; last = cmd; return 7 end)") == 0);
+    CHECK(lua_toboolean(L, -1));
+    lua_settop(L, 0);
+    // set again, the trampoline is installed once
+    CHECK(host_hook_count(EEHOOK_RUNCOMMAND) == 1);
+
+    // the length bounds the command, the result comes back as a number
+    CHECK(host_fire(EEHOOK_RUNCOMMAND, (LONG_PTR) L"lua print(1) and more", 12, 0, 0) == 7);
+    CHECK(lua_true(L, "return calls == 1 and last == 'lua print(1)'"));
+
+    // longer than the stack buffer of hooks_pushwstring
+    static wchar_t long_cmd[LONG_COMMAND + 1];
+    wmemset(long_cmd, L'x', LONG_COMMAND);
+    host_fire(EEHOOK_RUNCOMMAND, (LONG_PTR) long_cmd, LONG_COMMAND, 0, 0);
+    CHECK(lua_true(L, "return #last == 1000 and last:find('^x+$') ~= nil"));
+
+    // anything but a number is 0, errors are reported and leave no trace
+    // on the stack
+    CHECK(luaL_dostring(L,
+        "eelua.set_hook(RUNCOMMAND, function(cmd)\n"
+        "  if cmd == 'fail' then error('handler failed') end\n"
+        "  return 'not a number'\n"
+        "end)\n"
+        "return eelua.error_stats().reported") == 0);
+    double reported = lua_tonumber(L, -1);
+    lua_settop(L, 0);
+    CHECK(host_fire(EEHOOK_RUNCOMMAND, (LONG_PTR) L"ok", 2, 0, 0) == 0);
+    CHECK(host_fire(EEHOOK_RUNCOMMAND, (LONG_PTR) L"fail", 4, 0, 0) == 0);
+    CHECK(lua_gettop(L) == 0);
+    CHECK(luaL_dostring(L, "return eelua.error_stats().reported") == 0);
+    CHECK(lua_tonumber(L, -1) == reported + 1);
+    lua_settop(L, 0);
+
+    // handles come as light userdata, positions as numbers
+    CHECK(luaL_dostring(L,
+        "eelua.set_hook(PRETEXTMENU, function(doc, menu, x, y)\n"
+        "  menu_args = { doc, menu, x, y }\n"
+        "  return 0\n"
+        "end)") == 0);
+    static int doc, menu;
+    host_fire(EEHOOK_PRETEXTMENU, (LONG_PTR) &doc, (LONG_PTR) &menu, 120, -4);
+    lua_getglobal(L, "menu_args");
+    lua_rawgeti(L, -1, 1);
+    CHECK(lua_touserdata(L, -1) == &doc);
+    lua_rawgeti(L, -2, 2);
+    CHECK(lua_touserdata(L, -1) == &menu);
+    lua_settop(L, 0);
+    CHECK(lua_true(L, "return menu_args[3] == 120 and menu_args[4] == -4"));
+
+    // detached, the trampoline stays and returns 0
+    CHECK(lua_true(L,
+        "calls = 0\n"
+        "eelua.set_hook(RUNCOMMAND, nil)\n"
+        "return eelua.get_hook(RUNCOMMAND) == nil"));
+    CHECK(host_fire(EEHOOK_RUNCOMMAND, (LONG_PTR) L"lua", 3, 0, 0) == 0);
+    CHECK(host_hook_count(EEHOOK_RUNCOMMAND) == 1);
+    CHECK(lua_true(L, "return calls == 0"));
+
+    CHECK(lua_true(L,
+        "local ok, err = eelua.set_hook(1000, print)\n"
+        "return ok == nil and err:find('no native trampoline', 1, true) ~= nil"));
+}
+
+
+static void
+test_wm_filter(lua_State *L)
+{
+    lua_pushinteger(L, EEHOOK_APPMSG);
+    lua_setglobal(L, "APPMSG");
+    CHECK(luaL_dostring(L,
+        "seen = {}\n"
+        "eelua.set_hook(APPMSG, function(msg, wp, lp, cmd_id)\n"
+        "  seen[#seen + 1] = cmd_id\n"
+        "  return 0\n"
+        "end)\n"
+        "eelua.wm_filter_add(40001)") == 0);
+    lua_settop(L, 0);
+
+    // the menu and accelerator forms of a command both fold to its id
+    host_fire(EEHOOK_APPMSG, WM_COMMAND, 40001, 0, 0);
+    host_fire(EEHOOK_APPMSG, WM_COMMAND, 65536 + 40001, 0, 0);
+    CHECK(lua_true(L, "return #seen == 2 and seen[1] == 40001 and seen[2] == 40001"));
+
+    // other ids, other messages and high words below 105536 stay out
+    host_fire(EEHOOK_APPMSG, WM_COMMAND, 40002, 0, 0);
+    host_fire(EEHOOK_APPMSG, WM_USER, 40001, 0, 0);
+    host_fire(EEHOOK_APPMSG, WM_COMMAND, 65536 + 100, 0, 0);
+    CHECK(lua_true(L, "return #seen == 2"));
+
+    // with the filter off everything goes through, unmatched as -1
+    CHECK(lua_true(L, "return eelua.wm_filter(false) == true"));
+    host_fire(EEHOOK_APPMSG, WM_USER, 40001, 0, 0);
+    host_fire(EEHOOK_APPMSG, WM_COMMAND, 65536 + 100, 0, 0);
+    CHECK(lua_true(L,
+        "return #seen == 4 and seen[3] == -1 and seen[4] == -1\n"
+        "  and eelua.wm_filter(true) == false"));
+
+    CHECK(lua_true(L, "eelua.wm_filter_remove(40001) return true"));
+    host_fire(EEHOOK_APPMSG, WM_COMMAND, 40001, 0, 0);
+    CHECK(lua_true(L, "return #seen == 4"));
+
+    CHECK(lua_true(L,
+        "local ok, err = pcall(eelua.wm_filter_add, 65536)\n"
+        "return not ok and err:find('out of range', 1, true) ~= nil"));
+}
+
+
+static void
+test_wm_epoch(lua_State *L)
+{
+    CHECK(luaL_dostring(L,
+        "local ffi = require('ffi')\n"
+        "local p = ffi.cast('const volatile int*', eelua.journal_address('epoch'))\n"
+        "function epoch() return p[0] end\n"
+        "eelua.wm_epoch_add(40010)\n"
+        "eelua.wm_epoch_add(40011)\n"
+        "eelua.wm_epoch_add(40011, false)\n"
+        "e0 = epoch()") == 0);
+    lua_settop(L, 0);
+
+    // marked ids move the epoch even when the filter keeps them from Lua
+    host_fire(EEHOOK_APPMSG, WM_COMMAND, 40010, 0, 0);
+    host_fire(EEHOOK_APPMSG, WM_COMMAND, 65536 + 40010, 0, 0);
+    CHECK(lua_true(L, "return epoch() == e0 + 2"));
+
+    host_fire(EEHOOK_APPMSG, WM_COMMAND, 40011, 0, 0);
+    host_fire(EEHOOK_APPMSG, WM_COMMAND, 40012, 0, 0);
+    host_fire(EEHOOK_APPMSG, WM_USER, 40010, 0, 0);
+    CHECK(lua_true(L, "return epoch() == e0 + 2"));
+}
+
+
+void
+test_hooks(void)
+{
+    lua_State *L = fixture_open();
+    CHECK(L != NULL);
+    if (L == NULL) {
+        return;
+    }
+    test_trampolines(L);
+    test_wm_filter(L);
+    test_wm_epoch(L);
+    fixture_close(L);
+    // hooks_shutdown() took them out of the host
+    CHECK(host_hook_count(EEHOOK_RUNCOMMAND) == 0);
+}
@@ -0,0 +1,210 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+// The pool is compiled in here with malloc redirected, so the tests can
+// make new slabs fail and look at the counters directly. eelua_tests
+// leaves src/mempool.c out for that reason.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+
+static int s_fail_malloc = 0;
+
+static void *
+test_malloc(size_t size)
+{
+    return s_fail_malloc ? NULL : malloc(size);
+}
+
+#define malloc test_malloc
+#include "../src/mempool.c"
+#undef malloc
+
+
+static void
+fill(void *p, size_t n, int seed)
+{
+    for (size_t i = 0; i < n; i++) {
+        ((unsigned char *) p)[i] = (unsigned char) (seed + i);
+    }
+}
+
+
+static int
+filled(const void *p, size_t n, int seed)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (((const unsigned char *) p)[i] != (unsigned char) (seed + i)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+static void
+test_size_classes(void)
+{
+    mempool *pool = mempool_new();
+    int ok = 1;
+    for (size_t size = 1; size <= MEMPOOL_MAX_SMALL; size++) {
+        int c = class_index(pool, size);
+        ok = ok && c >= 0 && class_sizes[c] >= size
+            && (c == 0 || class_sizes[c - 1] < size);
+    }
+    CHECK(ok);
+    CHECK(class_index(pool, MEMPOOL_MAX_SMALL + 1) < 0);
+    mempool_free(pool);
+}
+
+
+static void
+test_counters(void)
+{
+    mempool *pool = mempool_new();
+    void *blocks[100];
+    for (int i = 0; i < 100; i++) {
+        blocks[i] = mempool_alloc(pool, NULL, 0, 24);
+        fill(blocks[i], 24, i);
+    }
+    void *large = mempool_alloc(pool, NULL, 0, 4000);
+
+    size_class *sc = &pool->classes[class_index(pool, 24)];
+    CHECK(sc->allocs == 100 && sc->live == 100);
+    CHECK(pool->large_allocs == 1 && pool->large_live == 1);
+    CHECK(pool->live_bytes == 100 * 24 + 4000);
+    CHECK(pool->slab_bytes == SLAB_SIZE);
+
+    int intact = 1;
+    for (int i = 0; i < 100; i++) {
+        intact = intact && filled(blocks[i], 24, i);
+        mempool_alloc(pool, blocks[i], 24, 0);
+    }
+    CHECK(intact);
+    mempool_alloc(pool, large, 4000, 0);
+    CHECK(sc->frees == 100 && sc->live == 0);
+    CHECK(pool->large_frees == 1 && pool->large_live == 0);
+    CHECK(pool->live_bytes == 0);
+    CHECK(pool->peak_bytes == 100 * 24 + 4000);
+
+    // freed blocks are handed out again before a new slab is carved
+    void *again = mempool_alloc(pool, NULL, 0, 30);
+    CHECK(again == blocks[99]);
+    CHECK(pool->slab_bytes == SLAB_SIZE);
+    mempool_alloc(pool, again, 30, 0);
+    mempool_free(pool);
+}
+
+
+static void
+test_realloc(void)
+{
+    mempool *pool = mempool_new();
+
+    // within a class the block stays
+    void *p = mempool_alloc(pool, NULL, 0, 40);
+    fill(p, 40, 1);
+    CHECK(mempool_alloc(pool, p, 40, 48) == p);
+    fill(p, 48, 1);
+
+    // small to small, small to large, large to large, large to small
+    size_t sizes[] = { 48, 300, 2000, 9000, 100, 16 };
+    size_t osize = sizes[0];
+    for (size_t i = 1; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t nsize = sizes[i];
+        p = mempool_alloc(pool, p, osize, nsize);
+        CHECK(p != NULL && filled(p, osize < nsize ? osize : nsize, 1));
+        fill(p, nsize, 1);
+        osize = nsize;
+    }
+    CHECK(pool->live_bytes == 16);
+    CHECK(pool->large_live == 0);
+    mempool_alloc(pool, p, 16, 0);
+    CHECK(pool->live_bytes == 0);
+    mempool_free(pool);
+}
+
+
+static void
+test_shrink_without_slabs(void)
+{
+    mempool *pool = mempool_new();
+    int c100 = class_index(pool, 100);
+    int c20 = class_index(pool, 20);
+
+    // large into a class with no free block and no slab to be had
+    void *large = mempool_alloc(pool, NULL, 0, 1000);
+    fill(large, 1000, 7);
+    s_fail_malloc = 1;
+    CHECK(mempool_alloc(pool, NULL, 0, 100) == NULL);
+    void *p = mempool_alloc(pool, large, 1000, 100);
+    CHECK(p != NULL && filled(p, 100, 7));
+    CHECK(pool->large_live == 0 && pool->classes[c100].live == 1);
+    CHECK(pool->live_bytes == 100);
+    // the rest of the old block serves the class
+    void *q = mempool_alloc(pool, NULL, 0, 100);
+    CHECK(q != NULL);
+
+    // small into an empty smaller class keeps the block
+    void *r = mempool_alloc(pool, p, 100, 20);
+    CHECK(r == p && filled(r, 20, 7));
+    CHECK(pool->classes[c100].live == 1 && pool->classes[c20].live == 1);
+    mempool_alloc(pool, r, 20, 0);
+    CHECK(mempool_alloc(pool, NULL, 0, 20) == r);
+    s_fail_malloc = 0;
+
+    // a large block just short of the slab header
+    void *t = mempool_alloc(pool, NULL, 0, MEMPOOL_MAX_SMALL + 1);
+    fill(t, MEMPOOL_MAX_SMALL, 3);
+    s_fail_malloc = 1;
+    t = mempool_alloc(pool, t, MEMPOOL_MAX_SMALL + 1, MEMPOOL_MAX_SMALL);
+    s_fail_malloc = 0;
+    CHECK(t != NULL && filled(t, MEMPOOL_MAX_SMALL, 3));
+
+    mempool_alloc(pool, t, MEMPOOL_MAX_SMALL, 0);
+    mempool_alloc(pool, r, 20, 0);
+    mempool_alloc(pool, q, 100, 0);
+    CHECK(pool->live_bytes == 0);
+    mempool_free(pool);
+}
+
+
+static void
+test_stats(void)
+{
+    mempool *pool = mempool_new();
+    lua_State *L = mempool_newstate(pool);
+    void *ud = NULL;
+    int pooled = lua_getallocf(L, &ud) == mempool_alloc;
+
+    CHECK(mempool_pushstats(L) == pooled);
+    if (pooled) {
+        lua_getfield(L, -1, "live_bytes");
+        CHECK(lua_tonumber(L, -1) > 0);
+        lua_getfield(L, -2, "classes");
+        CHECK(lua_objlen(L, -1) == MEMPOOL_NCLASSES);
+        lua_rawgeti(L, -1, MEMPOOL_NCLASSES);
+        lua_getfield(L, -1, "size");
+        CHECK(lua_tonumber(L, -1) == MEMPOOL_MAX_SMALL);
+    }
+    lua_close(L);
+    if (pooled) {
+        CHECK(pool->live_bytes == 0);
+    }
+    mempool_free(pool);
+}
+
+
+void
+test_mempool(void)
+{
+    test_size_classes();
+    test_counters();
+    test_realloc();
+    test_shrink_without_slabs();
+    test_stats();
+}
@@ -0,0 +1,22 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+// Runs tests/lua/test_reload.lua against the pure Lua eelua.reload and
+// eelua.watcher from ezip/eelua.
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "test.h"
+
+
+void
+test_reload(void)
+{
+    lua_State *L = luaL_newstate();
+    fixture_openlua(L);
+    fixture_dofile(L, "tests/lua/test_reload.lua");
+    lua_close(L);
+}
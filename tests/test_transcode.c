@@ -0,0 +1,240 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+// src/transcode.c: the UTF-8 conversions are its own, the other code pages
+// go through the shim, which converts them as UTF-8 too but reports the
+// lead bytes of the DBCS ones.
+
+#include <string.h>
+#include <wchar.h>
+
+#include "transcode.h"
+#include "test.h"
+
+#define CP_GBK          936
+#define CP_SJIS         932
+#define CP_GB18030      54936
+
+#define FFFD            0xFFFD
+#define SENTINEL        0x5A5A
+
+
+// Converts the UTF-8 in src to wide, true if it gives the len units of
+// want and the length query agrees.
+static int
+wide_is(const char *src, const wchar_t *want, int len)
+{
+    wchar_t dst[64];
+    int n = tc_to_wide(CP_UTF8, src, (int) strlen(src), dst, 64);
+    return n == len && tc_to_wide(CP_UTF8, src, (int) strlen(src), NULL, 0) == n &&
+           wmemcmp(dst, want, len) == 0;
+}
+
+
+// Converts wlen units of src to UTF-8, true if it gives want.
+static int
+narrow_is(const wchar_t *src, int wlen, const char *want)
+{
+    char dst[64];
+    int n = tc_to_narrow(CP_UTF8, src, wlen, dst, 64);
+    return n == (int) strlen(want) && tc_to_narrow(CP_UTF8, src, wlen, NULL, 0) == n &&
+           memcmp(dst, want, n) == 0;
+}
+
+
+static void
+test_surrogates(void)
+{
+    // a code point above the BMP, and the surrogates on their own
+    static const wchar_t lone_high[] = { 0xD83D, 'a' };
+    static const wchar_t lone_low[] = { 'a', 0xDE00 };
+    static const wchar_t reversed[] = { 0xDE00, 0xD83D };
+    CHECK(narrow_is(lone_high, 2, "\xEF\xBF\xBD" "a"));
+    CHECK(narrow_is(lone_low, 2, "a\xEF\xBF\xBD"));
+    CHECK(narrow_is(reversed, 2, "\xEF\xBF\xBD\xEF\xBF\xBD"));
+
+#if WCHAR_MAX > 0xFFFF
+    static const wchar_t smiley[] = { 'a', 0x1F600, 'b' };
+    static const wchar_t beyond[] = { 0x110000 };
+    CHECK(wide_is("a\xF0\x9F\x98\x80" "b", smiley, 3));
+    CHECK(narrow_is(smiley, 3, "a\xF0\x9F\x98\x80" "b"));
+    CHECK(narrow_is(beyond, 1, "\xEF\xBF\xBD"));
+    // with a whole code point per unit, a pair is two lone surrogates
+    static const wchar_t pair[] = { 0xD83D, 0xDE00 };
+    CHECK(narrow_is(pair, 2, "\xEF\xBF\xBD\xEF\xBF\xBD"));
+#else
+    static const wchar_t smiley[] = { 'a', 0xD83D, 0xDE00, 'b' };
+    CHECK(wide_is("a\xF0\x9F\x98\x80" "b", smiley, 4));
+    CHECK(narrow_is(smiley, 4, "a\xF0\x9F\x98\x80" "b"));
+    // no room for both units of the pair
+    wchar_t dst[2];
+    CHECK(tc_to_wide(CP_UTF8, "a\xF0\x9F\x98\x80", 5, dst, 2) == 1);
+#endif
+}
+
+
+static void
+test_ill_formed(void)
+{
+    // U+FFFD for each maximal subpart, as MultiByteToWideChar gives
+    static const wchar_t overlong2[] = { FFFD, FFFD };
+    static const wchar_t overlong3[] = { FFFD, FFFD, FFFD };
+    static const wchar_t overlong4[] = { FFFD, FFFD, FFFD, FFFD };
+    CHECK(wide_is("\xC0\x80", overlong2, 2));
+    CHECK(wide_is("\xC1\xBF", overlong2, 2));
+    CHECK(wide_is("\xE0\x80\x80", overlong3, 3));
+    CHECK(wide_is("\xF0\x80\x80\x80", overlong4, 4));
+    // encoded surrogates and code points above U+10FFFF
+    CHECK(wide_is("\xED\xA0\x80", overlong3, 3));
+    CHECK(wide_is("\xF4\x90\x80\x80", overlong4, 4));
+    CHECK(wide_is("\xF5\x80", overlong2, 2));
+
+    // truncated sequences are one U+FFFD each, up to the next lead byte
+    static const wchar_t cut_mid[] = { 'a', FFFD, 'b' };
+    static const wchar_t cut_end[] = { 'a', FFFD };
+    static const wchar_t cut_twice[] = { FFFD, FFFD, 0xE9 };
+    CHECK(wide_is("a\xE2\x82" "b", cut_mid, 3));
+    CHECK(wide_is("a\xF0\x9F\x98", cut_end, 2));
+    CHECK(wide_is("\xE2\x82\xF0\x9F\xC3\xA9", cut_twice, 3));
+    CHECK(wide_is("a\x80" "b", cut_mid, 3));
+
+    // the boundaries that are still well-formed
+    static const wchar_t edges[] = { 0x80, 0x7FF, 0x800, 0xD7FF, 0xE000, 0xFFFF };
+    CHECK(wide_is("\xC2\x80\xDF\xBF\xE0\xA0\x80\xED\x9F\xBF\xEE\x80\x80\xEF\xBF\xBF", edges, 6));
+    CHECK(narrow_is(edges, 6, "\xC2\x80\xDF\xBF\xE0\xA0\x80\xED\x9F\xBF\xEE\x80\x80\xEF\xBF\xBF"));
+}
+
+
+static void
+test_ascii_runs(void)
+{
+    // a non-ASCII character at every position of runs around the 16 byte
+    // blocks, widened and narrowed back again
+    int ok = 1;
+    for (int len = 1; len <= 40 && ok; len++) {
+        for (int at = 0; at <= len; at++) {
+            char src[48];
+            wchar_t want[48], dst[48];
+            char back[48];
+            int n = 0, w = 0;
+            for (int i = 0; i < len; i++) {
+                if (i == at) {
+                    src[n++] = '\xC3';
+                    src[n++] = '\xA9';
+                    want[w++] = 0xE9;
+                } else {
+                    src[n++] = (char) ('0' + i % 64);
+                    want[w++] = (wchar_t) ('0' + i % 64);
+                }
+            }
+            if (tc_ascii_prefix(src, n) != (at < len ? at : len) ||
+                tc_to_wide(CP_UTF8, src, n, dst, 48) != w || wmemcmp(dst, want, w) != 0 ||
+                tc_to_narrow(CP_UTF8, dst, w, back, 48) != n || memcmp(back, src, n) != 0) {
+                ok = 0;
+                break;
+            }
+            // the code pages the shim converts take the same ASCII path
+            if (at == len && (tc_to_wide(CP_GBK, src, n, dst, 48) != w ||
+                              wmemcmp(dst, want, w) != 0 ||
+                              tc_to_narrow(CP_GBK, dst, w, back, 48) != n ||
+                              memcmp(back, src, n) != 0)) {
+                ok = 0;
+                break;
+            }
+        }
+    }
+    CHECK(ok);
+
+    // a high bit past the first block stops the scan there
+    char run[64];
+    memset(run, 'x', sizeof(run));
+    run[37] = '\x80';
+    CHECK(tc_ascii_prefix(run, sizeof(run)) == 37);
+    CHECK(tc_ascii_prefix(run, 37) == 37);
+    CHECK(tc_ascii_prefix(run, 0) == 0);
+}
+
+
+static void
+test_cap(void)
+{
+    char src[40];
+    wchar_t dst[48];
+    char back[48];
+    memset(src, 'a', sizeof(src));
+
+    // at most cap units, nothing written past them
+    wmemset(dst, SENTINEL, 48);
+    CHECK(tc_to_wide(CP_UTF8, src, 40, dst, 20) == 20);
+    CHECK(dst[19] == 'a' && dst[20] == SENTINEL);
+    wmemset(dst, SENTINEL, 48);
+    CHECK(tc_to_wide(CP_GBK, src, 40, dst, 17) == 17);
+    CHECK(dst[16] == 'a' && dst[17] == SENTINEL);
+
+    // a character that does not fit is left out whole
+    wmemset(dst, SENTINEL, 48);
+    CHECK(tc_to_wide(CP_UTF8, "ab\xC3\xA9" "c", 5, dst, 3) == 3);
+    CHECK(dst[2] == 0xE9 && dst[3] == SENTINEL);
+
+    static const wchar_t wide[] = { 'a', 0xE9, 0x20AC };
+    memset(back, 0x5A, sizeof(back));
+    CHECK(tc_to_narrow(CP_UTF8, wide, 3, back, 2) == 1);
+    CHECK(back[1] == 0x5A);
+    CHECK(tc_to_narrow(CP_UTF8, wide, 3, back, 5) == 3);
+    CHECK(tc_to_narrow(CP_UTF8, wide, 3, back, 6) == 6);
+    CHECK(memcmp(back, "a\xC3\xA9\xE2\x82\xAC", 6) == 0);
+
+    // the bound holds the worst case
+    static const wchar_t worst[] = { 0xFFFF, 0xFFFF, 0xFFFF };
+    CHECK(tc_to_narrow(CP_UTF8, worst, 3, NULL, 0) <= tc_narrow_bound(CP_UTF8, 3));
+    CHECK(tc_narrow_bound(CP_GBK, 3) == 6);
+}
+
+
+static void
+test_narrow_cut(void)
+{
+    // UTF-8: back to the lead byte of a cut sequence
+    CHECK(tc_narrow_cut(CP_UTF8, "abc", 3) == 3);
+    CHECK(tc_narrow_cut(CP_UTF8, "ab\xC3", 3) == 2);
+    CHECK(tc_narrow_cut(CP_UTF8, "ab\xC3\xA9", 4) == 4);
+    CHECK(tc_narrow_cut(CP_UTF8, "a\xE2\x82", 3) == 1);
+    CHECK(tc_narrow_cut(CP_UTF8, "a\xE2\x82\xAC", 4) == 4);
+    CHECK(tc_narrow_cut(CP_UTF8, "\xF0\x9F\x98", 3) == 0);
+    CHECK(tc_narrow_cut(CP_UTF8, "\xF0\x9F\x98\x80", 4) == 4);
+    // stray continuation bytes are not held back
+    CHECK(tc_narrow_cut(CP_UTF8, "a\x80\x80\x80\x80", 5) == 5);
+
+    // GB18030: two byte and four byte characters
+    CHECK(tc_narrow_cut(CP_GB18030, "a\xB0", 2) == 1);
+    CHECK(tc_narrow_cut(CP_GB18030, "a\xB0\xA1", 3) == 3);
+    CHECK(tc_narrow_cut(CP_GB18030, "\xB0\xA1\xB0", 3) == 2);
+    CHECK(tc_narrow_cut(CP_GB18030, "a\x81\x30", 3) == 1);
+    CHECK(tc_narrow_cut(CP_GB18030, "a\x81\x30\x81", 4) == 1);
+    CHECK(tc_narrow_cut(CP_GB18030, "a\x81\x30\x81\x30", 5) == 5);
+    CHECK(tc_narrow_cut(CP_GB18030, "\x81\x30\x81\x30\xB0", 5) == 4);
+
+    // DBCS: trail bytes that look like lead bytes or ASCII
+    CHECK(tc_narrow_cut(CP_GBK, "a\xB0", 2) == 1);
+    CHECK(tc_narrow_cut(CP_GBK, "\xB0\xB0\xB0", 3) == 2);
+    CHECK(tc_narrow_cut(CP_GBK, "\xB0\xB0\xB0\xB0", 4) == 4);
+    CHECK(tc_narrow_cut(CP_GBK, "\x81\x40\x81", 3) == 2);
+    CHECK(tc_narrow_cut(CP_SJIS, "\x82\xA0\xE0", 3) == 2);
+    // half-width katakana are single bytes in Shift-JIS
+    CHECK(tc_narrow_cut(CP_SJIS, "\xB1\xB2", 2) == 2);
+
+    CHECK(tc_narrow_cut(CP_GBK, "", 0) == 0);
+}
+
+
+void
+test_transcode(void)
+{
+    test_surrogates();
+    test_ill_formed();
+    test_ascii_runs();
+    test_cap();
+    test_narrow_cut();
+}
@@ -0,0 +1,25 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+// Runs tests/lua/test_unicode.lua against ezip/eelua/unicode.lua, with the
+// transcoder from the eelua table of the worker states.
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "eelua.h"
+#include "test.h"
+
+
+void
+test_unicode(void)
+{
+    lua_State *L = luaL_newstate();
+    fixture_openlua(L);
+    luaopen_eelua_worker(L);
+    lua_pop(L, 1);
+    fixture_dofile(L, "tests/lua/test_unicode.lua");
+    lua_close(L);
+}
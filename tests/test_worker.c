@@ -0,0 +1,97 @@
+// Copyright (C) 2020 by Larry Xu
+//
+// This file is part of eelua, distributed under the MIT License.
+// For full terms see the included LICENSE file.
+
+// Jobs go through real worker threads and come back through
+// worker_poll(); the modules they run are in tests/lua.
+
+#include <windows.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#include "worker.h"
+#include "test.h"
+
+#define POLL_MS     5000
+
+static const char s_spawn[] =
+    "package.path = 'tests/lua/?.lua;' .. package.path\n"
+    "results = {}\n"
+    "local function job(name, module, func, args)\n"
+    "  local id, err = eelua.spawn(module, func, args, function(...)\n"
+    "    results[name] = { n = select('#', ...), ... }\n"
+    "  end)\n"
+    "  assert(id, err)\n"
+    "end\n"
+    "job('add', 'worker_job', 'add', { 40, 2 })\n"
+    "job('echo', 'worker_job', 'echo', { 'a', { b = { 1, 2 } }, true })\n"
+    "job('fail', 'worker_job', 'fail', { 'boom' })\n"
+    "job('bad_result', 'worker_job', 'bad_result')\n"
+    "job('no_func', 'worker_job', 'missing')\n"
+    "job('no_module', 'worker_missing', 'run')\n"
+    "job('not_table', 'worker_number', 'run')\n"
+    "return 7\n";
+
+static const char s_check[] =
+    "local r = results\n"
+    "local function failed(name, pat)\n"
+    "  return r[name][1] == false and tostring(r[name][2]):find(pat, 1, true) ~= nil\n"
+    "end\n"
+    "return r.add[1] == true and r.add[2] == 42 and r.add.n == 2\n"
+    "  and r.echo[1] == true and r.echo[2] == 'a' and r.echo[3].b[2] == 2\n"
+    "  and r.echo[4] == true\n"
+    "  and failed('fail', 'boom')\n"
+    "  and failed('bad_result', 'only nil')\n"
+    "  and failed('no_func', 'worker_job.missing is not a function')\n"
+    "  and failed('no_module', 'worker_missing')\n"
+    "  and failed('not_table', 'module worker_number returned number, not a table')\n";
+
+
+static int
+count_results(lua_State *L)
+{
+    int n = 0;
+    lua_getglobal(L, "results");
+    lua_pushnil(L);
+    while (lua_next(L, -2) != 0) {
+        lua_pop(L, 1);
+        n++;
+    }
+    lua_pop(L, 1);
+    return n;
+}
+
+
+void
+test_worker(void)
+{
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    lua_newtable(L);
+    worker_register(L);
+    lua_setglobal(L, "eelua");
+
+    CHECK(luaL_dostring(L, s_spawn) == 0);
+    int jobs = (int) lua_tointeger(L, -1);
+    lua_settop(L, 0);
+
+    for (int waited = 0; count_results(L) < jobs && waited < POLL_MS; waited++) {
+        if (worker_poll(L) == 0) {
+            Sleep(1);
+        }
+    }
+    CHECK(count_results(L) == jobs);
+    CHECK(luaL_dostring(L, s_check) == 0 && lua_toboolean(L, -1));
+    lua_settop(L, 0);
+
+    CHECK(luaL_dostring(L,
+        "local s = eelua.worker_stats()\n"
+        "return s.pending == 0 and s.submitted == 7 and s.completed == 2 and s.failed == 5") == 0);
+    CHECK(lua_toboolean(L, -1));
+
+    worker_shutdown();
+    lua_close(L);
+}